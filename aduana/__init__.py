@@ -1,7 +1,12 @@
 import functools
 import warnings
 import re
+import time
 
+try:
+    import numpy
+except ImportError:
+    numpy = None
 
 from _aduana import lib as C_ADUANA
 from _aduana import ffi
@@ -30,14 +35,29 @@ class AduanaException(Exception):
             return self.message
 
 
+class _ColumnView(object):
+    """Exposes C memory to numpy while keeping its owner alive"""
+    def __init__(self, owner, mem, dtype, size):
+        self._owner = owner
+        self.__array_interface__ = {
+            'version': 3,
+            'shape': (size,),
+            'typestr': numpy.dtype(dtype).str,
+            'data': (int(ffi.cast('uintptr_t', mem)), False)
+        }
+
+
 class CrawledPage(object):
-    def __init__(self, url, links=[]):
+    def __init__(self, url, links=[], scores=None):
         """Parameters:
             - url: a string
             - links: a list where each element can be:
                          a. A link URL
                          b. A pair made from a link URL and a score between 0 and 1
                      If the first option is used then score is assumed 0.0
+            - scores: if given, links must be a list of URLs and this a
+                      sequence (list or numpy array) with their scores. This
+                      is the fastest way to add many links.
         """
         # make sure we keep a reference to the module
         self._c_aduana = C_ADUANA
@@ -47,21 +67,59 @@ class CrawledPage(object):
             raise AduanaException(
                 "Error inside crawled_page_new: returned NULL")
 
-        for pair in links:
-            if (isinstance(pair, basestring)):
-                url = pair
-                score = 0.0
-            else:
-                url = pair[0]
-                score = pair[1]
+        if len(links) > 0:
+            self.add_links(links, scores)
 
-            ret = self._c_aduana.crawled_page_add_link(
-                self._crawled_page,
-                url,
-                ffi.cast("float", score))
-            if ret != 0:
-                raise AduanaException(
-                    "Error inside crawled_page_add_link: returned %d" % ret)
+    def add_links(self, links, scores=None):
+        """Add all links with a single call to the C library.
+
+        Arguments are the same as in the constructor. URLs containing null
+        bytes raise AduanaException and no link is added.
+        """
+        if scores is None:
+            urls = []
+            scores = []
+            for pair in links:
+                if isinstance(pair, basestring):
+                    urls.append(pair)
+                    scores.append(0.0)
+                else:
+                    urls.append(pair[0])
+                    scores.append(pair[1])
+        else:
+            urls = links
+        n_links = len(urls)
+        if len(scores) != n_links:
+            raise AduanaException("links and scores have different lengths")
+        if n_links == 0:
+            return
+
+        # all the URLs packed together, URL i spans [offsets[i], offsets[i+1])
+        blob = b''.join(urls)
+        if b'\0' in blob:
+            raise AduanaException("URLs cannot contain null bytes")
+        if numpy is not None:
+            c_offsets = numpy.zeros(n_links + 1, dtype=numpy.uintp)
+            numpy.cumsum(
+                numpy.fromiter((len(u) for u in urls), dtype=numpy.uintp, count=n_links),
+                out=c_offsets[1:])
+            c_scores = numpy.ascontiguousarray(scores, dtype=numpy.float32)
+            p_offsets = ffi.cast('size_t *', ffi.from_buffer(c_offsets))
+            p_scores = ffi.cast('float *', ffi.from_buffer(c_scores))
+        else:
+            offsets = [0]*(n_links + 1)
+            pos = 0
+            for i, u in enumerate(urls):
+                pos += len(u)
+                offsets[i + 1] = pos
+            p_offsets = ffi.new('size_t[]', offsets)
+            p_scores = ffi.new('float[]', list(scores))
+
+        ret = self._c_aduana.crawled_page_add_links(
+            self._crawled_page, blob, p_offsets, p_scores, n_links)
+        if ret != 0:
+            raise AduanaException(
+                "Error inside crawled_page_add_links: returned %d" % ret)
 
     @property
     def score(self):
@@ -87,6 +145,18 @@ class CrawledPage(object):
             raise AduanaException(
                 "Error inside crawled_page_set_hash64: returned %d" % ret)
 
+    @property
+    def simhash(self):
+        ret = None
+        if self._crawled_page.has_simhash:
+            ret = self._crawled_page.simhash
+        return ret
+
+    @simhash.setter
+    def simhash(self, value):
+        self._c_aduana.crawled_page_set_simhash(
+            self._crawled_page, ffi.cast('uint64_t', value))
+
     @property
     def time(self):
         return self._crawled_page.time
@@ -135,6 +205,33 @@ class PageInfo(object):
         return self._c_aduana.page_info_is_seed(self._page_info)
 
 
+class DomainInfo(object):
+    """Statistics of all the pages of a domain"""
+    def __init__(self, domain_hash, c_domain_info):
+        self.domain_hash = domain_hash
+        self.n_pages = c_domain_info.n_pages
+        self.n_crawled = c_domain_info.n_crawled
+        self.n_links_in = c_domain_info.n_links_in
+        self.last_crawl = c_domain_info.last_crawl
+        self.rate = C_ADUANA.domain_info_rate(c_domain_info)
+
+
+_ENV_STATS_FIELDS = ('page_size', 'map_size', 'last_page', 'free_pages',
+                     'n_readers', 'max_readers')
+_DB_STATS_FIELDS = ('depth', 'branch_pages', 'leaf_pages', 'overflow_pages',
+                    'entries')
+
+def _stats_dict(c_stats, fields):
+    return dict((f, getattr(c_stats, f)) for f in fields)
+
+def _prune_options(ttl, max_depth, score_percentile, now):
+    return ffi.new('PageDBPruneOptions *', {
+        'ttl': ttl,
+        'now': time.time() if now is None else now,
+        'max_depth': max_depth,
+        'score_percentile': score_percentile
+    })
+
 def only_if_open(f):
     @functools.wraps(f)
     def dec(*args, **kwargs):
@@ -190,6 +287,32 @@ class PageDB(object):
     def persist(self, value):
         self._c_aduana.page_db_set_persist(self._page_db[0], value)
 
+    @property
+    @only_if_open
+    def link_weights(self):
+        """If true store link scores as quantized weights together with the
+        links"""
+        return self._page_db[0].link_weights
+
+    @link_weights.setter
+    @only_if_open
+    def link_weights(self, value):
+        self._c_aduana.page_db_set_link_weights(
+            self._page_db[0], 1 if value else 0)
+
+    @property
+    @only_if_open
+    def track_linking_domains(self):
+        """If true keep sketches of the distinct domains linking to each
+        page and domain"""
+        return self._page_db[0].track_linking_domains
+
+    @track_linking_domains.setter
+    @only_if_open
+    def track_linking_domains(self, value):
+        self._c_aduana.page_db_set_track_linking_domains(
+            self._page_db[0], 1 if value else 0)
+
     def __del__(self):
         self.close()
 
@@ -214,6 +337,218 @@ class PageDB(object):
 
         self._c_aduana.hashinfo_stream_delete(st[0])
 
+    @only_if_open
+    def stats(self, max_samples=100000):
+        """Storage statistics, for capacity planning.
+
+        Returns a dictionary with:
+            - 'env': size of the LMDB environment, all sizes in pages except
+              'page_size' and 'map_size' which are in bytes.
+            - 'dbs': mdb_stat of each database, by name.
+            - 'hash2info': average record size and URL compression ratio,
+              computed from at most max_samples records (0 reads them all).
+        """
+        stats = ffi.new('PageDBStats *')
+        if self._c_aduana.page_db_stats(
+                self._page_db[0], max_samples, stats) != 0:
+            raise AduanaException.from_error(self._page_db[0].error)
+        return {
+            'env': _stats_dict(stats.env, _ENV_STATS_FIELDS),
+            'dbs': dict((ffi.string(db.name), _stats_dict(db, _DB_STATS_FIELDS))
+                        for db in stats.dbs),
+            'hash2info': _stats_dict(
+                stats, ('n_samples', 'record_size', 'url_size', 'url_compression'))
+        }
+
+    @only_if_open
+    def compact(self):
+        """Rewrite the database without free pages, to recover disk space
+        and scan speed.
+
+        Reads and writes continue during the copy, which is made again if
+        it was outdated by a write. Fails if other processes have the
+        database open or if read transactions are still open when the
+        file is swapped.
+        """
+        if self._c_aduana.page_db_compact(self._page_db[0]) != 0:
+            raise AduanaException.from_error(self._page_db[0].error)
+
+    @only_if_open
+    def prune(self, ttl=0, max_depth=0, score_percentile=0, now=None):
+        """Delete uncrawled pages, see BFScheduler.prune.
+
+        Returns the number of pruned pages.
+        """
+        options = _prune_options(ttl, max_depth, score_percentile, now)
+        n_pruned = ffi.new('size_t *')
+        if self._c_aduana.page_db_prune(
+                self._page_db[0], options, ffi.NULL, n_pruned) != 0:
+            raise AduanaException.from_error(self._page_db[0].error)
+        return n_pruned[0]
+
+    @only_if_open
+    def to_arrays(self, urls=False, part=0, n_parts=1):
+        """Export all the page info as a dictionary of numpy arrays.
+
+        Keys are 'hash', 'idx', 'linked_from', 'depth', 'n_crawls',
+        'n_changes', 'first_crawl', 'last_crawl' and 'score'. If urls is
+        True there are also 'url_offsets' and 'url_blob': the URL of page i
+        is url_blob[url_offsets[i]:url_offsets[i + 1]].
+
+        The arrays are views of memory allocated by the C library, no copy is
+        made. The export can be split in n_parts disjoint hash ranges, each one
+        exported with a different value of part, possibly from different
+        threads.
+        """
+        if numpy is None:
+            raise AduanaException('to_arrays requires numpy')
+
+        pCols = ffi.new('PageDBColumns **')
+        if self._c_aduana.page_db_columns_new(pCols, 1 if urls else 0) != 0:
+            raise AduanaException('could not allocate columns')
+        cols = ffi.gc(pCols[0], self._c_aduana.page_db_columns_delete)
+
+        begin = ffi.new('uint64_t *')
+        end = ffi.new('uint64_t *')
+        self._c_aduana.page_db_export_range(n_parts, part, begin, end)
+        if self._c_aduana.page_db_export(
+                self._page_db[0], begin[0], end[0], cols) != 0:
+            raise AduanaException.from_error(self._page_db[0].error)
+
+        n = cols.n_pages
+        columns = [
+            ('hash', numpy.uint64, n),
+            ('idx', numpy.uint64, n),
+            ('linked_from', numpy.uint64, n),
+            ('depth', numpy.uint64, n),
+            ('n_crawls', numpy.uint64, n),
+            ('n_changes', numpy.uint64, n),
+            ('first_crawl', numpy.float64, n),
+            ('last_crawl', numpy.float64, n),
+            ('score', numpy.float32, n)
+        ]
+        if urls:
+            columns.append(('url_offsets', numpy.uint64, n + 1))
+            n_bytes = ffi.cast('uint64_t *', cols.url_offsets.mem)[n]
+            columns.append(('url_blob', numpy.uint8, n_bytes))
+        return {
+            name: numpy.asarray(
+                _ColumnView(cols, getattr(cols, name).mem, dtype, size))
+            for name, dtype, size in columns
+        }
+
+    @only_if_open
+    def iter_domain(self, domain):
+        """Iterate over the pages of a single domain.
+
+        domain can be either an URL, and the pages with the same domain
+        will be returned, or a domain hash, which are the high 32 bits of
+        the page hash.
+        """
+        st = ffi.new('DomainStream **')
+        if isinstance(domain, basestring):
+            ret = self._c_aduana.page_db_domain_stream_new_url(
+                st, self._page_db[0], domain)
+        else:
+            ret = self._c_aduana.page_db_domain_stream_new(
+                st, self._page_db[0], domain)
+        if ret != 0:
+            raise AduanaException.from_error(self._page_db[0].error)
+
+        page_hash = ffi.new('uint64_t *')
+        pi = ffi.new('PageInfo **')
+        try:
+            while True:
+                ss = self._c_aduana.page_db_domain_stream_next(
+                    st[0], page_hash, pi)
+                if ss != self._c_aduana.stream_state_next:
+                    break
+                yield PageInfo(page_hash[0], pi[0])
+        finally:
+            self._c_aduana.page_db_domain_stream_delete(st[0])
+
+    @staticmethod
+    def _domain_hash(domain):
+        if isinstance(domain, basestring):
+            return C_ADUANA.page_db_hash_get_domain(C_ADUANA.page_db_hash(domain))
+        return domain
+
+    @only_if_open
+    def linking_domains(self, page_hash):
+        """Estimated number of distinct domains linking to a page"""
+        count = ffi.new('float *')
+        ret = self._c_aduana.page_db_get_linking_domains(
+            self._page_db[0], ffi.cast('uint64_t', page_hash), count)
+        if ret != 0:
+            raise AduanaException.from_error(self._page_db[0].error)
+        return count[0]
+
+    @only_if_open
+    def domain_linking_domains(self, domain):
+        """Estimated number of distinct domains linking to a domain, given as
+        an URL or as a domain hash"""
+        count = ffi.new('float *')
+        ret = self._c_aduana.page_db_get_domain_linking_domains(
+            self._page_db[0], self._domain_hash(domain), count)
+        if ret != 0:
+            raise AduanaException.from_error(self._page_db[0].error)
+        return count[0]
+
+    @only_if_open
+    def domain_info(self, domain):
+        """Statistics of a domain, given as an URL or as a domain hash"""
+        domain_hash = self._domain_hash(domain)
+        di = ffi.new('DomainInfo *')
+        ret = self._c_aduana.page_db_get_domain_info(
+            self._page_db[0], domain_hash, di)
+        if ret != 0:
+            raise AduanaException.from_error(self._page_db[0].error)
+        return DomainInfo(domain_hash, di)
+
+    @only_if_open
+    def simhash(self, page_hash):
+        """Last SimHash stored for a page and its crawl time, or None"""
+        simhash = ffi.new('uint64_t *')
+        last_crawl = ffi.new('double *')
+        found = ffi.new('int *')
+        ret = self._c_aduana.page_db_get_simhash(
+            self._page_db[0], ffi.cast('uint64_t', page_hash),
+            simhash, last_crawl, found)
+        if ret != 0:
+            raise AduanaException.from_error(self._page_db[0].error)
+        return (simhash[0], last_crawl[0]) if found[0] else None
+
+    @only_if_open
+    def find_near_dup(self, simhash, max_distance=3, min_crawl=0.0, exclude=0):
+        """Hash of a page whose SimHash is within max_distance, or None"""
+        dup_hash = ffi.new('uint64_t *')
+        found = ffi.new('int *')
+        ret = self._c_aduana.page_db_find_near_dup(
+            self._page_db[0], ffi.cast('uint64_t', simhash),
+            max_distance, min_crawl, ffi.cast('uint64_t', exclude),
+            dup_hash, found)
+        if ret != 0:
+            raise AduanaException.from_error(self._page_db[0].error)
+        return dup_hash[0] if found[0] else None
+
+    @only_if_open
+    def iter_domain_info(self):
+        st = ffi.new('DomainInfoStream **')
+        ret = self._c_aduana.domaininfo_stream_new(st, self._page_db[0])
+        if ret != 0:
+            raise AduanaException.from_error(self._page_db[0].error)
+
+        domain_hash = ffi.new('uint32_t *')
+        di = ffi.new('DomainInfo *')
+        try:
+            while True:
+                ss = self._c_aduana.domaininfo_stream_next(st[0], domain_hash, di)
+                if ss != self._c_aduana.stream_state_next:
+                    break
+                yield DomainInfo(domain_hash[0], di)
+        finally:
+            self._c_aduana.domaininfo_stream_delete(st[0])
+
     @only_if_open
     def page_info(self, page_hash):
         pi = ffi.new('PageInfo **')
@@ -240,6 +575,10 @@ class PageRankScorer(object):
         self._closed = False
         self._scorer = ffi.new('PageRankScorer **')
         self._c_aduana.page_rank_scorer_new(self._scorer, page_db._page_db[0])
+        self._shard_size = 0
+        self._extrapolation = 0
+        self._freeze = (0.0, 3)
+        self._use_weights = False
 
     @property
     def closed(self):
@@ -289,6 +628,57 @@ class PageRankScorer(object):
     def damping(self, value):
         self._c_aduana.page_rank_scorer_set_damping(self._scorer[0], value)
 
+    @property
+    def shard_size(self):
+        """If greater than 0 compute PageRank out of core, with shards of this
+        number of pages"""
+        return self._shard_size
+
+    @shard_size.setter
+    @only_if_open
+    def shard_size(self, value):
+        self._shard_size = value
+        self._c_aduana.page_rank_scorer_set_shard_size(self._scorer[0], value)
+
+    @property
+    def extrapolation(self):
+        """If greater than 0 apply Aitken extrapolation every this number of
+        iterations"""
+        return self._extrapolation
+
+    @extrapolation.setter
+    @only_if_open
+    def extrapolation(self, value):
+        self._extrapolation = value
+        self._c_aduana.page_rank_scorer_set_extrapolation(self._scorer[0], value)
+
+    @property
+    def freeze(self):
+        """Tuple (precision, loops). Pages whose score changes less than
+        precision during loops consecutive iterations are not recomputed
+        anymore. Disabled if precision is 0"""
+        return self._freeze
+
+    @freeze.setter
+    @only_if_open
+    def freeze(self, value):
+        precision, loops = value
+        self._freeze = (precision, loops)
+        self._c_aduana.page_rank_scorer_set_freeze(
+            self._scorer[0], precision, loops)
+
+    @property
+    def use_weights(self):
+        """If true distribute PageRank according to the link weights"""
+        return self._use_weights
+
+    @use_weights.setter
+    @only_if_open
+    def use_weights(self, value):
+        self._use_weights = value
+        self._c_aduana.page_rank_scorer_set_use_weights(
+            self._scorer[0], 1 if value else 0)
+
 class HitsScorer(object):
     def __init__(self, page_db):
         self._c_aduana = C_ADUANA
@@ -296,6 +686,8 @@ class HitsScorer(object):
         self._closed = False
         self._scorer = ffi.new('HitsScorer **')
         self._c_aduana.hits_scorer_new(self._scorer, page_db._page_db[0])
+        self._shard_size = 0
+        self._use_weights = False
 
     @property
     def closed(self):
@@ -333,15 +725,129 @@ class HitsScorer(object):
         self._c_aduana.hits_scorer_set_use_content_scores(
             self._scorer[0], 1 if value else 0)
 
+    @property
+    def shard_size(self):
+        """If greater than 0 compute HITS out of core, with shards of this
+        number of pages"""
+        return self._shard_size
+
+    @shard_size.setter
+    @only_if_open
+    def shard_size(self, value):
+        self._shard_size = value
+        self._c_aduana.hits_scorer_set_shard_size(self._scorer[0], value)
+
+    @property
+    def use_weights(self):
+        """If true multiply hub and authority scores by the link weights"""
+        return self._use_weights
+
+    @use_weights.setter
+    @only_if_open
+    def use_weights(self, value):
+        self._use_weights = value
+        self._c_aduana.hits_scorer_set_use_weights(
+            self._scorer[0], 1 if value else 0)
+
+class PPRScorer(object):
+    """Personalized PageRank with respect to the seeds, computed with
+    forward push. Only pages near the seeds get a score"""
+    def __init__(self, page_db):
+        self._c_aduana = C_ADUANA
+
+        self._closed = False
+        self._scorer = ffi.new('PPRScorer **')
+        self._c_aduana.ppr_scorer_new(self._scorer, page_db._page_db[0])
+
+    @property
+    def closed(self):
+        return self._closed
+
+    def __del__(self):
+        self.close()
+
+    @close_method
+    def close(self):
+        self._c_aduana.ppr_scorer_delete(self._scorer[0])
+
+    @only_if_open
+    def setup(self, scorer):
+        self._c_aduana.ppr_scorer_setup(self._scorer[0], scorer)
+
+    @property
+    @only_if_open
+    def damping(self):
+        return self._scorer[0].damping
+
+    @damping.setter
+    @only_if_open
+    def damping(self, value):
+        self._c_aduana.ppr_scorer_set_damping(self._scorer[0], value)
+
+    @property
+    @only_if_open
+    def epsilon(self):
+        """Pages are pushed only while residual >= epsilon*out_degree"""
+        return self._scorer[0].epsilon
+
+    @epsilon.setter
+    @only_if_open
+    def epsilon(self, value):
+        self._c_aduana.ppr_scorer_set_epsilon(self._scorer[0], value)
+
+    @property
+    @only_if_open
+    def max_pushes(self):
+        """If greater than 0 stop each update after this number of pushes"""
+        return self._scorer[0].max_pushes
+
+    @max_pushes.setter
+    @only_if_open
+    def max_pushes(self, value):
+        self._c_aduana.ppr_scorer_set_max_pushes(self._scorer[0], value)
+
+class LinkingDomainsScorer(object):
+    """Score pages by the number of distinct domains linking to them.
+    Enables tracking of linking domains inside the PageDB"""
+    def __init__(self, page_db):
+        self._c_aduana = C_ADUANA
+
+        self._closed = False
+        self._scorer = ffi.new('LinkingDomainsScorer **')
+        ret = self._c_aduana.linking_domains_scorer_new(
+            self._scorer, page_db._page_db[0])
+        if ret != 0:
+            if self._scorer[0]:
+                raise AduanaException.from_error(self._scorer[0].error)
+            else:
+                raise AduanaException(
+                    "Error inside linking_domains_scorer_new", ret)
+
+    @property
+    def closed(self):
+        return self._closed
+
+    def __del__(self):
+        self.close()
+
+    @close_method
+    def close(self):
+        self._c_aduana.linking_domains_scorer_delete(self._scorer[0])
+
+    @only_if_open
+    def setup(self, scorer):
+        self._c_aduana.linking_domains_scorer_setup(self._scorer[0], scorer)
+
 ########################################################################
 # Scheduler Wrappers
 ########################################################################
 class SchedulerCore(object):
-    def __init__(self, scheduler, scheduler_add, scheduler_request):
+    def __init__(self, scheduler, scheduler_add, scheduler_add_batch, scheduler_request):
         self._c_aduana = C_ADUANA
 
         self._sch = scheduler
         self._scheduler_add = scheduler_add
+        self._scheduler_add_batch = scheduler_add_batch
         self._scheduler_request = scheduler_request
 
     def add(self, crawled_page):
@@ -353,12 +859,27 @@ class SchedulerCore(object):
         if ret != 0:
             raise AduanaException.from_error(self._sch[0].error)
 
+    def add_batch(self, crawled_pages):
+        """Add several CrawledPage with a single database commit"""
+        if not all(isinstance(cp, CrawledPage) for cp in crawled_pages):
+            raise AduanaException("argument to function must be a list of CrawledPage instances")
+        if not crawled_pages:
+            return
+
+        pages = ffi.new('CrawledPage *[]',
+                        [cp._crawled_page for cp in crawled_pages])
+        ret = self._scheduler_add_batch(self._sch[0], pages, len(crawled_pages))
+        if ret != 0:
+            raise AduanaException.from_error(self._sch[0].error)
+
     def requests(self, n_pages):
         pReq = ffi.new('PageRequest **')
         ret = self._scheduler_request(self._sch[0], n_pages, pReq)
         if ret != 0:
             raise AduanaException.from_error(self._sch[0].error)
-        reqs = [ffi.string(pReq[0].urls[i]) for i in xrange(pReq[0].n_urls)]
+        # all URLs are NUL terminated inside a single buffer
+        req = pReq[0]
+        reqs = ffi.buffer(req.url_buf, req.url_buf_len)[:].split(b'\0')[:-1]
         self._c_aduana.page_request_delete(pReq[0])
         return reqs
 
@@ -375,6 +896,7 @@ class BFScheduler(object):
         self._core = SchedulerCore(
             self._sch,
             self._c_aduana.bf_scheduler_add,
+            self._c_aduana.bf_scheduler_add_batch,
             self._c_aduana.bf_scheduler_request
         )
 
@@ -423,10 +945,19 @@ class BFScheduler(object):
         else:
             scorer = scorer_class(page_db)
             use_scores = settings.get('USE_SCORES', False)
-            if use_scores:
+            if use_scores and scorer_class not in (PPRScorer, LinkingDomainsScorer):
                 if scorer_class == PageRankScorer:
                     scorer.damping = settings.get('PAGE_RANK_DAMPING', 0.85)
                 scorer.use_content_scores = use_scores
+            if scorer_class == PageRankScorer:
+                scorer.extrapolation = settings.get('PAGE_RANK_EXTRAPOLATION', 0)
+                scorer.freeze = settings.get('PAGE_RANK_FREEZE', (0.0, 3))
+            if scorer_class in (PageRankScorer, HitsScorer):
+                scorer.use_weights = settings.get('USE_LINK_WEIGHTS', False)
+            if scorer_class == PPRScorer:
+                scorer.damping = settings.get('PAGE_RANK_DAMPING', 0.85)
+                scorer.epsilon = settings.get('PPR_EPSILON', 1e-6)
+                scorer.max_pushes = settings.get('PPR_MAX_PUSHES', 0)
 
         scheduler = cls(page_db, scorer=scorer, persist=page_db.persist)
 
@@ -448,6 +979,10 @@ class BFScheduler(object):
     def add(self, crawled_page):
         return self._core.add(crawled_page)
 
+    @only_if_open
+    def add_batch(self, crawled_pages):
+        return self._core.add_batch(crawled_pages)
+
     @only_if_open
     def requests(self, n_pages):
         return self._core.requests(n_pages)
@@ -464,6 +999,48 @@ class BFScheduler(object):
     def set_update_interval(self, update_interval):
         self._c_aduana.bf_scheduler_set_update_interval(self._sch[0], update_interval)
 
+    @only_if_open
+    def stats(self):
+        """Storage statistics of the schedule.
+
+        Returns a dictionary with 'env' and 'dbs' as PageDB.stats
+        """
+        stats = ffi.new('BFSchedulerStats *')
+        if self._c_aduana.bf_scheduler_stats(self._sch[0], stats) != 0:
+            raise AduanaException.from_error(self._sch[0].error)
+        return {
+            'env': _stats_dict(stats.env, _ENV_STATS_FIELDS),
+            'dbs': {'schedule': _stats_dict(stats.schedule, _DB_STATS_FIELDS)}
+        }
+
+    @only_if_open
+    def compact(self):
+        """Rewrite the schedule without free pages, see PageDB.compact"""
+        if self._c_aduana.bf_scheduler_compact(self._sch[0]) != 0:
+            raise AduanaException.from_error(self._sch[0].error)
+
+    @only_if_open
+    def prune(self, ttl=0, max_depth=0, score_percentile=0, now=None):
+        """Delete uncrawled pages from the PageDB and the schedule.
+
+        A page is pruned if any of the criteria holds, a value of 0
+        disables the criteria:
+
+        - ttl: the page that linked to it was last crawled more than
+          ttl seconds before now, which defaults to the current time.
+        - max_depth: it is deeper than max_depth.
+        - score_percentile: its score is below this percentile, in
+          [0, 100], of the scores of all the uncrawled pages.
+
+        Crawled pages and seeds are never pruned. Returns the number of
+        pruned pages.
+        """
+        options = _prune_options(ttl, max_depth, score_percentile, now)
+        n_pruned = ffi.new('size_t *')
+        if self._c_aduana.bf_scheduler_prune(self._sch[0], options, n_pruned) != 0:
+            raise AduanaException.from_error(self._sch[0].error)
+        return n_pruned[0]
+
 class FreqScheduler(object):
     def __init__(self, page_db, persist=0, path=None):
         # save to make sure lib is available at destruction time
@@ -477,6 +1054,7 @@ class FreqScheduler(object):
         self._core = SchedulerCore(
             self._sch,
             self._c_aduana.freq_scheduler_add,
+            self._c_aduana.freq_scheduler_add_batch,
             self._c_aduana.freq_scheduler_request
         )
 
@@ -520,6 +1098,9 @@ class FreqScheduler(object):
         freq_margin = settings.get('FREQ_MARGIN', -1.0)
         scheduler.margin = freq_margin
 
+        scheduler.near_dup_distance = settings.get('FREQ_NEAR_DUP_DISTANCE', -1)
+        scheduler.near_dup_window = settings.get('FREQ_NEAR_DUP_WINDOW', 86400.0)
+
         return scheduler
 
     @only_if_open
@@ -549,10 +1130,20 @@ class FreqScheduler(object):
     def add(self, crawled_page):
         return self._core.add(crawled_page)
 
+    @only_if_open
+    def add_batch(self, crawled_pages):
+        return self._core.add_batch(crawled_pages)
+
     @only_if_open
     def requests(self, n_pages):
         return self._core.requests(n_pages)
 
+    @only_if_open
+    def compact(self):
+        """Rewrite the schedule without free pages, see PageDB.compact"""
+        if self._c_aduana.freq_scheduler_compact(self._sch[0]) != 0:
+            raise AduanaException.from_error(self._sch[0].error)
+
     def __del__(self):
         self.close()
 
@@ -580,6 +1171,26 @@ class FreqScheduler(object):
     def margin(self, value):
         self._sch[0].margin = value
 
+    @property
+    @only_if_open
+    def near_dup_distance(self):
+        return self._sch[0].near_dup_distance
+
+    @near_dup_distance.setter
+    @only_if_open
+    def near_dup_distance(self, value):
+        self._sch[0].near_dup_distance = value
+
+    @property
+    @only_if_open
+    def near_dup_window(self):
+        return self._sch[0].near_dup_window
+
+    @near_dup_window.setter
+    @only_if_open
+    def near_dup_window(self, value):
+        self._sch[0].near_dup_window = value
+
 def freq_spec(page_db, spec):
     rules = []
     for line in spec:
@@ -606,6 +1217,53 @@ def freq_spec(page_db, spec):
                     yield hash(page_info), 1.0/interval
                     break
 
+########################################################################
+# Metrics
+########################################################################
+_METRIC_FIELDS = ('count', 'sum', 'max', 'p50', 'p90', 'p99', 'p999')
+
+def metrics():
+    """Snapshot of the metrics of this process.
+
+    Returns a dictionary with two entries: 'counters' maps each counter
+    name to its value, 'histograms' maps each histogram name to a dictionary
+    with its count, sum, max and percentiles. Latencies are in nanoseconds.
+    """
+    snapshot = ffi.new('MetricsSnapshot *')
+    C_ADUANA.metrics_snapshot(snapshot)
+    counters = dict(
+        (ffi.string(c.name), c.value) for c in snapshot.counters)
+    histograms = dict(
+        (ffi.string(h.name),
+         dict((f, getattr(h, f)) for f in _METRIC_FIELDS))
+        for h in snapshot.histograms)
+    return {'counters': counters, 'histograms': histograms}
+
+def metrics_reset():
+    C_ADUANA.metrics_reset()
+
+def metrics_enable(value=True):
+    C_ADUANA.metrics_set_enabled(1 if value else 0)
+
+def metrics_text(snapshot=None):
+    """Format a snapshot, by default the current one, in the Prometheus text format"""
+    if snapshot is None:
+        snapshot = metrics()
+    lines = []
+    for name, value in sorted(snapshot['counters'].items()):
+        lines.append('# TYPE aduana_{0} counter'.format(name))
+        lines.append('aduana_{0} {1}'.format(name, value))
+    quantiles = (('0.5', 'p50'), ('0.9', 'p90'), ('0.99', 'p99'),
+                 ('0.999', 'p999'), ('1', 'max'))
+    for name, h in sorted(snapshot['histograms'].items()):
+        lines.append('# TYPE aduana_{0}_seconds summary'.format(name))
+        for q, f in quantiles:
+            lines.append('aduana_{0}_seconds{{quantile="{1}"}} {2:.9f}'.format(
+                name, q, 1e-9*h[f]))
+        lines.append('aduana_{0}_seconds_sum {1:.9f}'.format(name, 1e-9*h['sum']))
+        lines.append('aduana_{0}_seconds_count {1}'.format(name, h['count']))
+    return '\n'.join(lines) + '\n'
+
 if __name__ == '__main__':
     db = PageDB('./test_python_bindings')
     scorer = PageRankScorer(db)
@@ -1,15 +1,23 @@
 #!/usr/bin/env python
 from __future__ import print_function
 import sys
+import os
+import errno
 import json
 import imp
 import argparse
+import signal
+import socket
+import time
 
 import falcon
 from talons.auth import basicauth, middleware, external
+import gevent
 import gevent.pywsgi
+import gevent.socket
 
 import aduana
+import aduana.wire
 
 class Settings(object):
     """Stores server settings.
@@ -29,6 +37,10 @@ class Settings(object):
     PASSWDS           A dictionary mapping login name to password
     SSL_KEY           Path to SSL keyfile
     SSL_CERT          Path to SSL certificate
+    WORKERS           Number of server processes sharing the databases
+    WORKERS_UPDATE_INTERVAL
+                      Seconds between score updates when WORKERS > 1 and
+                      SCORE_UPDATE_INTERVAL is not set
     """
 
     # Default settings
@@ -46,6 +58,8 @@ class Settings(object):
     PASSWDS = None
     SSL_KEY = None
     SSL_CERT = None
+    WORKERS = 1
+    WORKERS_UPDATE_INTERVAL = 10
 
     def __init__(self, settings_module=None):
         """settings_module can be a python module which will be used to
@@ -91,7 +105,8 @@ class Crawled(object):
                     ["http://scrapinghub.com/platform/", 0.5],
                     ["http://scrapinghub.com/pricing/", 0.8],
                     ["http://scrapinghub.com/clients/", 0.9]],
-          "content_hash": 27348276 }
+          "content_hash": 27348276,
+          "simhash": 1234567890123 }
 
         Only the URL field is mandatory. If there are no links that field can
         be left out of the dictionary. If no score it will be assumed 0.0.
@@ -118,6 +133,10 @@ class Crawled(object):
             if content_hash:
                 cp.hash = int(content_hash)
 
+            simhash = data.get('simhash', None)
+            if simhash is not None:
+                cp.simhash = int(simhash)
+
         except TypeError as e:
             error_response(resp, 'ERROR: Incorrect data inside CrawledPage. ' + str(e))
             return
@@ -126,6 +145,47 @@ class Crawled(object):
         resp.status = falcon.HTTP_201
 
 
+class CrawledBatch(object):
+    def __init__(self, scheduler):
+        self.scheduler = scheduler
+
+    def on_post(self, req, resp):
+        """Serves POST requests with many crawled pages.
+
+        The body must be encoded with aduana.wire.encode_pages and the
+        content type set to aduana.wire.CONTENT_TYPE. All pages are added
+        to the database inside a single transaction.
+        """
+        content_type = (req.content_type or '').split(';')[0].strip()
+        if content_type != aduana.wire.CONTENT_TYPE:
+            error_response(
+                resp, 'ERROR: content type must be ' + aduana.wire.CONTENT_TYPE)
+            return
+
+        try:
+            pages = aduana.wire.decode_pages(req.stream.read())
+        except aduana.wire.WireError as e:
+            error_response(resp, 'ERROR: could not decode batch. ' + str(e))
+            return
+
+        try:
+            batch = []
+            for page in pages:
+                cp = aduana.CrawledPage(page.url, page.links, page.link_scores)
+                cp.score = page.score
+                if page.content_hash is not None:
+                    cp.hash = page.content_hash
+                if page.simhash is not None:
+                    cp.simhash = page.simhash
+                batch.append(cp)
+        except (TypeError, aduana.AduanaException) as e:
+            error_response(resp, 'ERROR: Incorrect data inside CrawledPage. ' + str(e))
+            return
+
+        self.scheduler.add_batch(batch)
+        resp.status = falcon.HTTP_201
+
+
 class Request(object):
     def __init__(self, scheduler, default_reqs = 10):
         self.scheduler = scheduler
@@ -138,6 +198,9 @@ class Request(object):
         string parameter 'n'. Syntax example:
 
              http://localhost:8000?n=42
+
+        If the Accept header names aduana.wire.CONTENT_TYPE the list is encoded
+        with aduana.wire.encode_urls instead of JSON.
         """
         try:
             n_reqs = int(req.params.get('n', self.default_reqs))
@@ -146,47 +209,123 @@ class Request(object):
             return
 
         urls = self.scheduler.requests(n_reqs)
-        resp.data = json.dumps(urls, ensure_ascii=True)
+        # only on explicit request, clients sending */* expect JSON
+        if aduana.wire.CONTENT_TYPE in (req.accept or ''):
+            resp.data = aduana.wire.encode_urls(urls)
+            resp.content_type = aduana.wire.CONTENT_TYPE
+        else:
+            resp.data = json.dumps(urls, ensure_ascii=True)
+            resp.content_type = "application/json"
+        resp.status = falcon.HTTP_200
+
+
+class Domain(object):
+    def __init__(self, page_db):
+        self.page_db = page_db
+
+    def on_get(self, req, resp):
+        """Serve GET requests, which return the pages of a single domain.
+
+        The domain is specified either with any URL of the domain, as the
+        'url' query parameter, or with the domain hash in hexadecimal as the
+        'hash' parameter. Syntax example:
+
+             http://localhost:8000/domain?url=http://scrapinghub.com
+        """
+        url = req.get_param('url')
+        domain_hash = req.get_param('hash')
+        if url is not None:
+            domain = url.encode('ascii', 'ignore')
+        elif domain_hash is not None:
+            try:
+                domain = int(domain_hash, 16)
+            except ValueError:
+                error_response(resp, 'ERROR: Incorrect domain hash')
+                return
+        else:
+            error_response(resp, 'ERROR: missing "url" or "hash" parameter')
+            return
+
+        pages = [{'url': pi.url,
+                  'hash': '{0:016x}'.format(pi.__hash__()),
+                  'n_crawls': pi.n_crawls,
+                  'last_crawl': pi.last_crawl,
+                  'score': pi.score}
+                 for pi in self.page_db.iter_domain(domain)]
+        resp.data = json.dumps(pages, ensure_ascii=True)
         resp.content_type = "application/json"
         resp.status = falcon.HTTP_200
 
 
-if __name__ == '__main__':
-    parser = argparse.ArgumentParser(description='Start Aduana server.')
-    parser.add_argument('settings',
-                        nargs='?',
-                        default=None,
-                        help='Path to python module containing server settings')
-    parser.add_argument('--seeds',
-                        nargs='?',
-                        default=None,
-                        help='Path to seeds file')
+class Metrics(object):
+    def on_get(self, req, resp):
+        """Serve GET requests, which return the library metrics in the
+        Prometheus text format.
 
-    args = parser.parse_args()
-    if args.settings is None:
-        settings = Settings()
+        With several workers each process keeps its own metrics, and the
+        response comes from whichever worker accepted the connection.
+        """
+        resp.data = aduana.metrics_text()
+        resp.content_type = "text/plain; version=0.0.4"
+        resp.status = falcon.HTTP_200
+
+
+class WorkerSettings(object):
+    """Settings of a single worker when running several of them.
+
+    Overrides the values given as keyword arguments and forwards everything
+    else to the server settings.
+    """
+    def __init__(self, settings, **overrides):
+        self.settings = settings
+        self.overrides = overrides
+
+    def __call__(self, name):
+        if name in self.overrides:
+            return self.overrides[name]
+        return self.settings(name)
+
+    def get(self, name, default=None):
+        return self(name) or default
+
+
+def worker_settings(settings, worker, n_workers):
+    """Adapt the settings to one of n_workers processes.
+
+    Only worker 0 runs the scorer and the BF update thread. Since it does
+    not see the pages added by the other workers it updates on a timer.
+    Each worker tracks crawl rates on its own, so the limits are split
+    between them.
+    """
+    overrides = {
+        'SOFT_CRAWL_LIMIT': settings.get('SOFT_CRAWL_LIMIT', 0.25)/n_workers,
+        'HARD_CRAWL_LIMIT': settings.get('HARD_CRAWL_LIMIT', 100.0)/n_workers,
+    }
+    if worker == 0:
+        overrides['SCORE_UPDATE_INTERVAL'] = settings.get(
+            'SCORE_UPDATE_INTERVAL', settings('WORKERS_UPDATE_INTERVAL'))
     else:
-        settings = Settings(args.settings)
+        overrides['SCORER'] = None
+    return WorkerSettings(settings, **overrides)
 
-    if args.seeds:
-        settings.SEEDS = args.seeds
 
-    page_db = aduana.PageDB(settings('PAGE_DB_PATH'))
+def open_scheduler(settings, persist):
+    page_db = aduana.PageDB(settings('PAGE_DB_PATH'), persist=persist)
     scheduler_class = settings.get('BACKEND_SCHEDULER', None)
     if scheduler_class is None:
         print('No SCHEDULER setting. Using default BFScheduler', file=sys.stderr)
         scheduler_class = aduana.BFScheduler
-    scheduler = scheduler_class.from_settings(page_db, settings, logger=None)
+    return page_db, scheduler_class.from_settings(page_db, settings, logger=None)
 
-    seeds_path = settings('SEEDS')
-    if seeds_path is None:
-        sys.exit("ERROR: SEEDS setting is missing and mandatory. Exit")
 
+def add_seeds(scheduler, seeds_path):
     with open(seeds_path, 'r') as seeds:
         for i, line in enumerate(seeds):
             scheduler.add(
                 aduana.CrawledPage('_seed_{0}'.format(i), [(line.strip(), 1.0)]))
 
+
+def make_app(settings, page_db, scheduler):
     middlewares = []
     passwds = settings('PASSWDS')
     if passwds:
@@ -208,12 +347,16 @@ if __name__ == '__main__':
         )
         middlewares.append(auth)
 
-    crawled = Crawled(scheduler)
-    request = Request(scheduler, settings('DEFAULT_REQS'))
-    app = application = falcon.API(before=middlewares)
-    app.add_route('/crawled', crawled)
-    app.add_route('/request', request)
+    app = falcon.API(before=middlewares)
+    app.add_route('/crawled', Crawled(scheduler))
+    app.add_route('/crawled_batch', CrawledBatch(scheduler))
+    app.add_route('/request', Request(scheduler, settings('DEFAULT_REQS')))
+    app.add_route('/domain', Domain(page_db))
+    app.add_route('/metrics', Metrics())
+    return app
 
+
+def ssl_paths(settings):
     key_path = settings('SSL_KEY')
     cert_path = settings('SSL_CERT')
 
@@ -222,10 +365,143 @@ if __name__ == '__main__':
               file=sys.stderr)
         key_path = None
         cert_path = None
+    return key_path, cert_path
+
+
+def reuseport_listener(address, port):
+    """A listening socket that other processes can bind to the same port"""
+    listener = gevent.socket.socket(gevent.socket.AF_INET, gevent.socket.SOCK_STREAM)
+    listener.setsockopt(gevent.socket.SOL_SOCKET, gevent.socket.SO_REUSEADDR, 1)
+    # not defined by the socket module of python 2
+    listener.setsockopt(gevent.socket.SOL_SOCKET,
+                        getattr(socket, 'SO_REUSEPORT', 15), 1)
+    listener.bind((address, port))
+    listener.listen(socket.SOMAXCONN)
+    return listener
+
+
+def run_worker(settings, worker, n_workers, seeds_path):
+    """Body of each forked process. The databases are opened after the fork"""
+    settings = worker_settings(settings, worker, n_workers)
+    page_db, scheduler = open_scheduler(settings, persist=1)
+    if worker == 0 and seeds_path:
+        add_seeds(scheduler, seeds_path)
+
+    key_path, cert_path = ssl_paths(settings)
+    server = gevent.pywsgi.WSGIServer(
+        reuseport_listener(settings('ADDRESS'), settings('PORT')),
+        make_app(settings, page_db, scheduler),
+        keyfile=key_path,
+        certfile=cert_path
+    )
+    gevent.signal(signal.SIGTERM, server.stop)
+    gevent.signal(signal.SIGINT, server.stop)
+    try:
+        server.serve_forever()
+    finally:
+        scheduler.close()
+        page_db.close()
+
+
+def run_workers(settings, n_workers, seeds_path):
+    """Fork the workers and restart them if they die"""
+    def start(worker):
+        pid = os.fork()
+        if pid == 0:
+            signal.signal(signal.SIGTERM, signal.SIG_DFL)
+            signal.signal(signal.SIGINT, signal.SIG_DFL)
+            status = 0
+            try:
+                run_worker(settings, worker, n_workers, seeds_path)
+            except Exception as e:
+                print('ERROR in worker {0}: {1}'.format(worker, e), file=sys.stderr)
+                status = 1
+            finally:
+                os._exit(status)
+        return pid
+
+    workers = {}
+    for i in range(n_workers):
+        workers[start(i)] = i
+
+    stopping = []
+    def stop(signum, frame):
+        stopping.append(signum)
+        for pid in list(workers):
+            try:
+                os.kill(pid, signal.SIGTERM)
+            except OSError:
+                pass
+    signal.signal(signal.SIGTERM, stop)
+    signal.signal(signal.SIGINT, stop)
+
+    print("Press Ctrl-C to exit")
+    while workers:
+        try:
+            pid, status = os.wait()
+        except OSError as e:
+            if e.errno == errno.EINTR:
+                continue
+            raise
+        worker = workers.pop(pid, None)
+        if worker is None:
+            continue
+        if not stopping:
+            print('WARNING: worker {0} exited with status {1}. Restarting'.format(
+                worker, status), file=sys.stderr)
+            # do not spin if the worker dies at start
+            time.sleep(1.0)
+            workers[start(worker)] = worker
+    print("Exit")
+
+    if not settings('PERSIST'):
+        # workers always persist, the databases are deleted by closing them
+        # once more without persistence, as in single process mode
+        page_db, scheduler = open_scheduler(settings, persist=0)
+        scheduler.close()
+        page_db.close()
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Start Aduana server.')
+    parser.add_argument('settings',
+                        nargs='?',
+                        default=None,
+                        help='Path to python module containing server settings')
+    parser.add_argument('--seeds',
+                        nargs='?',
+                        default=None,
+                        help='Path to seeds file')
+    parser.add_argument('--workers',
+                        type=int,
+                        default=None,
+                        help='Number of server processes')
+
+    args = parser.parse_args()
+    if args.settings is None:
+        settings = Settings()
+    else:
+        settings = Settings(args.settings)
+
+    if args.seeds:
+        settings.SEEDS = args.seeds
+
+    seeds_path = settings('SEEDS')
+    if seeds_path is None:
+        sys.exit("ERROR: SEEDS setting is missing and mandatory. Exit")
+
+    n_workers = args.workers or settings('WORKERS')
+    if n_workers > 1:
+        run_workers(settings, n_workers, seeds_path)
+        sys.exit(0)
+
+    page_db, scheduler = open_scheduler(settings, persist=settings('PERSIST'))
+    add_seeds(scheduler, seeds_path)
 
+    key_path, cert_path = ssl_paths(settings)
     server = gevent.pywsgi.WSGIServer(
         (settings('ADDRESS'), settings('PORT')),
-        app,
+        make_app(settings, page_db, scheduler),
         keyfile=key_path,
         certfile=cert_path
     )
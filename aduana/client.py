@@ -0,0 +1,114 @@
+"""Client for aduana_server, the native frontier server.
+
+Frames are a little endian uint32 with the length of the rest of the
+frame, an uint8 and a payload. Requests carry an operation code and
+responses a status. Pages and URLs travel encoded with aduana.wire.
+
+Responses arrive in the same order as requests, so add_batch does not wait
+for the server unless asked to: the response is read before the next
+operation that needs an answer. This keeps several batches in flight.
+"""
+
+import socket
+import struct
+
+from . import wire
+
+OP_ADD = 1
+OP_REQUEST = 2
+OP_METRICS = 3
+
+STATUS_OK = 0
+STATUS_ERROR = 1
+
+_frame = struct.Struct('<IB')
+_n = struct.Struct('<I')
+
+
+class ServerError(Exception):
+    pass
+
+
+class Client(object):
+    def __init__(self, address='localhost', port=8001, unix_path=None, timeout=None):
+        """Connect to aduana_server.
+
+        If unix_path is given connect to that Unix socket, otherwise to the
+        TCP address and port.
+        """
+        if unix_path:
+            self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self._sock.settimeout(timeout)
+            self._sock.connect(unix_path)
+        else:
+            self._sock = socket.create_connection((address, port), timeout)
+            self._sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self._file = self._sock.makefile('rb')
+        self._pending = 0
+
+    def _send(self, op, payload):
+        self._sock.sendall(_frame.pack(len(payload) + 1, op) + payload)
+        self._pending += 1
+
+    def _recv(self):
+        """Read the next response, returning its status and payload"""
+        header = self._file.read(_frame.size)
+        if len(header) < _frame.size:
+            raise ServerError('connection closed by server')
+        length, status = _frame.unpack(header)
+        payload = self._file.read(length - 1)
+        if len(payload) < length - 1:
+            raise ServerError('connection closed by server')
+        self._pending -= 1
+        return status, payload
+
+    def wait(self):
+        """Read the responses of all the requests sent, raising the first error"""
+        error = None
+        while self._pending:
+            status, payload = self._recv()
+            if status != STATUS_OK and error is None:
+                error = payload.decode('ascii', 'replace')
+        if error is not None:
+            raise ServerError(error)
+
+    def add_batch(self, pages, wait=False):
+        """Send a list of aduana.wire.Page
+
+        Errors are raised by the call that reads the response: this one if
+        wait is True, otherwise the next call to requests or wait.
+        """
+        self._send(OP_ADD, wire.encode_pages(pages))
+        if wait:
+            self.wait()
+
+    def requests(self, n_requests):
+        """Return at most n_requests URLs to crawl"""
+        self.wait()
+        self._send(OP_REQUEST, _n.pack(n_requests))
+        status, payload = self._recv()
+        if status != STATUS_OK:
+            raise ServerError(payload.decode('ascii', 'replace'))
+        return wire.decode_urls(payload)
+
+    def metrics(self):
+        """Return the server metrics in the Prometheus text format"""
+        self.wait()
+        self._send(OP_METRICS, b'')
+        status, payload = self._recv()
+        if status != STATUS_OK:
+            raise ServerError(payload.decode('ascii', 'replace'))
+        return payload.decode('ascii')
+
+    def close(self):
+        try:
+            self.wait()
+        finally:
+            self._file.close()
+            self._sock.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
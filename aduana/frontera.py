@@ -1,18 +1,160 @@
 from __future__ import absolute_import
 
+import collections
+import threading
+import time
+try:
+    import Queue as queue
+except ImportError:
+    import queue
+
 import frontera
 from frontera.core.models import Request
 import tempfile
 import aduana
+import aduana.wire
 import requests
 import requests.adapters
 import requests.auth
 
 
-class Backend(frontera.Backend):
-    def __init__(self, scheduler):
+class _BufferedBackend(frontera.Backend):
+    """Frontera backend talking to a scheduler from a worker thread.
+
+    Crawled pages are buffered and sent in batches when the buffer reaches
+    batch_size pages or its oldest page is batch_seconds old. Requests are
+    prefetched by the same thread so that get_next_requests can usually be
+    answered from memory.
+
+    Prefetched requests have already been removed from the schedule, and
+    are lost if the crawl stops before they are served.
+
+    Subclasses implement _add_batch, _requests and _close, which are only
+    called from the worker thread.
+    """
+    def __init__(self, batch_size=100, batch_seconds=1.0):
+        self._batch_size = batch_size
+        self._batch_seconds = batch_seconds
+        self._batch = []
+        self._batch_start = None
+
+        self._tasks = queue.Queue()
+        self._prefetch = collections.deque()
+        self._prefetch_lock = threading.Lock()
+        self._prefetch_pending = False
+        self._error = None
+        self._worker = threading.Thread(target=self._run, name='aduana-backend')
+        self._worker.daemon = True
+        self._worker.start()
+
+    def _add_batch(self, batch):
+        raise NotImplementedError
+
+    def _requests(self, n_requests):
+        raise NotImplementedError
+
+    def _close(self):
+        pass
+
+    def _run(self):
+        while True:
+            task = self._tasks.get()
+            if task is None:
+                break
+            try:
+                task()
+            except Exception as e:
+                # reported to the caller at the next call
+                self._error = e
+
+    def _check_error(self):
+        if self._error is not None:
+            error, self._error = self._error, None
+            raise error
+
+    def _flush(self, wait=False):
+        if self._batch:
+            batch, self._batch = self._batch, []
+            self._batch_start = None
+            self._tasks.put(lambda: self._add_batch(batch))
+        if wait:
+            done = threading.Event()
+            self._tasks.put(done.set)
+            done.wait()
+
+    def _add(self, page):
+        self._check_error()
+        if not self._batch:
+            self._batch_start = time.time()
+        self._batch.append(page)
+        if (len(self._batch) >= self._batch_size or
+                time.time() - self._batch_start >= self._batch_seconds):
+            self._flush()
+
+    def _request_prefetch(self, n_requests):
+        with self._prefetch_lock:
+            if self._prefetch_pending:
+                return
+            self._prefetch_pending = True
+        self._tasks.put(lambda: self._fetch(n_requests))
+
+    def _fetch(self, n_requests):
+        try:
+            urls = self._requests(n_requests)
+        finally:
+            with self._prefetch_lock:
+                self._prefetch_pending = False
+        with self._prefetch_lock:
+            self._prefetch.extend(urls)
+
+    def frontier_start(self):
+        pass
+
+    def frontier_stop(self):
+        self._flush(wait=True)
+        self._tasks.put(self._close)
+        self._tasks.put(None)
+        self._worker.join()
+        self._check_error()
+
+    def request_error(self, page, error):
+        pass
+
+    def get_next_requests(self, max_n_requests, **kwargs):
+        self._check_error()
+        # pages waiting too long inside the buffer are flushed even if no
+        # more pages are crawled
+        if (self._batch_start is not None and
+                time.time() - self._batch_start >= self._batch_seconds):
+            self._flush()
+
+        with self._prefetch_lock:
+            empty = not self._prefetch
+        if empty:
+            # nothing ready, wait as an unbuffered backend would do
+            self._flush()
+            self._request_prefetch(max_n_requests)
+            self._flush(wait=True)
+            self._check_error()
+
+        with self._prefetch_lock:
+            n = min(max_n_requests, len(self._prefetch))
+            urls = [self._prefetch.popleft() for _ in xrange(n)]
+        # keep ready the next call, which usually asks for the same number
+        self._request_prefetch(max_n_requests)
+        return map(Request, urls)
+
+
+class Backend(_BufferedBackend):
+    """Frontera backend running the scheduler in a worker thread.
+
+    Crawled pages are added in batches, with a single database commit.
+    See _BufferedBackend for the buffering and prefetching.
+    """
+    def __init__(self, scheduler, batch_size=100, batch_seconds=1.0):
         self._scheduler = scheduler
         self._n_seeds = 0
+        super(Backend, self).__init__(batch_size, batch_seconds)
 
     @classmethod
     def from_manager(cls, manager):
@@ -23,6 +165,12 @@ class Backend(frontera.Backend):
             db_path = tempfile.mkdtemp(prefix='frontera_', dir='./')
             persist = 0
         page_db = aduana.PageDB(db_path, persist=persist)
+        page_db.link_weights = manager.settings.get('USE_LINK_WEIGHTS', False)
+        page_db.track_linking_domains = manager.settings.get(
+            'TRACK_LINKING_DOMAINS', False)
+
+        batch_size = manager.settings.get('ADUANA_BATCH_SIZE', 100)
+        batch_seconds = manager.settings.get('ADUANA_BATCH_SECONDS', 1.0)
 
         scheduler_class = manager.settings.get('BACKEND_SCHEDULER', None)
         if scheduler_class is None:
@@ -31,37 +179,40 @@ class Backend(frontera.Backend):
                 'No SCHEDULER setting. Using default BFScheduler')
 
         if scheduler_class is aduana.BFScheduler:
-            return cls(
-                aduana.BFScheduler.from_settings(
-                    page_db, manager.settings, manager.logger))
+            scheduler = aduana.BFScheduler.from_settings(
+                page_db, manager.settings, manager.logger)
         elif scheduler_class is aduana.FreqScheduler:
-            return cls(
-                aduana.FreqScheduler.from_settings(
-                    page_db, manager.settings))
+            scheduler = aduana.FreqScheduler.from_settings(
+                page_db, manager.settings)
+        return cls(scheduler, batch_size, batch_seconds)
 
-    def frontier_start(self):
-        pass
+    def _add_batch(self, batch):
+        self._scheduler.add_batch(batch)
 
-    def frontier_stop(self):
+    def _requests(self, n_requests):
+        return self._scheduler.requests(n_requests)
+
+    def _close(self):
         self._scheduler.close()
         self._scheduler._page_db.close()
 
     def add_seeds(self, seeds):
-        self._scheduler.add(
+        self._add(
             aduana.CrawledPage(
                 '_seed_{0}'.format(self._n_seeds),
                 [(link.url, link.meta['scrapy_meta'].get('score', 1.0)) for link in seeds]
             )
         )
         self._n_seeds += 1
-
-    def request_error(self, page, error):
-        pass
+        # seeds must be available for the first requests
+        self._flush(wait=True)
+        self._check_error()
 
     def page_crawled(self, response, links):
         cp = aduana.CrawledPage(
             response.url,
-            [(link.url, link.meta['scrapy_meta'].get('score', 0.0)) for link in links])
+            [link.url for link in links],
+            [link.meta['scrapy_meta'].get('score', 0.0) for link in links])
 
         try:
             cp.score = response.meta['scrapy_meta']['score']
@@ -73,10 +224,7 @@ class Backend(frontera.Backend):
         except KeyError:
             pass
 
-        self._scheduler.add(cp)
-
-    def get_next_requests(self, max_n_requests, **kwargs):
-        return map(Request, self._scheduler.requests(max_n_requests))
+        self._add(cp)
 
 
 class IgnoreHostNameAdapter(requests.adapters.HTTPAdapter):
@@ -85,22 +233,35 @@ class IgnoreHostNameAdapter(requests.adapters.HTTPAdapter):
         return super(IgnoreHostNameAdapter,
                      self).cert_verify(conn, url, verify, cert)
 
-class WebBackend(frontera.Backend):
+class WebBackend(_BufferedBackend):
+    """Frontera backend talking to aduana-server.
+
+    Crawled pages are posted in batches to /crawled_batch, encoded with
+    aduana.wire, over a single persistent HTTP session. Requests for the
+    next pages are prefetched. Both happen in a worker thread, so the
+    spider does not wait for the round trip to the server.
+    """
     def __init__(self,
                  logger,
                  server_name='localhost',
                  server_port=8000,
                  server_cert=None,
                  user=None,
-                 passwd=None):
+                 passwd=None,
+                 batch_size=100,
+                 batch_seconds=1.0,
+                 compress=False):
         self.logger = logger
         schema = 'https' if server_cert else 'http'
         self.server = '{0}://{1}:{2}'.format(schema, server_name, server_port)
         self.server_cert = server_cert
+        self.compress = compress
+        # only used from the worker thread
         self.session = requests.Session()
         self.session.mount('https://', IgnoreHostNameAdapter())
         if user and passwd:
             self.session.auth = requests.auth.HTTPBasicAuth(user, passwd)
+        super(WebBackend, self).__init__(batch_size, batch_seconds)
 
     @classmethod
     def from_manager(cls, manager):
@@ -109,56 +270,50 @@ class WebBackend(frontera.Backend):
                    server_port=manager.settings.get('SERVER_PORT', 8000),
                    server_cert=manager.settings.get('SERVER_CERT', None),
                    user=manager.settings.get('USER', None),
-                   passwd=manager.settings.get('PASSWD', None))
-
-    def frontier_start(self):
-        pass
-
-    def frontier_stop(self):
-        self._scheduler.close()
-        self._scheduler._page_db.close()
-
-    def add_seeds(self, seeds):
-        pass
-
-    def request_error(self, page, error):
-        pass
-
-    def page_crawled(self, response, links):
-        try:
-            score = response.meta['scrapy_meta']['score']
-        except KeyError:
-            score = 0.0
-
-        try:
-            content_hash = response.meta['scrapy_meta']['content_hash']
-        except KeyError:
-            content_hash = None
-
-        message = {
-            'url': response.url,
-            'score': score,
-            'links': [(link.url, link.meta['scrapy_meta']['score']) for link in links],
-        }
-        if content_hash:
-            message['content_hash'] = content_hash
+                   passwd=manager.settings.get('PASSWD', None),
+                   batch_size=manager.settings.get('ADUANA_BATCH_SIZE', 100),
+                   batch_seconds=manager.settings.get('ADUANA_BATCH_SECONDS', 1.0),
+                   compress=manager.settings.get('ADUANA_COMPRESS', False))
 
+    def _add_batch(self, batch):
         r = self.session.post(
-            self.server + '/crawled',
-            json=message,
-            verify=self.server_cert is not None
+            self.server + '/crawled_batch',
+            data=aduana.wire.encode_pages(batch, self.compress),
+            headers={'Content-Type': aduana.wire.CONTENT_TYPE},
+            verify=self.server_cert
         )
         if r.status_code != 201:
-            self.logger.warning(r.text)
+            # the batch is lost, stop the crawl at the next call instead of
+            # silently dropping pages
+            raise requests.HTTPError(
+                'adding batch failed with status {0}: {1}'.format(
+                    r.status_code, r.text),
+                response=r)
 
-    def get_next_requests(self, max_n_requests, **kwargs):
+    def _requests(self, n_requests):
         r = self.session.get(
             self.server + '/request',
-            params={'n': max_n_requests},
+            params={'n': n_requests},
+            headers={'Accept': aduana.wire.CONTENT_TYPE},
             verify=self.server_cert
         )
         if r.status_code != 200:
             self.logger.warning(r.text)
             return []
-        else:
-            return map(Request, r.json())
+        return aduana.wire.decode_urls(r.content)
+
+    def _close(self):
+        self.session.close()
+
+    def add_seeds(self, seeds):
+        pass
+
+    def page_crawled(self, response, links):
+        meta = response.meta.get('scrapy_meta', {})
+        self._add(aduana.wire.Page(
+            url=response.url.encode('ascii', 'ignore'),
+            score=meta.get('score', 0.0),
+            content_hash=meta.get('content_hash', None),
+            links=[link.url.encode('ascii', 'ignore') for link in links],
+            link_scores=[link.meta['scrapy_meta'].get('score', 0.0)
+                         for link in links]))
@@ -0,0 +1,184 @@
+"""Binary encoding of the messages between WebBackend and aduana-server.
+
+A batch of crawled pages is a header followed by a body, compressed with
+zlib if the header flags say so. All integers are little endian.
+
+    header: magic 'ADNW', uint8 version, uint8 flags, uint32 number of pages
+    page:   uint32 url length, url
+            float32 score
+            uint8 flags (bit 0: content hash present, bit 1: simhash present)
+            [uint64 content hash] [uint64 simhash]
+            uint32 number of links n
+            n x uint32 link URL lengths
+            n x float32 link scores
+            the link URLs, one after the other
+
+Link URLs and scores are stored as columns so that they can be handed to
+CrawledPage.add_links without building the (url, score) pairs.
+
+A list of URLs, the answer to a request, uses the same header followed by
+the URL lengths and then the URLs.
+"""
+
+import collections
+import struct
+import zlib
+
+MAGIC = b'ADNW'
+VERSION = 1
+CONTENT_TYPE = 'application/x-aduana-batch'
+
+FLAG_ZLIB = 1
+
+PAGE_CONTENT_HASH = 1
+PAGE_SIMHASH = 2
+
+_header = struct.Struct('<4sBBI')
+_url_len = struct.Struct('<I')
+_page_fields = struct.Struct('<fB')
+_hash = struct.Struct('<Q')
+
+
+class Page(collections.namedtuple(
+        'Page', ['url', 'score', 'content_hash', 'simhash', 'links', 'link_scores'])):
+    """A crawled page as sent by WebBackend.
+
+    links is a sequence of URLs and link_scores a sequence of the same length
+    with their scores. content_hash and simhash are None when unknown.
+    """
+    __slots__ = ()
+
+    def __new__(cls, url, score=0.0, content_hash=None, simhash=None,
+                links=(), link_scores=()):
+        return super(Page, cls).__new__(
+            cls, url, score, content_hash, simhash, links, link_scores)
+
+
+class WireError(ValueError):
+    pass
+
+
+def _pack(n, body, compress):
+    flags = 0
+    if compress:
+        flags |= FLAG_ZLIB
+        body = zlib.compress(body, compress if compress is not True else 6)
+    return _header.pack(MAGIC, VERSION, flags, n) + body
+
+
+def _unpack(data):
+    if len(data) < _header.size:
+        raise WireError('message too short')
+    magic, version, flags, n = _header.unpack_from(data)
+    if magic != MAGIC:
+        raise WireError('bad magic')
+    if version != VERSION:
+        raise WireError('unsupported version {0}'.format(version))
+    body = data[_header.size:]
+    if flags & FLAG_ZLIB:
+        try:
+            body = zlib.decompress(body)
+        except zlib.error as e:
+            raise WireError('decompressing: {0}'.format(e))
+    return n, body
+
+
+def encode_pages(pages, compress=False):
+    """Encode a sequence of Page.
+
+    compress can be True or a zlib compression level between 1 and 9.
+    """
+    parts = []
+    for page in pages:
+        url = page.url
+        parts.append(_url_len.pack(len(url)))
+        parts.append(url)
+        flags = 0
+        if page.content_hash is not None:
+            flags |= PAGE_CONTENT_HASH
+        if page.simhash is not None:
+            flags |= PAGE_SIMHASH
+        parts.append(_page_fields.pack(page.score, flags))
+        if page.content_hash is not None:
+            parts.append(_hash.pack(page.content_hash))
+        if page.simhash is not None:
+            parts.append(_hash.pack(page.simhash))
+
+        n_links = len(page.links)
+        if len(page.link_scores) != n_links:
+            raise WireError('links and link_scores have different lengths')
+        parts.append(_url_len.pack(n_links))
+        if n_links:
+            parts.append(struct.pack('<{0}I'.format(n_links),
+                                     *[len(l) for l in page.links]))
+            parts.append(struct.pack('<{0}f'.format(n_links), *page.link_scores))
+            parts.extend(page.links)
+    return _pack(len(pages), b''.join(parts), compress)
+
+
+def decode_pages(data):
+    """Decode a message made by encode_pages into a list of Page"""
+    n_pages, body = _unpack(data)
+    pages = []
+    pos = 0
+    try:
+        for _ in range(n_pages):
+            (url_len,) = _url_len.unpack_from(body, pos)
+            pos += _url_len.size
+            url = body[pos:pos + url_len]
+            pos += url_len
+            score, flags = _page_fields.unpack_from(body, pos)
+            pos += _page_fields.size
+            content_hash = None
+            if flags & PAGE_CONTENT_HASH:
+                (content_hash,) = _hash.unpack_from(body, pos)
+                pos += _hash.size
+            simhash = None
+            if flags & PAGE_SIMHASH:
+                (simhash,) = _hash.unpack_from(body, pos)
+                pos += _hash.size
+
+            (n_links,) = _url_len.unpack_from(body, pos)
+            pos += _url_len.size
+            links = []
+            link_scores = ()
+            if n_links:
+                lengths = struct.unpack_from('<{0}I'.format(n_links), body, pos)
+                pos += 4*n_links
+                link_scores = struct.unpack_from('<{0}f'.format(n_links), body, pos)
+                pos += 4*n_links
+                for l in lengths:
+                    links.append(body[pos:pos + l])
+                    pos += l
+            if pos > len(body):
+                raise WireError('truncated message')
+            pages.append(Page(url, score, content_hash, simhash, links, link_scores))
+    except struct.error as e:
+        raise WireError('truncated message: {0}'.format(e))
+    if pos != len(body):
+        raise WireError('trailing bytes after last page')
+    return pages
+
+
+def encode_urls(urls, compress=False):
+    """Encode a sequence of URLs"""
+    body = b''.join(
+        [struct.pack('<{0}I'.format(len(urls)), *[len(u) for u in urls])] +
+        list(urls))
+    return _pack(len(urls), body, compress)
+
+
+def decode_urls(data):
+    """Decode a message made by encode_urls into a list of URLs"""
+    n_urls, body = _unpack(data)
+    if 4*n_urls > len(body):
+        raise WireError('truncated message')
+    lengths = struct.unpack_from('<{0}I'.format(n_urls), body)
+    urls = []
+    pos = 4*n_urls
+    for l in lengths:
+        urls.append(body[pos:pos + l])
+        pos += l
+    if pos != len(body):
+        raise WireError('message length does not match URL lengths')
+    return urls
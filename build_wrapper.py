@@ -14,6 +14,13 @@ aduana_src = [
     aduana_src_root + x for x in [
         'mmap_array.c',
         'page_db.c',
+        'page_db_domains.c',
+        'page_db_simhash.c',
+        'page_db_hll.c',
+        'page_db_export.c',
+        'page_db_archive.c',
+        'page_db_prune.c',
+        'page_db_storage.c',
         'hits.c',
         'page_rank.c',
         'scheduler.c',
@@ -24,7 +31,13 @@ aduana_src = [
         'txn_manager.c',
         'domain_temp.c',
         'freq_scheduler.c',
-        'freq_algo.c'
+        'freq_algo.c',
+        'link_shards.c',
+        'link_stream.c',
+        'ppr_scorer.c',
+        'hll.c',
+        'linking_domains_scorer.c',
+        'metrics.c'
     ]]
 
 if platform.system() == 'Windows':
@@ -62,11 +75,14 @@ ffi.set_source(
     #include "page_db.h"
     #include "page_rank.h"
     #include "page_rank_scorer.h"
+    #include "ppr_scorer.h"
+    #include "linking_domains_scorer.h"
     #include "scheduler.h"
     #include "txn_manager.h"
     #include "util.h"
     #include "freq_scheduler.h"
     #include "freq_algo.h"
+    #include "metrics.h"
     ''',
     sources            = aduana_src,
     include_dirs       = aduana_include,
@@ -118,6 +134,7 @@ ffi.cdef(
          LinkInfo *link_info; /**< Array of LinkInfo */
          size_t n_links;      /**< Number of items inside link_info */
          size_t m_links;      /**< Maximum number of items that can be stored inside link_info */
+         void *arena;         /**< Storage of the URLs */
     } PageLinks;
 
     typedef struct {
@@ -128,6 +145,8 @@ ffi.cdef(
         char *content_hash;          /**< A hash to detect content change since last crawl.
                                           Arbitrary byte sequence */
         size_t content_hash_length;  /**< Number of byes of the content_hash */
+        uint64_t simhash;            /**< SimHash of the page content */
+        int has_simhash;             /**< If 0 simhash has not been set */
     } CrawledPage;
 
     CrawledPage *
@@ -136,15 +155,28 @@ ffi.cdef(
     void
     crawled_page_delete(CrawledPage *cp);
 
+    int
+    crawled_page_reset(CrawledPage *cp, const char *url);
+
     int
     crawled_page_add_link(CrawledPage *cp, const char *url, float score);
 
     size_t
     crawled_page_n_links(const CrawledPage *cp);
 
+    int
+    crawled_page_add_links(CrawledPage *cp,
+                           const char *urls,
+                           const size_t *offsets,
+                           const float *scores,
+                           size_t n_links);
+
     int
     crawled_page_set_hash64(CrawledPage *cp, uint64_t hash);
 
+    void
+    crawled_page_set_simhash(CrawledPage *cp, uint64_t simhash);
+
     const LinkInfo *
     crawled_page_get_link(const CrawledPage *cp, size_t i);
 
@@ -160,13 +192,19 @@ ffi.cdef(
          char *path;
          void* txn_manager;
          void *domain_temp;
+         void *scratch;
          void *error;
          int persist;
+         int link_weights;
+         int track_linking_domains;
     } PageDB;
 
     uint64_t
     page_db_hash(const char *url);
 
+    uint32_t
+    page_db_hash_get_domain(uint64_t hash);
+
     PageDBError
     page_db_new(PageDB **db, const char *path);
 
@@ -176,12 +214,76 @@ ffi.cdef(
     PageDBError
     page_db_add(PageDB *db, const CrawledPage *page, void **page_info_list);
 
+    PageDBError
+    page_db_add_batch(PageDB *db,
+                      const CrawledPage **pages,
+                      size_t n_crawled,
+                      void **page_info_list);
+
     PageDBError
     page_db_delete(PageDB *db);
 
     void
     page_db_set_persist(PageDB *db, int value);
 
+    void
+    page_db_set_link_weights(PageDB *db, int value);
+
+    void
+    page_db_set_track_linking_domains(PageDB *db, int value);
+
+    PageDBError
+    page_db_get_linking_domains(PageDB *db, uint64_t hash, float *count);
+
+    PageDBError
+    page_db_get_domain_linking_domains(PageDB *db, uint32_t domain_hash, float *count);
+
+    typedef struct {
+         const char *name;
+         size_t depth;
+         size_t branch_pages;
+         size_t leaf_pages;
+         size_t overflow_pages;
+         size_t entries;
+    } TxnManagerDBStats;
+
+    typedef struct {
+         size_t page_size;
+         size_t map_size;
+         size_t last_page;
+         size_t free_pages;
+         size_t n_readers;
+         size_t max_readers;
+    } TxnManagerEnvStats;
+
+    typedef struct {
+         TxnManagerEnvStats env;
+         TxnManagerDBStats dbs[...];
+         size_t n_samples;
+         double record_size;
+         double url_size;
+         double url_compression;
+    } PageDBStats;
+
+    PageDBError
+    page_db_stats(PageDB *db, size_t max_samples, PageDBStats *stats);
+
+    PageDBError
+    page_db_compact(PageDB *db);
+
+    typedef struct {
+         double ttl;
+         double now;
+         uint64_t max_depth;
+         float score_percentile;
+    } PageDBPruneOptions;
+
+    PageDBError
+    page_db_prune(PageDB *db,
+                  const PageDBPruneOptions *options,
+                  uint64_t **pruned,
+                  size_t *n_pruned);
+
     typedef enum {
          stream_state_init,
          stream_state_next,
@@ -203,6 +305,104 @@ ffi.cdef(
 
     void
     hashinfo_stream_delete(HashInfoStream *st);
+
+    typedef struct {
+         char *mem;
+         int fd;
+         char *path;
+         size_t n_elements;
+         size_t element_size;
+         void *error;
+         int persist;
+    } MMapArray;
+
+    typedef struct {
+         size_t n_pages;
+         MMapArray *hash;
+         MMapArray *idx;
+         MMapArray *linked_from;
+         MMapArray *depth;
+         MMapArray *n_crawls;
+         MMapArray *n_changes;
+         MMapArray *first_crawl;
+         MMapArray *last_crawl;
+         MMapArray *score;
+         MMapArray *url_offsets;
+         MMapArray *url_blob;
+    } PageDBColumns;
+
+    PageDBError
+    page_db_columns_new(PageDBColumns **cols, int with_urls);
+
+    void
+    page_db_columns_delete(PageDBColumns *cols);
+
+    PageDBError
+    page_db_export(PageDB *db, uint64_t hash_begin, uint64_t hash_end, PageDBColumns *cols);
+
+    void
+    page_db_export_range(size_t n_parts, size_t part, uint64_t *hash_begin, uint64_t *hash_end);
+
+    typedef struct {
+         uint64_t n_pages;
+         uint64_t n_crawled;
+         uint64_t n_links_in;
+         uint64_t n_rates;
+         double rate_sum;
+         double last_crawl;
+    } DomainInfo;
+
+    float
+    domain_info_rate(const DomainInfo *di);
+
+    PageDBError
+    page_db_get_domain_info(PageDB *db, uint32_t domain_hash, DomainInfo *di);
+
+    PageDBError
+    page_db_rebuild_domains(PageDB *db);
+
+    PageDBError
+    page_db_get_simhash(PageDB *db, uint64_t hash,
+                        uint64_t *simhash, double *last_crawl, int *found);
+
+    PageDBError
+    page_db_find_near_dup(PageDB *db, uint64_t simhash,
+                          int max_distance, double min_crawl, uint64_t exclude,
+                          uint64_t *dup_hash, int *found);
+
+    typedef struct {
+         PageDB *db;
+         void *cur;
+         StreamState state;
+    } DomainInfoStream;
+
+    PageDBError
+    domaininfo_stream_new(DomainInfoStream **st, PageDB *db);
+
+    StreamState
+    domaininfo_stream_next(DomainInfoStream *st, uint32_t *domain_hash, DomainInfo *di);
+
+    void
+    domaininfo_stream_delete(DomainInfoStream *st);
+
+    typedef struct {
+         PageDB *db;
+         void *cur;
+         uint32_t domain_hash;
+         StreamState state;
+    } DomainStream;
+
+    PageDBError
+    page_db_domain_stream_new(DomainStream **st, PageDB *db, uint32_t domain_hash);
+
+    PageDBError
+    page_db_domain_stream_new_url(DomainStream **st, PageDB *db, const char *url);
+
+    StreamState
+    page_db_domain_stream_next(DomainStream *st, uint64_t *hash, PageInfo **pi);
+
+    void
+    page_db_domain_stream_delete(DomainStream *st);
     """
 )
 
@@ -240,6 +440,18 @@ ffi.cdef(
 
     void
     page_rank_scorer_set_damping(PageRankScorer *prs, float value);
+
+    void
+    page_rank_scorer_set_shard_size(PageRankScorer *prs, size_t value);
+
+    void
+    page_rank_scorer_set_extrapolation(PageRankScorer *prs, size_t value);
+
+    void
+    page_rank_scorer_set_freeze(PageRankScorer *prs, float precision, size_t loops);
+
+    void
+    page_rank_scorer_set_use_weights(PageRankScorer *prs, int value);
     """
 )
 
@@ -274,6 +486,84 @@ ffi.cdef(
 
     void
     hits_scorer_set_use_content_scores(HitsScorer *hs, int value);
+
+    void
+    hits_scorer_set_shard_size(HitsScorer *hs, size_t value);
+
+    void
+    hits_scorer_set_use_weights(HitsScorer *hs, int value);
+    """
+)
+
+ffi.cdef(
+    """
+    typedef enum {
+         ppr_scorer_error_ok = 0,   /**< No error */
+         ppr_scorer_error_memory,   /**< Error allocating memory */
+         ppr_scorer_error_internal  /**< Unexpected error */
+    } PPRScorerError;
+
+    typedef struct {
+         PageDB *page_db;
+         void *map_new;
+         void *map_old;
+         uint64_t *seeds;
+         size_t n_seeds;
+         uint64_t *queue;
+         size_t queue_begin;
+         size_t queue_len;
+         size_t m_queue;
+         size_t n_pushes;
+         void *error;
+         float damping;
+         float epsilon;
+         size_t max_pushes;
+    } PPRScorer;
+
+    PPRScorerError
+    ppr_scorer_new(PPRScorer **ppr, PageDB *db);
+
+    PPRScorerError
+    ppr_scorer_delete(PPRScorer *ppr);
+
+    void
+    ppr_scorer_setup(PPRScorer *ppr, void *scorer);
+
+    void
+    ppr_scorer_set_damping(PPRScorer *ppr, float value);
+
+    void
+    ppr_scorer_set_epsilon(PPRScorer *ppr, float value);
+
+    void
+    ppr_scorer_set_max_pushes(PPRScorer *ppr, size_t value);
+    """
+)
+
+ffi.cdef(
+    """
+    typedef enum {
+         linking_domains_scorer_error_ok = 0,   /**< No error */
+         linking_domains_scorer_error_memory,   /**< Error allocating memory */
+         linking_domains_scorer_error_internal  /**< Unexpected error */
+    } LinkingDomainsScorerError;
+
+    typedef struct {
+         PageDB *page_db;
+         void *scores_new;
+         void *scores_old;
+         float max_count;
+         void *error;
+    } LinkingDomainsScorer;
+
+    LinkingDomainsScorerError
+    linking_domains_scorer_new(LinkingDomainsScorer **lds, PageDB *db);
+
+    LinkingDomainsScorerError
+    linking_domains_scorer_delete(LinkingDomainsScorer *lds);
+
+    void
+    linking_domains_scorer_setup(LinkingDomainsScorer *lds, void *scorer);
     """
 )
 
@@ -282,6 +572,9 @@ ffi.cdef(
     typedef struct {
          char **urls;
          size_t n_urls;
+         char *url_buf;
+         size_t url_buf_len;
+         size_t url_buf_size;
     } PageRequest;
 
     PageRequest*
@@ -290,6 +583,9 @@ ffi.cdef(
     void
     page_request_delete(PageRequest *req);
 
+    void
+    page_request_reset(PageRequest *req);
+
     int
     page_request_add_url(PageRequest *req, const char *url);
     """
@@ -324,6 +620,9 @@ ffi.cdef(
     BFSchedulerError
     bf_scheduler_add(BFScheduler *sch, const CrawledPage *page);
 
+    BFSchedulerError
+    bf_scheduler_add_batch(BFScheduler *sch, const CrawledPage **pages, size_t n_pages);
+
     BFSchedulerError
     bf_scheduler_request(BFScheduler *sch, size_t n_pages, PageRequest **request);
 
@@ -350,6 +649,20 @@ ffi.cdef(
 
     void
     bf_scheduler_set_update_interval(BFScheduler *sch, time_t value);
+
+    typedef struct {
+         TxnManagerEnvStats env;
+         TxnManagerDBStats schedule;
+    } BFSchedulerStats;
+
+    BFSchedulerError
+    bf_scheduler_stats(BFScheduler *sch, BFSchedulerStats *stats);
+
+    BFSchedulerError
+    bf_scheduler_compact(BFScheduler *sch);
+
+    BFSchedulerError
+    bf_scheduler_prune(BFScheduler *sch, const PageDBPruneOptions *options, size_t *n_pruned);
     """
 )
 
@@ -370,6 +683,8 @@ ffi.cdef(
          int persist;
          float margin;
          size_t max_n_crawls;
+         int near_dup_distance;
+         float near_dup_window;
     } FreqScheduler;
 
     FreqSchedulerError
@@ -390,6 +705,12 @@ ffi.cdef(
     FreqSchedulerError
     freq_scheduler_add(FreqScheduler *sch, const CrawledPage *page);
 
+    FreqSchedulerError
+    freq_scheduler_add_batch(FreqScheduler *sch, const CrawledPage **pages, size_t n_pages);
+
+    FreqSchedulerError
+    freq_scheduler_compact(FreqScheduler *sch);
+
     void
     freq_scheduler_delete(FreqScheduler *sch);
 
@@ -417,5 +738,39 @@ ffi.cdef(
     """
 )
 
+ffi.cdef(
+    """
+    typedef struct {
+         const char *name;
+         uint64_t value;
+    } MetricsCounterSnapshot;
+
+    typedef struct {
+         const char *name;
+         uint64_t count;
+         uint64_t sum;
+         uint64_t max;
+         uint64_t p50;
+         uint64_t p90;
+         uint64_t p99;
+         uint64_t p999;
+    } MetricsHistogramSnapshot;
+
+    typedef struct {
+         MetricsCounterSnapshot counters[...];
+         MetricsHistogramSnapshot histograms[...];
+    } MetricsSnapshot;
+
+    void
+    metrics_snapshot(MetricsSnapshot *snapshot);
+
+    void
+    metrics_reset(void);
+
+    void
+    metrics_set_enabled(int value);
+    """
+)
+
 if __name__ == '__main__':
     ffi.compile()
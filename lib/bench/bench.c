@@ -0,0 +1,511 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "bf_scheduler.h"
+#include "freq_scheduler.h"
+#include "hits.h"
+#include "metrics.h"
+#include "page_rank.h"
+
+/** Pages added on each call when building the databases */
+#define BENCH_BATCH_SIZE 100
+/** Number of URLs asked on each scheduler request */
+#define BENCH_REQUEST_SIZE 10
+/** Maximum number of scheduler requests measured */
+#define BENCH_MAX_REQUESTS 1000
+/** Iterations of PageRank and HITS */
+#define BENCH_SCORER_LOOPS 10
+
+/** Sizes of the schedules before scaling */
+static const size_t bench_schedule_sizes[] = {10000, 100000, 1000000};
+#define BENCH_N_SCHEDULE_SIZES \
+     (sizeof(bench_schedule_sizes)/sizeof(*bench_schedule_sizes))
+
+/** Add n_pages crawled pages with consecutive ids starting at first, each one
+ * with n_links links to random pages among the first n_targets.
+ *
+ * If sch is not NULL pages are added to the scheduler instead of the PageDB.
+ */
+static int
+bench_add_pages(PageDB *db, BFScheduler *sch,
+                uint64_t first, size_t n_pages,
+                size_t n_links, uint64_t n_targets, uint64_t *rng) {
+     CrawledPage *batch[BENCH_BATCH_SIZE];
+     for (size_t i=0; i<BENCH_BATCH_SIZE; ++i)
+          if (!(batch[i] = crawled_page_new("")))
+               return -1;
+
+     int ret = 0;
+     for (size_t i=0; i<n_pages && ret == 0; i += BENCH_BATCH_SIZE) {
+          const size_t n = n_pages - i < BENCH_BATCH_SIZE? n_pages - i: BENCH_BATCH_SIZE;
+          for (size_t j=0; j<n && ret == 0; ++j)
+               ret = bench_crawled_page(batch[j], first + i + j, n_links, n_targets, rng);
+          if (ret != 0)
+               fprintf(stderr, "Could not allocate crawled page\n");
+          else if (sch && bf_scheduler_add_batch(sch, (const CrawledPage**)batch, n) != 0) {
+               fprintf(stderr, "Error adding pages: %s\n", sch->error->message);
+               ret = -1;
+          } else if (!sch && page_db_add_batch(db, (const CrawledPage**)batch, n, 0) != 0) {
+               fprintf(stderr, "Error adding pages: %s\n", db->error->message);
+               ret = -1;
+          }
+     }
+     for (size_t i=0; i<BENCH_BATCH_SIZE; ++i)
+          crawled_page_delete(batch[i]);
+     return ret;
+}
+
+/** Pages per second added with page_db_add, for several links per page */
+static int
+bench_page_db_add(BenchContext *ctx) {
+     const size_t links[] = {0, 10, 50, 200};
+     for (size_t k=0; k<sizeof(links)/sizeof(*links); ++k) {
+          // roughly the same amount of work for every number of links
+          const size_t n_pages = bench_scaled(ctx, 2000000/(links[k] + 20));
+          PageDB *db = bench_page_db_new(ctx);
+          CrawledPage *cp = crawled_page_new("");
+          uint64_t *latency = malloc(n_pages*sizeof(*latency));
+          if (!db || !cp || !latency) {
+               fprintf(stderr, "Could not allocate memory\n");
+               return -1;
+          }
+          uint64_t rng = ctx->seed;
+          uint64_t total = 0;
+          for (size_t i=0; i<n_pages; ++i) {
+               if (bench_crawled_page(cp, i, links[k], 10*n_pages, &rng) != 0) {
+                    fprintf(stderr, "Could not allocate crawled page\n");
+                    return -1;
+               }
+               const uint64_t t0 = metrics_now();
+               if (page_db_add(db, cp, 0) != 0) {
+                    fprintf(stderr, "Error adding page: %s\n", db->error->message);
+                    return -1;
+               }
+               total += latency[i] = metrics_now() - t0;
+          }
+          const double seconds = 1e-9*total;
+          bench_result_begin(&ctx->out, "page_db_add");
+          bench_result_add(&ctx->out, "links", links[k]);
+          bench_result_add(&ctx->out, "pages", n_pages);
+          bench_result_add(&ctx->out, "pages_per_sec", n_pages/seconds);
+          bench_result_add(&ctx->out, "links_per_sec", n_pages*links[k]/seconds);
+          bench_result_latency(&ctx->out, "add", latency, n_pages);
+          bench_result_end(&ctx->out);
+
+          free(latency);
+          crawled_page_delete(cp);
+          page_db_delete(db);
+     }
+     return 0;
+}
+
+/** Latency of bf_scheduler_request for several schedule sizes */
+static int
+bench_bf_scheduler_request(BenchContext *ctx) {
+     const size_t n_links = 10;
+     for (size_t k=0; k<BENCH_N_SCHEDULE_SIZES; ++k) {
+          const size_t size = bench_scaled(ctx, bench_schedule_sizes[k]);
+          const size_t n_crawled = size/n_links + 1;
+          PageDB *db = bench_page_db_new(ctx);
+          if (!db)
+               return -1;
+          BFScheduler *sch = 0;
+          if (bf_scheduler_new(&sch, db, 0) != 0) {
+               fprintf(stderr, "Error creating BFScheduler: %s\n",
+                       sch? sch->error->message: "NULL");
+               return -1;
+          }
+          sch->persist = 0;
+
+          // links point to pages never crawled, which become the schedule
+          uint64_t rng = ctx->seed;
+          const uint64_t t0 = metrics_now();
+          if (bench_add_pages(db, sch, 0, n_crawled, n_links, 100*size, &rng) != 0)
+               return -1;
+          const double setup = bench_seconds_since(t0);
+
+          size_t n_requests = size/(2*BENCH_REQUEST_SIZE);
+          if (n_requests > BENCH_MAX_REQUESTS)
+               n_requests = BENCH_MAX_REQUESTS;
+          if (n_requests == 0)
+               n_requests = 1;
+          uint64_t *latency = malloc(n_requests*sizeof(*latency));
+          if (!latency)
+               return -1;
+          size_t n_urls = 0;
+          for (size_t i=0; i<n_requests; ++i) {
+               PageRequest *req = 0;
+               const uint64_t t1 = metrics_now();
+               if (bf_scheduler_request(sch, BENCH_REQUEST_SIZE, &req) != 0) {
+                    fprintf(stderr, "Error requesting pages: %s\n", sch->error->message);
+                    return -1;
+               }
+               latency[i] = metrics_now() - t1;
+               n_urls += req->n_urls;
+               page_request_delete(req);
+          }
+          bench_result_begin(&ctx->out, "bf_scheduler_request");
+          bench_result_add(&ctx->out, "schedule", size);
+          bench_result_add(&ctx->out, "requests", n_requests);
+          bench_result_add(&ctx->out, "urls_per_request", (double)n_urls/n_requests);
+          bench_result_add(&ctx->out, "setup_sec", setup);
+          bench_result_latency(&ctx->out, "request", latency, n_requests);
+          bench_result_end(&ctx->out);
+
+          free(latency);
+          bf_scheduler_delete(sch);
+          page_db_delete(db);
+     }
+     return 0;
+}
+
+/** Latency of freq_scheduler_request for several schedule sizes */
+static int
+bench_freq_scheduler_request(BenchContext *ctx) {
+     for (size_t k=0; k<BENCH_N_SCHEDULE_SIZES; ++k) {
+          const size_t size = bench_scaled(ctx, bench_schedule_sizes[k]);
+          PageDB *db = bench_page_db_new(ctx);
+          if (!db)
+               return -1;
+
+          // every crawled page is scheduled
+          uint64_t rng = ctx->seed;
+          const uint64_t t0 = metrics_now();
+          if (bench_add_pages(db, 0, 0, size, 0, 1, &rng) != 0)
+               return -1;
+          FreqScheduler *sch = 0;
+          if (freq_scheduler_new(&sch, db, 0) != 0) {
+               fprintf(stderr, "Error creating FreqScheduler: %s\n",
+                       sch? sch->error->message: "NULL");
+               return -1;
+          }
+          sch->persist = 0;
+          if (freq_scheduler_load_simple(sch, 1.0, 0.0) != 0) {
+               fprintf(stderr, "Error loading schedule: %s\n", sch->error->message);
+               return -1;
+          }
+          const double setup = bench_seconds_since(t0);
+
+          // pages are put back in the schedule, it never runs out
+          const size_t n_requests = BENCH_MAX_REQUESTS;
+          uint64_t *latency = malloc(n_requests*sizeof(*latency));
+          if (!latency)
+               return -1;
+          size_t n_urls = 0;
+          for (size_t i=0; i<n_requests; ++i) {
+               PageRequest *req = 0;
+               const uint64_t t1 = metrics_now();
+               if (freq_scheduler_request(sch, BENCH_REQUEST_SIZE, &req) != 0) {
+                    fprintf(stderr, "Error requesting pages: %s\n", sch->error->message);
+                    return -1;
+               }
+               latency[i] = metrics_now() - t1;
+               n_urls += req->n_urls;
+               page_request_delete(req);
+          }
+          bench_result_begin(&ctx->out, "freq_scheduler_request");
+          bench_result_add(&ctx->out, "schedule", size);
+          bench_result_add(&ctx->out, "requests", n_requests);
+          bench_result_add(&ctx->out, "urls_per_request", (double)n_urls/n_requests);
+          bench_result_add(&ctx->out, "setup_sec", setup);
+          bench_result_latency(&ctx->out, "request", latency, n_requests);
+          bench_result_end(&ctx->out);
+
+          free(latency);
+          freq_scheduler_delete(sch);
+          page_db_delete(db);
+     }
+     return 0;
+}
+
+/** Graph shared by the scorer and scan scenarios, built on first use */
+static PageDB *bench_graph_db = 0;
+static size_t bench_graph_pages = 0;
+static size_t bench_graph_links = 0;
+
+static PageDB *
+bench_graph(BenchContext *ctx) {
+     if (bench_graph_db)
+          return bench_graph_db;
+
+     const size_t n_links = 10;
+     bench_graph_pages = bench_scaled(ctx, 100000);
+     bench_graph_links = bench_graph_pages*n_links;
+     if (!(bench_graph_db = bench_page_db_new(ctx)))
+          return 0;
+     uint64_t rng = ctx->seed;
+     if (bench_add_pages(bench_graph_db, 0, 0, bench_graph_pages,
+                         n_links, bench_graph_pages, &rng) != 0) {
+          page_db_delete(bench_graph_db);
+          bench_graph_db = 0;
+     }
+     return bench_graph_db;
+}
+
+static void
+bench_scorer_result(BenchContext *ctx, const char *name, double seconds) {
+     MetricsSnapshot snapshot;
+     metrics_snapshot(&snapshot);
+     const double loops = snapshot.counters[
+          strcmp(name, "hits") == 0? metric_hits_loops: metric_page_rank_loops].value;
+
+     bench_result_begin(&ctx->out, name);
+     bench_result_add(&ctx->out, "pages", bench_graph_pages);
+     bench_result_add(&ctx->out, "links", bench_graph_links);
+     bench_result_add(&ctx->out, "loops", loops);
+     bench_result_add(&ctx->out, "sec_per_loop", seconds/loops);
+     bench_result_add(&ctx->out, "links_per_sec", bench_graph_links*loops/seconds);
+     bench_result_end(&ctx->out);
+}
+
+/** Seconds per iteration of PageRank, links read from the PageDB */
+static int
+bench_page_rank(BenchContext *ctx) {
+     PageDB *db = bench_graph(ctx);
+     if (!db)
+          return -1;
+     PageRank *pr = 0;
+     PageDBLinkStream *st = 0;
+     if (page_rank_new(&pr, db->path, bench_graph_pages) != 0 ||
+         page_db_link_stream_new(&st, db) != 0) {
+          fprintf(stderr, "Error creating PageRank\n");
+          return -1;
+     }
+     pr->persist = 0;
+     pr->max_loops = BENCH_SCORER_LOOPS;
+     pr->precision = 0.0;
+
+     metrics_reset();
+     const uint64_t t0 = metrics_now();
+     PageRankError rc = page_rank_compute(pr, st,
+                                          page_db_link_stream_next_block,
+                                          page_db_link_stream_reset);
+     const double seconds = bench_seconds_since(t0);
+     if (rc != 0 && rc != page_rank_error_precision) {
+          fprintf(stderr, "Error computing PageRank: %s\n", pr->error->message);
+          return -1;
+     }
+     bench_scorer_result(ctx, "page_rank", seconds);
+
+     page_db_link_stream_delete(st);
+     page_rank_delete(pr);
+     return 0;
+}
+
+/** Seconds per iteration of HITS, links read from the PageDB */
+static int
+bench_hits(BenchContext *ctx) {
+     PageDB *db = bench_graph(ctx);
+     if (!db)
+          return -1;
+     Hits *hits = 0;
+     PageDBLinkStream *st = 0;
+     if (hits_new(&hits, db->path, bench_graph_pages) != 0 ||
+         page_db_link_stream_new(&st, db) != 0) {
+          fprintf(stderr, "Error creating HITS\n");
+          return -1;
+     }
+     hits->persist = 0;
+     hits->max_loops = BENCH_SCORER_LOOPS;
+     hits->precision = 0.0;
+
+     metrics_reset();
+     const uint64_t t0 = metrics_now();
+     HitsError rc = hits_compute(hits, st,
+                                 page_db_link_stream_next_block,
+                                 page_db_link_stream_reset);
+     const double seconds = bench_seconds_since(t0);
+     if (rc != 0 && rc != hits_error_precision) {
+          fprintf(stderr, "Error computing HITS: %s\n", hits->error->message);
+          return -1;
+     }
+     bench_scorer_result(ctx, "hits", seconds);
+
+     page_db_link_stream_delete(st);
+     hits_delete(hits);
+     return 0;
+}
+
+/** Records per second of full scans of the PageDB */
+static int
+bench_scan(BenchContext *ctx) {
+     PageDB *db = bench_graph(ctx);
+     if (!db)
+          return -1;
+
+     // page info, decoding every record
+     HashInfoStream *his;
+     if (hashinfo_stream_new(&his, db) != 0) {
+          fprintf(stderr, "Error creating stream: %s\n", db->error->message);
+          return -1;
+     }
+     uint64_t t0 = metrics_now();
+     size_t n_records = 0;
+     uint64_t hash;
+     PageInfo *pi;
+     while (hashinfo_stream_next(his, &hash, &pi) == stream_state_next) {
+          page_info_delete(pi);
+          ++n_records;
+     }
+     double seconds = bench_seconds_since(t0);
+     hashinfo_stream_delete(his);
+     bench_result_begin(&ctx->out, "scan_page_info");
+     bench_result_add(&ctx->out, "records", n_records);
+     bench_result_add(&ctx->out, "records_per_sec", n_records/seconds);
+     bench_result_end(&ctx->out);
+
+     // page info, exported as columns
+     PageDBColumns *cols;
+     if (page_db_columns_new(&cols, 0) != 0) {
+          fprintf(stderr, "Could not allocate columns\n");
+          return -1;
+     }
+     t0 = metrics_now();
+     if (page_db_export(db, 0, UINT64_MAX, cols) != 0) {
+          fprintf(stderr, "Error exporting: %s\n", db->error->message);
+          return -1;
+     }
+     seconds = bench_seconds_since(t0);
+     bench_result_begin(&ctx->out, "scan_export");
+     bench_result_add(&ctx->out, "records", cols->n_pages);
+     bench_result_add(&ctx->out, "records_per_sec", cols->n_pages/seconds);
+     bench_result_end(&ctx->out);
+     page_db_columns_delete(cols);
+
+     // links
+     PageDBLinkStream *st;
+     Link links[LINK_STREAM_BLOCK_SIZE];
+     if (page_db_link_stream_new(&st, db) != 0) {
+          fprintf(stderr, "Error creating link stream\n");
+          return -1;
+     }
+     t0 = metrics_now();
+     size_t n_links = 0;
+     size_t n;
+     while (page_db_link_stream_next_block(st, links, 0, LINK_STREAM_BLOCK_SIZE, &n) ==
+            stream_state_next)
+          n_links += n;
+     seconds = bench_seconds_since(t0);
+     page_db_link_stream_delete(st);
+     bench_result_begin(&ctx->out, "scan_links");
+     bench_result_add(&ctx->out, "links", n_links);
+     bench_result_add(&ctx->out, "links_per_sec", n_links/seconds);
+     bench_result_end(&ctx->out);
+     return 0;
+}
+
+static const BenchScenario bench_scenarios[] = {
+     {"page_db_add",            bench_page_db_add},
+     {"bf_scheduler_request",   bench_bf_scheduler_request},
+     {"freq_scheduler_request", bench_freq_scheduler_request},
+     {"page_rank",              bench_page_rank},
+     {"hits",                   bench_hits},
+     {"scan",                   bench_scan},
+};
+#define BENCH_N_SCENARIOS (sizeof(bench_scenarios)/sizeof(*bench_scenarios))
+
+static void
+print_help(const char *name) {
+     fprintf(stderr,
+             "Use: %s [options]\n"
+             "\n"
+             "Run the benchmarks and write the results as JSON\n"
+             "\n"
+             "Options:\n"
+             "  -o PATH   Write the results here instead of stdout\n"
+             "  -d DIR    Directory for the temporary databases. Default .\n"
+             "  -s SCALE  Multiply the size of every benchmark. Default 1\n"
+             "  -S SEED   Seed of the random generator. Default 1\n"
+             "  -f NAME   Run only the benchmarks whose name contains NAME\n"
+             "  -u PATH   URLs for the micro benchmarks, one per line, optionally\n"
+             "            gzipped. Default generated URLs\n"
+             "  -l        List the benchmarks\n",
+             name);
+}
+
+int
+main(int argc, char **argv) {
+     BenchContext ctx = {
+          .scale = 1.0,
+          .seed = 1,
+          .dir = "."
+     };
+     const char *output_path = 0;
+     const char *filter = 0;
+
+     int opt;
+     while ((opt = getopt(argc, argv, "o:d:s:S:f:u:lh")) != -1) {
+          switch (opt) {
+          case 'o':
+               output_path = optarg;
+               break;
+          case 'd':
+               ctx.dir = optarg;
+               break;
+          case 's':
+               if (sscanf(optarg, "%lf", &ctx.scale) != 1 || ctx.scale <= 0) {
+                    fprintf(stderr, "Could not understand scale: %s\n", optarg);
+                    goto exit_help;
+               }
+               break;
+          case 'S':
+               if (sscanf(optarg, "%" SCNu64, &ctx.seed) != 1 || ctx.seed == 0) {
+                    fprintf(stderr, "Seed must be a positive integer: %s\n", optarg);
+                    goto exit_help;
+               }
+               break;
+          case 'f':
+               filter = optarg;
+               break;
+          case 'u':
+               ctx.corpus = optarg;
+               break;
+          case 'l':
+               for (size_t i=0; i<BENCH_N_SCENARIOS; ++i)
+                    printf("%s\n", bench_scenarios[i].name);
+               for (size_t i=0; i<bench_micro_n_scenarios; ++i)
+                    printf("%s\n", bench_micro_scenarios[i].name);
+               return 0;
+          default:
+               goto exit_help;
+          }
+     }
+     if (optind != argc) {
+          fprintf(stderr, "Too many arguments\n");
+          goto exit_help;
+     }
+
+     FILE *output = stdout;
+     if (output_path && !(output = fopen(output_path, "w"))) {
+          fprintf(stderr, "Could not open %s\n", output_path);
+          return -1;
+     }
+     bench_output_begin(&ctx.out, output, &ctx);
+     int ret = 0;
+     for (size_t i=0; i<BENCH_N_SCENARIOS && ret == 0; ++i)
+          if (!filter || strstr(bench_scenarios[i].name, filter))
+               ret = bench_scenarios[i].run(&ctx);
+     for (size_t i=0; i<bench_micro_n_scenarios && ret == 0; ++i)
+          if (!filter || strstr(bench_micro_scenarios[i].name, filter))
+               ret = bench_micro_scenarios[i].run(&ctx);
+     bench_output_end(&ctx.out);
+     bench_micro_free();
+     if (bench_graph_db)
+          page_db_delete(bench_graph_db);
+     if (output != stdout)
+          fclose(output);
+     if (ret != 0)
+          fprintf(stderr, "Benchmark failed\n");
+     return ret;
+
+exit_help:
+     print_help(argv[0]);
+     return -1;
+}
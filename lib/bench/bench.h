@@ -0,0 +1,126 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "page_db.h"
+
+/** @addtogroup Bench
+ *
+ * Helpers shared by the scenarios of aduana_bench.
+ *
+ * Every scenario writes one or more results. A result is a flat JSON object
+ * with a name, the parameters of the scenario and the measurements, for
+ * example:
+ *
+ *     {"name": "page_db_add", "links": 10, "pages_per_sec": 52000.0}
+ * @{
+ */
+
+/** Number of domains among which the pages are spread */
+#define BENCH_N_DOMAINS 1000
+
+/** Results are appended to a JSON document and echoed to stderr */
+typedef struct {
+     FILE *output;
+     size_t n_results;
+     size_t n_fields;
+} BenchOutput;
+
+/** Options and state shared by all the scenarios */
+typedef struct {
+     BenchOutput out;
+     /** Multiplies the size of every scenario */
+     double scale;
+     /** Seed of the random generator, the same seed builds the same data */
+     uint64_t seed;
+     /** Directory where the temporary databases are created */
+     const char *dir;
+     /** File with one URL per line, optionally gzipped, used by the micro
+      * benchmarks. If NULL URLs are generated */
+     const char *corpus;
+} BenchContext;
+
+typedef int (BenchFunc)(BenchContext *ctx);
+
+typedef struct {
+     const char *name;
+     BenchFunc *run;
+} BenchScenario;
+
+void
+bench_output_begin(BenchOutput *out, FILE *output, const BenchContext *ctx);
+
+void
+bench_output_end(BenchOutput *out);
+
+/** Start a new result with the given name */
+void
+bench_result_begin(BenchOutput *out, const char *name);
+
+/** Add a numeric field to the current result */
+void
+bench_result_add(BenchOutput *out, const char *key, double value);
+
+void
+bench_result_end(BenchOutput *out);
+
+/** Size of a scenario: n multiplied by the scale, at least 1 */
+size_t
+bench_scaled(const BenchContext *ctx, size_t n);
+
+/** Seconds elapsed since t0, as returned by metrics_now */
+double
+bench_seconds_since(uint64_t t0);
+
+/** Processor time stamp counter, 0 if not available */
+uint64_t
+bench_cycles(void);
+
+/** xorshift64* generator. The state must not be 0 */
+uint64_t
+bench_rand(uint64_t *state);
+
+/** Uniform random number in [0, 1) */
+double
+bench_rand_uniform(uint64_t *state);
+
+/** Sort the n latencies and return the requested quantile */
+uint64_t
+bench_quantile(uint64_t *values, size_t n, double q);
+
+/** Add to the current result p50, p99 and max of n latencies, in
+ * microseconds. The values are sorted in place */
+void
+bench_result_latency(BenchOutput *out, const char *prefix, uint64_t *values, size_t n);
+
+/** URL of the page with the given id. Pages are spread among n_domains */
+void
+bench_url(char *url, size_t size, uint64_t id, size_t n_domains);
+
+/** Reset cp to the page with the given id, crawled at time id, with
+ * n_links links to random pages among the first n_targets.
+ *
+ * @return 0 if success, -1 if memory error
+ */
+int
+bench_crawled_page(CrawledPage *cp, uint64_t id,
+                   size_t n_links, uint64_t n_targets, uint64_t *rng);
+
+/** Create a new PageDB inside a temporary directory, deleted on
+ * page_db_delete */
+PageDB *
+bench_page_db_new(const BenchContext *ctx);
+
+/** Micro benchmarks of the core primitives, one scenario per primitive */
+extern const BenchScenario bench_micro_scenarios[];
+extern const size_t bench_micro_n_scenarios;
+
+/** Free the URL corpus loaded by the micro benchmarks */
+void
+bench_micro_free(void);
+
+/// @}
+
+#endif // __BENCH_H__
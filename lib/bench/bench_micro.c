@@ -0,0 +1,573 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "domain_temp.h"
+#include "metrics.h"
+#include "mmap_array.h"
+#include "scheduler.h"
+#include "smaz.h"
+#include "util.h"
+
+/** Timed passes over the inputs, before scaling */
+#define MICRO_PASSES 10
+/** URLs of the corpus, before scaling */
+#define MICRO_N_URLS 100000
+/** Longer URLs of the corpus are skipped */
+#define MICRO_MAX_URL 1024
+
+/** Result of the benchmarks, so that the compiler cannot remove them */
+static volatile uint64_t micro_sink = 0;
+
+static char **micro_urls = 0;
+static size_t micro_n_urls = 0;
+/** Sum of the length of all URLs */
+static size_t micro_url_bytes = 0;
+
+typedef struct {
+     uint64_t ns;
+     uint64_t cycles;
+} MicroTimer;
+
+static void
+micro_start(MicroTimer *t) {
+     t->cycles = bench_cycles();
+     t->ns = metrics_now();
+}
+
+static void
+micro_stop(MicroTimer *t) {
+     t->ns = metrics_now() - t->ns;
+     t->cycles = bench_cycles() - t->cycles;
+}
+
+/** Write a result with n_ops operations that processed n_bytes. The result is
+ * left open to add more fields */
+static void
+micro_result(BenchContext *ctx, const char *name, const MicroTimer *t,
+             size_t n_ops, size_t n_bytes) {
+     bench_result_begin(&ctx->out, name);
+     bench_result_add(&ctx->out, "ops", n_ops);
+     bench_result_add(&ctx->out, "ns_per_op", (double)t->ns/n_ops);
+     if (t->cycles > 0)
+          bench_result_add(&ctx->out, "cycles_per_op", (double)t->cycles/n_ops);
+     if (n_bytes > 0)
+          bench_result_add(&ctx->out, "bytes_per_sec", 1e9*n_bytes/t->ns);
+}
+
+static size_t
+micro_passes(const BenchContext *ctx) {
+     return bench_scaled(ctx, MICRO_PASSES);
+}
+
+static int
+micro_add_url(const char *url, size_t len) {
+     if (len == 0 || len >= MICRO_MAX_URL)
+          return 0;
+     char *copy = strndup(url, len);
+     if (!copy)
+          return -1;
+     micro_urls[micro_n_urls++] = copy;
+     micro_url_bytes += len;
+     return 0;
+}
+
+/** Read the first column of each line, skipping seeds, as in
+ * test/nodes.txt.gz */
+static int
+micro_read_corpus(const char *path, size_t max_urls) {
+     const size_t len = strlen(path);
+     const int gzipped = len > 3 && strcmp(path + len - 3, ".gz") == 0;
+     FILE *input;
+     if (gzipped) {
+          char *cmd;
+          if (asprintf(&cmd, "gzip -dc '%s'", path) == -1)
+               return -1;
+          input = popen(cmd, "r");
+          free(cmd);
+     } else {
+          input = fopen(path, "r");
+     }
+     if (!input) {
+          fprintf(stderr, "Could not open corpus %s\n", path);
+          return -1;
+     }
+
+     int ret = 0;
+     char *line = 0;
+     size_t size = 0;
+     while (ret == 0 && micro_n_urls < max_urls && getline(&line, &size, input) != -1)
+          if (strncmp(line, "_seed_", 6) != 0)
+               ret = micro_add_url(line, strcspn(line, " \t\r\n"));
+     free(line);
+     if (gzipped)
+          pclose(input);
+     else
+          fclose(input);
+     if (ret == 0 && micro_n_urls == 0) {
+          fprintf(stderr, "No URLs inside corpus %s\n", path);
+          ret = -1;
+     }
+     return ret;
+}
+
+/** Generate URLs of different shapes, when no corpus is given */
+static int
+micro_generate_corpus(uint64_t seed, size_t n_urls) {
+     static const char *words[] = {
+          "news", "blog", "article", "search", "products", "en-us", "category",
+          "2015", "index.html", "about", "download", "label", "reference", "site"
+     };
+     static const char *tlds[] = {"com", "org", "net", "es", "co.uk"};
+     const size_t n_words = sizeof(words)/sizeof(*words);
+     const size_t n_tlds = sizeof(tlds)/sizeof(*tlds);
+
+     uint64_t rng = seed;
+     char url[MICRO_MAX_URL];
+     for (size_t i=0; i<n_urls; ++i) {
+          int len = snprintf(url, sizeof(url), "%s://%sdomain%" PRIu64 ".%s",
+                             bench_rand(&rng) % 4 == 0? "https": "http",
+                             bench_rand(&rng) % 2 == 0? "www.": "",
+                             bench_rand(&rng) % (n_urls/10 + 1),
+                             tlds[bench_rand(&rng) % n_tlds]);
+          const size_t n_segments = bench_rand(&rng) % 5;
+          for (size_t j=0; j<n_segments; ++j)
+               len += snprintf(url + len, sizeof(url) - len, "/%s",
+                               words[bench_rand(&rng) % n_words]);
+          if (bench_rand(&rng) % 4 == 0)
+               len += snprintf(url + len, sizeof(url) - len, "?id=%" PRIu64,
+                               bench_rand(&rng) % 1000000);
+          if (micro_add_url(url, len) != 0)
+               return -1;
+     }
+     return 0;
+}
+
+/** Load the URL corpus on first use */
+static int
+micro_corpus(const BenchContext *ctx) {
+     if (micro_urls)
+          return 0;
+     const size_t max_urls = bench_scaled(ctx, MICRO_N_URLS);
+     if (!(micro_urls = calloc(max_urls, sizeof(*micro_urls)))) {
+          fprintf(stderr, "Could not allocate memory\n");
+          return -1;
+     }
+     const int ret = ctx->corpus?
+          micro_read_corpus(ctx->corpus, max_urls):
+          micro_generate_corpus(ctx->seed, max_urls);
+     if (ret != 0)
+          bench_micro_free();
+     return ret;
+}
+
+void
+bench_micro_free(void) {
+     for (size_t i=0; i<micro_n_urls; ++i)
+          free(micro_urls[i]);
+     free(micro_urls);
+     micro_urls = 0;
+     micro_n_urls = 0;
+     micro_url_bytes = 0;
+}
+
+static int
+micro_url_domain(BenchContext *ctx) {
+     if (micro_corpus(ctx) != 0)
+          return -1;
+     const size_t passes = micro_passes(ctx);
+     uint64_t acc = 0;
+     MicroTimer t = {0, 0};
+     for (size_t pass=0; pass<=passes; ++pass) {
+          if (pass == 1)
+               micro_start(&t);
+          for (size_t i=0; i<micro_n_urls; ++i) {
+               int start, end;
+               if (url_domain(micro_urls[i], &start, &end) == 0)
+                    acc += end - start;
+          }
+     }
+     micro_stop(&t);
+     micro_sink = acc;
+     micro_result(ctx, "micro_url_domain", &t, passes*micro_n_urls, passes*micro_url_bytes);
+     bench_result_end(&ctx->out);
+     return 0;
+}
+
+static int
+micro_same_domain(BenchContext *ctx) {
+     if (micro_corpus(ctx) != 0)
+          return -1;
+     // consecutive URLs of the corpus usually share domain
+     const size_t passes = micro_passes(ctx);
+     uint64_t acc = 0;
+     MicroTimer t = {0, 0};
+     for (size_t pass=0; pass<=passes; ++pass) {
+          if (pass == 1)
+               micro_start(&t);
+          for (size_t i=1; i<micro_n_urls; ++i)
+               acc += same_domain(micro_urls[i - 1], micro_urls[i]);
+     }
+     micro_stop(&t);
+     micro_sink = acc;
+     const size_t n_ops = micro_n_urls > 1? micro_n_urls - 1: 1;
+     micro_result(ctx, "micro_same_domain", &t, passes*n_ops, 2*passes*micro_url_bytes);
+     bench_result_add(&ctx->out, "same_fraction", (double)acc/((passes + 1)*n_ops));
+     bench_result_end(&ctx->out);
+     return 0;
+}
+
+static int
+micro_page_db_hash(BenchContext *ctx) {
+     if (micro_corpus(ctx) != 0)
+          return -1;
+     const size_t passes = micro_passes(ctx);
+     uint64_t acc = 0;
+     MicroTimer t = {0, 0};
+     for (size_t pass=0; pass<=passes; ++pass) {
+          if (pass == 1)
+               micro_start(&t);
+          for (size_t i=0; i<micro_n_urls; ++i)
+               acc ^= page_db_hash(micro_urls[i]);
+     }
+     micro_stop(&t);
+     micro_sink = acc;
+     micro_result(ctx, "micro_page_db_hash", &t, passes*micro_n_urls, passes*micro_url_bytes);
+     bench_result_end(&ctx->out);
+     return 0;
+}
+
+/** Encode and decode n values of random bit width, as signed integers if
+ * is_signed */
+static int
+micro_varint(BenchContext *ctx, int is_signed) {
+     const size_t n = bench_scaled(ctx, MICRO_N_URLS);
+     uint64_t *values = malloc(n*sizeof(*values));
+     uint8_t *buf = malloc(10*n);
+     if (!values || !buf) {
+          free(values);
+          free(buf);
+          return -1;
+     }
+     uint64_t rng = ctx->seed;
+     for (size_t i=0; i<n; ++i) {
+          values[i] = bench_rand(&rng) >> (bench_rand(&rng) % 64);
+          if (is_signed && bench_rand(&rng) % 2)
+               values[i] = -values[i];
+     }
+
+     const size_t passes = micro_passes(ctx);
+     uint8_t *end = buf;
+     MicroTimer t = {0, 0};
+     for (size_t pass=0; pass<=passes; ++pass) {
+          if (pass == 1)
+               micro_start(&t);
+          end = buf;
+          if (is_signed)
+               for (size_t i=0; i<n; ++i)
+                    end = varint_encode_int64((int64_t)values[i], end);
+          else
+               for (size_t i=0; i<n; ++i)
+                    end = varint_encode_uint64(values[i], end);
+     }
+     micro_stop(&t);
+     const size_t n_bytes = end - buf;
+     micro_result(ctx, is_signed? "micro_varint_encode_int64": "micro_varint_encode_uint64",
+                  &t, passes*n, passes*n_bytes);
+     bench_result_add(&ctx->out, "bytes_per_value", (double)n_bytes/n);
+     bench_result_end(&ctx->out);
+
+     uint64_t acc = 0;
+     for (size_t pass=0; pass<=passes; ++pass) {
+          if (pass == 1)
+               micro_start(&t);
+          uint8_t *in = buf;
+          uint8_t read;
+          if (is_signed)
+               for (size_t i=0; i<n; ++i, in += read)
+                    acc += (uint64_t)varint_decode_int64(in, &read);
+          else
+               for (size_t i=0; i<n; ++i, in += read)
+                    acc += varint_decode_uint64(in, &read);
+     }
+     micro_stop(&t);
+     micro_sink = acc;
+     micro_result(ctx, is_signed? "micro_varint_decode_int64": "micro_varint_decode_uint64",
+                  &t, passes*n, passes*n_bytes);
+     bench_result_end(&ctx->out);
+
+     free(values);
+     free(buf);
+     return 0;
+}
+
+static int
+micro_varint_uint64(BenchContext *ctx) {
+     return micro_varint(ctx, 0);
+}
+
+static int
+micro_varint_int64(BenchContext *ctx) {
+     return micro_varint(ctx, 1);
+}
+
+static int
+micro_smaz(BenchContext *ctx) {
+     if (micro_corpus(ctx) != 0)
+          return -1;
+     // compressed URLs, one after the other, as stored inside the PageDB
+     char *compressed = malloc(4*micro_url_bytes);
+     int *sizes = malloc(micro_n_urls*sizeof(*sizes));
+     char out[4*MICRO_MAX_URL];
+     if (!compressed || !sizes) {
+          free(compressed);
+          free(sizes);
+          return -1;
+     }
+
+     const size_t passes = micro_passes(ctx);
+     size_t n_compressed = 0;
+     MicroTimer t = {0, 0};
+     for (size_t pass=0; pass<=passes; ++pass) {
+          if (pass == 1)
+               micro_start(&t);
+          n_compressed = 0;
+          for (size_t i=0; i<micro_n_urls; ++i) {
+               const int len = strlen(micro_urls[i]);
+               sizes[i] = smaz_compress(micro_urls[i], len,
+                                        compressed + n_compressed, 4*len);
+               n_compressed += sizes[i];
+          }
+     }
+     micro_stop(&t);
+     micro_result(ctx, "micro_smaz_compress", &t, passes*micro_n_urls, passes*micro_url_bytes);
+     bench_result_add(&ctx->out, "ratio", (double)n_compressed/micro_url_bytes);
+     bench_result_end(&ctx->out);
+
+     uint64_t acc = 0;
+     for (size_t pass=0; pass<=passes; ++pass) {
+          if (pass == 1)
+               micro_start(&t);
+          char *in = compressed;
+          for (size_t i=0; i<micro_n_urls; in += sizes[i++])
+               acc += smaz_decompress(in, sizes[i], out, sizeof(out));
+     }
+     micro_stop(&t);
+     micro_sink = acc;
+     micro_result(ctx, "micro_smaz_decompress", &t, passes*micro_n_urls, passes*micro_url_bytes);
+     bench_result_end(&ctx->out);
+
+     free(compressed);
+     free(sizes);
+     return 0;
+}
+
+static int
+micro_page_info(BenchContext *ctx) {
+     if (micro_corpus(ctx) != 0)
+          return -1;
+     PageInfo *pis = calloc(micro_n_urls, sizeof(*pis));
+     MDB_val *vals = calloc(micro_n_urls, sizeof(*vals));
+     if (!pis || !vals) {
+          free(pis);
+          free(vals);
+          return -1;
+     }
+     // a page crawled several times, the most expensive record
+     uint64_t rng = ctx->seed;
+     uint64_t content_hash = 0;
+     for (size_t i=0; i<micro_n_urls; ++i) {
+          pis[i].url = micro_urls[i];
+          pis[i].linked_from = bench_rand(&rng);
+          pis[i].depth = bench_rand(&rng) % 10;
+          pis[i].first_crawl = 1.4e9;
+          pis[i].last_crawl = 1.4e9 + bench_rand(&rng) % 1000000;
+          pis[i].n_crawls = 2 + bench_rand(&rng) % 10;
+          pis[i].n_changes = bench_rand(&rng) % pis[i].n_crawls;
+          pis[i].score = bench_rand_uniform(&rng);
+          pis[i].content_hash_length = sizeof(content_hash);
+          pis[i].content_hash = (char*)&content_hash;
+     }
+
+     const size_t passes = micro_passes(ctx);
+     uint64_t acc = 0;
+     size_t n_bytes = 0;
+     MicroTimer t = {0, 0};
+     for (size_t pass=0; pass<=passes; ++pass) {
+          if (pass == 1)
+               micro_start(&t);
+          n_bytes = 0;
+          for (size_t i=0; i<micro_n_urls; ++i) {
+               MDB_val val;
+               if (page_info_dump(pis + i, &val) != 0) {
+                    fprintf(stderr, "Error dumping PageInfo\n");
+                    return -1;
+               }
+               n_bytes += val.mv_size;
+               free(val.mv_data);
+          }
+     }
+     micro_stop(&t);
+     micro_result(ctx, "micro_page_info_dump", &t, passes*micro_n_urls, passes*n_bytes);
+     bench_result_add(&ctx->out, "bytes_per_record", (double)n_bytes/micro_n_urls);
+     bench_result_end(&ctx->out);
+
+     for (size_t i=0; i<micro_n_urls; ++i)
+          if (page_info_dump(pis + i, vals + i) != 0)
+               return -1;
+     for (size_t pass=0; pass<=passes; ++pass) {
+          if (pass == 1)
+               micro_start(&t);
+          for (size_t i=0; i<micro_n_urls; ++i) {
+               PageInfo *pi = page_info_load(vals + i);
+               if (!pi) {
+                    fprintf(stderr, "Error loading PageInfo\n");
+                    return -1;
+               }
+               acc += pi->n_crawls;
+               page_info_delete(pi);
+          }
+     }
+     micro_stop(&t);
+     micro_sink = acc;
+     micro_result(ctx, "micro_page_info_load", &t, passes*micro_n_urls, passes*n_bytes);
+     bench_result_end(&ctx->out);
+
+     for (size_t i=0; i<micro_n_urls; ++i)
+          free(vals[i].mv_data);
+     free(vals);
+     free(pis);
+     return 0;
+}
+
+static int
+micro_schedule_cmp(BenchContext *ctx) {
+     const size_t n = bench_scaled(ctx, MICRO_N_URLS);
+     ScheduleKey *keys = malloc(n*sizeof(*keys));
+     MDB_val *vals = malloc(n*sizeof(*vals));
+     if (!keys || !vals) {
+          free(keys);
+          free(vals);
+          return -1;
+     }
+     // few different scores, so that ties are broken by hash
+     uint64_t rng = ctx->seed;
+     for (size_t i=0; i<n; ++i) {
+          keys[i].score = (bench_rand(&rng) % 100)/100.0f;
+          keys[i].hash = bench_rand(&rng);
+          vals[i].mv_size = sizeof(*keys);
+          vals[i].mv_data = keys + i;
+     }
+
+     const size_t passes = micro_passes(ctx);
+     uint64_t acc = 0;
+     MicroTimer t = {0, 0};
+     for (size_t pass=0; pass<=passes; ++pass) {
+          if (pass == 1)
+               micro_start(&t);
+          for (size_t i=1; i<n; ++i)
+               acc += schedule_entry_mdb_cmp_desc(vals + i - 1, vals + i);
+     }
+     micro_stop(&t);
+     micro_sink = acc;
+     micro_result(ctx, "micro_schedule_entry_mdb_cmp_desc", &t,
+                  passes*(n > 1? n - 1: 1), 0);
+     bench_result_end(&ctx->out);
+
+     free(keys);
+     free(vals);
+     return 0;
+}
+
+static int
+micro_domain_temp_heat(BenchContext *ctx) {
+     if (micro_corpus(ctx) != 0)
+          return -1;
+     uint32_t *domains = malloc(micro_n_urls*sizeof(*domains));
+     DomainTemp *dt = domain_temp_new(1000, 60.0);
+     if (!domains || !dt) {
+          free(domains);
+          if (dt)
+               domain_temp_delete(dt);
+          return -1;
+     }
+     for (size_t i=0; i<micro_n_urls; ++i)
+          domains[i] = page_db_hash_get_domain(page_db_hash(micro_urls[i]));
+
+     const size_t passes = micro_passes(ctx);
+     MicroTimer t = {0, 0};
+     for (size_t pass=0; pass<=passes; ++pass) {
+          if (pass == 1)
+               micro_start(&t);
+          for (size_t i=0; i<micro_n_urls; ++i)
+               domain_temp_heat(dt, domains[i]);
+     }
+     micro_stop(&t);
+     micro_result(ctx, "micro_domain_temp_heat", &t, passes*micro_n_urls, 0);
+     bench_result_add(&ctx->out, "domains_tracked", 1000);
+     bench_result_end(&ctx->out);
+
+     domain_temp_delete(dt);
+     free(domains);
+     return 0;
+}
+
+static int
+micro_mmap_array_idx(BenchContext *ctx) {
+     const size_t n = bench_scaled(ctx, 10*MICRO_N_URLS);
+     MMapArray *arr = 0;
+     size_t *idx = malloc(n*sizeof(*idx));
+     if (!idx || mmap_array_new(&arr, 0, n, sizeof(float)) != 0) {
+          free(idx);
+          if (arr)
+               mmap_array_delete(arr);
+          return -1;
+     }
+     uint64_t rng = ctx->seed;
+     for (size_t i=0; i<n; ++i) {
+          const float value = i;
+          mmap_array_set(arr, i, &value);
+          idx[i] = bench_rand(&rng) % n;
+     }
+
+     const size_t passes = micro_passes(ctx);
+     const char *names[] = {"micro_mmap_array_idx_seq", "micro_mmap_array_idx_random"};
+     for (int random=0; random<2; ++random) {
+          double acc = 0;
+          MicroTimer t = {0, 0};
+          for (size_t pass=0; pass<=passes; ++pass) {
+               if (pass == 1)
+                    micro_start(&t);
+               for (size_t i=0; i<n; ++i)
+                    acc += *(float*)mmap_array_idx(arr, random? idx[i]: i);
+          }
+          micro_stop(&t);
+          micro_sink = acc;
+          micro_result(ctx, names[random], &t, passes*n, passes*n*sizeof(float));
+          bench_result_end(&ctx->out);
+     }
+
+     mmap_array_delete(arr);
+     free(idx);
+     return 0;
+}
+
+const BenchScenario bench_micro_scenarios[] = {
+     {"micro_url_domain",        micro_url_domain},
+     {"micro_same_domain",       micro_same_domain},
+     {"micro_page_db_hash",      micro_page_db_hash},
+     {"micro_varint_uint64",     micro_varint_uint64},
+     {"micro_varint_int64",      micro_varint_int64},
+     {"micro_smaz",              micro_smaz},
+     {"micro_page_info",         micro_page_info},
+     {"micro_schedule_cmp",      micro_schedule_cmp},
+     {"micro_domain_temp_heat",  micro_domain_temp_heat},
+     {"micro_mmap_array_idx",    micro_mmap_array_idx},
+};
+const size_t bench_micro_n_scenarios =
+     sizeof(bench_micro_scenarios)/sizeof(*bench_micro_scenarios);
@@ -0,0 +1,162 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined __x86_64__) || (defined __i386__)
+#include <x86intrin.h>
+#endif
+
+#include "bench.h"
+#include "metrics.h"
+
+#ifndef BENCH_BUILD_TYPE
+#define BENCH_BUILD_TYPE ""
+#endif
+
+void
+bench_output_begin(BenchOutput *out, FILE *output, const BenchContext *ctx) {
+     out->output = output;
+     out->n_results = 0;
+     out->n_fields = 0;
+     fprintf(output,
+             "{\n"
+             "  \"build_type\": \"%s\",\n"
+             "  \"scale\": %g,\n"
+             "  \"seed\": %" PRIu64 ",\n"
+             "  \"results\": [",
+             BENCH_BUILD_TYPE, ctx->scale, ctx->seed);
+}
+
+void
+bench_output_end(BenchOutput *out) {
+     fprintf(out->output, "\n  ]\n}\n");
+     fflush(out->output);
+}
+
+void
+bench_result_begin(BenchOutput *out, const char *name) {
+     fprintf(out->output, "%s\n    {\"name\": \"%s\"",
+             out->n_results > 0? ",": "", name);
+     fprintf(stderr, "%-28s", name);
+     out->n_fields = 0;
+}
+
+void
+bench_result_add(BenchOutput *out, const char *key, double value) {
+     fprintf(out->output, ", \"%s\": %.6g", key, value);
+     fprintf(stderr, "%s%s=%.6g", out->n_fields > 0? ", ": " ", key, value);
+     ++out->n_fields;
+}
+
+void
+bench_result_end(BenchOutput *out) {
+     fprintf(out->output, "}");
+     fprintf(stderr, "\n");
+     ++out->n_results;
+}
+
+size_t
+bench_scaled(const BenchContext *ctx, size_t n) {
+     const size_t m = n*ctx->scale;
+     return m > 0? m: 1;
+}
+
+double
+bench_seconds_since(uint64_t t0) {
+     return 1e-9*(metrics_now() - t0);
+}
+
+uint64_t
+bench_cycles(void) {
+#if (defined __x86_64__) || (defined __i386__)
+     return __rdtsc();
+#else
+     return 0;
+#endif
+}
+
+uint64_t
+bench_rand(uint64_t *state) {
+     uint64_t x = *state;
+     x ^= x >> 12;
+     x ^= x << 25;
+     x ^= x >> 27;
+     *state = x;
+     return x*0x2545F4914F6CDD1DULL;
+}
+
+double
+bench_rand_uniform(uint64_t *state) {
+     return (bench_rand(state) >> 11)*(1.0/9007199254740992.0);
+}
+
+static int
+bench_cmp_uint64(const void *a, const void *b) {
+     const uint64_t x = *(const uint64_t*)a;
+     const uint64_t y = *(const uint64_t*)b;
+     return (x > y) - (x < y);
+}
+
+uint64_t
+bench_quantile(uint64_t *values, size_t n, double q) {
+     if (n == 0)
+          return 0;
+     qsort(values, n, sizeof(*values), bench_cmp_uint64);
+     return values[(size_t)(q*(n - 1))];
+}
+
+void
+bench_result_latency(BenchOutput *out, const char *prefix, uint64_t *values, size_t n) {
+     char key[64];
+     const double q[] = {0.5, 0.99, 1.0};
+     const char *names[] = {"p50", "p99", "max"};
+     for (size_t i=0; i<3; ++i) {
+          snprintf(key, sizeof(key), "%s_%s_us", prefix, names[i]);
+          bench_result_add(out, key, 1e-3*bench_quantile(values, n, q[i]));
+     }
+}
+
+void
+bench_url(char *url, size_t size, uint64_t id, size_t n_domains) {
+     snprintf(url, size, "http://www.domain%zu.com/page/%" PRIu64,
+              (size_t)(id % n_domains), id);
+}
+
+int
+bench_crawled_page(CrawledPage *cp, uint64_t id,
+                   size_t n_links, uint64_t n_targets, uint64_t *rng) {
+     char url[128];
+     bench_url(url, sizeof(url), id, BENCH_N_DOMAINS);
+     if (crawled_page_reset(cp, url) != 0)
+          return -1;
+     cp->time = id;
+     for (size_t i=0; i<n_links; ++i) {
+          bench_url(url, sizeof(url), bench_rand(rng) % n_targets, BENCH_N_DOMAINS);
+          if (crawled_page_add_link(cp, url, bench_rand_uniform(rng)) != 0)
+               return -1;
+     }
+     return 0;
+}
+
+PageDB *
+bench_page_db_new(const BenchContext *ctx) {
+     char *path;
+     if (asprintf(&path, "%s/aduana-bench-XXXXXX", ctx->dir) == -1)
+          return 0;
+     PageDB *db = 0;
+     if (!mkdtemp(path)) {
+          fprintf(stderr, "Could not create directory %s\n", path);
+     } else if (page_db_new(&db, path) != 0) {
+          fprintf(stderr, "Error creating PageDB: %s\n",
+                  db? db->error->message: "NULL");
+          db = 0;
+     } else {
+          db->persist = 0;
+     }
+     free(path);
+     return db;
+}
@@ -0,0 +1,467 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "bf_scheduler.h"
+#include "freq_scheduler.h"
+#include "metrics.h"
+#include "web_graph.h"
+
+/** Value of CrawlSim::version for pages never fetched */
+#define CRAWL_SIM_NOT_FETCHED UINT32_MAX
+
+/** A scheduler seen through the two operations the crawler needs */
+typedef struct {
+     void *sch;
+     int (*request)(void *sch, size_t n_pages, PageRequest **request);
+     int (*add_batch)(void *sch, const CrawledPage **pages, size_t n_pages);
+     const char *(*message)(void *sch);
+} CrawlScheduler;
+
+typedef struct {
+     BenchContext ctx;
+     WebGraph graph;
+     PageDB *db;
+
+     /** Simulated fetches per second */
+     double fetch_rate;
+     /** Simulated clock, in seconds */
+     double clock;
+     /** Pages asked on each request */
+     size_t batch_size;
+     /** Write progress every this number of fetches */
+     size_t report_every;
+
+     /** Version of each page when it was last fetched */
+     uint32_t *version;
+     CrawledPage **batch;
+     uint64_t *batch_pages;
+
+     /** Different pages fetched, among all phases */
+     uint64_t n_crawled;
+
+// Statistics of the current phase
+// -----------------------------------------------------------------------------
+     size_t phase;
+     uint64_t n_fetches;
+     uint64_t n_relevant;
+     /** Fetches of a page that had not changed since the previous one */
+     uint64_t n_unchanged;
+     /** Wall time spent inside the crawl loop, in ns */
+     uint64_t busy;
+     uint64_t *request_latency;
+     uint64_t *add_latency;
+     size_t n_requests;
+     size_t m_requests;
+} CrawlSim;
+
+static int
+crawl_bf_request(void *sch, size_t n_pages, PageRequest **request) {
+     return bf_scheduler_request(sch, n_pages, request);
+}
+
+static int
+crawl_bf_add_batch(void *sch, const CrawledPage **pages, size_t n_pages) {
+     return bf_scheduler_add_batch(sch, pages, n_pages);
+}
+
+static const char *
+crawl_bf_message(void *sch) {
+     return ((BFScheduler*)sch)->error->message;
+}
+
+static int
+crawl_freq_request(void *sch, size_t n_pages, PageRequest **request) {
+     return freq_scheduler_request(sch, n_pages, request);
+}
+
+static int
+crawl_freq_add_batch(void *sch, const CrawledPage **pages, size_t n_pages) {
+     return freq_scheduler_add_batch(sch, pages, n_pages);
+}
+
+static const char *
+crawl_freq_message(void *sch) {
+     return ((FreqScheduler*)sch)->error->message;
+}
+
+/** Fraction of fetched pages whose last fetched copy is still current */
+static double
+crawl_sim_freshness(const CrawlSim *sim) {
+     uint64_t n_fresh = 0;
+     for (uint64_t i=0; i<sim->graph.n_pages; ++i)
+          if (sim->version[i] != CRAWL_SIM_NOT_FETCHED &&
+              sim->version[i] == (uint32_t)web_graph_version(&sim->graph, i, sim->clock))
+               ++n_fresh;
+     return sim->n_crawled > 0? (double)n_fresh/sim->n_crawled: 0.0;
+}
+
+static void
+crawl_sim_begin_phase(CrawlSim *sim, size_t phase) {
+     sim->phase = phase;
+     sim->n_fetches = 0;
+     sim->n_relevant = 0;
+     sim->n_unchanged = 0;
+     sim->busy = 0;
+     sim->n_requests = 0;
+}
+
+static void
+crawl_sim_report(CrawlSim *sim, const char *name) {
+     const double seconds = 1e-9*sim->busy;
+     BenchOutput *out = &sim->ctx.out;
+     bench_result_begin(out, name);
+     bench_result_add(out, "phase", sim->phase);
+     bench_result_add(out, "fetches", sim->n_fetches);
+     bench_result_add(out, "sim_hours", sim->clock/3600.0);
+     bench_result_add(out, "wall_sec", seconds);
+     bench_result_add(out, "pages_per_sec", seconds > 0? sim->n_fetches/seconds: 0.0);
+     bench_result_add(out, "coverage", (double)sim->n_crawled/sim->graph.n_pages);
+     bench_result_add(out, "harvest_rate",
+                      sim->n_fetches > 0? (double)sim->n_relevant/sim->n_fetches: 0.0);
+     bench_result_add(out, "unchanged_fraction",
+                      sim->n_fetches > 0? (double)sim->n_unchanged/sim->n_fetches: 0.0);
+     bench_result_add(out, "freshness", crawl_sim_freshness(sim));
+}
+
+/** Fetch the n pages inside sim->batch_pages and add them to the scheduler */
+static int
+crawl_sim_fetch(CrawlSim *sim, CrawlScheduler *s, size_t n) {
+     for (size_t i=0; i<n; ++i) {
+          const uint64_t page = sim->batch_pages[i];
+          if (web_graph_fetch(&sim->graph, page, sim->clock, sim->batch[i]) != 0) {
+               fprintf(stderr, "Could not allocate crawled page\n");
+               return -1;
+          }
+          const uint32_t version =
+               (uint32_t)web_graph_version(&sim->graph, page, sim->clock);
+          if (sim->version[page] == CRAWL_SIM_NOT_FETCHED)
+               ++sim->n_crawled;
+          else if (sim->version[page] == version)
+               ++sim->n_unchanged;
+          sim->version[page] = version;
+          if (sim->batch[i]->score >= WEB_GRAPH_RELEVANT)
+               ++sim->n_relevant;
+          ++sim->n_fetches;
+          sim->clock += 1.0/sim->fetch_rate;
+     }
+     const uint64_t t0 = metrics_now();
+     if (s->add_batch(s->sch, (const CrawledPage**)sim->batch, n) != 0) {
+          fprintf(stderr, "Error adding pages: %s\n", s->message(s->sch));
+          return -1;
+     }
+     if (sim->n_requests < sim->m_requests)
+          sim->add_latency[sim->n_requests] = metrics_now() - t0;
+     return 0;
+}
+
+/** Crawl until max_fetches pages are fetched or the scheduler runs out */
+static int
+crawl_sim_run(CrawlSim *sim, CrawlScheduler *s, uint64_t max_fetches) {
+     const uint64_t first = sim->n_fetches;
+     uint64_t next_report = sim->n_fetches + sim->report_every;
+     while (sim->n_fetches - first < max_fetches) {
+          size_t n = sim->batch_size;
+          if (max_fetches - (sim->n_fetches - first) < n)
+               n = max_fetches - (sim->n_fetches - first);
+
+          const uint64_t t0 = metrics_now();
+          PageRequest *req = 0;
+          if (s->request(s->sch, n, &req) != 0) {
+               fprintf(stderr, "Error requesting pages: %s\n", s->message(s->sch));
+               return -1;
+          }
+          const uint64_t t1 = metrics_now();
+          size_t n_pages = 0;
+          for (size_t i=0; i<req->n_urls; ++i)
+               if (web_graph_parse_url(&sim->graph, req->urls[i],
+                                       sim->batch_pages + n_pages) == 0)
+                    ++n_pages;
+          const int empty = req->n_urls == 0;
+          page_request_delete(req);
+          if (empty)
+               break;
+
+          if (sim->n_requests < sim->m_requests)
+               sim->request_latency[sim->n_requests] = t1 - t0;
+          if (n_pages > 0 && crawl_sim_fetch(sim, s, n_pages) != 0)
+               return -1;
+          ++sim->n_requests;
+          sim->busy += metrics_now() - t0;
+
+          if (sim->n_fetches >= next_report) {
+               crawl_sim_report(sim, "crawl_progress");
+               bench_result_end(&sim->ctx.out);
+               next_report += sim->report_every;
+          }
+     }
+     return 0;
+}
+
+static void
+crawl_sim_summary(CrawlSim *sim) {
+     const size_t n = sim->n_requests < sim->m_requests? sim->n_requests: sim->m_requests;
+     crawl_sim_report(sim, "crawl_summary");
+     bench_result_latency(&sim->ctx.out, "request", sim->request_latency, n);
+     bench_result_latency(&sim->ctx.out, "add", sim->add_latency, n);
+     bench_result_end(&sim->ctx.out);
+}
+
+/** Discovery crawl starting from the home page of the first domains */
+static int
+crawl_sim_discover(CrawlSim *sim, size_t n_seeds, uint64_t max_fetches) {
+     BFScheduler *sch = 0;
+     if (bf_scheduler_new(&sch, sim->db, 0) != 0) {
+          fprintf(stderr, "Error creating BFScheduler: %s\n",
+                  sch? sch->error->message: "NULL");
+          return -1;
+     }
+     sch->persist = 0;
+     CrawlScheduler s = {
+          .sch = sch,
+          .request = crawl_bf_request,
+          .add_batch = crawl_bf_add_batch,
+          .message = crawl_bf_message
+     };
+
+     crawl_sim_begin_phase(sim, 0);
+     int ret = 0;
+     for (size_t i=0; i<n_seeds && ret == 0; i += sim->batch_size) {
+          size_t n = 0;
+          for (; n < sim->batch_size && i + n < n_seeds && i + n < sim->graph.n_domains; ++n)
+               sim->batch_pages[n] = sim->graph.domain_start[i + n];
+          if (n > 0)
+               ret = crawl_sim_fetch(sim, &s, n);
+     }
+     const uint64_t left = max_fetches > sim->n_fetches? max_fetches - sim->n_fetches: 0;
+     if (ret == 0 && (ret = crawl_sim_run(sim, &s, left)) == 0)
+          crawl_sim_summary(sim);
+     bf_scheduler_delete(sch);
+     return ret;
+}
+
+/** Recrawl the known pages with a FreqScheduler, rebuilt every reload
+ * fetches so that it uses the change rates learnt so far */
+static int
+crawl_sim_refresh(CrawlSim *sim, float freq_scale,
+                  uint64_t reload, uint64_t max_fetches) {
+     crawl_sim_begin_phase(sim, 1);
+     while (sim->n_fetches < max_fetches) {
+          FreqScheduler *sch = 0;
+          if (freq_scheduler_new(&sch, sim->db, 0) != 0) {
+               fprintf(stderr, "Error creating FreqScheduler: %s\n",
+                       sch? sch->error->message: "NULL");
+               return -1;
+          }
+          sch->persist = 0;
+          // with freq_scale positive the default is only used for pages with
+          // unknown change rate
+          const float freq_default = sqrt(WEB_GRAPH_MIN_RATE*WEB_GRAPH_MAX_RATE);
+          if (freq_scheduler_load_simple(sch, freq_default, freq_scale) != 0) {
+               fprintf(stderr, "Error loading schedule: %s\n", sch->error->message);
+               freq_scheduler_delete(sch);
+               return -1;
+          }
+          CrawlScheduler s = {
+               .sch = sch,
+               .request = crawl_freq_request,
+               .add_batch = crawl_freq_add_batch,
+               .message = crawl_freq_message
+          };
+          const uint64_t before = sim->n_fetches;
+          uint64_t n = max_fetches - sim->n_fetches;
+          if (reload > 0 && reload < n)
+               n = reload;
+          const int ret = crawl_sim_run(sim, &s, n);
+          freq_scheduler_delete(sch);
+          if (ret != 0)
+               return -1;
+          if (sim->n_fetches == before)
+               break;
+     }
+     crawl_sim_summary(sim);
+     return 0;
+}
+
+static void
+print_help(const char *name) {
+     fprintf(stderr,
+             "Use: %s [options]\n"
+             "\n"
+             "Crawl a synthetic power law web graph and write crawl speed and\n"
+             "quality as JSON\n"
+             "\n"
+             "Options:\n"
+             "  -n N      Pages of the graph. Default 1000000\n"
+             "  -l N      Mean links per page. Default 20\n"
+             "  -m MODE   'bf' to only discover pages with BFScheduler, 'freq' to\n"
+             "            also recrawl them with FreqScheduler. Default bf\n"
+             "  -c N      Fetches of each phase. Default the number of pages\n"
+             "  -k N      Number of seeds, home pages of the first domains. Default 10\n"
+             "  -r RATE   Simulated fetches per second. Default 100\n"
+             "  -b N      Pages asked on each request. Default 100\n"
+             "  -F SCALE  freq_scale of the FreqScheduler, 0 to recrawl all pages\n"
+             "            at the same frequency. Default 1\n"
+             "  -R N      Rebuild the FreqScheduler every N fetches. Default the\n"
+             "            number of pages discovered\n"
+             "  -i N      Write progress every N fetches. Default fetches/10\n"
+             "  -S SEED   Seed of the graph. Default 1\n"
+             "  -d DIR    Directory for the temporary databases. Default .\n"
+             "  -o PATH   Write the results here instead of stdout\n",
+             name);
+}
+
+int
+main(int argc, char **argv) {
+     CrawlSim sim = {
+          .ctx = {
+               .scale = 1.0,
+               .seed = 1,
+               .dir = "."
+          },
+          .fetch_rate = 100.0,
+          .batch_size = 100
+     };
+     uint64_t n_pages = 1000000;
+     double mean_links = 20.0;
+     int freq_mode = 0;
+     uint64_t max_fetches = 0;
+     size_t n_seeds = 10;
+     float freq_scale = 1.0;
+     uint64_t reload = 0;
+     const char *output_path = 0;
+
+     int opt;
+     while ((opt = getopt(argc, argv, "n:l:m:c:k:r:b:F:R:i:S:d:o:h")) != -1) {
+          int ok = 1;
+          switch (opt) {
+          case 'n':
+               ok = sscanf(optarg, "%" SCNu64, &n_pages) == 1 && n_pages > 0;
+               break;
+          case 'l':
+               ok = sscanf(optarg, "%lf", &mean_links) == 1 && mean_links >= 0;
+               break;
+          case 'm':
+               ok = strcmp(optarg, "bf") == 0 || strcmp(optarg, "freq") == 0;
+               freq_mode = strcmp(optarg, "freq") == 0;
+               break;
+          case 'c':
+               ok = sscanf(optarg, "%" SCNu64, &max_fetches) == 1;
+               break;
+          case 'k':
+               ok = sscanf(optarg, "%zu", &n_seeds) == 1 && n_seeds > 0;
+               break;
+          case 'r':
+               ok = sscanf(optarg, "%lf", &sim.fetch_rate) == 1 && sim.fetch_rate > 0;
+               break;
+          case 'b':
+               ok = sscanf(optarg, "%zu", &sim.batch_size) == 1 && sim.batch_size > 0;
+               break;
+          case 'F':
+               ok = sscanf(optarg, "%f", &freq_scale) == 1;
+               break;
+          case 'R':
+               ok = sscanf(optarg, "%" SCNu64, &reload) == 1;
+               break;
+          case 'i':
+               ok = sscanf(optarg, "%zu", &sim.report_every) == 1;
+               break;
+          case 'S':
+               ok = sscanf(optarg, "%" SCNu64, &sim.ctx.seed) == 1 && sim.ctx.seed > 0;
+               break;
+          case 'd':
+               sim.ctx.dir = optarg;
+               break;
+          case 'o':
+               output_path = optarg;
+               break;
+          default:
+               goto exit_help;
+          }
+          if (!ok) {
+               fprintf(stderr, "Invalid value for -%c: %s\n", opt, optarg);
+               goto exit_help;
+          }
+     }
+     if (optind != argc) {
+          fprintf(stderr, "Too many arguments\n");
+          goto exit_help;
+     }
+     if (max_fetches == 0)
+          max_fetches = n_pages;
+     if (sim.report_every == 0)
+          sim.report_every = max_fetches/10 > 0? max_fetches/10: 1;
+     // freq_scheduler_load_simple treats a non positive scale as disabled
+     if (freq_scale <= 0)
+          freq_scale = -1.0;
+
+     if (web_graph_init(&sim.graph, n_pages, mean_links, sim.ctx.seed) != 0 ||
+         !(sim.version = malloc(n_pages*sizeof(*sim.version))) ||
+         !(sim.batch = calloc(sim.batch_size, sizeof(*sim.batch))) ||
+         !(sim.batch_pages = malloc(sim.batch_size*sizeof(*sim.batch_pages)))) {
+          fprintf(stderr, "Could not allocate memory\n");
+          return -1;
+     }
+     memset(sim.version, 0xFF, n_pages*sizeof(*sim.version));
+     for (size_t i=0; i<sim.batch_size; ++i)
+          if (!(sim.batch[i] = crawled_page_new(""))) {
+               fprintf(stderr, "Could not allocate memory\n");
+               return -1;
+          }
+     // latencies of each request, the last ones are dropped on long runs
+     sim.m_requests = max_fetches/sim.batch_size + n_seeds/sim.batch_size + 2;
+     if (sim.m_requests > 10000000)
+          sim.m_requests = 10000000;
+     if (!(sim.request_latency = malloc(sim.m_requests*sizeof(*sim.request_latency))) ||
+         !(sim.add_latency = malloc(sim.m_requests*sizeof(*sim.add_latency)))) {
+          fprintf(stderr, "Could not allocate memory\n");
+          return -1;
+     }
+     if (!(sim.db = bench_page_db_new(&sim.ctx)))
+          return -1;
+
+     FILE *output = stdout;
+     if (output_path && !(output = fopen(output_path, "w"))) {
+          fprintf(stderr, "Could not open %s\n", output_path);
+          return -1;
+     }
+     bench_output_begin(&sim.ctx.out, output, &sim.ctx);
+     bench_result_begin(&sim.ctx.out, "web_graph");
+     bench_result_add(&sim.ctx.out, "pages", sim.graph.n_pages);
+     bench_result_add(&sim.ctx.out, "domains", sim.graph.n_domains);
+     bench_result_add(&sim.ctx.out, "mean_links", sim.graph.mean_links);
+     bench_result_add(&sim.ctx.out, "fetch_rate", sim.fetch_rate);
+     bench_result_end(&sim.ctx.out);
+
+     int ret = crawl_sim_discover(&sim, n_seeds, max_fetches);
+     if (ret == 0 && freq_mode)
+          ret = crawl_sim_refresh(&sim, freq_scale,
+                                  reload > 0? reload: sim.n_crawled, max_fetches);
+     bench_output_end(&sim.ctx.out);
+
+     page_db_delete(sim.db);
+     for (size_t i=0; i<sim.batch_size; ++i)
+          crawled_page_delete(sim.batch[i]);
+     free(sim.batch);
+     free(sim.batch_pages);
+     free(sim.version);
+     free(sim.request_latency);
+     free(sim.add_latency);
+     web_graph_free(&sim.graph);
+     if (output != stdout)
+          fclose(output);
+     if (ret != 0)
+          fprintf(stderr, "Simulation failed\n");
+     return ret;
+
+exit_help:
+     print_help(argv[0]);
+     return -1;
+}
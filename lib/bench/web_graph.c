@@ -0,0 +1,219 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "web_graph.h"
+
+/** Tail index of the domain sizes */
+#define WEB_GRAPH_DOMAIN_TAIL 1.5
+/** Minimum number of pages of a domain */
+#define WEB_GRAPH_DOMAIN_MIN 10.0
+/** Tail index of the out degree */
+#define WEB_GRAPH_LINKS_TAIL 2.0
+/** Exponent applied to the uniform numbers that choose the Zipf links. An
+ * exponent g gives a Zipf law with exponent 1 - 1/g */
+#define WEB_GRAPH_ZIPF_EXP 10.0
+/** Exponent applied to the uniform numbers that choose links inside a domain,
+ * larger means more links to the home page */
+#define WEB_GRAPH_LOCAL_EXP 3.0
+
+/** Independent streams of random numbers derived from each page */
+enum {
+     web_graph_salt_links = 1,
+     web_graph_salt_score,
+     web_graph_salt_topic,
+     web_graph_salt_rate,
+     web_graph_salt_phase,
+     web_graph_salt_content
+};
+
+/** splitmix64 finalizer */
+static uint64_t
+web_graph_mix(uint64_t x) {
+     x += 0x9E3779B97F4A7C15ULL;
+     x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ULL;
+     x = (x ^ (x >> 27))*0x94D049BB133111EBULL;
+     return x ^ (x >> 31);
+}
+
+static uint64_t
+web_graph_hash(const WebGraph *graph, uint64_t x, uint64_t salt) {
+     return web_graph_mix(graph->seed ^ web_graph_mix(x ^ (salt << 56)));
+}
+
+/** Uniform in [0, 1) */
+static double
+web_graph_uniform(uint64_t x) {
+     return (x >> 11)*(1.0/9007199254740992.0);
+}
+
+/** Next uniform number of the stream, in [0, 1) */
+static double
+web_graph_next(uint64_t *state) {
+     *state = web_graph_mix(*state);
+     return web_graph_uniform(*state);
+}
+
+static uint64_t
+web_graph_gcd(uint64_t a, uint64_t b) {
+     while (b != 0) {
+          const uint64_t r = a % b;
+          a = b;
+          b = r;
+     }
+     return a;
+}
+
+int
+web_graph_init(WebGraph *graph, uint64_t n_pages, double mean_links, uint64_t seed) {
+     graph->seed = seed;
+     graph->n_pages = n_pages > 0? n_pages: 1;
+     graph->mean_links = mean_links;
+     graph->local_fraction = 0.7;
+     graph->topic_fraction = 0.2;
+
+     size_t m_domains = 1024;
+     graph->n_domains = 0;
+     if (!(graph->domain_start = malloc(m_domains*sizeof(*graph->domain_start))))
+          return -1;
+
+     const double max_size = graph->n_pages/20.0 > WEB_GRAPH_DOMAIN_MIN?
+          graph->n_pages/20.0: WEB_GRAPH_DOMAIN_MIN;
+     uint64_t state = seed;
+     uint64_t start = 0;
+     while (start < graph->n_pages) {
+          if (graph->n_domains + 1 >= m_domains) {
+               m_domains *= 2;
+               uint64_t *p = realloc(graph->domain_start,
+                                     m_domains*sizeof(*graph->domain_start));
+               if (!p) {
+                    web_graph_free(graph);
+                    return -1;
+               }
+               graph->domain_start = p;
+          }
+          double size = WEB_GRAPH_DOMAIN_MIN*
+               pow(1.0 - web_graph_next(&state), -1.0/WEB_GRAPH_DOMAIN_TAIL);
+          if (size > max_size)
+               size = max_size;
+          graph->domain_start[graph->n_domains++] = start;
+          start += (uint64_t)size;
+     }
+     graph->domain_start[graph->n_domains] = graph->n_pages;
+
+     // Zipf ranks are scattered among domains with rank*perm_mult mod n_pages
+     graph->perm_mult = ((uint64_t)(0.6180339887*graph->n_pages)) | 1;
+     while (web_graph_gcd(graph->perm_mult, graph->n_pages) != 1)
+          graph->perm_mult += 2;
+     return 0;
+}
+
+void
+web_graph_free(WebGraph *graph) {
+     free(graph->domain_start);
+     graph->domain_start = 0;
+     graph->n_domains = 0;
+}
+
+size_t
+web_graph_domain(const WebGraph *graph, uint64_t page) {
+     size_t lo = 0;
+     size_t hi = graph->n_domains;
+     while (hi - lo > 1) {
+          const size_t mid = lo + (hi - lo)/2;
+          if (graph->domain_start[mid] <= page)
+               lo = mid;
+          else
+               hi = mid;
+     }
+     return lo;
+}
+
+void
+web_graph_url(const WebGraph *graph, uint64_t page, char *url, size_t size) {
+     snprintf(url, size, "http://www.d%zu.sim/%" PRIu64,
+              web_graph_domain(graph, page), page);
+}
+
+int
+web_graph_parse_url(const WebGraph *graph, const char *url, uint64_t *page) {
+     const char *path = strstr(url, ".sim/");
+     if (strncmp(url, "http://www.d", 12) != 0 || !path ||
+         sscanf(path + 5, "%" SCNu64, page) != 1)
+          return -1;
+     return *page < graph->n_pages? 0: -1;
+}
+
+float
+web_graph_score(const WebGraph *graph, uint64_t page) {
+     const size_t domain = web_graph_domain(graph, page);
+     const double u = web_graph_uniform(web_graph_hash(graph, page, web_graph_salt_score));
+     const int on_topic = web_graph_uniform(
+          web_graph_hash(graph, domain, web_graph_salt_topic)) < graph->topic_fraction;
+     return on_topic? WEB_GRAPH_RELEVANT*(1.0 + u): WEB_GRAPH_RELEVANT*u;
+}
+
+double
+web_graph_change_rate(const WebGraph *graph, uint64_t page) {
+     const double u = web_graph_uniform(web_graph_hash(graph, page, web_graph_salt_rate));
+     return WEB_GRAPH_MIN_RATE*pow(WEB_GRAPH_MAX_RATE/WEB_GRAPH_MIN_RATE, u);
+}
+
+uint64_t
+web_graph_version(const WebGraph *graph, uint64_t page, double time) {
+     const double phase = web_graph_uniform(web_graph_hash(graph, page, web_graph_salt_phase));
+     const double v = web_graph_change_rate(graph, page)*time + phase;
+     return v > 0? (uint64_t)v: 0;
+}
+
+/** Target of the next link of page */
+static uint64_t
+web_graph_next_link(const WebGraph *graph, uint64_t page, uint64_t *state) {
+     if (web_graph_next(state) < graph->local_fraction) {
+          const size_t domain = web_graph_domain(graph, page);
+          const uint64_t start = graph->domain_start[domain];
+          const uint64_t size = graph->domain_start[domain + 1] - start;
+          return start + (uint64_t)(size*pow(web_graph_next(state), WEB_GRAPH_LOCAL_EXP));
+     }
+     const uint64_t rank = graph->n_pages*pow(web_graph_next(state), WEB_GRAPH_ZIPF_EXP);
+     if (graph->n_pages < (1ULL << 32))
+          return (rank*graph->perm_mult) % graph->n_pages;
+     // the product could overflow, scatter with a hash instead
+     return web_graph_mix(rank) % graph->n_pages;
+}
+
+int
+web_graph_fetch(const WebGraph *graph, uint64_t page, double time, CrawledPage *cp) {
+     char url[128];
+     web_graph_url(graph, page, url, sizeof(url));
+     if (crawled_page_reset(cp, url) != 0)
+          return -1;
+     cp->time = time;
+     cp->score = web_graph_score(graph, page);
+     const uint64_t version = web_graph_version(graph, page, time);
+     if (crawled_page_set_hash64(
+              cp, web_graph_hash(graph, page ^ (version << 40), web_graph_salt_content)) != 0)
+          return -1;
+
+     uint64_t state = web_graph_hash(graph, page, web_graph_salt_links);
+     const double xm = graph->mean_links*(WEB_GRAPH_LINKS_TAIL - 1.0)/WEB_GRAPH_LINKS_TAIL;
+     double degree = xm*pow(1.0 - web_graph_next(&state), -1.0/WEB_GRAPH_LINKS_TAIL);
+     if (degree > 50*graph->mean_links)
+          degree = 50*graph->mean_links;
+     const size_t n_links = degree;
+     for (size_t i=0; i<n_links; ++i) {
+          const uint64_t target = web_graph_next_link(graph, page, &state);
+          web_graph_url(graph, target, url, sizeof(url));
+          // half of the link score is a hint of the target content
+          const float score = 0.5*web_graph_score(graph, target) +
+               0.25*web_graph_next(&state);
+          if (crawled_page_add_link(cp, url, score) != 0)
+               return -1;
+     }
+     return 0;
+}
@@ -0,0 +1,105 @@
+#ifndef __WEB_GRAPH_H__
+#define __WEB_GRAPH_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "page_db.h"
+
+/** @addtogroup WebGraph
+ *
+ * Synthetic web graph, large enough to test crawls of millions of pages.
+ *
+ * Nothing is stored per page: the links, score and change process of each
+ * page are derived from a hash of the seed and the page index, so the same
+ * seed always generates the same graph and pages can be generated in any
+ * order. The only memory used is the table of domains.
+ *
+ * - Domain sizes and out degrees follow Pareto distributions.
+ * - Most links stay inside the page domain and point preferably to the
+ *   pages near the domain home page.
+ * - The remaining links follow a Zipf distribution over a random
+ *   permutation of all pages, which gives a power law in-degree.
+ * - A fraction of the domains is on topic. Their pages have a score above
+ *   @ref WEB_GRAPH_RELEVANT and links to them carry a noisy hint of it.
+ * - Each page changes periodically, with a rate log-uniform between
+ *   @ref WEB_GRAPH_MIN_RATE and @ref WEB_GRAPH_MAX_RATE changes per second.
+ * @{
+ */
+
+/** Pages with a score at least this are on topic */
+#define WEB_GRAPH_RELEVANT 0.5
+/** Slowest change rate, about once a month */
+#define WEB_GRAPH_MIN_RATE (1.0/(30*86400.0))
+/** Fastest change rate, once an hour */
+#define WEB_GRAPH_MAX_RATE (1.0/3600.0)
+
+typedef struct {
+     uint64_t seed;
+     uint64_t n_pages;
+     /** Mean number of links per page */
+     double mean_links;
+     /** Fraction of links that point inside the same domain */
+     double local_fraction;
+     /** Fraction of domains on topic */
+     double topic_fraction;
+
+     size_t n_domains;
+     /** Index of the first page of each domain, with a last element equal
+      * to n_pages */
+     uint64_t *domain_start;
+     /** Multiplier of the permutation used by the Zipf links, coprime with
+      * n_pages */
+     uint64_t perm_mult;
+} WebGraph;
+
+/** Generate the domains of a graph with n_pages and the given mean number of
+ * links per page. The rest of options get their default value and can be
+ * changed before using the graph.
+ *
+ * @return 0 if success, -1 if memory error
+ */
+int
+web_graph_init(WebGraph *graph, uint64_t n_pages, double mean_links, uint64_t seed);
+
+void
+web_graph_free(WebGraph *graph);
+
+/** Domain of the page */
+size_t
+web_graph_domain(const WebGraph *graph, uint64_t page);
+
+/** Write the URL of the page */
+void
+web_graph_url(const WebGraph *graph, uint64_t page, char *url, size_t size);
+
+/** Page index from a URL written by @ref web_graph_url
+ *
+ * @return 0 if success, -1 if the URL is not from this graph
+ */
+int
+web_graph_parse_url(const WebGraph *graph, const char *url, uint64_t *page);
+
+/** Score of the page content, in [0, 1) */
+float
+web_graph_score(const WebGraph *graph, uint64_t page);
+
+/** Number of changes per second of the page content */
+double
+web_graph_change_rate(const WebGraph *graph, uint64_t page);
+
+/** Number of times the page has changed at the given time */
+uint64_t
+web_graph_version(const WebGraph *graph, uint64_t page, double time);
+
+/** Reset cp to the page as fetched at the given time, with its links and
+ * a content hash that changes with its version.
+ *
+ * @return 0 if success, -1 if memory error
+ */
+int
+web_graph_fetch(const WebGraph *graph, uint64_t page, double time, CrawledPage *cp);
+
+/// @}
+
+#endif // __WEB_GRAPH_H__
@@ -0,0 +1,978 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "bf_scheduler.h"
+#include "freq_scheduler.h"
+#include "hits_scorer.h"
+#include "page_rank_scorer.h"
+#include "metrics.h"
+#include "wire.h"
+
+/* Protocol
+ * --------
+ * Requests and responses are frames: a uint32 (little endian) with the
+ * length of the rest of the frame, followed by an uint8 and a payload.
+ *
+ * In requests the uint8 is the operation:
+ *   - SERVER_OP_ADD: payload is an uncompressed aduana.wire message with
+ *     crawled pages. The response has no payload.
+ *   - SERVER_OP_REQUEST: payload is an uint32 with the maximum number of
+ *     URLs. The response payload is an aduana.wire message with the URLs.
+ *   - SERVER_OP_METRICS: no payload. The response payload is the output of
+ *     metrics_write_text.
+ *
+ * In responses the uint8 is SERVER_STATUS_OK or SERVER_STATUS_ERROR, in which
+ * case the payload is an error message. Responses arrive in the same order
+ * as requests, so a client can send several requests before reading.
+ *
+ * Threads
+ * -------
+ * The main thread does all network I/O using epoll. When a whole frame has
+ * been received the connection is handed to a worker, and it is not watched
+ * again until the worker has written the response (EPOLLONESHOT). Workers
+ * adding pages join a group commit: one of them adds the pages of all the
+ * waiting workers in a single transaction. Requests are served from a queue
+ * of URLs that is refilled from the scheduler when it runs out. Adds and
+ * refills share the PageDB state outside LMDB, as the domain temperatures,
+ * and so they are serialized.
+ *
+ * A connection whose client has closed its side is kept until the frames
+ * already received have been answered.
+ */
+
+#define SERVER_OP_ADD 1
+#define SERVER_OP_REQUEST 2
+#define SERVER_OP_METRICS 3
+
+#define SERVER_STATUS_OK 0
+#define SERVER_STATUS_ERROR 1
+
+#define SERVER_DEFAULT_PORT "8001"
+#define SERVER_DEFAULT_ADDRESS "0.0.0.0"
+#define SERVER_DEFAULT_WORKERS 4
+/** Maximum number of pages inside a group commit */
+#define SERVER_DEFAULT_MAX_BATCH 256
+/** Number of URLs requested to the scheduler each time the queue runs out */
+#define SERVER_DEFAULT_PREFETCH 1024
+/** Frames larger than this close the connection */
+#define SERVER_MAX_FRAME (64*1024*1024)
+/** Maximum number of URLs in a single request */
+#define SERVER_MAX_REQUEST 65536
+#define SERVER_MAX_EVENTS 64
+
+typedef enum {
+     server_socket_listen,
+     server_socket_signal,
+     server_socket_conn
+} ServerSocketKind;
+
+/** Common header of everything registered inside epoll */
+typedef struct {
+     ServerSocketKind kind;
+     int fd;
+} ServerSocket;
+
+typedef struct Connection {
+     ServerSocket sock;
+
+     /** Received bytes, starting with the current frame */
+     char *in;
+     size_t in_len;
+     size_t in_size;
+     /** Length of the frame being processed, including the length prefix */
+     size_t frame_len;
+
+     /** Response being sent */
+     char *out;
+     size_t out_len;
+     size_t out_pos;
+     size_t out_size;
+
+     /** The client will not send more data */
+     int eof;
+     /** A response could not be built, close as soon as possible */
+     int failed;
+
+     /** Next in the job queue */
+     struct Connection *next_job;
+     /** All connections, only touched by the main thread */
+     struct Connection *prev;
+     struct Connection *next;
+} Connection;
+
+/** Pages of a worker waiting to be committed */
+typedef struct Commit {
+     const CrawledPage **pages;
+     size_t n_pages;
+
+     int done;
+     int status;
+     char message[256];
+
+     struct Commit *next;
+} Commit;
+
+typedef struct {
+     PageDB *page_db;
+     BFScheduler *bf;
+     FreqScheduler *freq;
+     HitsScorer *hits;
+     PageRankScorer *page_rank;
+
+     int epfd;
+     Connection *conns;
+
+     /** Serializes all calls to the PageDB and the scheduler */
+     pthread_mutex_t sched_mtx;
+
+     /** Connections with a complete frame waiting for a worker */
+     pthread_mutex_t jobs_mtx;
+     pthread_cond_t jobs_cond;
+     Connection *jobs_head;
+     Connection *jobs_tail;
+     int stop;
+
+     /** Group commit */
+     pthread_mutex_t commit_mtx;
+     pthread_cond_t commit_cond;
+     Commit *pending_head;
+     Commit *pending_tail;
+     int committing;
+     const CrawledPage **batch;
+     size_t batch_alloc;
+     size_t max_batch;
+
+     /** Queue of URLs ready to be served */
+     pthread_mutex_t prefetch_mtx;
+     PageRequest *prefetch;
+     size_t prefetch_next;
+     size_t prefetch_size;
+} Server;
+
+/** Copy an error message, marking the end if it had to be truncated */
+static void
+server_copy_message(char *message, size_t message_size, const char *error) {
+     if (snprintf(message, message_size, "%s", error) >= (int)message_size &&
+         message_size > 4)
+          strcpy(message + message_size - 4, "...");
+}
+
+static int
+server_add_batch(Server *srv, const CrawledPage **pages, size_t n_pages,
+                 char *message, size_t message_size) {
+     int ret;
+     pthread_mutex_lock(&srv->sched_mtx);
+     if (srv->bf) {
+          if ((ret = bf_scheduler_add_batch(srv->bf, pages, n_pages)) != 0)
+               server_copy_message(message, message_size, srv->bf->error->message);
+     } else {
+          if ((ret = freq_scheduler_add_batch(srv->freq, pages, n_pages)) != 0)
+               server_copy_message(message, message_size, srv->freq->error->message);
+     }
+     pthread_mutex_unlock(&srv->sched_mtx);
+     return ret;
+}
+
+static int
+server_scheduler_request(Server *srv, size_t n, PageRequest **req) {
+     pthread_mutex_lock(&srv->sched_mtx);
+     const int ret = srv->bf?
+          bf_scheduler_request(srv->bf, n, req):
+          freq_scheduler_request(srv->freq, n, req);
+     pthread_mutex_unlock(&srv->sched_mtx);
+     return ret;
+}
+
+static const char *
+server_scheduler_error(Server *srv) {
+     return srv->bf? srv->bf->error->message: srv->freq->error->message;
+}
+
+/** Add the pages inside the next group commit and wait until it is done */
+static int
+server_commit(Server *srv, Commit *c) {
+     c->done = 0;
+     c->next = 0;
+
+     pthread_mutex_lock(&srv->commit_mtx);
+     if (srv->pending_tail)
+          srv->pending_tail->next = c;
+     else
+          srv->pending_head = c;
+     srv->pending_tail = c;
+
+     while (!c->done) {
+          if (srv->committing) {
+               pthread_cond_wait(&srv->commit_cond, &srv->commit_mtx);
+               continue;
+          }
+          // become the leader and commit as many waiting pages as allowed
+          srv->committing = 1;
+          Commit *first = srv->pending_head;
+          Commit *last = first;
+          size_t n_pages = first->n_pages;
+          while (last->next && n_pages + last->next->n_pages <= srv->max_batch) {
+               last = last->next;
+               n_pages += last->n_pages;
+          }
+          srv->pending_head = last->next;
+          if (!srv->pending_head)
+               srv->pending_tail = 0;
+          last->next = 0;
+          pthread_mutex_unlock(&srv->commit_mtx);
+
+          int status = 0;
+          char message[sizeof(c->message)] = "";
+          if (n_pages > srv->batch_alloc) {
+               const CrawledPage **batch = realloc(srv->batch, n_pages*sizeof(*batch));
+               if (batch) {
+                    srv->batch = batch;
+                    srv->batch_alloc = n_pages;
+               } else {
+                    status = -1;
+                    snprintf(message, sizeof(message), "allocating batch");
+               }
+          }
+          if (status == 0) {
+               size_t i = 0;
+               for (Commit *p=first; p; p=p->next) {
+                    memcpy(srv->batch + i, p->pages, p->n_pages*sizeof(*p->pages));
+                    i += p->n_pages;
+               }
+               status = server_add_batch(srv, srv->batch, n_pages,
+                                         message, sizeof(message));
+          }
+
+          pthread_mutex_lock(&srv->commit_mtx);
+          for (Commit *p=first; p; ) {
+               Commit *next = p->next;
+               p->status = status;
+               memcpy(p->message, message, sizeof(message));
+               p->done = 1;
+               p = next;
+          }
+          srv->committing = 0;
+          pthread_cond_broadcast(&srv->commit_cond);
+     }
+     pthread_mutex_unlock(&srv->commit_mtx);
+     return c->status;
+}
+
+/** Make room for n more bytes at the end of the output buffer */
+static char *
+connection_out_reserve(Connection *conn, size_t n) {
+     if (conn->out_len + n > conn->out_size) {
+          size_t size = conn->out_size? conn->out_size: 4096;
+          while (size < conn->out_len + n)
+               size *= 2;
+          char *p = realloc(conn->out, size);
+          if (!p)
+               return 0;
+          conn->out = p;
+          conn->out_size = size;
+     }
+     return conn->out + conn->out_len;
+}
+
+/** Start a response frame. The length is written by @ref response_end */
+static int
+response_begin(Connection *conn, uint8_t status) {
+     char *p = connection_out_reserve(conn, 5);
+     if (!p)
+          return -1;
+     p[4] = status;
+     conn->out_len += 5;
+     return 0;
+}
+
+static void
+response_end(Connection *conn) {
+     const uint32_t len = conn->out_len - 4;
+     memcpy(conn->out, &len, sizeof(len));
+}
+
+static void
+response_error(Connection *conn, const char *message) {
+     conn->out_len = 0;
+     const size_t n = strlen(message);
+     char *p;
+     if (response_begin(conn, SERVER_STATUS_ERROR) != 0 ||
+         !(p = connection_out_reserve(conn, n))) {
+          // not even the error fits, the client will see the connection closed
+          conn->out_len = 0;
+          conn->failed = 1;
+          return;
+     }
+     memcpy(p, message, n);
+     conn->out_len += n;
+     response_end(conn);
+}
+
+static void
+server_serve_add(Server *srv, WirePages *wp, Commit *commit,
+                 Connection *conn, const char *payload, size_t len) {
+     if (wire_pages_decode(wp, payload, len) != 0) {
+          response_error(conn, wp->error->message);
+          return;
+     }
+     commit->pages = (const CrawledPage **)wp->pages;
+     commit->n_pages = wp->n_pages;
+     if (commit->n_pages > 0 && server_commit(srv, commit) != 0) {
+          response_error(conn, commit->message);
+          return;
+     }
+     if (response_begin(conn, SERVER_STATUS_OK) != 0)
+          response_error(conn, "memory error");
+     else
+          response_end(conn);
+}
+
+static void
+server_serve_request(Server *srv, char **urls,
+                     Connection *conn, const char *payload, size_t len) {
+     uint32_t n;
+     if (len != sizeof(n)) {
+          response_error(conn, "request payload must be an uint32");
+          return;
+     }
+     memcpy(&n, payload, sizeof(n));
+     if (n > SERVER_MAX_REQUEST)
+          n = SERVER_MAX_REQUEST;
+
+     pthread_mutex_lock(&srv->prefetch_mtx);
+     PageRequest *old = 0;
+     size_t n_urls = 0;
+     const char *error = 0;
+     for (int refilled = 0; n_urls < n; refilled = 1) {
+          PageRequest *req = srv->prefetch;
+          while (n_urls < n && req && srv->prefetch_next < req->n_urls)
+               urls[n_urls++] = req->urls[srv->prefetch_next++];
+          if (n_urls == n || refilled)
+               break;
+          // the URLs already taken must survive until encoded
+          old = srv->prefetch;
+          srv->prefetch = 0;
+          srv->prefetch_next = 0;
+          const size_t n_fetch = n - n_urls > srv->prefetch_size?
+               n - n_urls: srv->prefetch_size;
+          if (server_scheduler_request(srv, n_fetch, &srv->prefetch) != 0) {
+               error = server_scheduler_error(srv);
+               page_request_delete(srv->prefetch);
+               srv->prefetch = 0;
+               break;
+          }
+     }
+     if (error) {
+          response_error(conn, error);
+     } else if (response_begin(conn, SERVER_STATUS_OK) != 0 ||
+                wire_encode_urls(urls, n_urls,
+                                 &conn->out, &conn->out_len, &conn->out_size) != 0) {
+          response_error(conn, "memory error");
+     } else {
+          response_end(conn);
+     }
+     page_request_delete(old);
+     pthread_mutex_unlock(&srv->prefetch_mtx);
+}
+
+static void
+server_serve_metrics(Connection *conn) {
+     char *text = 0;
+     size_t n = 0;
+     FILE *f = open_memstream(&text, &n);
+     int rc = f? metrics_write_text(f): -1;
+     if (f && fclose(f) != 0)
+          rc = -1;
+     if (rc != 0) {
+          free(text);
+          response_error(conn, "writing metrics");
+          return;
+     }
+     char *p;
+     if (response_begin(conn, SERVER_STATUS_OK) != 0 ||
+         !(p = connection_out_reserve(conn, n))) {
+          response_error(conn, "memory error");
+     } else {
+          memcpy(p, text, n);
+          conn->out_len += n;
+          response_end(conn);
+     }
+     free(text);
+}
+
+static void *
+server_worker(void *arg) {
+     Server *srv = arg;
+     WirePages *wp = 0;
+     Commit commit;
+     char **urls = malloc(SERVER_MAX_REQUEST*sizeof(*urls));
+     if (wire_pages_new(&wp) != 0 || !urls) {
+          fprintf(stderr, "Worker could not allocate memory\n");
+          free(urls);
+          return 0;
+     }
+
+     while (1) {
+          pthread_mutex_lock(&srv->jobs_mtx);
+          while (!srv->jobs_head && !srv->stop)
+               pthread_cond_wait(&srv->jobs_cond, &srv->jobs_mtx);
+          Connection *conn = srv->jobs_head;
+          if (conn) {
+               srv->jobs_head = conn->next_job;
+               if (!srv->jobs_head)
+                    srv->jobs_tail = 0;
+          }
+          pthread_mutex_unlock(&srv->jobs_mtx);
+          if (!conn)
+               break;
+
+          const char *payload = conn->in + 5;
+          const size_t len = conn->frame_len - 5;
+          conn->out_len = 0;
+          conn->out_pos = 0;
+          switch ((uint8_t)conn->in[4]) {
+          case SERVER_OP_ADD:
+               server_serve_add(srv, wp, &commit, conn, payload, len);
+               break;
+          case SERVER_OP_REQUEST:
+               server_serve_request(srv, urls, conn, payload, len);
+               break;
+          case SERVER_OP_METRICS:
+               server_serve_metrics(conn);
+               break;
+          default:
+               response_error(conn, "unknown operation");
+               break;
+          }
+          // consume the frame and give the connection back to the main thread
+          memmove(conn->in, conn->in + conn->frame_len, conn->in_len - conn->frame_len);
+          conn->in_len -= conn->frame_len;
+          conn->frame_len = 0;
+
+          struct epoll_event ev = {.events = EPOLLOUT | EPOLLONESHOT,
+                                   .data.ptr = conn};
+          if (epoll_ctl(srv->epfd, EPOLL_CTL_MOD, conn->sock.fd, &ev) != 0)
+               fprintf(stderr, "Could not watch connection: %s\n", strerror(errno));
+     }
+     wire_pages_delete(wp);
+     free(urls);
+     return 0;
+}
+
+static void
+connection_close(Server *srv, Connection *conn) {
+     close(conn->sock.fd);
+     if (conn->prev)
+          conn->prev->next = conn->next;
+     else
+          srv->conns = conn->next;
+     if (conn->next)
+          conn->next->prev = conn->prev;
+     free(conn->in);
+     free(conn->out);
+     free(conn);
+}
+
+/** Hand the connection to a worker if a whole frame has been received,
+ * otherwise keep reading.
+ *
+ * @return 0 if success, -1 if the connection must be closed
+ */
+static int
+connection_dispatch(Server *srv, Connection *conn) {
+     uint32_t len;
+     if (conn->in_len >= sizeof(len)) {
+          memcpy(&len, conn->in, sizeof(len));
+          if (len < 1 || len > SERVER_MAX_FRAME)
+               return -1;
+          if (conn->in_len >= sizeof(len) + len) {
+               conn->frame_len = sizeof(len) + len;
+               conn->next_job = 0;
+               pthread_mutex_lock(&srv->jobs_mtx);
+               if (srv->jobs_tail)
+                    srv->jobs_tail->next_job = conn;
+               else
+                    srv->jobs_head = conn;
+               srv->jobs_tail = conn;
+               pthread_cond_signal(&srv->jobs_cond);
+               pthread_mutex_unlock(&srv->jobs_mtx);
+               return 0;
+          }
+     }
+     // nothing left to answer
+     if (conn->eof)
+          return -1;
+     struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT,
+                              .data.ptr = conn};
+     return epoll_ctl(srv->epfd, EPOLL_CTL_MOD, conn->sock.fd, &ev);
+}
+
+static int
+connection_read(Server *srv, Connection *conn) {
+     while (1) {
+          if (conn->in_len == conn->in_size) {
+               size_t size = conn->in_size? 2*conn->in_size: 4096;
+               if (size > SERVER_MAX_FRAME + 4096)
+                    return -1;
+               char *p = realloc(conn->in, size);
+               if (!p)
+                    return -1;
+               conn->in = p;
+               conn->in_size = size;
+          }
+          ssize_t n = read(conn->sock.fd,
+                           conn->in + conn->in_len,
+                           conn->in_size - conn->in_len);
+          if (n > 0)
+               conn->in_len += n;
+          else if (n == 0) {
+               // answer the frames already received before closing
+               conn->eof = 1;
+               break;
+          }
+          else if (errno == EAGAIN || errno == EWOULDBLOCK)
+               break;
+          else if (errno != EINTR)
+               return -1;
+     }
+     return connection_dispatch(srv, conn);
+}
+
+static int
+connection_write(Server *srv, Connection *conn) {
+     if (conn->failed)
+          return -1;
+     while (conn->out_pos < conn->out_len) {
+          ssize_t n = send(conn->sock.fd,
+                           conn->out + conn->out_pos,
+                           conn->out_len - conn->out_pos,
+                           MSG_NOSIGNAL);
+          if (n >= 0)
+               conn->out_pos += n;
+          else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+               struct epoll_event ev = {.events = EPOLLOUT | EPOLLONESHOT,
+                                        .data.ptr = conn};
+               return epoll_ctl(srv->epfd, EPOLL_CTL_MOD, conn->sock.fd, &ev);
+          }
+          else if (errno != EINTR)
+               return -1;
+     }
+     conn->out_len = 0;
+     conn->out_pos = 0;
+     // the client may have sent more requests already
+     return connection_dispatch(srv, conn);
+}
+
+static int
+server_accept(Server *srv, ServerSocket *listener) {
+     int fd;
+     while ((fd = accept4(listener->fd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+          const int one = 1;
+          // fails harmlessly for Unix sockets
+          setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+          Connection *conn = calloc(1, sizeof(*conn));
+          if (!conn) {
+               close(fd);
+               continue;
+          }
+          conn->sock.kind = server_socket_conn;
+          conn->sock.fd = fd;
+          conn->next = srv->conns;
+          if (srv->conns)
+               srv->conns->prev = conn;
+          srv->conns = conn;
+
+          struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT,
+                                   .data.ptr = conn};
+          if (epoll_ctl(srv->epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+               connection_close(srv, conn);
+     }
+     if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+          fprintf(stderr, "Error accepting connection: %s\n", strerror(errno));
+          return -1;
+     }
+     return 0;
+}
+
+static int
+listen_tcp(const char *address, const char *port) {
+     struct addrinfo hints = {
+          .ai_family = AF_UNSPEC,
+          .ai_socktype = SOCK_STREAM,
+          .ai_flags = AI_PASSIVE
+     };
+     struct addrinfo *res;
+     int rc = getaddrinfo(address, port, &hints, &res);
+     if (rc != 0) {
+          fprintf(stderr, "Could not resolve %s:%s: %s\n", address, port, gai_strerror(rc));
+          return -1;
+     }
+     int fd = -1;
+     for (struct addrinfo *ai=res; ai; ai=ai->ai_next) {
+          fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      ai->ai_protocol);
+          if (fd < 0)
+               continue;
+          const int one = 1;
+          setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+          if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+              listen(fd, SOMAXCONN) == 0)
+               break;
+          close(fd);
+          fd = -1;
+     }
+     freeaddrinfo(res);
+     if (fd < 0)
+          fprintf(stderr, "Could not listen on %s:%s\n", address, port);
+     return fd;
+}
+
+static int
+listen_unix(const char *path) {
+     struct sockaddr_un addr = {.sun_family = AF_UNIX};
+     if (strlen(path) >= sizeof(addr.sun_path)) {
+          fprintf(stderr, "Unix socket path too long: %s\n", path);
+          return -1;
+     }
+     strcpy(addr.sun_path, path);
+     unlink(path);
+
+     int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+     if (fd < 0 ||
+         bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+         listen(fd, SOMAXCONN) != 0) {
+          fprintf(stderr, "Could not listen on %s: %s\n", path, strerror(errno));
+          if (fd >= 0)
+               close(fd);
+          return -1;
+     }
+     return fd;
+}
+
+/** Add each line of the seeds file as a link from its own seed page */
+static int
+server_add_seeds(Server *srv, const char *path) {
+     FILE *seeds = fopen(path, "r");
+     if (!seeds) {
+          fprintf(stderr, "Could not open seeds file %s: %s\n", path, strerror(errno));
+          return -1;
+     }
+     char *line = 0;
+     size_t line_size = 0;
+     ssize_t n;
+     char name[64];
+     char message[256];
+     int ret = 0;
+     for (size_t i=0; ret == 0 && (n = getline(&line, &line_size, seeds)) != -1; ++i) {
+          while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r' || line[n - 1] == ' '))
+               line[--n] = '\0';
+          if (n == 0)
+               continue;
+          snprintf(name, sizeof(name), "_seed_%zu", i);
+          CrawledPage *cp = crawled_page_new(name);
+          if (!cp || crawled_page_add_link(cp, line, 1.0) != 0) {
+               fprintf(stderr, "Could not allocate seed page\n");
+               ret = -1;
+          } else if (server_add_batch(srv, (const CrawledPage **)&cp, 1,
+                                      message, sizeof(message)) != 0) {
+               fprintf(stderr, "Could not add seed %s: %s\n", line, message);
+               ret = -1;
+          }
+          crawled_page_delete(cp);
+     }
+     free(line);
+     fclose(seeds);
+     return ret;
+}
+
+static void
+print_help(const char *name) {
+     fprintf(stderr,
+             "Use: %s [options] path_to_page_db\n"
+             "\n"
+             "Options:\n"
+             "  -p PORT     Listen on this TCP port. Default %s unless -u is given\n"
+             "  -a ADDRESS  Bind TCP socket to this address. Default %s\n"
+             "  -u PATH     Listen on this Unix socket\n"
+             "  -w N        Number of worker threads. Default %d\n"
+             "  -b N        Maximum number of pages per commit. Default %d\n"
+             "  -q N        URLs requested to the scheduler at once. Default %d\n"
+             "  -s SCHED    Scheduler, bf or freq. Default bf\n"
+             "  -r SCORER   Scorer for bf scheduler: none, hits or pagerank. Default none\n"
+             "  -l SOFT     Soft crawl rate limit per domain. Default 0.25\n"
+             "  -L HARD     Hard crawl rate limit per domain. Default 100\n"
+             "  -f FREQ     Default crawl frequency for freq scheduler. Default 0.1\n"
+             "  -S PATH     Seeds file, with one URL per line\n",
+             name, SERVER_DEFAULT_PORT, SERVER_DEFAULT_ADDRESS,
+             SERVER_DEFAULT_WORKERS, SERVER_DEFAULT_MAX_BATCH, SERVER_DEFAULT_PREFETCH);
+}
+
+int
+main(int argc, char **argv) {
+     const char *port = 0;
+     const char *address = SERVER_DEFAULT_ADDRESS;
+     const char *unix_path = 0;
+     const char *sched_name = "bf";
+     const char *scorer_name = "none";
+     const char *seeds_path = 0;
+     size_t n_workers = SERVER_DEFAULT_WORKERS;
+     float soft_rate = 0.25;
+     float hard_rate = 100.0;
+     float freq_default = 0.1;
+
+     Server srv = {
+          .epfd = -1,
+          .max_batch = SERVER_DEFAULT_MAX_BATCH,
+          .prefetch_size = SERVER_DEFAULT_PREFETCH
+     };
+
+     int opt;
+     while ((opt = getopt(argc, argv, "p:a:u:w:b:q:s:r:l:L:f:S:h")) != -1) {
+          int ok = 1;
+          switch (opt) {
+          case 'p': port = optarg; break;
+          case 'a': address = optarg; break;
+          case 'u': unix_path = optarg; break;
+          case 'w': ok = sscanf(optarg, "%zu", &n_workers) == 1 && n_workers > 0; break;
+          case 'b': ok = sscanf(optarg, "%zu", &srv.max_batch) == 1 && srv.max_batch > 0; break;
+          case 'q': ok = sscanf(optarg, "%zu", &srv.prefetch_size) == 1 && srv.prefetch_size > 0; break;
+          case 's': sched_name = optarg; break;
+          case 'r': scorer_name = optarg; break;
+          case 'l': ok = sscanf(optarg, "%f", &soft_rate) == 1; break;
+          case 'L': ok = sscanf(optarg, "%f", &hard_rate) == 1; break;
+          case 'f': ok = sscanf(optarg, "%f", &freq_default) == 1; break;
+          case 'S': seeds_path = optarg; break;
+          default:
+               print_help(argv[0]);
+               return -1;
+          }
+          if (!ok) {
+               fprintf(stderr, "Incorrect value for option -%c: %s\n", opt, optarg);
+               print_help(argv[0]);
+               return -1;
+          }
+     }
+     if (optind != argc - 1) {
+          fprintf(stderr, "Incorrect number of arguments\n");
+          print_help(argv[0]);
+          return -1;
+     }
+     if (!port && !unix_path)
+          port = SERVER_DEFAULT_PORT;
+
+     pthread_mutex_init(&srv.sched_mtx, 0);
+
+     if (page_db_new(&srv.page_db, argv[optind]) != 0) {
+          fprintf(stderr, "Error opening page database: ");
+          fprintf(stderr, "%s", srv.page_db? srv.page_db->error->message: "NULL");
+          fprintf(stderr, "\n");
+          return -1;
+     }
+     page_db_set_persist(srv.page_db, 1);
+
+     if (strcmp(sched_name, "bf") == 0) {
+          if (bf_scheduler_new(&srv.bf, srv.page_db, 0) != 0) {
+               fprintf(stderr, "Error opening BFS scheduler database: ");
+               fprintf(stderr, "%s", srv.bf? srv.bf->error->message: "NULL");
+               fprintf(stderr, "\n");
+               return -1;
+          }
+          bf_scheduler_set_persist(srv.bf, 1);
+          if (bf_scheduler_set_max_domain_crawl_rate(srv.bf, soft_rate, hard_rate) != 0) {
+               fprintf(stderr, "Error setting crawl rate: %s\n", srv.bf->error->message);
+               return -1;
+          }
+          int scorer_error = 0;
+          if (strcmp(scorer_name, "hits") == 0) {
+               if (hits_scorer_new(&srv.hits, srv.page_db) != 0)
+                    scorer_error = 1;
+               else {
+                    hits_scorer_set_persist(srv.hits, 1);
+                    hits_scorer_setup(srv.hits, srv.bf->scorer);
+               }
+          } else if (strcmp(scorer_name, "pagerank") == 0) {
+               if (page_rank_scorer_new(&srv.page_rank, srv.page_db) != 0)
+                    scorer_error = 1;
+               else {
+                    page_rank_scorer_set_persist(srv.page_rank, 1);
+                    page_rank_scorer_setup(srv.page_rank, srv.bf->scorer);
+               }
+          } else if (strcmp(scorer_name, "none") != 0) {
+               fprintf(stderr, "Unknown scorer: %s\n", scorer_name);
+               print_help(argv[0]);
+               return -1;
+          }
+          if (scorer_error) {
+               fprintf(stderr, "Error creating scorer %s\n", scorer_name);
+               return -1;
+          }
+          if ((srv.hits || srv.page_rank) && bf_scheduler_update_start(srv.bf) != 0) {
+               fprintf(stderr, "Error starting update thread: %s\n", srv.bf->error->message);
+               return -1;
+          }
+     } else if (strcmp(sched_name, "freq") == 0) {
+          if (freq_scheduler_new(&srv.freq, srv.page_db, 0) != 0) {
+               fprintf(stderr, "Error opening frequency scheduler database: ");
+               fprintf(stderr, "%s", srv.freq? srv.freq->error->message: "NULL");
+               fprintf(stderr, "\n");
+               return -1;
+          }
+          srv.freq->persist = 1;
+          if (freq_scheduler_load_simple(srv.freq, freq_default, -1.0) != 0) {
+               fprintf(stderr, "Error loading frequencies: %s\n", srv.freq->error->message);
+               return -1;
+          }
+     } else {
+          fprintf(stderr, "Unknown scheduler: %s\n", sched_name);
+          print_help(argv[0]);
+          return -1;
+     }
+
+     if (seeds_path && server_add_seeds(&srv, seeds_path) != 0)
+          return -1;
+
+     // signals are received through a file descriptor inside the event loop
+     sigset_t mask;
+     sigemptyset(&mask);
+     sigaddset(&mask, SIGINT);
+     sigaddset(&mask, SIGTERM);
+     pthread_sigmask(SIG_BLOCK, &mask, 0);
+     ServerSocket signal_sock = {.kind = server_socket_signal,
+                                 .fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)};
+     ServerSocket tcp_sock = {.kind = server_socket_listen, .fd = -1};
+     ServerSocket unix_sock = {.kind = server_socket_listen, .fd = -1};
+
+     if ((srv.epfd = epoll_create1(EPOLL_CLOEXEC)) < 0 || signal_sock.fd < 0) {
+          fprintf(stderr, "Error creating epoll: %s\n", strerror(errno));
+          return -1;
+     }
+     if ((port && (tcp_sock.fd = listen_tcp(address, port)) < 0) ||
+         (unix_path && (unix_sock.fd = listen_unix(unix_path)) < 0))
+          return -1;
+
+     ServerSocket *socks[] = {&signal_sock, &tcp_sock, &unix_sock};
+     for (size_t i=0; i<sizeof(socks)/sizeof(*socks); ++i) {
+          if (socks[i]->fd < 0)
+               continue;
+          struct epoll_event ev = {.events = EPOLLIN, .data.ptr = socks[i]};
+          if (epoll_ctl(srv.epfd, EPOLL_CTL_ADD, socks[i]->fd, &ev) != 0) {
+               fprintf(stderr, "Error adding socket to epoll: %s\n", strerror(errno));
+               return -1;
+          }
+     }
+
+     pthread_mutex_init(&srv.jobs_mtx, 0);
+     pthread_cond_init(&srv.jobs_cond, 0);
+     pthread_mutex_init(&srv.commit_mtx, 0);
+     pthread_cond_init(&srv.commit_cond, 0);
+     pthread_mutex_init(&srv.prefetch_mtx, 0);
+
+     pthread_t *workers = calloc(n_workers, sizeof(*workers));
+     if (!workers) {
+          fprintf(stderr, "Could not allocate memory\n");
+          return -1;
+     }
+     for (size_t i=0; i<n_workers; ++i)
+          if (pthread_create(workers + i, 0, server_worker, &srv) != 0) {
+               fprintf(stderr, "Could not start worker %zu\n", i);
+               return -1;
+          }
+
+     if (port)
+          printf("Listening on %s:%s\n", address, port);
+     if (unix_path)
+          printf("Listening on %s\n", unix_path);
+     printf("Press Ctrl-C to exit\n");
+     fflush(stdout);
+
+     int running = 1;
+     int ret = 0;
+     struct epoll_event events[SERVER_MAX_EVENTS];
+     while (running) {
+          int n = epoll_wait(srv.epfd, events, SERVER_MAX_EVENTS, -1);
+          if (n < 0) {
+               if (errno == EINTR)
+                    continue;
+               fprintf(stderr, "Error waiting for events: %s\n", strerror(errno));
+               ret = -1;
+               break;
+          }
+          for (int i=0; i<n; ++i) {
+               ServerSocket *sock = events[i].data.ptr;
+               switch (sock->kind) {
+               case server_socket_signal:
+                    running = 0;
+                    break;
+               case server_socket_listen:
+                    server_accept(&srv, sock);
+                    break;
+               case server_socket_conn: {
+                    Connection *conn = (Connection*)sock;
+                    int rc = 0;
+                    if (events[i].events & EPOLLERR)
+                         rc = -1;
+                    else if (events[i].events & EPOLLOUT)
+                         rc = connection_write(&srv, conn);
+                    else if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))
+                         rc = connection_read(&srv, conn);
+                    if (rc != 0)
+                         connection_close(&srv, conn);
+                    break;
+               }
+               }
+          }
+     }
+     printf("Exit\n");
+
+     pthread_mutex_lock(&srv.jobs_mtx);
+     srv.stop = 1;
+     pthread_cond_broadcast(&srv.jobs_cond);
+     pthread_mutex_unlock(&srv.jobs_mtx);
+     // workers finish the jobs already queued before exiting
+     for (size_t i=0; i<n_workers; ++i)
+          pthread_join(workers[i], 0);
+     free(workers);
+
+     while (srv.conns)
+          connection_close(&srv, srv.conns);
+     for (size_t i=0; i<sizeof(socks)/sizeof(*socks); ++i)
+          if (socks[i]->fd >= 0)
+               close(socks[i]->fd);
+     if (unix_path)
+          unlink(unix_path);
+     close(srv.epfd);
+
+     page_request_delete(srv.prefetch);
+     free(srv.batch);
+     if (srv.bf) {
+          bf_scheduler_update_stop(srv.bf);
+          bf_scheduler_delete(srv.bf);
+     }
+     if (srv.freq)
+          freq_scheduler_delete(srv.freq);
+     if (srv.hits)
+          hits_scorer_delete(srv.hits);
+     if (srv.page_rank)
+          page_rank_scorer_delete(srv.page_rank);
+     page_db_delete(srv.page_db);
+
+     return ret;
+}
@@ -22,6 +22,7 @@
 #include "xxhash.h"
 
 #include "page_db.h"
+#include "metrics.h"
 #include "util.h"
 #include "scheduler.h"
 #include "bf_scheduler.h"
@@ -156,6 +157,11 @@ bf_scheduler_crawlable_page(BFScheduler *sch, PageInfo *pi) {
 
 BFSchedulerError
 bf_scheduler_add(BFScheduler *sch, const CrawledPage *page) {
+     return bf_scheduler_add_batch(sch, &page, 1);
+}
+
+BFSchedulerError
+bf_scheduler_add_batch(BFScheduler *sch, const CrawledPage **pages, size_t n_pages) {
      if (bf_scheduler_expand(sch) != 0)
           return sch->error->code;
 
@@ -165,8 +171,8 @@ bf_scheduler_add(BFScheduler *sch, const CrawledPage *page) {
      MDB_txn *txn = 0;
      MDB_cursor *cur = 0;
 
-     PageInfoList *pil;
-     if (page_db_add(sch->page_db, page, &pil) != 0) {
+     PageInfoList *pil = 0;
+     if (page_db_add_batch(sch->page_db, pages, n_pages, &pil) != 0) {
           error1 = "adding crawled page";
           error2 = sch->page_db->error->message;
           goto on_error;
@@ -176,7 +182,7 @@ bf_scheduler_add(BFScheduler *sch, const CrawledPage *page) {
      if ((rc = pthread_mutex_lock(&sch->update_thread->wait_mutex)) != 0)
           error1 = "locking n_pages mutex";
      else {
-          sch->update_thread->n_pages_new += 1.0;
+          sch->update_thread->n_pages_new += n_pages;
           if ((rc = pthread_cond_broadcast(&sch->update_thread->wait_cond)) != 0)
                error1 = "broadcasting n_pages signal";
           else if ((rc = pthread_mutex_unlock(&sch->update_thread->wait_mutex)) != 0)
@@ -402,6 +408,9 @@ static BFSchedulerError
 bf_scheduler_update_batch(BFScheduler *sch) {
      assert(sch->scorer->state != 0);
 
+     const uint64_t t0 = metrics_now();
+     size_t n_pages = 0;
+
      if (bf_scheduler_expand(sch) != 0)
           return sch->error->code;
 
@@ -444,6 +453,7 @@ bf_scheduler_update_batch(BFScheduler *sch) {
           float score_new;
           switch (hashidx_stream_next(sch->update_thread->stream, &hash, &idx)) {
           case stream_state_next:
+               ++n_pages;
                sch->scorer->get(sch->scorer->state, idx, &score_old, &score_new);
                // to gain some performance we don't bother to change the schedule unless
                // there is some significant score change
@@ -473,6 +483,8 @@ bf_scheduler_update_batch(BFScheduler *sch) {
      }
      txn = 0;
 
+     metrics_count(metric_bf_scheduler_updates, n_pages);
+     metrics_record_since(metric_bf_scheduler_update_batch, t0);
      return 0;
 on_error:
      if (sch->update_thread->stream)
@@ -731,6 +743,8 @@ bf_scheduler_add_requests(BFScheduler *sch,
                     delete = 1;
                }
                page_info_delete(pi);
+          } else { // pruned from the PageDB --> delete
+               delete = 1;
           }
           if (delete && (mdb_rc = mdb_cursor_del(cur, 0)) != 0) {
                error1 = "deleting head of schedule";
@@ -754,6 +768,7 @@ on_error:
 
 BFSchedulerError
 bf_scheduler_request(BFScheduler *sch, size_t n_pages, PageRequest **request) {
+     const uint64_t t0 = metrics_now();
      char *error1 = 0;
      char *error2 = 0;
 
@@ -808,6 +823,8 @@ bf_scheduler_request(BFScheduler *sch, size_t n_pages, PageRequest **request) {
           error2 = sch->txn_manager->error->message;
           goto on_error;
      }
+     metrics_count(metric_bf_scheduler_requests, req->n_urls);
+     metrics_record_since(metric_bf_scheduler_request, t0);
      return 0;
 
 on_error:
@@ -862,6 +879,130 @@ bf_scheduler_set_update_interval(BFScheduler *sch, time_t value) {
      sch->update_thread->rest_time = value;
 }
 
+BFSchedulerError
+bf_scheduler_stats(BFScheduler *sch, BFSchedulerStats *stats) {
+     const char *name = "schedule";
+     if (txn_manager_stats(sch->txn_manager, &stats->env, &name, 1, &stats->schedule) != 0) {
+          bf_scheduler_set_error(sch, bf_scheduler_error_internal, __func__);
+          bf_scheduler_add_error(sch, sch->txn_manager->error->message);
+     }
+     return sch->error->code;
+}
+
+BFSchedulerError
+bf_scheduler_compact(BFScheduler *sch) {
+     if (txn_manager_compact(sch->txn_manager, 1) != 0) {
+          bf_scheduler_set_error(sch, bf_scheduler_error_internal, __func__);
+          bf_scheduler_add_error(sch, sch->txn_manager->error->message);
+     }
+     return sch->error->code;
+}
+
+static int
+bf_scheduler_hash_cmp(const void *a, const void *b) {
+     const uint64_t x = *(const uint64_t*)a;
+     const uint64_t y = *(const uint64_t*)b;
+     return x < y? -1: x > y;
+}
+
+BFSchedulerError
+bf_scheduler_prune(BFScheduler *sch, const PageDBPruneOptions *options, size_t *n_pruned) {
+     char *error1 = 0;
+     char *error2 = 0;
+
+     MDB_txn *txn = 0;
+     MDB_cursor *cur = 0;
+
+     uint64_t *pruned = 0;
+     if (page_db_prune(sch->page_db, options, &pruned, n_pruned) != 0) {
+          error1 = "pruning PageDB";
+          error2 = sch->page_db->error->message;
+          goto on_error;
+     }
+
+     // Schedule keys start with the score given by the scorer, so we cannot
+     // look up the pruned pages and must sweep the whole schedule instead.
+     // It is done in batches to let requests in between.
+     ScheduleKey last;
+     int started = 0;
+     int done = *n_pruned == 0;
+     while (!done) {
+          if (bf_scheduler_expand(sch) != 0) {
+               free(pruned);
+               return sch->error->code;
+          }
+          if (txn_manager_begin(sch->txn_manager, 0, &txn) != 0) {
+               error1 = "starting transaction";
+               error2 = sch->txn_manager->error->message;
+               goto on_error;
+          }
+          int mdb_rc = bf_scheduler_open_cursor(txn, &cur);
+          if (mdb_rc != 0) {
+               error1 = "opening cursor";
+               error2 = mdb_strerror(mdb_rc);
+               goto on_error;
+          }
+          MDB_val key = {
+               .mv_size = sizeof(last),
+               .mv_data = &last
+          };
+          MDB_val val;
+          mdb_rc = mdb_cursor_get(cur, &key, &val, started? MDB_SET_RANGE: MDB_FIRST);
+          for (size_t i=0; mdb_rc == 0 && i<PAGE_DB_PRUNE_BATCH; ++i) {
+               last = *(ScheduleKey*)key.mv_data;
+               started = 1;
+               if (bsearch(&last.hash, pruned, *n_pruned, sizeof(*pruned), bf_scheduler_hash_cmp)) {
+                    // the page could have been found again since it was pruned
+                    PageInfo *pi;
+                    if (page_db_get_info(sch->page_db, last.hash, &pi) != 0) {
+                         error1 = "retrieving PageInfo from PageDB";
+                         error2 = sch->page_db->error->message;
+                         goto on_error;
+                    }
+                    if (pi)
+                         page_info_delete(pi);
+                    else if ((mdb_rc = mdb_cursor_del(cur, 0)) != 0) {
+                         error1 = "deleting pruned page from schedule";
+                         error2 = mdb_strerror(mdb_rc);
+                         goto on_error;
+                    }
+               }
+               mdb_rc = mdb_cursor_get(cur, &key, &val, MDB_NEXT);
+          }
+          switch (mdb_rc) {
+          case MDB_NOTFOUND:
+               done = 1;
+               // fall through
+          case 0:
+               break;
+          default:
+               error1 = "iterating schedule";
+               error2 = mdb_strerror(mdb_rc);
+               goto on_error;
+          }
+          cur = 0;
+          if (txn_manager_commit(sch->txn_manager, txn) != 0) {
+               txn = 0;
+               error1 = "commiting schedule transaction";
+               error2 = sch->txn_manager->error->message;
+               goto on_error;
+          }
+          txn = 0;
+     }
+     free(pruned);
+     return 0;
+
+on_error:
+     if (txn)
+          txn_manager_abort(sch->txn_manager, txn);
+     free(pruned);
+
+     bf_scheduler_set_error(sch, bf_scheduler_error_internal, __func__);
+     bf_scheduler_add_error(sch, error1);
+     bf_scheduler_add_error(sch, error2);
+     return sch->error->code;
+}
+
 void
 bf_scheduler_delete(BFScheduler *sch) {
      if (sch->update_thread->state != update_thread_none) {
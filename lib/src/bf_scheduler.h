@@ -168,6 +168,15 @@ bf_scheduler_new(BFScheduler **sch, PageDB *db, const char *path);
 BFSchedulerError
 bf_scheduler_add(BFScheduler *sch, const CrawledPage *page);
 
+/** Add several crawled pages, with a single commit to each database.
+ *
+ * See @ref page_db_add_batch.
+ *
+ * @return 0 if success, otherwise the error code
+ */
+BFSchedulerError
+bf_scheduler_add_batch(BFScheduler *sch, const CrawledPage **pages, size_t n_pages);
+
 /** Add to schedule all non-crawled pages
  *
  * This can be used to retry pages that were requested but could not be
@@ -228,6 +237,45 @@ bf_scheduler_set_max_crawl_depth(BFScheduler *sch, uint64_t value);
 void
 bf_scheduler_set_update_interval(BFScheduler *sch, time_t value);
 
+/** Storage statistics of the scheduler, see @ref bf_scheduler_stats */
+typedef struct {
+     TxnManagerEnvStats env;
+     TxnManagerDBStats schedule;
+} BFSchedulerStats;
+
+/** Get the size of the schedule and of its environment.
+ *
+ * The statistics of the @ref PageDB are obtained with @ref page_db_stats.
+ *
+ * @return 0 if success, otherwise the error code
+ */
+BFSchedulerError
+bf_scheduler_stats(BFScheduler *sch, BFSchedulerStats *stats);
+
+/** Compact the schedule environment, see @ref txn_manager_compact.
+ *
+ * The schedule churns constantly with the deletes and puts of each request
+ * and score change, so it fragments faster than the @ref PageDB.
+ *
+ * @return 0 if success, otherwise the error code
+ */
+BFSchedulerError
+bf_scheduler_compact(BFScheduler *sch);
+
+/** Prune uncrawled pages from the @ref PageDB, see @ref page_db_prune, and
+ * remove them from the schedule.
+ *
+ * The whole schedule is scanned in batches of @ref PAGE_DB_PRUNE_BATCH
+ * entries. Entries of pages missing from the PageDB are also dropped by
+ * @ref bf_scheduler_request when they reach the head of the schedule.
+ *
+ * @param n_pruned Number of pages pruned from the PageDB
+ *
+ * @return 0 if success, otherwise the error code
+ */
+BFSchedulerError
+bf_scheduler_prune(BFScheduler *sch, const PageDBPruneOptions *options, size_t *n_pruned);
+
 /// @}
 
 #if (defined TEST) && TEST
@@ -18,6 +18,7 @@
 #include <time.h>
 
 #include "freq_scheduler.h"
+#include "metrics.h"
 #include "txn_manager.h"
 #include "util.h"
 #include "scheduler.h"
@@ -48,6 +49,8 @@ freq_scheduler_new(FreqScheduler **sch, PageDB *db, const char *path) {
      p->persist = FREQ_SCHEDULER_DEFAULT_PERSIST;
      p->margin = -1.0; // disabled
      p->max_n_crawls = 0;
+     p->near_dup_distance = FREQ_SCHEDULER_DEFAULT_NEAR_DUP_DISTANCE;
+     p->near_dup_window = FREQ_SCHEDULER_DEFAULT_NEAR_DUP_WINDOW;
 
      // create directory if not present yet
      char *error = 0;
@@ -206,6 +209,11 @@ freq_scheduler_load_simple(FreqScheduler *sch,
      uint64_t hash;
      PageInfo *pi;
 
+     // pages come grouped by domain, remember the rate of the last one
+     uint32_t domain = 0;
+     float domain_rate = -1.0;
+     int has_domain_rate = 0;
+
      while ((ss = hashinfo_stream_next(st, &hash, &pi)) == stream_state_next) {
           if ((pi->n_crawls > 0) &&
 	      ((sch->max_n_crawls == 0) || (pi->n_crawls < sch->max_n_crawls)) &&
@@ -214,6 +222,24 @@ freq_scheduler_load_simple(FreqScheduler *sch,
                float freq = freq_default;
                if (freq_scale > 0) {
                     float rate = page_info_rate(pi);
+                    if (rate <= 0) {
+                         // crawled only once, use the mean rate of the domain
+                         if (!has_domain_rate ||
+                             domain != page_db_hash_get_domain(hash)) {
+                              DomainInfo di;
+                              domain = page_db_hash_get_domain(hash);
+                              if (page_db_get_domain_info(sch->page_db, domain, &di) != 0) {
+                                   error1 = "retrieving domain info";
+                                   error2 = sch->page_db->error->message;
+                                   page_info_delete(pi);
+                                   hashinfo_stream_delete(st);
+                                   goto on_error;
+                              }
+                              domain_rate = domain_info_rate(&di);
+                              has_domain_rate = 1;
+                         }
+                         rate = domain_rate;
+                    }
                     if (rate > 0) {
                          freq = freq_scale * rate;
                     }
@@ -299,10 +325,42 @@ on_error:
      return sch->error->code;
 }
 
+/** Check if some other page with similar content has been crawled inside
+ * the near duplicate window */
+static FreqSchedulerError
+freq_scheduler_near_dup(FreqScheduler *sch, uint64_t hash, int *dup) {
+     uint64_t simhash;
+     double last_crawl;
+     int found;
+
+     *dup = 0;
+     if (page_db_get_simhash(sch->page_db, hash, &simhash, &last_crawl, &found) != 0)
+          goto on_error;
+     if (found) {
+          uint64_t dup_hash;
+          if (page_db_find_near_dup(sch->page_db,
+                                    simhash,
+                                    sch->near_dup_distance,
+                                    difftime(time(0), 0) - sch->near_dup_window,
+                                    hash,
+                                    &dup_hash,
+                                    dup) != 0)
+               goto on_error;
+     }
+     return 0;
+
+on_error:
+     freq_scheduler_set_error(sch, freq_scheduler_error_internal, __func__);
+     freq_scheduler_add_error(sch, "looking for near duplicates");
+     freq_scheduler_add_error(sch, sch->page_db->error->message);
+     return sch->error->code;
+}
+
 FreqSchedulerError
 freq_scheduler_request(FreqScheduler *sch,
                        size_t max_requests,
                        PageRequest **request) {
+     const uint64_t t0 = metrics_now();
      char *error1 = 0;
      char *error2 = 0;
 
@@ -318,6 +376,10 @@ freq_scheduler_request(FreqScheduler *sch,
      }
 
      int interrupt_requests = 0;
+     // first page skipped because of a near duplicate. If it reaches the head
+     // of the schedule again all remaining pages are being skipped
+     uint64_t first_dup = 0;
+     int has_dup = 0;
      while ((req->n_urls < max_requests) && !interrupt_requests) {
           MDB_val key;
           MDB_val val;
@@ -331,6 +393,10 @@ freq_scheduler_request(FreqScheduler *sch,
 	       // copy data before deleting cursor
                sk = *(ScheduleKey*)key.mv_data;
                freq = *(float*)val.mv_data;
+               if (has_dup && sk.hash == first_dup) {
+                    interrupt_requests = 1;
+                    break;
+               }
 
 
                PageInfo *pi = 0;
@@ -355,7 +421,19 @@ freq_scheduler_request(FreqScheduler *sch,
 			 goto on_error;
 		    }
 		    if (crawl) {
-			 if (page_request_add_url(req, pi->url) != 0) {
+			 int dup = 0;
+			 if (sch->near_dup_distance >= 0 &&
+			     freq_scheduler_near_dup(sch, sk.hash, &dup) != 0) {
+			      page_info_delete(pi);
+			      freq_scheduler_cursor_abort(sch, cursor);
+			      return sch->error->code;
+			 }
+			 if (dup && !has_dup) {
+			      first_dup = sk.hash;
+			      has_dup = 1;
+			 }
+			 // near duplicates keep their place in the schedule
+			 if (!dup && page_request_add_url(req, pi->url) != 0) {
 			      error1 = "adding url to request";
 			      goto on_error;
 			 }
@@ -387,6 +465,8 @@ freq_scheduler_request(FreqScheduler *sch,
      if (freq_scheduler_cursor_commit(sch, cursor) != 0)
 	  goto on_error;
 
+     metrics_count(metric_freq_scheduler_requests, req->n_urls);
+     metrics_record_since(metric_freq_scheduler_request, t0);
      return sch->error->code;
 on_error:
      freq_scheduler_cursor_abort(sch, cursor);
@@ -408,6 +488,25 @@ freq_scheduler_add(FreqScheduler *sch, const CrawledPage *page) {
      return sch->error->code;
 }
 
+FreqSchedulerError
+freq_scheduler_add_batch(FreqScheduler *sch, const CrawledPage **pages, size_t n_pages) {
+     if (page_db_add_batch(sch->page_db, pages, n_pages, 0) != 0) {
+          freq_scheduler_set_error(sch, freq_scheduler_error_internal, __func__);
+          freq_scheduler_add_error(sch, "adding crawled pages");
+          freq_scheduler_add_error(sch, sch->page_db->error->message);
+     }
+     return sch->error->code;
+}
+
+FreqSchedulerError
+freq_scheduler_compact(FreqScheduler *sch) {
+     if (txn_manager_compact(sch->txn_manager, 1) != 0) {
+          freq_scheduler_set_error(sch, freq_scheduler_error_internal, __func__);
+          freq_scheduler_add_error(sch, sch->txn_manager->error->message);
+     }
+     return sch->error->code;
+}
+
 void
 freq_scheduler_delete(FreqScheduler *sch) {
      mdb_env_close(sch->txn_manager->env);
@@ -25,6 +25,11 @@ typedef struct {
 /** Don't persist by default */
 #define FREQ_SCHEDULER_DEFAULT_PERSIST 0
 
+/** Near duplicate detection disabled by default */
+#define FREQ_SCHEDULER_DEFAULT_NEAR_DUP_DISTANCE -1
+/** Default @ref FreqScheduler::near_dup_window, one day */
+#define FREQ_SCHEDULER_DEFAULT_NEAR_DUP_WINDOW 86400.0
+
 typedef enum {
      freq_scheduler_error_ok = 0,       /**< No error */
      freq_scheduler_error_memory,       /**< Error allocating memory */
@@ -54,6 +59,18 @@ typedef struct {
      float margin;
      /** Do not crawl more than this specified number of times */
      size_t max_n_crawls;
+     /** If not negative, skip pages with a near duplicate crawled recently.
+      *
+      * A near duplicate is another page whose SimHash (see
+      * @ref crawled_page_set_simhash) is at most at this Hamming distance.
+      * Skipped pages are not returned in the request but keep their place
+      * in the schedule, so each cluster of duplicates is fetched about once
+      * per @ref FreqScheduler::near_dup_window.
+      */
+     int near_dup_distance;
+     /** Seconds since the crawl of a near duplicate during which a page is
+      * skipped */
+     float near_dup_window;
 } FreqScheduler;
 
 
@@ -75,7 +92,9 @@ freq_scheduler_new(FreqScheduler **sch, PageDB *db, const char *path);
  * @param freq_default This is a mandatory parameter. This is the frequency to
  *                     be used if no page change rate can be computed.
  * @param freq_scale   If positive pages will be crawled with frequency
- *                     freq_scale*page_change_rate. If negative this parameter is not
+ *                     freq_scale*page_change_rate. Pages crawled just once use
+ *                     the mean change rate of their domain (see
+ *                     @ref domain_info_rate). If negative this parameter is not
  *                     used and freq_default is used for all pages.
  */
 FreqSchedulerError
@@ -112,6 +131,22 @@ freq_scheduler_request(FreqScheduler *sch,
 FreqSchedulerError
 freq_scheduler_add(FreqScheduler *sch, const CrawledPage *page);
 
+/** Add several crawled pages with a single commit.
+ *
+ * See @ref page_db_add_batch.
+ *
+ * @return 0 if success, otherwise the error code
+ */
+FreqSchedulerError
+freq_scheduler_add_batch(FreqScheduler *sch, const CrawledPage **pages, size_t n_pages);
+
+/** Compact the schedule environment, see @ref txn_manager_compact.
+ *
+ * @return 0 if success, otherwise the error code
+ */
+FreqSchedulerError
+freq_scheduler_compact(FreqScheduler *sch);
+
 /** Delete scheduler.
  *
  * It may or may not delete associated disk files depending on the
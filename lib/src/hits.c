@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "metrics.h"
 #include "mmap_array.h"
 #include "hits.h"
 #include "util.h"
@@ -57,12 +58,16 @@ hits_new(Hits **hits, const char *path, size_t max_vertices) {
      p->precision = HITS_DEFAULT_PRECISION;
      p->persist = HITS_DEFAULT_PERSIST;
      p->scores = 0;
+     p->shard_size = HITS_DEFAULT_SHARD_SIZE;
+     p->use_weights = HITS_DEFAULT_USE_WEIGHTS;
+     p->shards = 0;
 
      char *error1 = 0;
      char *error2 = 0;
      p->path_h1 = build_path(path, "hits_h1.bin");
      p->path_h2 = build_path(path, "hits_h2.bin");
-     if (!p->path_h1 || !p->path_h2) {
+     p->path_shards = build_path(path, "hits_shards");
+     if (!p->path_h1 || !p->path_h2 || !p->path_shards) {
           error1 = "building file paths";
           goto on_error;
      }
@@ -138,9 +143,13 @@ hits_delete(Hits *hits) {
      } else if (mmap_array_delete(hits->a2) != 0) {
           error1 = "deleting a2";
           error2 = hits->a2->error->message;
+     } else if (link_shards_delete(hits->shards) != 0) {
+          error1 = "deleting shards";
+          error2 = hits->shards->error->message;
      } else {
           free(hits->path_h1);
           free(hits->path_h2);
+          free(hits->path_shards);
           error_delete(hits->error);
           free(hits);
           return 0;
@@ -189,11 +198,9 @@ hits_set_n_pages(Hits *hits, size_t n_pages) {
 static HitsError
 hits_loop(Hits *hits,
           void *stream_state,
-          LinkStreamNextFunc *link_stream_next
-     ) {
-     Link link;
-     int end_stream = 0;
-
+          LinkStreamNextBlockFunc *link_stream_next_block,
+          Link *links,
+          float *weights) {
      if (mmap_array_advise(hits->h2, MADV_SEQUENTIAL) != 0)
           return hits_error_internal;
      mmap_array_zero(hits->h2);
@@ -201,56 +208,122 @@ hits_loop(Hits *hits,
           return hits_error_internal;
      mmap_array_zero(hits->a2);
 
-     do {
-          switch(link_stream_next(stream_state, &link)) {
-          case stream_state_init:
-               break;
-          case stream_state_error:
-               return hits_error_internal;
-          case stream_state_end:
-               end_stream = 1;
-               break;
-          case stream_state_next:
+     size_t n_links;
+     StreamState state;
+     while ((state = link_stream_next_block(stream_state,
+                                            links, weights, LINK_STREAM_BLOCK_SIZE,
+                                            &n_links)) == stream_state_next) {
+          for (size_t i=0; i<n_links; ++i) {
+               const Link *link = links + i;
                // check if mmap array should be expanded
-               if (link.from >= (int64_t)hits->n_pages)
-                    if (hits_set_n_pages(hits, link.from + 1) != 0)
+               if (link->from >= (int64_t)hits->n_pages)
+                    if (hits_set_n_pages(hits, link->from + 1) != 0)
                          return hits_error_internal;
-               if (link.to >= (int64_t)hits->n_pages)
-                    if (hits_set_n_pages(hits, link.to + 1) != 0)
+               if (link->to >= (int64_t)hits->n_pages)
+                    if (hits_set_n_pages(hits, link->to + 1) != 0)
                          return hits_error_internal;
 
+               const float w = weights? weights[i]: 1.0;
                // hub[i] = sum(auth[j]) for all j such that i->j
-               float *s2 = mmap_array_idx(hits->h2, link.from);
-               float *s1 = mmap_array_idx(hits->a1, link.to);
+               float *s2 = mmap_array_idx(hits->h2, link->from);
+               float *s1 = mmap_array_idx(hits->a1, link->to);
+               // ignore links out of the known graph
                if (s1 && s2) {
                     if (hits->scores) {
-                         float *score = mmap_array_idx(hits->scores, link.to);
+                         float *score = mmap_array_idx(hits->scores, link->to);
                          if (score)
-                              *s2 += (*score)*(*s1);
+                              *s2 += w*(*score)*(*s1);
                     } else {
-                         *s2 += *s1;
+                         *s2 += w*(*s1);
                     }
                }
-#if 0 // ignore links out of the known graph
-               else {
-                    return hits_error_internal;
-               }
-#endif
 
                // auth[i] = sum(hub[j]) for all j such that j->i
-               s2 = mmap_array_idx(hits->a2, link.to);
-               s1 = mmap_array_idx(hits->h1, link.from);
+               s2 = mmap_array_idx(hits->a2, link->to);
+               s1 = mmap_array_idx(hits->h1, link->from);
                if (s1 && s2)
-                    *s2 += *s1;
-#if 0 // ignore links out of the known graph
-               else
-                    return hits_error_internal;
-               break;
-#endif
+                    *s2 += w*(*s1);
           }
-     } while (!end_stream);
+     }
+     if (state == stream_state_error)
+          return hits_error_internal;
+
+     return 0;
+}
+
+// Same as hits_loop but processing one shard at a time. The new authorities of
+// the shard destinations are accumulated in `slice`, while hubs are read and
+// written in increasing order.
+static HitsError
+hits_loop_shards(Hits *hits, Link *links, float *weights, float *slice) {
+     char *error1 = 0;
+     char *error2 = 0;
+
+     if (mmap_array_advise(hits->h2, MADV_SEQUENTIAL) != 0 ||
+         mmap_array_advise(hits->a2, MADV_SEQUENTIAL) != 0) {
+          error1 = "advising h2 and a2 on sequential access";
+          goto on_error;
+     }
+     mmap_array_zero(hits->h2);
+     mmap_array_zero(hits->a2);
+
+     size_t n_links;
+     for (size_t s=0; s<hits->shards->n_shards; ++s) {
+          const size_t begin = link_shards_begin(hits->shards, s);
+          const size_t end = link_shards_end(hits->shards, s);
+          memset(slice, 0, (end - begin)*sizeof(float));
 
+          if (link_shards_rewind(hits->shards, s) != 0) {
+               error1 = "rewinding shard";
+               error2 = hits->shards->error->message;
+               goto on_error;
+          }
+          StreamState state;
+          while ((state = link_shards_read(hits->shards, s,
+                                           links, weights, LINK_STREAM_BLOCK_SIZE,
+                                           &n_links)) == stream_state_next)
+               for (size_t i=0; i<n_links; ++i) {
+                    const Link *link = links + i;
+                    const float w = weights? weights[i]: 1.0;
+                    // hub[i] = sum(auth[j]) for all j such that i->j
+                    float *s2 = mmap_array_idx(hits->h2, link->from);
+                    float *s1 = mmap_array_idx(hits->a1, link->to);
+                    if (s1 && s2) {
+                         if (hits->scores) {
+                              float *score = mmap_array_idx(hits->scores, link->to);
+                              if (score)
+                                   *s2 += w*(*score)*(*s1);
+                         } else {
+                              *s2 += w*(*s1);
+                         }
+                    }
+                    // auth[i] = sum(hub[j]) for all j such that j->i
+                    s1 = mmap_array_idx(hits->h1, link->from);
+                    if (s1)
+                         slice[link->to - begin] += w*(*s1);
+               }
+          if (state == stream_state_error) {
+               error1 = "reading shard";
+               error2 = hits->shards->error->message;
+               goto on_error;
+          }
+          for (size_t i=begin; i<end; ++i) {
+               float *a2 = mmap_array_idx(hits->a2, i);
+               if (!a2) {
+                    error1 = "accessing a2";
+                    error2 = hits->a2->error->message;
+                    goto on_error;
+               }
+               *a2 = slice[i - begin];
+          }
+     }
      return 0;
+
+on_error:
+     hits_set_error(hits, hits_error_internal, __func__);
+     hits_add_error(hits, error1);
+     hits_add_error(hits, error2);
+     return hits->error->code;
 }
 
 static HitsError
@@ -335,17 +408,81 @@ on_error:
      return hits->error->code;
 }
 
-HitsError
-hits_compute(Hits *hits,
-             void *stream_state,
-             LinkStreamNextFunc *link_stream_next,
-             LinkStreamResetFunc *link_stream_reset) {
+static HitsError
+hits_compute_shards(Hits *hits,
+                    void *stream_state,
+                    LinkStreamNextBlockFunc *link_stream_next_block,
+                    Link *links,
+                    float *weights) {
+     char *error1 = 0;
+     char *error2 = 0;
+
+     float *slice = 0;
+
+     if (!hits->shards) {
+          if (link_shards_new(&hits->shards, hits->path_shards, hits->shard_size) != 0) {
+               error1 = "creating shards";
+               error2 = hits->shards? hits->shards->error->message: "NULL";
+               goto on_error;
+          }
+          hits->shards->persist = hits->persist;
+     }
+     hits->shards->shard_size = hits->shard_size;
+     hits->shards->weights = weights != 0;
+     if (link_shards_build(hits->shards, stream_state, link_stream_next_block) != 0) {
+          error1 = "building shards";
+          error2 = hits->shards->error->message;
+          goto on_error;
+     }
+     if (hits->shards->n_vertices > hits->n_pages &&
+         hits_set_n_pages(hits, hits->shards->n_vertices) != 0)
+          goto on_error_no_msg;
+
+     if (!(slice = malloc(hits->shard_size*sizeof(*slice)))) {
+          error1 = "allocating shard slice";
+          goto on_error;
+     }
+
+     float delta = hits->precision + 1.0;
+     size_t n_loops = 0;
+     while (delta > hits->precision) {
+          if (hits_loop_shards(hits, links, weights, slice) != 0 ||
+              hits_end_loop(hits, &delta) != 0)
+               goto on_error_no_msg;
+
+          ++n_loops;
+          metrics_count(metric_hits_loops, 1);
+          if (n_loops == hits->max_loops) {
+               free(slice);
+               return hits_error_precision;
+          }
+     }
+
+     free(slice);
+     return 0;
+
+on_error:
+     hits_set_error(hits, hits_error_internal, __func__);
+     hits_add_error(hits, error1);
+     hits_add_error(hits, error2);
+on_error_no_msg:
+     free(slice);
+     return hits->error->code;
+}
+
+static HitsError
+hits_compute_stream(Hits *hits,
+                    void *stream_state,
+                    LinkStreamNextBlockFunc *link_stream_next_block,
+                    LinkStreamResetFunc *link_stream_reset,
+                    Link *links,
+                    float *weights) {
      HitsError rc = 0;
 
      float delta = hits->precision + 1.0;
      size_t n_loops = 0;
      while (delta > hits->precision) {
-          if ((rc = hits_loop(hits, stream_state, link_stream_next)) != 0)
+          if ((rc = hits_loop(hits, stream_state, link_stream_next_block, links, weights)) != 0)
                return rc;
           if (link_stream_reset(stream_state) == stream_state_error)
                return hits_error_internal;
@@ -353,12 +490,39 @@ hits_compute(Hits *hits,
                return rc;
 
           ++n_loops;
+          metrics_count(metric_hits_loops, 1);
           if (n_loops == hits->max_loops)
                return hits_error_precision;
      }
      return 0;
 }
 
+HitsError
+hits_compute(Hits *hits,
+             void *stream_state,
+             LinkStreamNextBlockFunc *link_stream_next_block,
+             LinkStreamResetFunc *link_stream_reset) {
+     const uint64_t t0 = metrics_now();
+     Link *links = malloc(LINK_STREAM_BLOCK_SIZE*sizeof(*links));
+     // weights are only requested from the stream if they are used
+     float *weights = hits->use_weights?
+          malloc(LINK_STREAM_BLOCK_SIZE*sizeof(*weights)): 0;
+     if (!links || (hits->use_weights && !weights)) {
+          free(links);
+          free(weights);
+          hits_set_error(hits, hits_error_memory, __func__);
+          hits_add_error(hits, "allocating link block");
+          return hits->error->code;
+     }
+     HitsError rc = hits->shard_size > 0?
+          hits_compute_shards(hits, stream_state, link_stream_next_block, links, weights):
+          hits_compute_stream(hits, stream_state, link_stream_next_block, link_stream_reset, links, weights);
+     free(links);
+     free(weights);
+     metrics_record_since(metric_hits_compute, t0);
+     return rc;
+}
+
 HitsError
 hits_get_hub(const Hits *pr,
              size_t idx,
@@ -391,6 +555,8 @@ void
 hits_set_persist(Hits *hits, int value) {
      hits->persist = hits->h1->persist = hits->h2->persist =
           hits->a1->persist = hits->a2->persist = value;
+     if (hits->shards)
+          hits->shards->persist = value;
 }
 
 #if (defined TEST) && TEST
@@ -3,6 +3,7 @@
 
 #include "mmap_array.h"
 #include "link_stream.h"
+#include "link_shards.h"
 
 /** @addtogroup Hits
  * @{
@@ -18,6 +19,8 @@ typedef enum {
 #define HITS_DEFAULT_MAX_LOOPS 100   /**< Default @ref Hits::max_loops */
 #define HITS_DEFAULT_PRECISION 1e-4  /**< Default @ref Hits::precision */
 #define HITS_DEFAULT_PERSIST 0       /**< Default @ref Hits::persist */
+#define HITS_DEFAULT_SHARD_SIZE 0    /**< Default @ref Hits::shard_size */
+#define HITS_DEFAULT_USE_WEIGHTS 0   /**< Default @ref Hits::use_weights */
 
 /** Implementation of the HITS algorithm.
  *
@@ -50,6 +53,11 @@ typedef struct {
      char *path_h1;
      /** Path to mmap file of @ref Hits::h2 */
      char *path_h2;
+     /** Path to the directory of the out of core shards */
+     char *path_shards;
+
+     /** Links partitioned by destination, only used if @ref Hits::shard_size > 0 */
+     LinkShards *shards;
 
      /** Number of pages */
      size_t n_pages;
@@ -68,6 +76,13 @@ typedef struct {
      float precision;
      /** If true, do not delete files after deleting object*/
      int persist;
+     /** If greater than 0 links are first partitioned into @ref LinkShards
+      * of this number of pages and each iteration processes one shard at a
+      * time, keeping only a slice of the new authorities in memory */
+     size_t shard_size;
+     /** If true, hub and authority scores propagated through each link are
+      * multiplied by the link weight */
+     int use_weights;
 } Hits;
 
 /** Create a new structure.
@@ -95,11 +110,14 @@ hits_set_n_pages(Hits *hits, size_t n_pages);
 /** Compute HITS score for all pages.
  *
  * The algorithm makes random access of pages scores and sequential access of
- * the links.
+ * the links. If @ref Hits::shard_size is greater than 0 the link stream is
+ * read only once, to build the shards, and all further access is sequential.
  *
  * @param pr
  * @param link_stream_state For example @ref PageDBLinkStream
- * @param link_stream_next For example @ref page_db_link_stream_next
+ * @param link_stream_next_block For example @ref page_db_link_stream_next_block.
+ *        Streams returning one link at a time can be wrapped with
+ *        @ref LinkStreamBlockAdapter.
  * @param link_stream_reset For example @ref page_db_link_stream_reset
  *
  * @return 0 if success, otherwise an error code.
@@ -107,7 +125,7 @@ hits_set_n_pages(Hits *hits, size_t n_pages);
 HitsError
 hits_compute(Hits *hits,
              void *link_stream_state,
-             LinkStreamNextFunc *link_stream_next,
+             LinkStreamNextBlockFunc *link_stream_next_block,
              LinkStreamResetFunc *link_stream_reset);
 
 /** Get hub score associated to a given page.
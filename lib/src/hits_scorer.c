@@ -67,7 +67,7 @@ hits_scorer_update(void *state) {
 
      HitsError herr = hits_compute(hs->hits,
                                    st,
-                                   page_db_link_stream_next,
+                                   page_db_link_stream_next_block,
                                    page_db_link_stream_reset);
 
      // Inside a page scorer we allow some lack of precision
@@ -145,6 +145,16 @@ hits_scorer_set_use_content_scores(HitsScorer *hs, int value) {
      hs->use_content_scores = value;
 }
 
+void
+hits_scorer_set_shard_size(HitsScorer *hs, size_t value) {
+     hs->hits->shard_size = value;
+}
+
+void
+hits_scorer_set_use_weights(HitsScorer *hs, int value) {
+     hs->hits->use_weights = value;
+}
+
 
 #if (defined TEST) && TEST
 #include "CuTest.h"
@@ -84,6 +84,15 @@ hits_scorer_set_persist(HitsScorer *hs, int value);
 /** Sets @ref HitsScorer::use_content_scores */
 void
 hits_scorer_set_use_content_scores(HitsScorer *hs, int value);
+
+/** Sets @ref Hits::shard_size. If greater than 0 compute out of core */
+void
+hits_scorer_set_shard_size(HitsScorer *hs, size_t value);
+
+/** Sets @ref Hits::use_weights. Links must be stored with weights, see
+ * @ref PageDB::link_weights */
+void
+hits_scorer_set_use_weights(HitsScorer *hs, int value);
 /// @}
 
 #endif // __HITS_SCORER_H__
@@ -0,0 +1,163 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hll.h"
+
+/** Spread the bits of an item over 64 bits (the splitmix64 finalizer).
+ *
+ * Items are usually hashes already, but of only 32 bits and we need more to
+ * compute the ranks.
+ */
+static uint64_t
+hll_hash(uint32_t item) {
+     uint64_t h = item + 0x9E3779B97F4A7C15ULL;
+     h = (h ^ (h >> 30))*0xBF58476D1CE4E5B9ULL;
+     h = (h ^ (h >> 27))*0x94D049BB133111EBULL;
+     return h ^ (h >> 31);
+}
+
+/** Add the hash of an item to the registers */
+static int
+hll_add_dense(HLL *hll, uint32_t item) {
+     const uint64_t h = hll_hash(item);
+     const size_t i = h >> (64 - HLL_PRECISION);
+     // rank of the remaining bits, at most 64 - HLL_PRECISION + 1
+     uint64_t w = h << HLL_PRECISION;
+     uint8_t rank = 1;
+     while (rank <= 64 - HLL_PRECISION && !(w & (1ULL << 63))) {
+          w <<= 1;
+          ++rank;
+     }
+     if (hll->registers[i] >= rank)
+          return 0;
+     hll->registers[i] = rank;
+     return 1;
+}
+
+void
+hll_init(HLL *hll) {
+     hll->dense = 0;
+     hll->n_sparse = 0;
+}
+
+void
+hll_promote(HLL *hll) {
+     if (hll->dense)
+          return;
+     memset(hll->registers, 0, sizeof(hll->registers));
+     for (size_t i=0; i<hll->n_sparse; ++i)
+          hll_add_dense(hll, hll->sparse[i]);
+     hll->dense = 1;
+     hll->n_sparse = 0;
+}
+
+int
+hll_add(HLL *hll, uint32_t item) {
+     if (hll->dense)
+          return hll_add_dense(hll, item);
+
+     // insertion into the sorted list of items
+     size_t i = 0;
+     while (i < hll->n_sparse && hll->sparse[i] < item)
+          ++i;
+     if (i < hll->n_sparse && hll->sparse[i] == item)
+          return 0;
+     if (hll->n_sparse == HLL_SPARSE_MAX) {
+          hll_promote(hll);
+          hll_add_dense(hll, item);
+          return 1;
+     }
+     memmove(hll->sparse + i + 1,
+             hll->sparse + i,
+             (hll->n_sparse - i)*sizeof(*hll->sparse));
+     hll->sparse[i] = item;
+     ++hll->n_sparse;
+     return 1;
+}
+
+void
+hll_merge(HLL *hll, const HLL *other) {
+     if (!other->dense) {
+          for (size_t i=0; i<other->n_sparse; ++i)
+               hll_add(hll, other->sparse[i]);
+          return;
+     }
+     hll_promote(hll);
+     for (size_t i=0; i<HLL_REGISTERS; ++i)
+          if (other->registers[i] > hll->registers[i])
+               hll->registers[i] = other->registers[i];
+}
+
+float
+hll_count(const HLL *hll) {
+     if (!hll->dense)
+          return hll->n_sparse;
+
+     const double m = HLL_REGISTERS;
+     double sum = 0.0;
+     size_t zeros = 0;
+     for (size_t i=0; i<HLL_REGISTERS; ++i) {
+          sum += ldexp(1.0, -hll->registers[i]);
+          zeros += hll->registers[i] == 0;
+     }
+     const double alpha = 0.7213/(1.0 + 1.079/m);
+     const double estimate = alpha*m*m/sum;
+     // small range correction: linear counting of the empty registers
+     if (estimate <= 2.5*m && zeros > 0)
+          return m*log(m/zeros);
+     return estimate;
+}
+
+size_t
+hll_size(const HLL *hll) {
+     return 1 + (hll->dense?
+                 sizeof(hll->registers):
+                 hll->n_sparse*sizeof(*hll->sparse));
+}
+
+void
+hll_dump(const HLL *hll, void *buf) {
+     uint8_t *p = buf;
+     if (hll->dense) {
+          p[0] = HLL_DENSE;
+          memcpy(p + 1, hll->registers, sizeof(hll->registers));
+     } else {
+          p[0] = HLL_SPARSE;
+          memcpy(p + 1, hll->sparse, hll->n_sparse*sizeof(*hll->sparse));
+     }
+}
+
+int
+hll_load(HLL *hll, const void *buf, size_t size) {
+     const uint8_t *p = buf;
+     if (size < 1)
+          return -1;
+     switch (p[0]) {
+     case HLL_DENSE:
+          if (size != 1 + sizeof(hll->registers))
+               return -1;
+          hll->dense = 1;
+          hll->n_sparse = 0;
+          memcpy(hll->registers, p + 1, sizeof(hll->registers));
+          return 0;
+     case HLL_SPARSE:
+          if ((size - 1) % sizeof(*hll->sparse) != 0 ||
+              (size - 1)/sizeof(*hll->sparse) > HLL_SPARSE_MAX)
+               return -1;
+          hll->dense = 0;
+          hll->n_sparse = (size - 1)/sizeof(*hll->sparse);
+          memcpy(hll->sparse, p + 1, size - 1);
+          return 0;
+     default:
+          return -1;
+     }
+}
+
+#if (defined TEST) && TEST
+#include "test_hll.c"
+#endif // TEST
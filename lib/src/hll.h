@@ -0,0 +1,90 @@
+#ifndef __HLL_H__
+#define __HLL_H__
+
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** Number of bits of the item hash used to select a register */
+#define HLL_PRECISION 7
+/** Number of registers of a dense sketch, one byte each */
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+/** Maximum number of items of a sparse sketch. It takes the same space as a
+ * dense sketch. */
+#define HLL_SPARSE_MAX (HLL_REGISTERS/sizeof(uint32_t))
+
+#define HLL_SPARSE 0 /**< Tag of serialized sparse sketches */
+#define HLL_DENSE 1  /**< Tag of serialized dense sketches */
+
+/** HyperLogLog sketch of a set of 32 bit items.
+ *
+ * Small sets are stored sparse, as the sorted list of their items, and
+ * counted exactly. When the list grows past @ref HLL_SPARSE_MAX items the
+ * sketch is promoted to @ref HLL_REGISTERS dense registers, each holding the
+ * maximum rank (position of the first set bit) of the hashes that fall on it.
+ * The relative error of the dense estimate is around 1.04/sqrt(HLL_REGISTERS).
+ *
+ * The serialized form starts with a tag byte, @ref HLL_SPARSE or
+ * @ref HLL_DENSE, followed by the items or the registers, so that the sketch of
+ * a set with a few items takes only a few bytes.
+ */
+typedef struct {
+     int dense;       /**< If true the registers are used, otherwise the items */
+     size_t n_sparse; /**< Number of items of a sparse sketch */
+     uint32_t sparse[HLL_SPARSE_MAX]; /**< Sorted items of a sparse sketch */
+     uint8_t registers[HLL_REGISTERS]; /**< Registers of a dense sketch */
+} HLL;
+
+/// @addtogroup HLL
+/// @{
+
+/** Initialize an empty sparse sketch */
+void
+hll_init(HLL *hll);
+
+/** Convert into a dense sketch. Does nothing if already dense */
+void
+hll_promote(HLL *hll);
+
+/** Add an item.
+ *
+ * @return 1 if the sketch changed, 0 otherwise. Adding an item already
+ *         present never changes the sketch.
+ */
+int
+hll_add(HLL *hll, uint32_t item);
+
+/** Add all the items of another sketch */
+void
+hll_merge(HLL *hll, const HLL *other);
+
+/** Estimate the number of distinct items added */
+float
+hll_count(const HLL *hll);
+
+/** Number of bytes of the serialized sketch */
+size_t
+hll_size(const HLL *hll);
+
+/** Serialize sketch into buf, which must have at least @ref hll_size bytes */
+void
+hll_dump(const HLL *hll, void *buf);
+
+/** Load a serialized sketch.
+ *
+ * @return 0 if success, -1 if the data is malformed
+ */
+int
+hll_load(HLL *hll, const void *buf, size_t size);
+
+/// @}
+
+#if (defined TEST) && TEST
+#include "CuTest.h"
+CuSuite *
+test_hll_suite(void);
+#endif
+#endif // __HLL_H__
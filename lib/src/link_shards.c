@@ -0,0 +1,322 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "link_shards.h"
+#include "util.h"
+
+static void
+link_shards_set_error(LinkShards *ls, int code, const char *message) {
+     error_set(ls->error, code, message);
+}
+
+static void
+link_shards_add_error(LinkShards *ls, const char *message) {
+     error_add(ls->error, message);
+}
+
+LinkShardsError
+link_shards_new(LinkShards **ls, const char *path, size_t shard_size) {
+     LinkShards *p = *ls = calloc(1, sizeof(*p));
+     if (!p)
+          return link_shards_error_memory;
+     if (!(p->error = error_new())) {
+          free(p);
+          return link_shards_error_memory;
+     }
+     p->shard_size = shard_size > 0? shard_size: LINK_SHARDS_DEFAULT_SHARD_SIZE;
+     p->persist = LINK_SHARDS_DEFAULT_PERSIST;
+     p->weights = LINK_SHARDS_DEFAULT_WEIGHTS;
+
+     char *error = 0;
+     if (!(p->path = strdup(path))) {
+          link_shards_set_error(p, link_shards_error_memory, __func__);
+          return p->error->code;
+     }
+     if ((error = make_dir(p->path)) != 0) {
+          link_shards_set_error(p, link_shards_error_file, __func__);
+          link_shards_add_error(p, error);
+          return p->error->code;
+     }
+     return 0;
+}
+
+static LinkShardsError
+link_shards_flush(LinkShards *ls, LinkShard *shard) {
+     if (shard->n_buffer > 0 &&
+         fwrite(shard->buffer, sizeof(Link), shard->n_buffer, shard->file) != shard->n_buffer) {
+          link_shards_set_error(ls, link_shards_error_file, __func__);
+          link_shards_add_error(ls, strerror(errno));
+          return ls->error->code;
+     }
+     if (shard->n_buffer > 0 && shard->weight_file &&
+         fwrite(shard->weight_buffer, sizeof(float), shard->n_buffer, shard->weight_file) != shard->n_buffer) {
+          link_shards_set_error(ls, link_shards_error_file, __func__);
+          link_shards_add_error(ls, strerror(errno));
+          return ls->error->code;
+     }
+     shard->n_buffer = 0;
+     return 0;
+}
+
+/** Open (truncating) a new shard file and reserve its write buffer */
+static LinkShardsError
+link_shards_open_shard(LinkShards *ls, size_t i) {
+     LinkShard *shard = ls->shards + i;
+     char fname[64];
+     snprintf(fname, sizeof(fname), "shard_%zu.bin", i);
+     char wname[64];
+     snprintf(wname, sizeof(wname), "shard_%zu.weights", i);
+
+     char *error1 = 0;
+     char *error2 = 0;
+     if (!shard->path && !(shard->path = build_path(ls->path, fname))) {
+          error1 = "building shard path";
+          goto on_error;
+     }
+     if (shard->file)
+          fclose(shard->file);
+     if (!(shard->file = fopen(shard->path, "w+b"))) {
+          error1 = "opening shard file";
+          error2 = strerror(errno);
+          goto on_error;
+     }
+     if (!shard->buffer &&
+         !(shard->buffer = malloc(LINK_SHARDS_BUFFER_SIZE*sizeof(Link)))) {
+          error1 = "allocating write buffer";
+          goto on_error;
+     }
+     if (shard->weight_file) {
+          fclose(shard->weight_file);
+          shard->weight_file = 0;
+     }
+     if (shard->weight_path && !ls->weights)
+          remove(shard->weight_path);
+     if (ls->weights) {
+          if (!shard->weight_path && !(shard->weight_path = build_path(ls->path, wname))) {
+               error1 = "building weights path";
+               goto on_error;
+          }
+          if (!(shard->weight_file = fopen(shard->weight_path, "w+b"))) {
+               error1 = "opening weights file";
+               error2 = strerror(errno);
+               goto on_error;
+          }
+          if (!shard->weight_buffer &&
+              !(shard->weight_buffer = malloc(LINK_SHARDS_BUFFER_SIZE*sizeof(float)))) {
+               error1 = "allocating weights buffer";
+               goto on_error;
+          }
+     }
+     shard->n_links = 0;
+     shard->n_buffer = 0;
+     return 0;
+
+on_error:
+     link_shards_set_error(ls, link_shards_error_file, __func__);
+     link_shards_add_error(ls, error1);
+     link_shards_add_error(ls, error2);
+     return ls->error->code;
+}
+
+/** Make sure shards [0, n_shards) exist and are open for writing */
+static LinkShardsError
+link_shards_grow(LinkShards *ls, size_t n_shards) {
+     if (n_shards <= ls->n_shards)
+          return 0;
+     LinkShard *shards = realloc(ls->shards, n_shards*sizeof(*shards));
+     if (!shards) {
+          link_shards_set_error(ls, link_shards_error_memory, __func__);
+          return ls->error->code;
+     }
+     memset(shards + ls->n_shards, 0, (n_shards - ls->n_shards)*sizeof(*shards));
+     ls->shards = shards;
+     for (size_t i=ls->n_shards; i<n_shards; ++i) {
+          ls->n_shards = i + 1;
+          if (link_shards_open_shard(ls, i) != 0)
+               return ls->error->code;
+     }
+     return 0;
+}
+
+LinkShardsError
+link_shards_build(LinkShards *ls,
+                  void *link_stream_state,
+                  LinkStreamNextBlockFunc *link_stream_next_block) {
+     char *error1 = 0;
+     for (size_t i=0; i<ls->n_shards; ++i)
+          if (link_shards_open_shard(ls, i) != 0)
+               return ls->error->code;
+     ls->n_vertices = 0;
+     ls->n_links = 0;
+
+     Link *links = malloc(LINK_STREAM_BLOCK_SIZE*sizeof(*links));
+     float *weights = ls->weights?
+          malloc(LINK_STREAM_BLOCK_SIZE*sizeof(*weights)): 0;
+     if (!links || (ls->weights && !weights)) {
+          free(links);
+          free(weights);
+          link_shards_set_error(ls, link_shards_error_memory, __func__);
+          return ls->error->code;
+     }
+
+     size_t n_links;
+     StreamState state;
+     while ((state = link_stream_next_block(link_stream_state,
+                                            links, weights, LINK_STREAM_BLOCK_SIZE,
+                                            &n_links)) == stream_state_next) {
+          for (size_t j=0; j<n_links; ++j) {
+               const Link *link = links + j;
+               if (link->from < 0 || link->to < 0)
+                    continue;
+               if ((size_t)link->from >= ls->n_vertices)
+                    ls->n_vertices = link->from + 1;
+               if ((size_t)link->to >= ls->n_vertices)
+                    ls->n_vertices = link->to + 1;
+
+               size_t i = link->to/ls->shard_size;
+               if (link_shards_grow(ls, i + 1) != 0)
+                    goto on_error_no_msg;
+
+               LinkShard *shard = ls->shards + i;
+               if (weights)
+                    shard->weight_buffer[shard->n_buffer] = weights[j];
+               shard->buffer[shard->n_buffer++] = *link;
+               ++shard->n_links;
+               ++ls->n_links;
+               if (shard->n_buffer == LINK_SHARDS_BUFFER_SIZE &&
+                   link_shards_flush(ls, shard) != 0)
+                    goto on_error_no_msg;
+          }
+     }
+     if (state == stream_state_error) {
+          error1 = "getting next links";
+          goto on_error;
+     }
+
+     for (size_t i=0; i<ls->n_shards; ++i) {
+          if (link_shards_flush(ls, ls->shards + i) != 0)
+               goto on_error_no_msg;
+          if (fflush(ls->shards[i].file) != 0 ||
+              (ls->shards[i].weight_file && fflush(ls->shards[i].weight_file) != 0)) {
+               error1 = strerror(errno);
+               goto on_error;
+          }
+     }
+     free(links);
+     free(weights);
+     return 0;
+
+on_error:
+     link_shards_set_error(ls, link_shards_error_internal, __func__);
+     link_shards_add_error(ls, error1);
+on_error_no_msg:
+     free(links);
+     free(weights);
+     return ls->error->code;
+}
+
+size_t
+link_shards_begin(const LinkShards *ls, size_t shard) {
+     return shard*ls->shard_size;
+}
+
+size_t
+link_shards_end(const LinkShards *ls, size_t shard) {
+     size_t end = (shard + 1)*ls->shard_size;
+     return end < ls->n_vertices? end: ls->n_vertices;
+}
+
+LinkShardsError
+link_shards_rewind(LinkShards *ls, size_t shard) {
+     if (shard >= ls->n_shards) {
+          link_shards_set_error(ls, link_shards_error_internal, __func__);
+          link_shards_add_error(ls, "shard out of range");
+          return ls->error->code;
+     }
+     if (fseek(ls->shards[shard].file, 0, SEEK_SET) != 0 ||
+         (ls->shards[shard].weight_file &&
+          fseek(ls->shards[shard].weight_file, 0, SEEK_SET) != 0)) {
+          link_shards_set_error(ls, link_shards_error_file, __func__);
+          link_shards_add_error(ls, strerror(errno));
+          return ls->error->code;
+     }
+     return 0;
+}
+
+StreamState
+link_shards_read(LinkShards *ls,
+                 size_t shard,
+                 Link *links,
+                 float *weights,
+                 size_t max_links,
+                 size_t *n_links) {
+     *n_links = 0;
+     if (shard >= ls->n_shards) {
+          link_shards_set_error(ls, link_shards_error_internal, __func__);
+          link_shards_add_error(ls, "shard out of range");
+          return stream_state_error;
+     }
+     FILE *file = ls->shards[shard].file;
+     FILE *weight_file = ls->shards[shard].weight_file;
+     *n_links = fread(links, sizeof(Link), max_links, file);
+     if (*n_links == 0) {
+          if (ferror(file)) {
+               link_shards_set_error(ls, link_shards_error_file, __func__);
+               link_shards_add_error(ls, "reading shard");
+               return stream_state_error;
+          }
+          return stream_state_end;
+     }
+     if (weights && weight_file) {
+          if (fread(weights, sizeof(float), *n_links, weight_file) != *n_links) {
+               link_shards_set_error(ls, link_shards_error_file, __func__);
+               link_shards_add_error(ls, "reading shard weights");
+               return stream_state_error;
+          }
+     } else if (weights) {
+          for (size_t i=0; i<*n_links; ++i)
+               weights[i] = 1.0;
+     }
+     return stream_state_next;
+}
+
+LinkShardsError
+link_shards_delete(LinkShards *ls) {
+     if (!ls)
+          return 0;
+
+     for (size_t i=0; i<ls->n_shards; ++i) {
+          LinkShard *shard = ls->shards + i;
+          if (shard->file)
+               fclose(shard->file);
+          if (shard->path && !ls->persist)
+               remove(shard->path);
+          if (shard->weight_file)
+               fclose(shard->weight_file);
+          if (shard->weight_path && !ls->persist)
+               remove(shard->weight_path);
+          free(shard->path);
+          free(shard->buffer);
+          free(shard->weight_path);
+          free(shard->weight_buffer);
+     }
+     if (ls->path && !ls->persist)
+          rmdir(ls->path);
+     free(ls->shards);
+     free(ls->path);
+     error_delete(ls->error);
+     free(ls);
+     return 0;
+}
+
+#if (defined TEST) && TEST
+#include "test_link_shards.c"
+#endif // TEST
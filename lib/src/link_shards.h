@@ -0,0 +1,168 @@
+#ifndef __LINK_SHARDS_H__
+#define __LINK_SHARDS_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "link_stream.h"
+#include "util.h"
+
+/** @addtogroup LinkShards
+ *
+ * Out of core storage of the link graph, in the spirit of GraphChi and
+ * X-Stream.
+ *
+ * Links are streamed once from a @ref LinkStreamNextBlockFunc and appended to a set
+ * of shard files, partitioned by destination: shard `i` contains all links
+ * whose destination is in the interval [i*shard_size, (i + 1)*shard_size).
+ * Since links are appended in the order of the original stream (which for
+ * @ref PageDBLinkStream is the order of the source page) each shard is also
+ * sorted by source. If @ref LinkShards::weights is set the weight of each
+ * link is stored in a second file per shard, in the same order, so that
+ * unweighted shards keep 16 bytes per link.
+ *
+ * A scorer then processes one shard at a time: the slice of destination values
+ * fits in memory and both the shard file and the source values are read
+ * sequentially.
+ *
+ * @{
+ */
+
+typedef enum {
+     link_shards_error_ok = 0,  /**< No error */
+     link_shards_error_memory,  /**< Error allocating memory */
+     link_shards_error_file,    /**< Error reading or writing shard files */
+     link_shards_error_internal /**< Unexpected error */
+} LinkShardsError;
+
+/** Default value for @ref LinkShards::shard_size.
+ *
+ * With 4 byte floats this is a 16MB slice of destination values
+ */
+#define LINK_SHARDS_DEFAULT_SHARD_SIZE (1 << 22)
+/** Default value for @ref LinkShards::persist */
+#define LINK_SHARDS_DEFAULT_PERSIST 0
+/** Default value for @ref LinkShards::weights */
+#define LINK_SHARDS_DEFAULT_WEIGHTS 0
+/** Number of links buffered in memory for each shard while writing */
+#define LINK_SHARDS_BUFFER_SIZE 1024
+
+/** A single shard file */
+typedef struct {
+     /** Path to the shard file */
+     char *path;
+     /** Open shard file */
+     FILE *file;
+     /** Total number of links inside this shard */
+     size_t n_links;
+     /** Write buffer */
+     Link *buffer;
+     /** Number of links inside the write buffer */
+     size_t n_buffer;
+     /** Path to the file with the link weights */
+     char *weight_path;
+     /** Open file with the link weights, only if @ref LinkShards::weights */
+     FILE *weight_file;
+     /** Write buffer of the link weights */
+     float *weight_buffer;
+} LinkShard;
+
+typedef struct {
+     /** Directory where shard files are stored */
+     char *path;
+     /** Array of shards */
+     LinkShard *shards;
+     /** Number of shards */
+     size_t n_shards;
+     /** Number of vertices seen: 1 + largest source or destination index */
+     size_t n_vertices;
+     /** Total number of links */
+     size_t n_links;
+
+     /** Error status */
+     Error *error;
+
+// Options
+// -----------------------------------------------------------------------------
+     /** Number of destination vertices inside each shard */
+     size_t shard_size;
+     /** If true, do not delete files after deleting object */
+     int persist;
+     /** If true, @ref link_shards_build also stores the weight of each link */
+     int weights;
+} LinkShards;
+
+/** Create a new set of shards.
+ *
+ * @param ls The new structure is returned here.
+ * @param path Directory where the shard files will be stored. Created if necessary.
+ * @param shard_size Number of destination vertices for each shard. If 0 then
+ *                   @ref LINK_SHARDS_DEFAULT_SHARD_SIZE is used.
+ *
+ * @return 0 if success, otherwise an error code.
+ */
+LinkShardsError
+link_shards_new(LinkShards **ls, const char *path, size_t shard_size);
+
+/** Partition all the links of a stream into the shard files.
+ *
+ * Any previous content of the shards is discarded. The stream is consumed
+ * exactly once, and asked for weights only if @ref LinkShards::weights is set.
+ * Streams returning one link at a time can be wrapped with
+ * @ref LinkStreamBlockAdapter.
+ */
+LinkShardsError
+link_shards_build(LinkShards *ls,
+                  void *link_stream_state,
+                  LinkStreamNextBlockFunc *link_stream_next_block);
+
+/** First destination vertex of the given shard */
+size_t
+link_shards_begin(const LinkShards *ls, size_t shard);
+
+/** One past the last destination vertex of the given shard */
+size_t
+link_shards_end(const LinkShards *ls, size_t shard);
+
+/** Rewind a shard so that it can be read from the start with @ref link_shards_read */
+LinkShardsError
+link_shards_rewind(LinkShards *ls, size_t shard);
+
+/** Read the next block of links from a shard.
+ *
+ * @param ls
+ * @param shard Shard index
+ * @param links Output buffer
+ * @param weights Output buffer for the link weights, with the same capacity.
+ *                Can be NULL. If the shards were built without weights
+ *                they are set to 1.0.
+ * @param max_links Capacity of the output buffers
+ * @param n_links Number of links written to the output buffer
+ *
+ * @return stream_state_next while there are links left, stream_state_end when
+ *         the shard has been fully read and stream_state_error on failure.
+ */
+StreamState
+link_shards_read(LinkShards *ls,
+                 size_t shard,
+                 Link *links,
+                 float *weights,
+                 size_t max_links,
+                 size_t *n_links);
+
+/** Close files and free memory.
+ *
+ * Shard files are deleted unless @ref LinkShards::persist is true
+ */
+LinkShardsError
+link_shards_delete(LinkShards *ls);
+
+/// @}
+
+#if (defined TEST) && TEST
+#include "CuTest.h"
+CuSuite *
+test_link_shards_suite(void);
+#endif
+
+#endif // __LINK_SHARDS_H__
@@ -0,0 +1,42 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+
+#include "link_stream.h"
+
+StreamState
+link_stream_block_adapter_next_block(void *state,
+                                     Link *links,
+                                     float *weights,
+                                     size_t max_links,
+                                     size_t *n_links) {
+     LinkStreamBlockAdapter *adapter = (LinkStreamBlockAdapter*)state;
+     *n_links = 0;
+     while (*n_links < max_links) {
+          StreamState ss = adapter->next(adapter->state, links + *n_links);
+          if (ss == stream_state_init)
+               continue;
+          if (ss == stream_state_end)
+               break;
+          if (ss != stream_state_next) {
+               *n_links = 0;
+               return ss;
+          }
+          if (weights)
+               weights[*n_links] = 1.0;
+          ++(*n_links);
+     }
+     return *n_links > 0? stream_state_next: stream_state_end;
+}
+
+StreamState
+link_stream_block_adapter_reset(void *state) {
+     LinkStreamBlockAdapter *adapter = (LinkStreamBlockAdapter*)state;
+     return adapter->reset? adapter->reset(adapter->state): stream_state_error;
+}
+
+#if (defined TEST) && TEST
+#include "test_link_stream.c"
+#endif // TEST
@@ -1,16 +1,100 @@
 #ifndef __LINK_STREAM_H__
 #define __LINK_STREAM_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "util.h"
 
+/// @addtogroup LinkStream
+/// @{
+
+/** A link between two pages.
+ *
+ * Weights, when needed, are returned in a separate array by
+ * @ref LinkStreamNextBlockFunc so that streams and shards of unweighted links
+ * do not pay for them.
+ */
 typedef struct {
      int64_t from;
      int64_t to;
 } Link;
 
+/** Number of links that consumers of a @ref LinkStreamNextBlockFunc
+ *  request on each call */
+#define LINK_STREAM_BLOCK_SIZE 1024
+
+/** Get the next link */
 typedef StreamState (LinkStreamNextFunc)(void *state, Link *link);
+
+/** Get the next block of links.
+ *
+ * @param state Stream state
+ * @param links Output buffer
+ * @param weights Output buffer for the weight of each link, with the same
+ *                capacity. If NULL weights are not returned. Streams without
+ *                weights set them to 1.0.
+ * @param max_links Capacity of the output buffers
+ * @param n_links Number of links written to the output buffer
+ *
+ * @return stream_state_next if at least one link was written. Once the stream
+ *         is exhausted returns stream_state_end and sets n_links to 0.
+ */
+typedef StreamState (LinkStreamNextBlockFunc)(void *state,
+                                               Link *links,
+                                               float *weights,
+                                               size_t max_links,
+                                               size_t *n_links);
+
+/** Rewind the stream to the first link */
 typedef StreamState (LinkStreamResetFunc)(void *state);
 
+/** Adapts a stream that returns one link at a time to the block interface.
+ *
+ * @ref page_rank_compute, @ref hits_compute and @ref link_shards_build only
+ * accept a @ref LinkStreamNextBlockFunc. Streams written against the former
+ * @ref LinkStreamNextFunc interface can still be used wrapping them:
+ *
+ * @code
+ * LinkStreamBlockAdapter adapter = {
+ *      .state = my_state, .next = my_next, .reset = my_reset
+ * };
+ * page_rank_compute(pr, &adapter,
+ *                   link_stream_block_adapter_next_block,
+ *                   link_stream_block_adapter_reset);
+ * @endcode
+ */
+typedef struct {
+     void *state;                /**< State of the wrapped stream */
+     LinkStreamNextFunc *next;   /**< Next function of the wrapped stream */
+     LinkStreamResetFunc *reset; /**< Reset function of the wrapped stream,
+                                    can be NULL if never rewound */
+} LinkStreamBlockAdapter;
+
+/** @ref LinkStreamNextBlockFunc of a @ref LinkStreamBlockAdapter.
+ *
+ * Weights are always 1.0. A wrapped stream can return stream_state_init
+ * before its first link, as the single link consumers used to skip it.
+ * Errors of the wrapped stream are returned as is, dropping the links
+ * already read for the block.
+ */
+StreamState
+link_stream_block_adapter_next_block(void *state,
+                                     Link *links,
+                                     float *weights,
+                                     size_t max_links,
+                                     size_t *n_links);
+
+/** @ref LinkStreamResetFunc of a @ref LinkStreamBlockAdapter */
+StreamState
+link_stream_block_adapter_reset(void *state);
+
+/// @}
+
+#if (defined TEST) && TEST
+#include "CuTest.h"
+CuSuite *
+test_link_stream_suite(void);
+#endif
+
 #endif // __LINK_STREAM_H__
@@ -0,0 +1,145 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "linking_domains_scorer.h"
+#include "mmap_array.h"
+#include "page_db.h"
+#include "util.h"
+
+static void
+linking_domains_scorer_set_error(LinkingDomainsScorer *lds, int code, const char *message) {
+     error_set(lds->error, code, message);
+}
+
+static void
+linking_domains_scorer_add_error(LinkingDomainsScorer *lds, const char *message) {
+     error_add(lds->error, message);
+}
+
+LinkingDomainsScorerError
+linking_domains_scorer_new(LinkingDomainsScorer **lds, PageDB *db) {
+     LinkingDomainsScorer *p = *lds = calloc(1, sizeof(*p));
+     if (!p)
+          return linking_domains_scorer_error_memory;
+     if (!(p->error = error_new())) {
+          free(p);
+          return linking_domains_scorer_error_memory;
+     }
+     p->page_db = db;
+     page_db_set_track_linking_domains(db, 1);
+
+     char *error1 = 0;
+     char *error2 = 0;
+
+     char *pscores_new = build_path(db->path, "linking_domains_1.bin");
+     char *pscores_old = build_path(db->path, "linking_domains_2.bin");
+     if (!pscores_new || !pscores_old) {
+          error1 = "building file paths";
+          goto on_error;
+     }
+     if (mmap_array_new(&p->scores_new, pscores_new, 1, sizeof(float)) != 0) {
+          error1 = "creating scores array";
+          error2 = p->scores_new? p->scores_new->error->message: "memory error";
+          goto on_error;
+     }
+     if (mmap_array_new(&p->scores_old, pscores_old, 1, sizeof(float)) != 0) {
+          error1 = "creating scores array";
+          error2 = p->scores_old? p->scores_old->error->message: "memory error";
+          goto on_error;
+     }
+     mmap_array_zero(p->scores_new);
+     mmap_array_zero(p->scores_old);
+
+     free(pscores_new);
+     free(pscores_old);
+     return 0;
+
+on_error:
+     free(pscores_new);
+     free(pscores_old);
+     linking_domains_scorer_set_error(p, linking_domains_scorer_error_internal, __func__);
+     linking_domains_scorer_add_error(p, error1);
+     linking_domains_scorer_add_error(p, error2);
+     return p->error->code;
+}
+
+int
+linking_domains_scorer_update(void *state) {
+     LinkingDomainsScorer *lds = (LinkingDomainsScorer*)state;
+
+     // the scores of the last update become the old ones
+     MMapArray *scores = lds->scores_old;
+     lds->scores_old = lds->scores_new;
+     lds->scores_new = scores;
+
+     if (page_db_get_linking_domains_counts(lds->page_db, scores) != 0) {
+          linking_domains_scorer_set_error(lds, linking_domains_scorer_error_internal, __func__);
+          linking_domains_scorer_add_error(lds, "retrieving linking domains");
+          linking_domains_scorer_add_error(lds, lds->page_db->error->message);
+          return lds->error->code;
+     }
+
+     float *value = (float*)scores->mem;
+     float max_count = 0.0;
+     for (size_t i=0; i<scores->n_elements; ++i)
+          if (value[i] > max_count)
+               max_count = value[i];
+     lds->max_count = max_count;
+
+     if (max_count > 0.0) {
+          const float norm = 1.0/log1pf(max_count);
+          for (size_t i=0; i<scores->n_elements; ++i)
+               value[i] = log1pf(value[i])*norm;
+     }
+     return 0;
+}
+
+int
+linking_domains_scorer_add(void *state, const PageInfo *page_info, float *score) {
+     (void)state;
+     (void)page_info;
+     *score = 0.0;
+     return 0;
+}
+
+int
+linking_domains_scorer_get(void *state, size_t idx, float *score_old, float *score_new) {
+     LinkingDomainsScorer *lds = (LinkingDomainsScorer*)state;
+     // pages added after the updates have no score yet
+     *score_old = idx < lds->scores_old->n_elements?
+          *(float*)mmap_array_idx(lds->scores_old, idx): 0.0;
+     *score_new = idx < lds->scores_new->n_elements?
+          *(float*)mmap_array_idx(lds->scores_new, idx): 0.0;
+     return 0;
+}
+
+void
+linking_domains_scorer_setup(LinkingDomainsScorer *lds, Scorer *scorer) {
+     scorer->state = (void*)lds;
+     scorer->add = linking_domains_scorer_add;
+     scorer->get = linking_domains_scorer_get;
+     scorer->update = linking_domains_scorer_update;
+}
+
+LinkingDomainsScorerError
+linking_domains_scorer_delete(LinkingDomainsScorer *lds) {
+     if (!lds)
+          return 0;
+     if ((lds->scores_new && mmap_array_delete(lds->scores_new) != 0) ||
+         (lds->scores_old && mmap_array_delete(lds->scores_old) != 0)) {
+          linking_domains_scorer_set_error(lds, linking_domains_scorer_error_internal, __func__);
+          linking_domains_scorer_add_error(lds, "deleting scores arrays");
+          return lds->error->code;
+     }
+     error_delete(lds->error);
+     free(lds);
+     return 0;
+}
+
+#if (defined TEST) && TEST
+#include "test_linking_domains_scorer.c"
+#endif // TEST
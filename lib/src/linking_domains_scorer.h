@@ -0,0 +1,88 @@
+#ifndef __LINKING_DOMAINS_SCORER_H__
+#define __LINKING_DOMAINS_SCORER_H__
+
+#include "mmap_array.h"
+#include "page_db.h"
+#include "scorer.h"
+#include "util.h"
+
+/** @addtogroup LinkingDomainsScorer
+ *
+ * Scores pages by the number of distinct domains linking to them, as
+ * estimated by the sketches that @ref PageDB maintains when
+ * @ref PageDB::track_linking_domains is set.
+ *
+ * There is no iterative computation: each update is a single scan of the
+ * sketches. The score of a page is log(1 + n)/log(1 + n_max) where n is its
+ * number of linking domains and n_max the maximum among all pages.
+ *
+ * @{
+ */
+
+typedef enum {
+     linking_domains_scorer_error_ok = 0,   /**< No error */
+     linking_domains_scorer_error_memory,   /**< Error allocating memory */
+     linking_domains_scorer_error_internal  /**< Unexpected error */
+} LinkingDomainsScorerError;
+
+typedef struct {
+     /** Database with crawl information */
+     PageDB *page_db;
+
+     /** Scores computed by the last call to @ref linking_domains_scorer_update */
+     MMapArray *scores_new;
+     /** Scores computed by the previous call to @ref linking_domains_scorer_update */
+     MMapArray *scores_old;
+
+     /** Maximum number of linking domains found by the last update */
+     float max_count;
+
+     /** Error status */
+     Error *error;
+} LinkingDomainsScorer;
+
+/** Create new scorer.
+ *
+ * It also enables @ref PageDB::track_linking_domains.
+ */
+LinkingDomainsScorerError
+linking_domains_scorer_new(LinkingDomainsScorer **lds, PageDB *db);
+
+/** Add new page to scorer. New pages get score 0 until the next update.
+ *
+ * Function signature complies with @ref Scorer::add
+ */
+int
+linking_domains_scorer_add(void *state, const PageInfo *page_info, float *score);
+
+/** Get score of the previous and last updates.
+ *
+ * Function signature complies with @ref Scorer::get
+ */
+int
+linking_domains_scorer_get(void *state, size_t idx, float *score_old, float *score_new);
+
+/** Recompute scores from the current sketches.
+ *
+ * Function signature complies with @ref Scorer::update
+ */
+int
+linking_domains_scorer_update(void *state);
+
+/** Given a @ref Scorer fill its fields with the necessary info */
+void
+linking_domains_scorer_setup(LinkingDomainsScorer *lds, Scorer *scorer);
+
+/** Delete scorer and its files */
+LinkingDomainsScorerError
+linking_domains_scorer_delete(LinkingDomainsScorer *lds);
+
+/// @}
+
+#if (defined TEST) && TEST
+#include "CuTest.h"
+CuSuite *
+test_linking_domains_scorer_suite(void);
+#endif
+
+#endif // __LINKING_DOMAINS_SCORER_H__
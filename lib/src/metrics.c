@@ -0,0 +1,203 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+
+typedef struct {
+     uint64_t count;
+     uint64_t sum;
+     uint64_t max;
+     uint64_t buckets[METRICS_N_BUCKETS];
+} Histogram;
+
+static const char *counter_names[METRIC_N_COUNTERS] = {
+     [metric_page_db_add_pages]       = "page_db_add_pages",
+     [metric_page_db_add_links]       = "page_db_add_links",
+     [metric_page_db_add_link_bytes]  = "page_db_add_link_bytes",
+     [metric_page_db_pruned]          = "page_db_pruned",
+     [metric_txn_manager_resizes]     = "txn_manager_resizes",
+     [metric_bf_scheduler_requests]   = "bf_scheduler_requests",
+     [metric_bf_scheduler_updates]    = "bf_scheduler_updates",
+     [metric_freq_scheduler_requests] = "freq_scheduler_requests",
+     [metric_page_rank_loops]         = "page_rank_loops",
+     [metric_hits_loops]              = "hits_loops",
+};
+
+static const char *histogram_names[METRIC_N_HISTOGRAMS] = {
+     [metric_page_db_add]               = "page_db_add",
+     [metric_page_db_prune]             = "page_db_prune",
+     [metric_txn_manager_begin_read]    = "txn_manager_begin_read",
+     [metric_txn_manager_begin_write]   = "txn_manager_begin_write",
+     [metric_txn_manager_commit]        = "txn_manager_commit",
+     [metric_txn_manager_expand]        = "txn_manager_expand",
+     [metric_txn_manager_resize_stall]  = "txn_manager_resize_stall",
+     [metric_txn_manager_compact_stall] = "txn_manager_compact_stall",
+     [metric_bf_scheduler_request]      = "bf_scheduler_request",
+     [metric_bf_scheduler_update_batch] = "bf_scheduler_update_batch",
+     [metric_freq_scheduler_request]    = "freq_scheduler_request",
+     [metric_page_rank_compute]         = "page_rank_compute",
+     [metric_hits_compute]              = "hits_compute",
+};
+
+static uint64_t counters[METRIC_N_COUNTERS];
+static Histogram histograms[METRIC_N_HISTOGRAMS];
+static int enabled = 1;
+
+uint64_t
+metrics_now(void) {
+     struct timespec t;
+     clock_gettime(CLOCK_MONOTONIC, &t);
+     return (uint64_t)t.tv_sec*1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+/** Values below 2*METRICS_SUB_BUCKETS have their own bucket. Above that,
+ * values sharing the METRICS_SUB_BUCKET_BITS + 1 most significant bits share
+ * a bucket.
+ */
+static size_t
+metrics_bucket(uint64_t value) {
+     if (value < 2*METRICS_SUB_BUCKETS)
+          return value;
+     const int shift = 63 - __builtin_clzll(value) - METRICS_SUB_BUCKET_BITS;
+     return (size_t)shift*METRICS_SUB_BUCKETS + (value >> shift);
+}
+
+/** Largest value that falls inside the bucket */
+static uint64_t
+metrics_bucket_value(size_t bucket) {
+     if (bucket < 2*METRICS_SUB_BUCKETS)
+          return bucket;
+     const size_t shift = bucket/METRICS_SUB_BUCKETS - 1;
+     const uint64_t q = bucket - shift*METRICS_SUB_BUCKETS;
+     return ((q + 1) << shift) - 1;
+}
+
+void
+metrics_count(MetricCounter counter, uint64_t n) {
+     if (!__atomic_load_n(&enabled, __ATOMIC_RELAXED))
+          return;
+     __atomic_fetch_add(&counters[counter], n, __ATOMIC_RELAXED);
+}
+
+void
+metrics_record(MetricHistogram histogram, uint64_t value) {
+     if (!__atomic_load_n(&enabled, __ATOMIC_RELAXED))
+          return;
+     Histogram *h = &histograms[histogram];
+     __atomic_fetch_add(&h->buckets[metrics_bucket(value)], 1, __ATOMIC_RELAXED);
+     __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+     __atomic_fetch_add(&h->sum, value, __ATOMIC_RELAXED);
+     uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+     while (value > max &&
+            !__atomic_compare_exchange_n(&h->max, &max, value, 1,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+          ;
+}
+
+void
+metrics_record_since(MetricHistogram histogram, uint64_t t0) {
+     metrics_record(histogram, metrics_now() - t0);
+}
+
+void
+metrics_set_enabled(int value) {
+     __atomic_store_n(&enabled, value, __ATOMIC_RELAXED);
+}
+
+static void
+metrics_histogram_snapshot(const Histogram *h, MetricsHistogramSnapshot *s) {
+     uint64_t buckets[METRICS_N_BUCKETS];
+     uint64_t count = 0;
+     for (size_t i=0; i<METRICS_N_BUCKETS; ++i)
+          count += buckets[i] = __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+
+     s->count = count;
+     s->sum = __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+     s->max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+     const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+     uint64_t *values[] = {&s->p50, &s->p90, &s->p99, &s->p999};
+     size_t q = 0;
+     uint64_t seen = 0;
+     for (size_t i=0; i<METRICS_N_BUCKETS && q < 4; ++i) {
+          seen += buckets[i];
+          while (q < 4 && count > 0 && seen >= quantiles[q]*count) {
+               const uint64_t v = metrics_bucket_value(i);
+               *values[q++] = v < s->max? v: s->max;
+          }
+     }
+     for (; q < 4; ++q)
+          *values[q] = 0;
+}
+
+void
+metrics_snapshot(MetricsSnapshot *snapshot) {
+     for (size_t i=0; i<METRIC_N_COUNTERS; ++i) {
+          snapshot->counters[i].name = counter_names[i];
+          snapshot->counters[i].value = __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+     }
+     for (size_t i=0; i<METRIC_N_HISTOGRAMS; ++i) {
+          snapshot->histograms[i].name = histogram_names[i];
+          metrics_histogram_snapshot(&histograms[i], &snapshot->histograms[i]);
+     }
+}
+
+void
+metrics_reset(void) {
+     for (size_t i=0; i<METRIC_N_COUNTERS; ++i)
+          __atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+     for (size_t i=0; i<METRIC_N_HISTOGRAMS; ++i) {
+          Histogram *h = &histograms[i];
+          __atomic_store_n(&h->count, 0, __ATOMIC_RELAXED);
+          __atomic_store_n(&h->sum, 0, __ATOMIC_RELAXED);
+          __atomic_store_n(&h->max, 0, __ATOMIC_RELAXED);
+          for (size_t j=0; j<METRICS_N_BUCKETS; ++j)
+               __atomic_store_n(&h->buckets[j], 0, __ATOMIC_RELAXED);
+     }
+}
+
+int
+metrics_write_text(FILE *output) {
+     MetricsSnapshot s;
+     metrics_snapshot(&s);
+
+     for (size_t i=0; i<METRIC_N_COUNTERS; ++i)
+          if (fprintf(output,
+                      "# TYPE aduana_%s counter\n"
+                      "aduana_%s %" PRIu64 "\n",
+                      s.counters[i].name,
+                      s.counters[i].name, s.counters[i].value) < 0)
+               return -1;
+
+     for (size_t i=0; i<METRIC_N_HISTOGRAMS; ++i) {
+          const MetricsHistogramSnapshot *h = &s.histograms[i];
+          if (fprintf(output,
+                      "# TYPE aduana_%s_seconds summary\n"
+                      "aduana_%s_seconds{quantile=\"0.5\"} %.9f\n"
+                      "aduana_%s_seconds{quantile=\"0.9\"} %.9f\n"
+                      "aduana_%s_seconds{quantile=\"0.99\"} %.9f\n"
+                      "aduana_%s_seconds{quantile=\"0.999\"} %.9f\n"
+                      "aduana_%s_seconds{quantile=\"1\"} %.9f\n"
+                      "aduana_%s_seconds_sum %.9f\n"
+                      "aduana_%s_seconds_count %" PRIu64 "\n",
+                      h->name,
+                      h->name, 1e-9*h->p50,
+                      h->name, 1e-9*h->p90,
+                      h->name, 1e-9*h->p99,
+                      h->name, 1e-9*h->p999,
+                      h->name, 1e-9*h->max,
+                      h->name, 1e-9*h->sum,
+                      h->name, h->count) < 0)
+               return -1;
+     }
+     return 0;
+}
+
+#if (defined TEST) && TEST
+#include "test_metrics.c"
+#endif // TEST
@@ -0,0 +1,127 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+/** @addtogroup Metrics
+ *
+ * Process wide counters and latency histograms.
+ *
+ * All metrics are static and updated with atomic operations, so recording
+ * is cheap and never blocks. Histograms are log-linear, as in HdrHistogram:
+ * each power of two is divided in @ref METRICS_SUB_BUCKETS linear buckets,
+ * which bounds the relative error of the percentiles to
+ * 1/@ref METRICS_SUB_BUCKETS.
+ *
+ * Latencies are recorded in nanoseconds, see @ref metrics_now.
+ * @{
+ */
+
+/** Log2 of the number of linear buckets per power of two */
+#define METRICS_SUB_BUCKET_BITS 4
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BUCKET_BITS)
+/** Number of buckets to hold any uint64_t */
+#define METRICS_N_BUCKETS ((64 - METRICS_SUB_BUCKET_BITS + 1)*METRICS_SUB_BUCKETS)
+
+typedef enum {
+     metric_page_db_add_pages,       /**< Crawled pages added to @ref PageDB */
+     metric_page_db_add_links,       /**< Links of the added pages */
+     metric_page_db_add_link_bytes,  /**< Bytes of link records written */
+     metric_page_db_pruned,          /**< Pages deleted by @ref page_db_prune */
+     metric_txn_manager_resizes,     /**< Number of times the mmap was enlarged */
+     metric_bf_scheduler_requests,   /**< URLs returned by @ref bf_scheduler_request */
+     metric_bf_scheduler_updates,    /**< Pages visited by the update thread */
+     metric_freq_scheduler_requests, /**< URLs returned by @ref freq_scheduler_request */
+     metric_page_rank_loops,         /**< PageRank iterations */
+     metric_hits_loops,              /**< HITS iterations */
+     METRIC_N_COUNTERS
+} MetricCounter;
+
+typedef enum {
+     metric_page_db_add,               /**< @ref page_db_add_batch */
+     metric_page_db_prune,             /**< @ref page_db_prune */
+     metric_txn_manager_begin_read,    /**< Beginning a read transaction */
+     metric_txn_manager_begin_write,   /**< Beginning a write transaction, includes
+                                          waiting for the write lock */
+     metric_txn_manager_commit,        /**< @ref txn_manager_commit */
+     metric_txn_manager_expand,        /**< @ref txn_manager_expand, even if no resize */
+     metric_txn_manager_resize_stall,  /**< Time new transactions are blocked by a
+                                          resize */
+     metric_txn_manager_compact_stall, /**< Time write transactions are blocked
+                                          by @ref txn_manager_compact */
+     metric_bf_scheduler_request,      /**< @ref bf_scheduler_request */
+     metric_bf_scheduler_update_batch, /**< One batch of the update thread */
+     metric_freq_scheduler_request,    /**< @ref freq_scheduler_request */
+     metric_page_rank_compute,         /**< @ref page_rank_compute */
+     metric_hits_compute,              /**< @ref hits_compute */
+     METRIC_N_HISTOGRAMS
+} MetricHistogram;
+
+typedef struct {
+     const char *name;
+     uint64_t value;
+} MetricsCounterSnapshot;
+
+/** Summary of a histogram. All values in the units recorded */
+typedef struct {
+     const char *name;
+     uint64_t count;
+     uint64_t sum;
+     uint64_t max;
+     uint64_t p50;
+     uint64_t p90;
+     uint64_t p99;
+     uint64_t p999;
+} MetricsHistogramSnapshot;
+
+typedef struct {
+     MetricsCounterSnapshot counters[METRIC_N_COUNTERS];
+     MetricsHistogramSnapshot histograms[METRIC_N_HISTOGRAMS];
+} MetricsSnapshot;
+
+/** Monotonic time in nanoseconds */
+uint64_t
+metrics_now(void);
+
+/** Add n to a counter */
+void
+metrics_count(MetricCounter counter, uint64_t n);
+
+/** Record a value inside a histogram */
+void
+metrics_record(MetricHistogram histogram, uint64_t value);
+
+/** Record the time elapsed since t0, as returned by @ref metrics_now */
+void
+metrics_record_since(MetricHistogram histogram, uint64_t t0);
+
+/** Enable or disable recording. Enabled by default */
+void
+metrics_set_enabled(int value);
+
+/** Copy the current value of all metrics.
+ *
+ * Metrics keep being updated while the snapshot is taken, so the values of
+ * different metrics may not be exactly consistent with each other.
+ */
+void
+metrics_snapshot(MetricsSnapshot *snapshot);
+
+/** Set all metrics to zero */
+void
+metrics_reset(void);
+
+/** Write all metrics in the Prometheus text format */
+int
+metrics_write_text(FILE *output);
+
+/// @}
+
+#if (defined TEST) && TEST
+#include "CuTest.h"
+CuSuite *
+test_metrics_suite(void);
+#endif
+
+#endif // __METRICS_H__
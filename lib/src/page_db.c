@@ -2,7 +2,6 @@
 #define _BSD_SOURCE 1
 #define _GNU_SOURCE 1
 
-#include <errno.h>
 #include <inttypes.h>
 #include <limits.h>
 #ifdef __APPLE__
@@ -22,7 +21,9 @@
 #include "xxhash.h"
 
 #include "page_db.h"
+#include "page_db_private.h"
 #include "hits.h"
+#include "metrics.h"
 #include "page_rank.h"
 #include "txn_manager.h"
 #include "util.h"
@@ -39,6 +40,11 @@ page_links_new(void) {
           free(pl);
           return 0;
      }
+     if (!(pl->arena = arena_new(0))) {
+          free(pl->link_info);
+          free(pl);
+          return 0;
+     }
      pl->n_links = 0;
      pl->m_links = PAGE_LINKS_MIN_LINKS;
      return pl;
@@ -48,13 +54,31 @@ page_links_new(void) {
 static void
 page_links_delete(PageLinks *pl) {
      if (pl) {
-          for (size_t i=0; i<pl->n_links; ++i)
-               free(pl->link_info[i].url);
+          arena_delete(pl->arena);
           free(pl->link_info);
           free(pl);
      }
 }
 
+/** Make room for at least n_links more links.
+ *
+ * @return 0 if success, -1 if failure
+ */
+static int
+page_links_reserve(PageLinks *pl, size_t n_links) {
+     size_t m_links = pl->m_links;
+     while (m_links < pl->n_links + n_links)
+          m_links *= 2;
+     if (m_links != pl->m_links) {
+          void *p = realloc(pl->link_info, m_links*sizeof(LinkInfo));
+          if (!p)
+               return -1;
+          pl->link_info = p;
+          pl->m_links = m_links;
+     }
+     return 0;
+}
+
 /** Add a new @ref LinkInfo inside.
  *
  * Makes a copy of the URL.
@@ -72,7 +96,7 @@ page_links_add_link(PageLinks *pl, const char *url, float score) {
           pl->m_links *= 2;
      }
      pl->link_info[pl->n_links].score = score;
-     if (!(pl->link_info[pl->n_links].url = strdup(url)))
+     if (!(pl->link_info[pl->n_links].url = arena_strdup(pl->arena, url)))
           return -1;
 
      pl->n_links++;
@@ -91,7 +115,7 @@ crawled_page_new(const char *url) {
           return 0;
      }
 
-     if (!(cp->url = strdup(url))) {
+     if (!(cp->url = arena_strdup(cp->links->arena, url))) {
           page_links_delete(cp->links);
           free(cp);
           return 0;
@@ -105,10 +129,24 @@ crawled_page_new(const char *url) {
      return cp;
 }
 
+int
+crawled_page_reset(CrawledPage *cp, const char *url) {
+     cp->links->n_links = 0;
+     if (arena_reset(cp->links->arena) != 0 ||
+         !(cp->url = arena_strdup(cp->links->arena, url)))
+          return -1;
+     cp->time = difftime(time(0), 0);
+     cp->score = 0.0;
+     // keep the memory, set_hash reallocates when the length changes
+     cp->content_hash_length = 0;
+     cp->simhash = 0;
+     cp->has_simhash = 0;
+     return 0;
+}
+
 void
 crawled_page_delete(CrawledPage *cp) {
      if (cp) {
-          free(cp->url);
           page_links_delete(cp->links);
           free(cp->content_hash);
           free(cp);
@@ -141,11 +179,43 @@ crawled_page_set_hash32(CrawledPage *cp, uint32_t hash) {
      return crawled_page_set_hash(cp, (char*)&hash, sizeof(hash));
 }
 
+void
+crawled_page_set_simhash(CrawledPage *cp, uint64_t simhash) {
+     cp->simhash = simhash;
+     cp->has_simhash = 1;
+}
+
 int
 crawled_page_add_link(CrawledPage *cp, const char *url, float score) {
      return page_links_add_link(cp->links, url, score);
 }
 
+int
+crawled_page_add_links(CrawledPage *cp,
+                       const char *urls,
+                       const size_t *offsets,
+                       const float *scores,
+                       size_t n_links) {
+     // URLs are used as C strings, where a null byte would cut them short
+     if (n_links > 0 &&
+         memchr(urls + offsets[0], '\0', offsets[n_links] - offsets[0]) != 0)
+          return -1;
+     PageLinks *pl = cp->links;
+     if (page_links_reserve(pl, n_links) != 0)
+          return -1;
+     for (size_t i=0; i<n_links; ++i) {
+          char *url = arena_strndup(
+               pl->arena, urls + offsets[i], offsets[i + 1] - offsets[i]);
+          if (!url)
+               return -1;
+
+          LinkInfo *link = pl->link_info + pl->n_links++;
+          link->url = url;
+          link->score = scores? scores[i]: 0.0;
+     }
+     return 0;
+}
+
 size_t
 crawled_page_n_links(const CrawledPage *cp) {
      return cp->links->n_links;
@@ -279,17 +349,19 @@ page_info_update(PageInfo *pi, const CrawledPage *cp) {
 /** Serialize the PageInfo into a contiguos block of memory.
  *
  * Note that enough new memory will be allocated inside val.mv_data to contain
- * the results of the dump. This memory should be freed when no longer is
- * necessary (for example after an mdb_cursor_put).
+ * the results of the dump. If arena is NULL this memory should be freed when
+ * no longer is necessary (for example after an mdb_cursor_put), otherwise it
+ * is taken from the arena.
  *
  * @param pi The PageInfo to be serialized
  * @param val The destination of the serialization. Should have no memory
  *            allocated inside mv_data since new memory will be allocated.
+ * @param arena If not NULL, where memory is allocated
  *
  * @return 0 if success, -1 if failure.
  */
 static int
-page_info_dump(const PageInfo *pi, MDB_val *val) {
+page_info_dump_arena(const PageInfo *pi, MDB_val *val, Arena *arena) {
      /* To save space we apply the following 'compression' method:
         1. If n_crawls > 1 all data is saved
         2. If n_crawls = 1 we have the following constraints:
@@ -322,7 +394,8 @@ page_info_dump(const PageInfo *pi, MDB_val *val) {
      }
 
      size_t url_size = strlen(pi->url);
-     char *data = val->mv_data = malloc(val->mv_size + 4*url_size);
+     const size_t max_size = val->mv_size + 4*url_size;
+     char *data = val->mv_data = arena? arena_alloc(arena, max_size): malloc(max_size);
      if (!data)
           return -1;
 
@@ -355,6 +428,11 @@ page_info_dump(const PageInfo *pi, MDB_val *val) {
      return 0;
 }
 
+int
+page_info_dump(const PageInfo *pi, MDB_val *val) {
+     return page_info_dump_arena(pi, val, 0);
+}
+
 // fast retrieval of just the score associated with the page
 static float
 page_info_dump_get_score(MDB_val *val) {
@@ -364,12 +442,7 @@ page_info_dump_get_score(MDB_val *val) {
      return *((float*)data);
 }
 
-/** Create a new PageInfo loading the information from a previously
- * dumped PageInfo inside val.
- *
- * @return pointer to the new PageInfo or NULL if failure
- */
-static PageInfo *
+PageInfo *
 page_info_load(const MDB_val *val) {
      PageInfo *pi = calloc(1, sizeof(*pi));
      if (!pi)
@@ -462,10 +535,38 @@ page_info_list_new(PageInfo *pi, uint64_t hash) {
      pil->hash = hash;
      pil->page_info = pi;
      pil->next = 0;
+     pil->arena = 0;
 
      return pil;
 }
 
+/** Add to the head of an arena backed list a copy of the PageInfo.
+ *
+ * @return A pointer to the first element of the list, or NULL if failure
+ */
+static PageInfoList *
+page_info_list_cons_copy(PageInfoList *pil, Arena *arena, const PageInfo *pi, uint64_t hash) {
+     PageInfoList *node = arena_alloc(arena, sizeof(*node));
+     PageInfo *copy = arena_alloc(arena, sizeof(*copy));
+     if (!node || !copy)
+          return 0;
+
+     *copy = *pi;
+     if (!(copy->url = arena_strdup(arena, pi->url)))
+          return 0;
+     copy->content_hash = 0;
+     if (pi->content_hash_length > 0) {
+          if (!(copy->content_hash = arena_alloc(arena, pi->content_hash_length)))
+               return 0;
+          memcpy(copy->content_hash, pi->content_hash, pi->content_hash_length);
+     }
+     node->hash = hash;
+     node->page_info = copy;
+     node->next = pil;
+     node->arena = arena;
+     return node;
+}
+
 PageInfoList *
 page_info_list_cons(PageInfoList *pil, PageInfo *pi, uint64_t hash) {
      PageInfoList *pil_new = page_info_list_new(pi, hash);
@@ -479,6 +580,12 @@ page_info_list_cons(PageInfoList *pil, PageInfo *pi, uint64_t hash) {
 
 void
 page_info_list_delete(PageInfoList *pil) {
+     if (!pil)
+          return;
+     if (pil->arena) {
+          arena_delete(pil->arena);
+          return;
+     }
      PageInfoList *next;
      do {
           next = pil->next;
@@ -497,6 +604,24 @@ page_info_list_delete(PageInfoList *pil) {
  * crawled or not. It is used to assign new IDs
  */
 static char info_n_pages[] = "n_pages";
+/** Version of the format of the links database, see
+ * @ref PAGE_DB_LINKS_FORMAT_VERSION. Databases created before this key
+ * existed use format 0.
+ */
+static char info_links_format[] = "links_format";
+/** Present if the domains database is up to date with the rest of the
+ * databases. Databases created before the domains database existed must be
+ * rebuilt, see @ref page_db_rebuild_domains.
+ */
+static char info_domains[] = "domains";
+/** While converting the links database to a new format, index of the last
+ * converted page. It allows to resume an interrupted conversion.
+ */
+static char info_links_upgrade[] = "links_upgrade";
+
+/** Number of pages whose links are converted inside each write transaction
+ * when upgrading the links format */
+#define PAGE_DB_LINKS_UPGRADE_BATCH 10000
 
 
 uint64_t
@@ -541,52 +666,576 @@ page_db_open_cursor(MDB_txn *txn,
      return mdb_rc;
 }
 
-static int
+int
 page_db_open_hash2info(MDB_txn *txn, MDB_cursor **cursor) {
      return page_db_open_cursor(
           txn, "hash2info", MDB_INTEGERKEY, cursor, 0);
 }
 
-static int
+int
 page_db_open_hash2idx(MDB_txn *txn, MDB_cursor **cursor) {
      return page_db_open_cursor(
           txn, "hash2idx", MDB_INTEGERKEY, cursor, 0);
 }
 
-static int
+int
 page_db_open_links(MDB_txn *txn, MDB_cursor **cursor) {
      return page_db_open_cursor(
           txn, "links", MDB_INTEGERKEY, cursor, 0);
 }
 
-static int
+int
 page_db_open_info(MDB_txn *txn, MDB_cursor **cursor) {
      return page_db_open_cursor(txn, "info", 0, cursor, 0);
 }
 
+int
+page_db_open_domains(MDB_txn *txn, MDB_cursor **cursor) {
+     return page_db_open_cursor(
+          txn, "domains", MDB_INTEGERKEY, cursor, 0);
+}
 
-static void
+int
+page_db_open_simhash(MDB_txn *txn, MDB_cursor **cursor) {
+     return page_db_open_cursor(
+          txn, "simhash", MDB_INTEGERKEY, cursor, 0);
+}
+
+int
+page_db_open_simhash_lsh(MDB_txn *txn, MDB_cursor **cursor) {
+     return page_db_open_cursor(
+          txn, "simhash_lsh",
+          MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP,
+          cursor, 0);
+}
+
+int
+page_db_open_page_hll(MDB_txn *txn, MDB_cursor **cursor) {
+     return page_db_open_cursor(
+          txn, "page_hll", MDB_INTEGERKEY, cursor, 0);
+}
+
+int
+page_db_open_domain_hll(MDB_txn *txn, MDB_cursor **cursor) {
+     return page_db_open_cursor(
+          txn, "domain_hll", MDB_INTEGERKEY, cursor, 0);
+}
+
+int
+page_db_info_get_n_pages(MDB_cursor *cur_info, size_t *n_pages) {
+     MDB_val key = {
+          .mv_size = sizeof(info_n_pages),
+          .mv_data = info_n_pages
+     };
+     MDB_val val;
+     int mdb_rc = mdb_cursor_get(cur_info, &key, &val, MDB_SET);
+     if (mdb_rc == 0)
+          *n_pages = *(size_t*)val.mv_data;
+     return mdb_rc;
+}
+
+int
+page_db_info_set_domains(MDB_cursor *cur_info) {
+     uint32_t has_domains = 1;
+     MDB_val key = {
+          .mv_size = sizeof(info_domains),
+          .mv_data = info_domains
+     };
+     MDB_val val = {
+          .mv_size = sizeof(has_domains),
+          .mv_data = &has_domains
+     };
+     return mdb_cursor_put(cur_info, &key, &val, 0);
+}
+
+
+void
 page_db_set_error(PageDB *db, int code, const char *message) {
      error_set(db->error, code, message);
 }
 
-static void
+void
 page_db_add_error(PageDB *db, const char *message) {
      error_add(db->error, message);
 }
 
-/** Doubles database size.
- *
- * This function is automatically called when an operation cannot proceed because
- * of insufficient allocated mmap memory.
- */
-static PageDBError
+PageDBError
+page_db_stream_open(PageDB *db,
+                    int (*open_cursor)(MDB_txn *txn, MDB_cursor **cursor),
+                    MDB_cursor **cur,
+                    const char *func) {
+     MDB_txn *txn;
+     int mdb_rc = 0;
+     char *error = 0;
+
+     *cur = 0;
+     if (txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn) != 0)
+          error = db->txn_manager->error->message;
+     else if ((mdb_rc = open_cursor(txn, cur)) != 0) {
+          txn_manager_abort(db->txn_manager, txn);
+          error = "opening cursor";
+     }
+     if (error) {
+          page_db_set_error(db, page_db_error_internal, func);
+          page_db_add_error(db, error);
+          if (mdb_rc != 0)
+               page_db_add_error(db, mdb_strerror(mdb_rc));
+          return db->error->code;
+     }
+     return 0;
+}
+
+void
+page_db_stream_close(PageDB *db, MDB_cursor *cur) {
+     if (cur) {
+          MDB_txn *txn = mdb_cursor_txn(cur);
+          mdb_cursor_close(cur);
+          txn_manager_abort(db->txn_manager, txn);
+     }
+}
+
+PageDBError
 page_db_expand(PageDB *db) {
      if (txn_manager_expand(db->txn_manager, 0) != 0) {
           page_db_set_error(db, page_db_error_internal, __func__);
           page_db_add_error(db, db->txn_manager->error->message);
      }
-     return db->error->code;
+     return db->error->code;
+}
+
+static int
+page_db_links_cmp(const void *a, const void *b) {
+     const uint64_t x = *(const uint64_t*)a;
+     const uint64_t y = *(const uint64_t*)b;
+     return x < y? -1: x > y;
+}
+
+static uint64_t
+page_db_zigzag_encode(int64_t x) {
+     return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63);
+}
+
+static int64_t
+page_db_zigzag_decode(uint64_t x) {
+     return (int64_t)(x >> 1) ^ -(int64_t)(x & 1);
+}
+
+/** Quantize a link score into 4 bits, see @ref PAGE_DB_LINKS_WEIGHTED */
+static uint8_t
+page_db_link_weight_quantize(float score) {
+     if (!(score > 0)) // also catches NaN
+          return 0;
+     if (score >= 1.0)
+          return 15;
+     return (uint8_t)(score*16.0);
+}
+
+static float
+page_db_link_weight(uint8_t q) {
+     return ((q & 0xF) + 1)/16.0;
+}
+
+/** Sort links, moving the quantized weights (if present) together with the
+ * indices */
+static void
+page_db_links_sort(uint64_t *ids, uint8_t *q, size_t n) {
+     if (!q) {
+          qsort(ids, n, sizeof(*ids), page_db_links_cmp);
+     } else {
+          // indices are much smaller than 2^60, pack the weight in the low bits
+          for (size_t i=0; i<n; ++i)
+               ids[i] = (ids[i] << 4) | (q[i] & 0xF);
+          qsort(ids, n, sizeof(*ids), page_db_links_cmp);
+          for (size_t i=0; i<n; ++i) {
+               q[i] = ids[i] & 0xF;
+               ids[i] >>= 4;
+          }
+     }
+}
+
+/** Encode the links of a page using the current links format.
+ *
+ * Links are sorted in place inside each group.
+ *
+ * @param from Index of the page
+ * @param diff Indices of links to a different domain
+ * @param diff_q Quantized weights of the links in diff, or NULL if the links
+ *               have no weights
+ * @param n_diff
+ * @param same Indices of links to the same domain
+ * @param same_q Quantized weights of the links in same, or NULL
+ * @param n_same
+ * @param val The output value. Its data is allocated and must be freed.
+ *
+ * @return 0 if success, -1 if memory error
+ */
+static int
+page_db_links_encode(uint64_t from,
+                     uint64_t *diff, uint8_t *diff_q, size_t n_diff,
+                     uint64_t *same, uint8_t *same_q, size_t n_same,
+                     MDB_val *val) {
+     page_db_links_sort(diff, diff_q, n_diff);
+     page_db_links_sort(same, same_q, n_same);
+
+     const int weighted = diff_q != 0 && same_q != 0;
+     const size_t n_to = n_diff + n_same;
+     uint32_t *deltas = malloc((n_to + 1)*sizeof(*deltas));
+     uint8_t *buf = val->mv_data =
+          malloc(1 + 2*MAX_VARINT_SIZE + (n_to + 1)/2 +
+                 SVB_MAX_SIZE(n_to) + MAX_VARINT_SIZE*n_to);
+     if (!deltas || !buf) {
+          free(deltas);
+          free(buf);
+          val->mv_data = 0;
+          return -1;
+     }
+
+     int svb = 1;
+     uint64_t prev = from;
+     for (size_t i=0; i<n_to && svb; ++i) {
+          const uint64_t to = i < n_diff? diff[i]: same[i - n_diff];
+          const uint64_t zz = page_db_zigzag_encode((int64_t)to - (int64_t)prev);
+          if (zz > UINT32_MAX)
+               svb = 0;
+          deltas[i] = zz;
+          prev = to;
+     }
+     *(buf++) = (svb? PAGE_DB_LINKS_SVB: PAGE_DB_LINKS_VARINT) |
+          (weighted? PAGE_DB_LINKS_WEIGHTED: 0);
+     buf = varint_encode_uint64(n_diff, buf);
+     if (svb || weighted)
+          buf = varint_encode_uint64(n_to, buf);
+     if (weighted) {
+          for (size_t i=0; i<n_to; i += 2) {
+               const uint8_t q1 = i < n_diff? diff_q[i]: same_q[i - n_diff];
+               uint8_t q2 = 0;
+               if (i + 1 < n_to)
+                    q2 = i + 1 < n_diff? diff_q[i + 1]: same_q[i + 1 - n_diff];
+               *(buf++) = (q1 & 0xF) | (q2 << 4);
+          }
+     }
+     if (svb) {
+          buf = svb_encode_uint32(deltas, n_to, buf);
+     } else {
+          prev = from;
+          for (size_t i=0; i<n_to; ++i) {
+               const uint64_t to = i < n_diff? diff[i]: same[i - n_diff];
+               buf = varint_encode_int64((int64_t)to - (int64_t)prev, buf);
+               prev = to;
+          }
+     }
+     val->mv_size = buf - (uint8_t*)val->mv_data;
+     free(deltas);
+     return 0;
+}
+
+/** Make room for n links inside the decoding buffers of the stream */
+static int
+page_db_link_stream_reserve(PageDBLinkStream *es, size_t n) {
+     if (n > es->m_to) {
+          uint64_t *to = realloc(es->to, n*sizeof(*to));
+          if (!to)
+               return -1;
+          es->to = to;
+          float *weights = realloc(es->weights, n*sizeof(*weights));
+          if (!weights)
+               return -1;
+          es->weights = weights;
+          es->m_to = n;
+     }
+     if (n > es->m_deltas) {
+          uint32_t *deltas = realloc(es->deltas, n*sizeof(*deltas));
+          if (!deltas)
+               return -1;
+          es->deltas = deltas;
+          es->m_deltas = n;
+     }
+     return 0;
+}
+
+int
+page_db_links_decode(PageDBLinkStream *es,
+                     uint64_t from,
+                     const MDB_val *val,
+                     int format,
+                     int only_diff_domain) {
+     uint8_t *pos = (uint8_t*)val->mv_data;
+     uint8_t *end = pos + val->mv_size;
+
+     es->from = from;
+     es->i_to = 0;
+     es->n_to = 0;
+     es->n_diff = 0;
+     if (pos == end)
+          return format > 0? -1: 0;
+
+     const int tag = format > 0? *(pos++): PAGE_DB_LINKS_VARINT;
+     const int weighted = tag & PAGE_DB_LINKS_WEIGHTED;
+
+     uint8_t read = 0;
+     es->n_diff = varint_decode_uint64(pos, &read);
+     pos += read;
+
+     size_t n = end - pos; // upper bound, each varint takes at least 1 byte
+     if ((tag & ~PAGE_DB_LINKS_WEIGHTED) == PAGE_DB_LINKS_SVB || weighted) {
+          n = varint_decode_uint64(pos, &read);
+          pos += read;
+     }
+     size_t n_decode = n;
+     if (only_diff_domain && n_decode > es->n_diff)
+          n_decode = es->n_diff;
+     if (page_db_link_stream_reserve(es, n) != 0)
+          return -1;
+
+     if (weighted) {
+          if ((size_t)(end - pos) < (n + 1)/2)
+               return -1;
+          for (size_t i=0; i<n_decode; ++i)
+               es->weights[i] = page_db_link_weight(pos[i/2] >> (4*(i%2)));
+          pos += (n + 1)/2;
+     }
+
+     uint64_t id = from;
+     switch (tag & ~PAGE_DB_LINKS_WEIGHTED) {
+     case PAGE_DB_LINKS_SVB:
+          // the control bytes of all the n values come before the data, so
+          // all of them must be decoded even if only the first are needed
+          if (n > 0 && svb_decode_uint32(pos, end - pos, n, es->deltas) == 0)
+               return -1;
+          for (size_t i=0; i<n_decode; ++i)
+               es->to[i] = id += page_db_zigzag_decode(es->deltas[i]);
+          es->n_to = n_decode;
+          break;
+     case PAGE_DB_LINKS_VARINT:
+          while (pos < end && es->n_to < n_decode) {
+               es->to[es->n_to++] = id += varint_decode_int64(pos, &read);
+               pos += read;
+          }
+          break;
+     default:
+          return -1;
+     }
+     if (!weighted)
+          for (size_t i=0; i<es->n_to; ++i)
+               es->weights[i] = 1.0;
+     return 0;
+}
+
+/** Convert all values of the links database to the current format.
+ *
+ * Conversion is made in batches, each one inside its own write transaction,
+ * and progress is recorded inside the info database so that an interrupted
+ * conversion can be resumed.
+ */
+static PageDBError
+page_db_upgrade_links(PageDB *db) {
+     PageDBLinkStream *es = calloc(1, sizeof(*es));
+     if (!es) {
+          page_db_set_error(db, page_db_error_memory, __func__);
+          return db->error->code;
+     }
+
+     MDB_txn *txn = 0;
+     MDB_cursor *cur_links = 0;
+     MDB_cursor *cur_info = 0;
+     MDB_val key;
+     MDB_val val;
+     MDB_val new_val = {0, 0};
+
+     int mdb_rc = 0;
+     char *error = 0;
+
+     uint64_t next = 0;
+     int done = 0;
+     while (!done) {
+          if (page_db_expand(db) != 0)
+               goto on_error_no_msg;
+
+          if ((txn_manager_begin(db->txn_manager, 0, &txn)) != 0) {
+               error = db->txn_manager->error->message;
+               goto on_error;
+          }
+          if ((mdb_rc = page_db_open_links(txn, &cur_links)) != 0) {
+               error = "opening links cursor";
+               goto on_error;
+          }
+          if ((mdb_rc = page_db_open_info(txn, &cur_info)) != 0) {
+               error = "opening info cursor";
+               goto on_error;
+          }
+
+          // resume a previous conversion
+          key.mv_size = sizeof(info_links_upgrade);
+          key.mv_data = info_links_upgrade;
+          switch (mdb_rc = mdb_cursor_get(cur_info, &key, &val, MDB_SET)) {
+          case 0:
+               next = *(uint64_t*)val.mv_data + 1;
+               break;
+          case MDB_NOTFOUND:
+               break;
+          default:
+               error = "retrieving info.links_upgrade";
+               goto on_error;
+          }
+
+          key.mv_size = sizeof(uint64_t);
+          key.mv_data = &next;
+          mdb_rc = mdb_cursor_get(cur_links, &key, &val, MDB_SET_RANGE);
+          for (size_t n=0; mdb_rc == 0 && n < PAGE_DB_LINKS_UPGRADE_BATCH; ++n) {
+               uint64_t from = *(uint64_t*)key.mv_data;
+               if (page_db_links_decode(es, from, &val, 0, 0) != 0) {
+                    error = "decoding links";
+                    goto on_error;
+               }
+               if (page_db_links_encode(from,
+                                        es->to, 0, es->n_diff,
+                                        es->to + es->n_diff, 0, es->n_to - es->n_diff,
+                                        &new_val) != 0) {
+                    error = "encoding links";
+                    goto on_error;
+               }
+               key.mv_size = sizeof(uint64_t);
+               key.mv_data = &from;
+               if ((mdb_rc = mdb_cursor_put(cur_links, &key, &new_val, 0)) != 0) {
+                    error = "storing links";
+                    goto on_error;
+               }
+               free(new_val.mv_data);
+               new_val.mv_data = 0;
+
+               next = from + 1;
+               mdb_rc = mdb_cursor_get(cur_links, &key, &val, MDB_NEXT);
+          }
+
+          switch (mdb_rc) {
+          case 0: { // batch finished, record progress
+               uint64_t last = next - 1;
+               key.mv_size = sizeof(info_links_upgrade);
+               key.mv_data = info_links_upgrade;
+               val.mv_size = sizeof(uint64_t);
+               val.mv_data = &last;
+               if ((mdb_rc = mdb_cursor_put(cur_info, &key, &val, 0)) != 0) {
+                    error = "storing info.links_upgrade";
+                    goto on_error;
+               }
+               break;
+          }
+          case MDB_NOTFOUND: { // all converted
+               uint32_t format = PAGE_DB_LINKS_FORMAT_VERSION;
+               key.mv_size = sizeof(info_links_format);
+               key.mv_data = info_links_format;
+               val.mv_size = sizeof(uint32_t);
+               val.mv_data = &format;
+               if ((mdb_rc = mdb_cursor_put(cur_info, &key, &val, 0)) != 0) {
+                    error = "storing info.links_format";
+                    goto on_error;
+               }
+               key.mv_size = sizeof(info_links_upgrade);
+               key.mv_data = info_links_upgrade;
+               if ((mdb_rc = mdb_cursor_get(cur_info, &key, &val, MDB_SET)) == 0)
+                    mdb_rc = mdb_cursor_del(cur_info, 0);
+               if (mdb_rc != 0 && mdb_rc != MDB_NOTFOUND) {
+                    error = "deleting info.links_upgrade";
+                    goto on_error;
+               }
+               mdb_rc = 0;
+               done = 1;
+               break;
+          }
+          default:
+               error = "iterating links";
+               goto on_error;
+          }
+          mdb_cursor_close(cur_links);
+          mdb_cursor_close(cur_info);
+          cur_links = cur_info = 0;
+          if (txn_manager_commit(db->txn_manager, txn) != 0) {
+               txn = 0;
+               error = db->txn_manager->error->message;
+               goto on_error;
+          }
+          txn = 0;
+     }
+     page_db_link_stream_delete(es);
+     return 0;
+
+on_error:
+     page_db_set_error(db, page_db_error_internal, __func__);
+     page_db_add_error(db, error);
+     if (mdb_rc != 0)
+          page_db_add_error(db, mdb_strerror(mdb_rc));
+on_error_no_msg:
+     free(new_val.mv_data);
+     if (cur_links)
+          mdb_cursor_close(cur_links);
+     if (cur_info)
+          mdb_cursor_close(cur_info);
+     if (txn)
+          txn_manager_abort(db->txn_manager, txn);
+     page_db_link_stream_delete(es);
+     return db->error->code;
+}
+
+/** Initialize the info database if empty and check the links format.
+ *
+ * @param links_format Output, the version of the links format of the database.
+ * @param has_domains Output, true if the domains database is up to date
+ * @return 0 if success, otherwise an LMDB error code
+ */
+static int
+page_db_init_info(MDB_txn *txn, MDB_dbi dbi_info, MDB_dbi dbi_links,
+                  uint32_t *links_format, int *has_domains) {
+     int mdb_rc;
+     // initialize n_pages inside info database
+     size_t n_pages = 0;
+     MDB_val key = {
+          .mv_size = sizeof(info_n_pages),
+          .mv_data = info_n_pages
+     };
+     MDB_val val = {
+          .mv_size = sizeof(size_t),
+          .mv_data = &n_pages
+     };
+     mdb_rc = mdb_put(txn, dbi_info, &key, &val, MDB_NOOVERWRITE);
+     if (mdb_rc != 0 && mdb_rc != MDB_KEYEXIST)
+          return mdb_rc;
+
+     key.mv_size = sizeof(info_domains);
+     key.mv_data = info_domains;
+     switch (mdb_rc = mdb_get(txn, dbi_info, &key, &val)) {
+     case 0:
+          *has_domains = 1;
+          break;
+     case MDB_NOTFOUND:
+          *has_domains = 0;
+          break;
+     default:
+          return mdb_rc;
+     }
+
+     key.mv_size = sizeof(info_links_format);
+     key.mv_data = info_links_format;
+     switch (mdb_rc = mdb_get(txn, dbi_info, &key, &val)) {
+     case 0:
+          *links_format = *(uint32_t*)val.mv_data;
+          return 0;
+     case MDB_NOTFOUND: {
+          // an empty links database can be written directly in the current format
+          MDB_stat stat;
+          if ((mdb_rc = mdb_stat(txn, dbi_links, &stat)) != 0)
+               return mdb_rc;
+          if (stat.ms_entries > 0) {
+               *links_format = 0;
+               return 0;
+          }
+          *links_format = PAGE_DB_LINKS_FORMAT_VERSION;
+          val.mv_size = sizeof(uint32_t);
+          val.mv_data = links_format;
+          return mdb_put(txn, dbi_info, &key, &val, 0);
+     }
+     default:
+          return mdb_rc;
+     }
 }
 
 PageDBError
@@ -601,7 +1250,15 @@ page_db_new(PageDB **db, const char *path) {
           return page_db_error_memory;
      }
      p->persist = PAGE_DB_DEFAULT_PERSIST;
+     p->link_weights = PAGE_DB_DEFAULT_LINK_WEIGHTS;
+     p->track_linking_domains = PAGE_DB_DEFAULT_TRACK_LINKING_DOMAINS;
      p->domain_temp = 0;
+     if (!(p->scratch = arena_new(0))) {
+          error_delete(p->error);
+          free(p);
+          *db = 0;
+          return page_db_error_memory;
+     }
 
      // create directory if not present yet
      const char *error = make_dir(path);
@@ -625,13 +1282,16 @@ page_db_new(PageDB **db, const char *path) {
      // initialize LMDB on the directory
      MDB_txn *txn;
      MDB_dbi dbi;
+     MDB_dbi dbi_links;
+     uint32_t links_format = PAGE_DB_LINKS_FORMAT_VERSION;
+     int has_domains = 1;
      int mdb_rc = 0;
      if ((mdb_rc = mdb_env_create(&p->txn_manager->env) != 0))
           error = "creating environment";
      else if ((mdb_rc = mdb_env_set_mapsize(
                     p->txn_manager->env, PAGE_DB_DEFAULT_SIZE)) != 0)
           error = "setting map size";
-     else if ((mdb_rc = mdb_env_set_maxdbs(p->txn_manager->env, 5)) != 0)
+     else if ((mdb_rc = mdb_env_set_maxdbs(p->txn_manager->env, PAGE_DB_MAX_DBS)) != 0)
           error = "setting number of databases";
      else if ((mdb_rc = mdb_env_open(
                     p->txn_manager->env,
@@ -654,37 +1314,54 @@ page_db_new(PageDB **db, const char *path) {
      else if ((mdb_rc = mdb_dbi_open(txn,
                                      "links",
                                      MDB_CREATE | MDB_INTEGERKEY,
-                                     &dbi)) != 0)
+                                     &dbi_links)) != 0)
           error = "creating links database";
+     else if ((mdb_rc = mdb_dbi_open(txn,
+                                     "domains",
+                                     MDB_CREATE | MDB_INTEGERKEY,
+                                     &dbi)) != 0)
+          error = "creating domains database";
+     else if ((mdb_rc = mdb_dbi_open(txn,
+                                     "simhash",
+                                     MDB_CREATE | MDB_INTEGERKEY,
+                                     &dbi)) != 0)
+          error = "creating simhash database";
+     else if ((mdb_rc = mdb_dbi_open(txn,
+                                     "simhash_lsh",
+                                     MDB_CREATE | MDB_INTEGERKEY |
+                                     MDB_DUPSORT | MDB_DUPFIXED | MDB_INTEGERDUP,
+                                     &dbi)) != 0)
+          error = "creating simhash_lsh database";
+     else if ((mdb_rc = mdb_dbi_open(txn,
+                                     "page_hll",
+                                     MDB_CREATE | MDB_INTEGERKEY,
+                                     &dbi)) != 0)
+          error = "creating page_hll database";
+     else if ((mdb_rc = mdb_dbi_open(txn,
+                                     "domain_hll",
+                                     MDB_CREATE | MDB_INTEGERKEY,
+                                     &dbi)) != 0)
+          error = "creating domain_hll database";
      else if ((mdb_rc = mdb_dbi_open(txn, "info", MDB_CREATE, &dbi)) != 0)
           error = "creating info database";
-     else {
-          // initialize n_pages inside info database
-          size_t n_pages = 0;
-          MDB_val key = {
-               .mv_size = sizeof(info_n_pages),
-               .mv_data = info_n_pages
-          };
-          MDB_val val = {
-               .mv_size = sizeof(size_t),
-               .mv_data = &n_pages
-          };
-          switch (mdb_rc = mdb_put(txn, dbi, &key, &val, MDB_NOOVERWRITE)) {
-          case MDB_KEYEXIST:
-          case 0:
-               if (txn_manager_commit(p->txn_manager, txn) != 0)
-                    error = p->txn_manager->error->message;
-               break; // we good
-          default:
-               error = "could not initialize info.n_pages";
-          }
-     }
+     else if ((mdb_rc = page_db_init_info(
+                    txn, dbi, dbi_links, &links_format, &has_domains)) != 0)
+          error = "could not initialize info database";
+     else if (txn_manager_commit(p->txn_manager, txn) != 0)
+          error = p->txn_manager->error->message;
+     else if (links_format > PAGE_DB_LINKS_FORMAT_VERSION)
+          error = "unsupported links format";
 
      if (error != 0) {
           page_db_set_error(p, page_db_error_internal, __func__);
           page_db_add_error(p, error);
           page_db_add_error(p, mdb_strerror(mdb_rc));
 
+          mdb_env_close(p->txn_manager->env);
+     } else if (links_format < PAGE_DB_LINKS_FORMAT_VERSION &&
+                page_db_upgrade_links(p) != 0) {
+          mdb_env_close(p->txn_manager->env);
+     } else if (!has_domains && page_db_rebuild_domains(p) != 0) {
           mdb_env_close(p->txn_manager->env);
      }
 
@@ -697,6 +1374,8 @@ page_db_new(PageDB **db, const char *path) {
  * @param cur An open cursor to the hash2info database
  * @param key The key (hash) to the page
  * @param page
+ * @param rate_old Output, change rate of the page before this crawl or -1.0
+ *                 if not valid
  * @param mdb_error In case of failure, if the error occurs inside LMDB this output parameter
  *                  will be set with the error (otherwise is set to zero).
  * @return 0 if success, -1 if failure.
@@ -706,9 +1385,11 @@ page_db_add_crawled_page_info(MDB_cursor *cur,
                               MDB_val *key,
                               const CrawledPage *page,
                               PageInfo **page_info,
+                              float *rate_old,
                               int *mdb_error) {
      MDB_val val;
      *page_info = 0;
+     *rate_old = -1.0;
 
      int mdb_rc = mdb_cursor_get(cur, key, &val, MDB_SET);
      int put_flags = 0;
@@ -716,6 +1397,7 @@ page_db_add_crawled_page_info(MDB_cursor *cur,
      case 0:
           if (!(*page_info = page_info_load(&val)))
                goto on_error;
+          *rate_old = page_info_rate(*page_info);
           if ((page_info_update(*page_info, page) != 0))
                goto on_error;
           put_flags = MDB_CURRENT;
@@ -748,11 +1430,12 @@ on_error:
      return -1;
 }
 
-/** Store a new or updated @ref PageInfo for an uncrawled link.
+/** Store a new @ref PageInfo for an uncrawled link.
  *
  * @param cur An open cursor to the hash2info database
  * @param key The key (hash) to the page
- * @param url
+ * @param page_info Filled with the new PageInfo. Its URL points to the link URL
+ * @param arena Temporary memory for the serialization
  * @param mdb_error In case of failure, if the error occurs inside LMDB this output parameter
  *                  will be set with the error (otherwise is set to zero).
  * @return 0 if success, -1 if failure.
@@ -763,33 +1446,28 @@ page_db_add_link_page_info(MDB_cursor *cur,
                            uint64_t linked_from,
                            uint64_t depth,
                            const LinkInfo *link,
-                           PageInfo **page_info,
+                           PageInfo *page_info,
+                           Arena *arena,
                            int *mdb_error) {
      MDB_val val;
      int mdb_rc = 0;
 
-     PageInfo *pi = *page_info =
-          page_info_new_link(link->url, linked_from, depth, link->score);
-     if (!pi)
-          goto on_error;
+     memset(page_info, 0, sizeof(*page_info));
+     page_info->url = link->url;
+     page_info->score = link->score;
+     page_info->linked_from = linked_from;
+     page_info->depth = depth;
 
-     if ((page_info_dump(pi, &val)   != 0))
+     if ((page_info_dump_arena(page_info, &val, arena) != 0))
           goto on_error;
 
      if ((mdb_rc = mdb_cursor_put(cur, key, &val, MDB_NOOVERWRITE)) != 0)
           goto on_error;
 
-     free(val.mv_data);
-     val.mv_data = 0;
-
      *mdb_error = 0;
      return 0;
 on_error:
-     if (val.mv_data)
-          free(val.mv_data);
-
      *mdb_error = mdb_rc;
-     page_info_delete(pi);
      return -1;
 }
 
@@ -806,28 +1484,59 @@ on_error:
 */
 PageDBError
 page_db_add(PageDB *db, const CrawledPage *page, PageInfoList **page_info_list) {
-     // check if page should be expanded
-     if (page_db_expand(db) != 0)
-          return db->error->code;
+     return page_db_add_batch(db, &page, 1, page_info_list);
+}
 
-     MDB_txn *txn;
+/** Add the batch inside a single write transaction.
+ *
+ * If LMDB runs out of space map_full is set to 1 and the transaction is
+ * rolled back, so the whole batch can be retried after growing the map.
+ */
+static PageDBError
+page_db_add_batch_txn(PageDB *db,
+                      const CrawledPage **pages,
+                      size_t n_crawled,
+                      PageInfoList **page_info_list,
+                      int *map_full) {
+     const uint64_t t0 = metrics_now();
+     size_t n_links_total = 0;
+     size_t link_bytes = 0;
+
+     *map_full = 0;
+     MDB_txn *txn = 0;
 
      MDB_cursor *cur_hash2info;
      MDB_cursor *cur_hash2idx;
      MDB_cursor *cur_links;
      MDB_cursor *cur_info;
+     MDB_cursor *cur_domains;
+     MDB_cursor *cur_simhash;
+     MDB_cursor *cur_simhash_lsh;
+     MDB_cursor *cur_page_hll;
+     MDB_cursor *cur_domain_hll;
 
      MDB_val key;
      MDB_val val;
 
-     int mdb_rc;
+     int mdb_rc = 0;
      char *error = 0;
 
      uint64_t *diff_id = 0;
      uint64_t *same_id = 0;
+     // quantized link weights, parallel to diff_id and same_id
+     uint8_t *diff_q = 0;
+     uint8_t *same_q = 0;
+
+     Arena *list_arena = 0;
+     if (page_info_list)
+          *page_info_list = 0;
+
+     if (page_info_list && !(list_arena = arena_new(0))) {
+          error = "allocating new PageInfo list";
+          goto on_error;
+     }
 
      // start a new write transaction
-     txn = 0;
      if ((txn_manager_begin(db->txn_manager, 0, &txn)) != 0)
           error = db->txn_manager->error->message;
      else if ((mdb_rc = page_db_open_hash2info(txn, &cur_hash2info)) != 0)
@@ -838,112 +1547,237 @@ page_db_add(PageDB *db, const CrawledPage *page, PageInfoList **page_info_list)
           error = "opening links cursor";
      else if ((mdb_rc = page_db_open_info(txn, &cur_info)) != 0)
           error = "opening info cursor";
+     else if ((mdb_rc = page_db_open_domains(txn, &cur_domains)) != 0)
+          error = "opening domains cursor";
+     else if ((mdb_rc = page_db_open_simhash(txn, &cur_simhash)) != 0)
+          error = "opening simhash cursor";
+     else if ((mdb_rc = page_db_open_simhash_lsh(txn, &cur_simhash_lsh)) != 0)
+          error = "opening simhash_lsh cursor";
+     else if ((mdb_rc = page_db_open_page_hll(txn, &cur_page_hll)) != 0)
+          error = "opening page_hll cursor";
+     else if ((mdb_rc = page_db_open_domain_hll(txn, &cur_domain_hll)) != 0)
+          error = "opening domain_hll cursor";
 
      if (error != 0)
           goto on_error;
 
      // get n_pages
-     key.mv_size = sizeof(info_n_pages);
-     key.mv_data = info_n_pages;
-     if ((mdb_rc = mdb_cursor_get(cur_info, &key, &val, MDB_SET)) != 0) {
+     size_t n_pages;
+     if ((mdb_rc = page_db_info_get_n_pages(cur_info, &n_pages)) != 0) {
           error = "retrieving info.n_pages";
           goto on_error;
      }
-     size_t n_pages = *(size_t*)val.mv_data;
 
-     uint64_t cp_hash = page_db_hash(page->url);
-     key.mv_size = sizeof(uint64_t);
-     key.mv_data = &cp_hash;
-
-     if (db->domain_temp) {
-          domain_temp_update(db->domain_temp, (float)page->time);
-          domain_temp_heat(db->domain_temp, page_db_hash_get_domain(cp_hash));
-     }
+     // all the pages share the transaction, and so a single commit
+     for (size_t p=0; p<n_crawled; ++p) {
+          const CrawledPage *page = pages[p];
+          // we are the only writer, the scratch memory is ours until commit
+          if (arena_reset(db->scratch) != 0) {
+               error = "resetting scratch memory";
+               goto on_error;
+          }
+          same_q = diff_q = 0;
+
+          uint64_t cp_hash = page_db_hash(page->url);
+          key.mv_size = sizeof(uint64_t);
+          key.mv_data = &cp_hash;
+
+          if (page->has_simhash &&
+              (mdb_rc = page_db_simhash_update(cur_simhash,
+                                               cur_simhash_lsh,
+                                               cp_hash,
+                                               page->simhash,
+                                               page->time)) != 0) {
+               error = "updating simhash index";
+               goto on_error;
+          }
 
-     PageInfo *pi;
-     if (page_db_add_crawled_page_info(cur_hash2info, &key, page, &pi, &mdb_rc) != 0) {
-          error = "adding/updating page info";
-          goto on_error;
-     }
-     uint64_t link_depth = pi->depth + 1;
+          // statistics of the domain of the crawled page, stored after adding links
+          const uint32_t cp_domain = page_db_hash_get_domain(cp_hash);
+          DomainInfo cp_domain_info;
+          if ((mdb_rc = page_db_domain_info_load(cur_domains, cp_domain, &cp_domain_info)) != 0) {
+               error = "retrieving domain info";
+               goto on_error;
+          }
 
-     if (page_info_list) {
-          *page_info_list = page_info_list_new(pi, cp_hash);
-          if (!*page_info_list) {
-               error = "allocating new PageInfo list";
+          PageInfo *pi;
+          float rate_old;
+          if (page_db_add_crawled_page_info(cur_hash2info, &key, page, &pi, &rate_old, &mdb_rc) != 0) {
+               error = "adding/updating page info";
                goto on_error;
           }
-     } else {
+          uint64_t link_depth = pi->depth + 1;
+          // links are counted inside the target domains only the first time
+          const int first_crawl = pi->n_crawls == 1;
+          page_db_domain_info_crawl(&cp_domain_info, pi, rate_old);
+
+          if (page_info_list) {
+               PageInfoList *pil = page_info_list_cons_copy(
+                    *page_info_list, list_arena, pi, cp_hash);
+               if (!pil) {
+                    page_info_delete(pi);
+                    error = "allocating new PageInfo list";
+                    goto on_error;
+               }
+               *page_info_list = pil;
+          }
           page_info_delete(pi);
-          pi = 0;
-     }
-
-     size_t n_links = crawled_page_n_links(page);
-     // store here links inside the same domain as the crawled page
-     same_id = malloc((n_links + 1)*sizeof(*same_id));
-     // store here links outside the domain of the crawled page
-     diff_id = malloc((n_links + 1)*sizeof(*diff_id));
-     // next link id is going to be written here
-     uint64_t *id = diff_id;
-     // number of id's in same_id and diff_id. The first element of diff_id
-     // array is reserved for the id of the crawled page, so we start at 1.
-     // The first element of same_id will be a copy of the last element of
-     // diff_id, so we start at 1 too.
-     uint64_t same_i = 1;
-     uint64_t diff_i = 1;
-     if (!same_id || !diff_id) {
-          error = "could not malloc";
-          goto on_error;
-     }
-     // hash of the current URL
-     uint64_t hash = cp_hash;
-     for (size_t i=0; i <= n_links; ++i) {
-          const LinkInfo *link = i > 0? crawled_page_get_link(page, i - 1): 0;
-          if (link) {
-               hash = page_db_hash(link->url);
-               key.mv_size = sizeof(uint64_t);
-               key.mv_data = &hash;
 
-               id = same_domain(page->url, link->url)?
-                    same_id + same_i++:
-                    diff_id + diff_i++;
+          size_t n_links = crawled_page_n_links(page);
+          // store here links inside the same domain as the crawled page
+          same_id = arena_alloc(db->scratch, (n_links + 1)*sizeof(*same_id));
+          // store here links outside the domain of the crawled page
+          diff_id = arena_alloc(db->scratch, (n_links + 1)*sizeof(*diff_id));
+          // next link id is going to be written here
+          uint64_t *id = diff_id;
+          // number of id's in same_id and diff_id. The first element of diff_id
+          // array is reserved for the id of the crawled page, so we start at 1.
+          // The first element of same_id will be a copy of the last element of
+          // diff_id, so we start at 1 too.
+          uint64_t same_i = 1;
+          uint64_t diff_i = 1;
+          if (!same_id || !diff_id) {
+               error = "could not malloc";
+               goto on_error;
           }
-          val.mv_size = sizeof(uint64_t);
-          val.mv_data = &n_pages;
-
-          switch (mdb_rc = mdb_cursor_put(cur_hash2idx, &key, &val, MDB_NOOVERWRITE)) {
-          case MDB_KEYEXIST: // not really an error
-               *id = *(uint64_t*)val.mv_data;
-               break;
-          case 0:
-               *id = n_pages++;
+          if (db->link_weights &&
+              (!(same_q = arena_alloc(db->scratch, n_links + 1)) ||
+               !(diff_q = arena_alloc(db->scratch, n_links + 1)))) {
+               error = "could not malloc";
+               goto on_error;
+          }
+          // hash of the current URL
+          uint64_t hash = cp_hash;
+          for (size_t i=0; i <= n_links; ++i) {
+               const LinkInfo *link = i > 0? crawled_page_get_link(page, i - 1): 0;
+               int same = 1;
                if (link) {
-                    if (page_db_add_link_page_info(
-                             cur_hash2info,
-                             &key,
-                             cp_hash,
-                             link_depth,
-                             link,
-                             &pi,
-                             &mdb_rc) != 0) {
-                         error = "adding/updating link info";
-                         goto on_error;
-                    }
-                    if (page_info_list) {
-                         if (!(*page_info_list = page_info_list_cons(*page_info_list, pi, hash))) {
-                              error = "adding new PageInfo to list";
+                    hash = page_db_hash(link->url);
+                    key.mv_size = sizeof(uint64_t);
+                    key.mv_data = &hash;
+
+                    same = same_domain(page->url, link->url);
+                    if (db->link_weights)
+                         (same? same_q + same_i: diff_q + diff_i)[0] =
+                              page_db_link_weight_quantize(link->score);
+                    id = same?
+                         same_id + same_i++:
+                         diff_id + diff_i++;
+               }
+               val.mv_size = sizeof(uint64_t);
+               val.mv_data = &n_pages;
+
+               int new_page = 0;
+               switch (mdb_rc = mdb_cursor_put(cur_hash2idx, &key, &val, MDB_NOOVERWRITE)) {
+               case MDB_KEYEXIST: // not really an error
+                    *id = *(uint64_t*)val.mv_data;
+                    break;
+               case 0:
+                    new_page = 1;
+                    *id = n_pages++;
+                    if (link) {
+                         PageInfo link_pi;
+                         if (page_db_add_link_page_info(
+                                  cur_hash2info,
+                                  &key,
+                                  cp_hash,
+                                  link_depth,
+                                  link,
+                                  &link_pi,
+                                  db->scratch,
+                                  &mdb_rc) != 0) {
+                              error = "adding/updating link info";
                               goto on_error;
                          }
+                         if (page_info_list) {
+                              PageInfoList *pil = page_info_list_cons_copy(
+                                   *page_info_list, list_arena, &link_pi, hash);
+                              if (!pil) {
+                                   error = "adding new PageInfo to list";
+                                   goto on_error;
+                              }
+                              *page_info_list = pil;
+                         }
                     }
-                    else {
-                         page_info_delete(pi);
+                    break;
+               default:
+                    goto on_error;
+               }
+
+               const int link_in = first_crawl && !same;
+               if (new_page || link_in) {
+                    const uint32_t domain = page_db_hash_get_domain(hash);
+                    if (domain == cp_domain) {
+                         cp_domain_info.n_pages += new_page;
+                         cp_domain_info.n_links_in += link_in;
+                    } else {
+                         DomainInfo di;
+                         if ((mdb_rc = page_db_domain_info_load(cur_domains, domain, &di)) != 0) {
+                              error = "retrieving domain info";
+                              goto on_error;
+                         }
+                         di.n_pages += new_page;
+                         di.n_links_in += link_in;
+                         if ((mdb_rc = page_db_domain_info_store(cur_domains, domain, &di)) != 0) {
+                              error = "storing domain info";
+                              goto on_error;
+                         }
                     }
+               }
 
+               // seeds have no domain and are not counted as linking domains
+               if (db->track_linking_domains && link && cp_domain != 0) {
+                    uint32_t domain = page_db_hash_get_domain(hash);
+                    if (domain != cp_domain) {
+                         MDB_val page_key = {
+                              .mv_size = sizeof(hash),
+                              .mv_data = &hash
+                         };
+                         MDB_val domain_key = {
+                              .mv_size = sizeof(domain),
+                              .mv_data = &domain
+                         };
+                         if ((mdb_rc = page_db_hll_add(cur_page_hll, &page_key, 0, cp_domain)) != 0 ||
+                             (mdb_rc = page_db_hll_add(cur_domain_hll, &domain_key, 1, cp_domain)) != 0) {
+                              error = "updating linking domains";
+                              goto on_error;
+                         }
+                    }
                }
-               break;
-          default:
+          }
+          if ((mdb_rc = page_db_domain_info_store(cur_domains, cp_domain, &cp_domain_info)) != 0) {
+               error = "storing domain info";
+               goto on_error;
+          }
+
+          // store links
+          // The format for the links is the following:
+          //
+          // KEY = ID of crawled page
+          // VAL = Number of links to different domain,
+          //       diff link id 1, diff link id 2, ...
+          //       same link id 1, same link id 2, ...
+
+          key.mv_size = sizeof(uint64_t);
+          key.mv_data = diff_id; // remember that diff_id[0] is the id of the
+                                 // crawled page
+          // the links are stored as deltas starting from the 'from' page, see
+          // PAGE_DB_LINKS_FORMAT_VERSION
+          if (page_db_links_encode(diff_id[0],
+                                   diff_id + 1, diff_q? diff_q + 1: 0, diff_i - 1,
+                                   same_id + 1, same_q? same_q + 1: 0, same_i - 1,
+                                   &val) != 0) {
+               error = "allocating memory to store links";
+               goto on_error;
+          }
+          if ((mdb_rc = mdb_cursor_put(cur_links, &key, &val, 0)) != 0) {
+               free(val.mv_data);
+               error = "storing links";
                goto on_error;
           }
+          free(val.mv_data);
+          n_links_total += diff_i + same_i - 2;
+          link_bytes += val.mv_size;
      }
 
      // store n_pages
@@ -956,56 +1790,38 @@ page_db_add(PageDB *db, const CrawledPage *page, PageInfoList **page_info_list)
           goto on_error;
      }
 
-     // store links and commit transaction
-     // The format for the links is the following:
-     //
-     // KEY = ID of crawled page
-     // VAL = Number of links to different domain,
-     //       diff link id 1, diff link id 2, ...
-     //       same link id 1, same link id 2, ...
-
-     key.mv_size = sizeof(uint64_t);
-     key.mv_data = diff_id; // remember that diff_id[0] is the id of the
-                            // crawled page
-     // the links are stored as deltas starting from the 'from' page, encoded
-     // using varint.
-     uint8_t *buf = val.mv_data = malloc(MAX_VARINT_SIZE*(n_links + 1));
-     if (!buf) {
-          error = "allocating memory to store links";
-          goto on_error;
-     }
-     // write number of diff links (substract 1 to take into account this page id)
-     buf = varint_encode_uint64(diff_i - 1, buf);
-     // write diff links
-     for (size_t i=1; i<diff_i; ++i)
-          buf = varint_encode_int64((int64_t)diff_id[i] - (int64_t)diff_id[i-1], buf);
-     same_id[0] = diff_id[diff_i-1];
-     for (size_t i=1; i<same_i; ++i)
-          buf = varint_encode_int64((int64_t)same_id[i] - (int64_t)same_id[i-1], buf);
-
-     val.mv_size = (char*)buf - (char*)val.mv_data;
-     if ((mdb_rc = mdb_cursor_put(cur_links, &key, &val, 0)) != 0) {
-          error = "storing links";
-          goto on_error;
-     }
-     free(val.mv_data);
-     free(same_id);
-     free(diff_id);
-     same_id = diff_id = 0;
-
      if (txn_manager_commit(db->txn_manager, txn) != 0) {
+          txn = 0;
+          *map_full = db->txn_manager->error->code == txn_manager_error_map_full;
           error = db->txn_manager->error->message;
           goto on_error;
      }
+     // domain temperatures live outside the database and cannot be rolled
+     // back, so they are only updated once the batch is committed
+     if (db->domain_temp)
+          for (size_t p=0; p<n_crawled; ++p) {
+               domain_temp_update(db->domain_temp, (float)pages[p]->time);
+               domain_temp_heat(db->domain_temp,
+                                page_db_hash_get_domain(page_db_hash(pages[p]->url)));
+          }
+     // nothing was crawled and the empty list does not own the arena
+     if (page_info_list && !*page_info_list)
+          arena_delete(list_arena);
+     metrics_count(metric_page_db_add_pages, n_crawled);
+     metrics_count(metric_page_db_add_links, n_links_total);
+     metrics_count(metric_page_db_add_link_bytes, link_bytes);
+     metrics_record_since(metric_page_db_add, t0);
      return db->error->code;
 
 on_error:
-     if (same_id)
-          free(same_id);
-     if (diff_id)
-          free(diff_id);
      if (txn)
           txn_manager_abort(db->txn_manager, txn);
+     if (page_info_list)
+          *page_info_list = 0;
+     arena_delete(list_arena);
+
+     if (mdb_rc == MDB_MAP_FULL)
+          *map_full = 1;
 
      page_db_set_error(db, page_db_error_internal, __func__);
      page_db_add_error(db, error);
@@ -1015,6 +1831,31 @@ on_error:
      return db->error->code;
 }
 
+PageDBError
+page_db_add_batch(PageDB *db,
+                  const CrawledPage **pages,
+                  size_t n_crawled,
+                  PageInfoList **page_info_list) {
+     // check if page should be expanded
+     if (page_db_expand(db) != 0)
+          return db->error->code;
+
+     // the expansion only guarantees a fixed amount of free pages, a large
+     // batch can still need more
+     int map_full = 0;
+     while (page_db_add_batch_txn(db, pages, n_crawled, page_info_list, &map_full) != 0 &&
+            map_full) {
+          error_clean(db->error);
+          error_clean(db->txn_manager->error);
+          if (txn_manager_grow(db->txn_manager) != 0) {
+               page_db_set_error(db, page_db_error_internal, __func__);
+               page_db_add_error(db, db->txn_manager->error->message);
+               break;
+          }
+     }
+     return db->error->code;
+}
+
 PageDBError
 page_db_get_info(PageDB *db, uint64_t hash, PageInfo **pi) {
      MDB_txn *txn;
@@ -1066,7 +1907,7 @@ on_error:
      return db->error->code;
 }
 
-static PageDBError
+PageDBError
 page_db_get_idx_cur(PageDB *db, MDB_cursor *cur, uint64_t hash, uint64_t *idx) {
      int mdb_rc = 0;
 
@@ -1097,7 +1938,7 @@ page_db_get_idx(PageDB *db, uint64_t hash, uint64_t *idx) {
      MDB_txn *txn = 0;
      MDB_cursor *cur = 0;
 
-     int mdb_rc;
+     int mdb_rc = 0;
      int ret = 0;
      char *error = 0;
      if (txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn) != 0)
@@ -1124,6 +1965,29 @@ page_db_get_idx(PageDB *db, uint64_t hash, uint64_t *idx) {
      return ret;
 }
 
+PageDBError
+page_db_set_by_hash(PageDB *db,
+                    MDB_cursor *cur_hash2idx,
+                    uint64_t hash,
+                    MMapArray *values,
+                    const void *value) {
+     uint64_t idx = 0;
+     switch (page_db_get_idx_cur(db, cur_hash2idx, hash, &idx)) {
+     case 0:
+          if (mmap_array_set(values, idx, value) != 0) {
+               page_db_set_error(db, page_db_error_internal, __func__);
+               page_db_add_error(db, values->error->message);
+               return db->error->code;
+          }
+          return 0;
+     case page_db_error_no_page:
+          // ignore
+          return 0;
+     default:
+          return db->error->code;
+     }
+}
+
 PageDBError
 page_db_get_scores(PageDB *db, MMapArray **scores) {
      MDB_txn *txn;
@@ -1154,14 +2018,12 @@ page_db_get_scores(PageDB *db, MMapArray **scores) {
           goto on_error;
 
      // get n_pages
-     key.mv_size = sizeof(info_n_pages);
-     key.mv_data = info_n_pages;
-     if ((mdb_rc = mdb_cursor_get(cur_info, &key, &val, MDB_SET)) != 0) {
+     size_t n_pages;
+     if ((mdb_rc = page_db_info_get_n_pages(cur_info, &n_pages)) != 0) {
           error1 = "retrieving info.n_pages";
           error2 = mdb_strerror(mdb_rc);
           goto on_error;
      }
-     size_t n_pages = *(size_t*)val.mv_data;
 
      pscores = build_path(db->path, "scores.bin");
      if (mmap_array_new(scores, pscores, n_pages, sizeof(float)) != 0) {
@@ -1178,23 +2040,10 @@ page_db_get_scores(PageDB *db, MMapArray **scores) {
           uint64_t hash = *(uint64_t*)key.mv_data;
           float score = page_info_dump_get_score(&val);
 
-          size_t idx;
-          switch (page_db_get_idx_cur(db, cur_hash2idx, hash, &idx)) {
-          case 0:
-               if (mmap_array_set(*scores, idx, &score) != 0) {
-                    error1 = "setting score";
-                    error2 = (*scores)->error->message;
-                    goto on_error;
-               }
-               break;
-          case page_db_error_no_page:
-               // ignore
-               break;
-          default:
-               error1 = db->error->message;
+          if (page_db_set_by_hash(db, cur_hash2idx, hash, *scores, &score) != 0) {
+               error1 = "setting score";
                goto on_error;
           }
-
      }
      if (mdb_rc != MDB_NOTFOUND) {
           error1 = "iterating on hash2info";
@@ -1255,6 +2104,7 @@ page_db_delete(PageDB *db) {
      }
      free(db->path);
      domain_temp_delete(db->domain_temp);
+     arena_delete(db->scratch);
      error_delete(db->error);
      free(db);
      return 0;
@@ -1291,7 +2141,7 @@ page_db_info_dump(PageDB *db, FILE *output) {
                error = "PageInfo error format";
                goto on_error;
           }
-          uint64_t idx;
+          uint64_t idx = 0;
           if (page_db_get_idx_cur(db, cur_hash2idx, *(uint64_t*)key.mv_data, &idx) != 0) {
                error = "Could not retrieve page index";
                goto on_error;
@@ -1340,10 +2190,13 @@ page_db_links_dump(PageDB *db, FILE *output) {
           return page_db_error_internal;
      stream->only_diff_domain = 0;
 
-     Link link;
+     Link links[LINK_STREAM_BLOCK_SIZE];
+     size_t n_links;
      StreamState state;
-     while ((state = page_db_link_stream_next(stream, &link)) == stream_state_next) {
-          fprintf(output, "%"PRIi64" %"PRIi64"\n", link.from, link.to);
+     while ((state = page_db_link_stream_next_block(
+                  stream, links, 0, LINK_STREAM_BLOCK_SIZE, &n_links)) == stream_state_next) {
+          for (size_t i=0; i<n_links; ++i)
+               fprintf(output, "%"PRIi64" %"PRIi64"\n", links[i].from, links[i].to);
      }
      page_db_link_stream_delete(stream);
 
@@ -1358,6 +2211,16 @@ page_db_set_persist(PageDB *db, int value) {
      db->persist = value;
 }
 
+void
+page_db_set_link_weights(PageDB *db, int value) {
+     db->link_weights = value;
+}
+
+void
+page_db_set_track_linking_domains(PageDB *db, int value) {
+     db->track_linking_domains = value;
+}
+
 PageDBError
 page_db_set_domain_temp(PageDB *db, size_t n_domains, float window) {
      if (db->domain_temp)
@@ -1381,35 +2244,13 @@ hashinfo_stream_new(HashInfoStream **st, PageDB *db) {
           return page_db_error_memory;
 
      p->db = db;
-
-     MDB_txn *txn;
-     int mdb_rc = 0;
-     char *error = 0;
-
-     // start a new read transaction
-     if (txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn) != 0) {
-          error = db->txn_manager->error->message;
-          goto mdb_error;
-     }
-     // open cursor to links database
-     if ((mdb_rc = page_db_open_hash2info(txn, &p->cur)) != 0) {
-          error = "opening hash2info cursor";
-          goto mdb_error;
+     if (page_db_stream_open(db, page_db_open_hash2info, &p->cur, __func__) != 0) {
+          p->state = stream_state_error;
+          return db->error->code;
      }
-
      p->state = stream_state_init;
 
      return 0;
-
-mdb_error:
-     p->state = stream_state_error;
-
-     page_db_set_error(db, page_db_error_internal, __func__);
-     page_db_add_error(db, error);
-     if (mdb_rc != 0)
-          page_db_add_error(db, mdb_strerror(mdb_rc));
-
-     return db->error->code;
 }
 
 StreamState
@@ -1433,12 +2274,11 @@ hashinfo_stream_next(HashInfoStream *st, uint64_t *hash, PageInfo **pi) {
 
 void
 hashinfo_stream_delete(HashInfoStream *st) {
-     MDB_txn *txn = mdb_cursor_txn(st->cur);
-     mdb_cursor_close(st->cur);
-     txn_manager_abort(st->db->txn_manager, txn);
+     page_db_stream_close(st->db, st->cur);
      free(st);
 }
 /// @}
+
 /// @addtogroup PageDBLinkStream
 /// @{
 
@@ -1447,32 +2287,13 @@ page_db_link_stream_copy_links(PageDBLinkStream *es,
                                MDB_val *key,
                                MDB_val *val,
                                int only_diff_domain) {
-     // decompressing varints can expand size at most 8x
-     size_t max_size = 8*val->mv_size;
-     if (max_size > es->m_to) {
-          if ((es->to = (uint64_t*)realloc(es->to, max_size*sizeof(uint64_t))) == 0) {
-               es->state = stream_state_error;
-               return -1;
-          }
-          es->m_to = max_size;
-     }
-     es->i_to = 0;
-     es->n_to = 0;
-     uint64_t id = es->from = *(uint64_t*)key->mv_data;
-
-     uint8_t read = 0;
-     es->n_diff = varint_decode_uint64(val->mv_data, &read);
-
-     uint8_t *pos = (uint8_t*)val->mv_data;
-     uint8_t *end = pos + val->mv_size/sizeof(uint8_t);
-     pos += read;
-     while (pos < end) {
-          es->to[es->n_to++] = id += varint_decode_int64(pos, &read);
-          pos += read;
-
-          if (only_diff_domain &&
-              (es->n_to == es->n_diff))
-               break;
+     if (page_db_links_decode(es,
+                              *(uint64_t*)key->mv_data,
+                              val,
+                              PAGE_DB_LINKS_FORMAT_VERSION,
+                              only_diff_domain) != 0) {
+          es->state = stream_state_error;
+          return -1;
      }
      return 0;
 }
@@ -1593,6 +2414,86 @@ page_db_link_stream_next(void *st, Link *link) {
      return es->state;
 }
 
+StreamState
+page_db_link_stream_next_block(void *st, Link *links, float *weights,
+                               size_t max_links, size_t *n_links) {
+     PageDBLinkStream *es = st;
+     *n_links = 0;
+     if (!es->cur)
+          return es->state;
+     while (*n_links < max_links) {
+          if (es->i_to >= es->n_to) {
+               int mdb_rc;
+               MDB_val key;
+               MDB_val val;
+
+               switch (mdb_rc = mdb_cursor_get(es->cur, &key, &val, MDB_NEXT)) {
+               case 0:
+                    if (page_db_link_stream_copy_links(es, &key, &val, es->only_diff_domain) != 0)
+                         return stream_state_error;
+                    continue;
+               case MDB_NOTFOUND:
+                    return es->state = *n_links > 0? stream_state_next: stream_state_end;
+               default:
+                    return es->state = stream_state_error;
+               }
+          }
+          size_t n = es->n_to - es->i_to;
+          if (n > max_links - *n_links)
+               n = max_links - *n_links;
+          Link *link = links + *n_links;
+          const uint64_t *to = es->to + es->i_to;
+          for (size_t i=0; i<n; ++i) {
+               link[i].from = es->from;
+               link[i].to = to[i];
+          }
+          if (weights)
+               memcpy(weights + *n_links, es->weights + es->i_to, n*sizeof(*weights));
+          *n_links += n;
+          es->i_to += n;
+     }
+     return es->state = stream_state_next;
+}
+
+PageDBError
+page_db_link_stream_out_links(PageDBLinkStream *es,
+                              uint64_t from,
+                              const uint64_t **to,
+                              size_t *n_to) {
+     *to = es->to;
+     *n_to = 0;
+     if (!es->cur)
+          return 0;
+
+     int mdb_rc;
+     MDB_val key = {
+          .mv_size = sizeof(uint64_t),
+          .mv_data = &from
+     };
+     MDB_val val;
+     switch (mdb_rc = mdb_cursor_get(es->cur, &key, &val, MDB_SET_KEY)) {
+     case 0:
+          if (page_db_link_stream_copy_links(es, &key, &val, es->only_diff_domain) != 0) {
+               page_db_set_error(es->db, page_db_error_internal, __func__);
+               page_db_add_error(es->db, "decoding links");
+               return es->db->error->code;
+          }
+          // the links are handed to the caller, do not stream them again
+          es->i_to = es->n_to;
+          *to = es->to;
+          *n_to = es->n_to;
+          return 0;
+     case MDB_NOTFOUND:
+          es->i_to = es->n_to = 0;
+          return 0;
+     default:
+          page_db_set_error(es->db, page_db_error_internal, __func__);
+          page_db_add_error(es->db, "looking up links");
+          page_db_add_error(es->db, mdb_strerror(mdb_rc));
+          return es->db->error->code;
+     }
+}
+
 void
 page_db_link_stream_delete(PageDBLinkStream *es) {
      if (es) {
@@ -1601,6 +2502,8 @@ page_db_link_stream_delete(PageDBLinkStream *es) {
                mdb_cursor_close(es->cur);
           }
           free(es->to);
+          free(es->weights);
+          free(es->deltas);
           free(es);
      }
 }
@@ -1614,35 +2517,13 @@ hashidx_stream_new(HashIdxStream **st, PageDB *db) {
           return page_db_error_memory;
 
      p->db = db;
-
-     MDB_txn *txn;
-     int mdb_rc = 0;
-     char *error = 0;
-
-     // start a new read transaction
-     if (txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn) != 0) {
-          error = db->txn_manager->error->message;
-          goto mdb_error;
-     }
-     // open cursor to links database
-     if ((mdb_rc = page_db_open_hash2idx(txn, &p->cur)) != 0) {
-          error = "opening hash2idx cursor";
-          goto mdb_error;
+     if (page_db_stream_open(db, page_db_open_hash2idx, &p->cur, __func__) != 0) {
+          p->state = stream_state_error;
+          return db->error->code;
      }
-
      p->state = stream_state_init;
 
      return 0;
-
-mdb_error:
-     p->state = stream_state_error;
-
-     page_db_set_error(db, page_db_error_internal, __func__);
-     page_db_add_error(db, error);
-     if (mdb_rc != 0)
-          page_db_add_error(db, mdb_strerror(mdb_rc));
-
-     return db->error->code;
 }
 
 StreamState
@@ -1666,9 +2547,7 @@ hashidx_stream_next(HashIdxStream *st, uint64_t *hash, size_t *idx) {
 
 void
 hashidx_stream_delete(HashIdxStream *st) {
-     MDB_txn *txn = mdb_cursor_txn(st->cur);
-     mdb_cursor_close(st->cur);
-     txn_manager_abort(st->db->txn_manager, txn);
+     page_db_stream_close(st->db, st->cur);
      free(st);
 }
 
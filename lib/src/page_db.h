@@ -23,9 +23,11 @@
 
 #include "domain_temp.h"
 #include "hits.h"
+#include "hll.h"
 #include "link_stream.h"
 #include "page_rank.h"
 #include "txn_manager.h"
+#include "util.h"
 
 #define KB 1024LL
 #define MB (1024*KB)
@@ -61,6 +63,9 @@ typedef struct {
      LinkInfo *link_info; /**< Array of LinkInfo */
      size_t n_links;      /**< Number of items inside link_info */
      size_t m_links;      /**< Maximum number of items that can be stored inside link_info */
+     /** Storage of the link URLs, and of the URL of the page that owns the
+      * links. They are all freed at once. */
+     Arena *arena;
 } PageLinks;
 
 /** The information that comes with a crawled page. */
@@ -77,6 +82,10 @@ typedef struct {
      char *content_hash;          /**< A hash to detect content change since last crawl.
                                        Arbitrary byte sequence */
      size_t content_hash_length;  /**< Number of byes of the content_hash */
+     /** SimHash of the page content, to find near duplicates. Only valid if
+      * @ref CrawledPage::has_simhash */
+     uint64_t simhash;
+     int has_simhash;             /**< True if @ref CrawledPage::simhash has been set */
 } CrawledPage;
 
 /** Create a new CrawledPage
@@ -88,12 +97,24 @@ typedef struct {
     - time: current time
     - score: 0. It can be setted directly.
     - content_hash: NULL. Use @ref crawled_page_set_hash to change
+    - simhash: not set. Use @ref crawled_page_set_simhash to change
 
     @return NULL if failure, otherwise a newly allocated CrawledPage
 */
 CrawledPage *
 crawled_page_new(const char *url);
 
+/** Reuse a CrawledPage for a different page.
+ *
+ * All fields are set as in @ref crawled_page_new, but the memory already
+ * reserved for the links is kept, so that after a few pages no more memory
+ * is allocated.
+ *
+ * @return 0 if success, -1 if failure
+ */
+int
+crawled_page_reset(CrawledPage *cp, const char *url);
+
 /** Delete a Crawled Page created with @ref crawled_page_new */
 void
 crawled_page_delete(CrawledPage *cp);
@@ -117,10 +138,41 @@ crawled_page_set_hash64(CrawledPage *cp, uint64_t hash);
 int
 crawled_page_set_hash32(CrawledPage *cp, uint32_t hash);
 
+/** Set the SimHash of the page content.
+ *
+ * Pages with SimHash are added to an index inside @ref PageDB that allows
+ * finding near duplicates, see @ref page_db_find_near_dup.
+ */
+void
+crawled_page_set_simhash(CrawledPage *cp, uint64_t simhash);
+
 /** Add a new link to the crawled page */
 int
 crawled_page_add_link(CrawledPage *cp, const char *url, float score);
 
+/** Add many links at once.
+ *
+ * Space for all the links is reserved once and URL lengths are known in
+ * advance, which makes this much faster than repeated calls to
+ * @ref crawled_page_add_link, specially from the Python wrapper.
+ *
+ * @param urls All URLs concatenated. They need not be null terminated, but
+ *             must not contain null bytes either.
+ * @param offsets n_links + 1 positions inside urls. URL i spans from
+ *                offsets[i] to offsets[i + 1]
+ * @param scores n_links scores. If NULL all links get score 0
+ * @param n_links Number of links
+ *
+ * @return 0 if success, -1 if failure. If a URL contains a null byte no link
+ *         is added, otherwise links added before failure are kept.
+ */
+int
+crawled_page_add_links(CrawledPage *cp,
+                       const char *urls,
+                       const size_t *offsets,
+                       const float *scores,
+                       size_t n_links);
+
 /** Get number of links inside page */
 size_t
 crawled_page_n_links(const CrawledPage *cp);
@@ -192,12 +244,34 @@ page_info_is_seed(const PageInfo *pi);
 void
 page_info_delete(PageInfo *pi);
 
+/** Serialize the PageInfo as stored inside the PageDB.
+ *
+ * New memory is allocated inside val->mv_data, which must be freed by the
+ * caller.
+ *
+ * @return 0 if success, -1 if failure.
+ */
+int
+page_info_dump(const PageInfo *pi, MDB_val *val);
+
+/** Create a new PageInfo loading the information from a previously
+ * dumped PageInfo inside val.
+ *
+ * @return pointer to the new PageInfo or NULL if failure
+ */
+PageInfo *
+page_info_load(const MDB_val *val);
+
 /** A linked list of @ref PageInfo (and hash), to be returned by @ref page_db_add */
 struct PageInfoList {
      uint64_t hash;        /**< Hash inside the hash2info database */
      PageInfo *page_info;  /**< Info inside the hash2info database */
      /** A pointer to the next element, or NULL */
      struct PageInfoList *next;
+     /** If not NULL all the nodes and their @ref PageInfo live inside this
+      * arena, which is freed with the list. Lists returned by
+      * @ref page_db_add are built this way. */
+     Arena *arena;
 };
 typedef struct PageInfoList PageInfoList;
 
@@ -222,15 +296,43 @@ page_info_list_new(PageInfo *pi, uint64_t hash);
 PageInfoList *
 page_info_list_cons(PageInfoList *pil, PageInfo *pi, uint64_t hash);
 
-/** Deletes the list and all its contents */
+/** Deletes the list and all its contents. Does nothing if NULL */
 void
 page_info_list_delete(PageInfoList *pil);
 
 /// @}
 
+/// @addtogroup DomainInfo
+/// @{
+
+/** Statistics of all the pages of a domain.
+ *
+ * Stored inside the domains database with the domain hash as key and
+ * updated incrementally by @ref page_db_add. Since the record has fixed size
+ * per domain decisions need just one lookup.
+ */
+typedef struct {
+     uint64_t n_pages;    /**< Number of pages, crawled or not */
+     uint64_t n_crawled;  /**< Number of pages crawled at least once */
+     /** Number of links from pages of other domains, counted the first time
+      * the linking page is crawled */
+     uint64_t n_links_in;
+     uint64_t n_rates;    /**< Number of pages with a valid change rate */
+     double rate_sum;     /**< Sum of the valid change rates, see @ref page_info_rate */
+     double last_crawl;   /**< Last time a page of this domain was crawled */
+} DomainInfo;
+
+/** Mean change rate of the pages of the domain, or -1.0 if no page
+ * has a valid rate yet */
+float
+domain_info_rate(const DomainInfo *di);
+
+/// @}
+
 /// @addtogroup PageDB
 /// @{
 #define PAGE_DB_DEFAULT_SIZE 100*MB /**< Initial size of the mmap region */
+#define PAGE_DB_MAX_DBS 10 /**< Maximum number of databases inside the environment */
 
 typedef enum {
      page_db_error_ok = 0,       /**< No error */
@@ -241,13 +343,49 @@ typedef enum {
 } PageDBError;
 
 #define PAGE_DB_DEFAULT_PERSIST 1 /**< Default @ref PageDB.persist */
+#define PAGE_DB_DEFAULT_LINK_WEIGHTS 0 /**< Default @ref PageDB.link_weights */
+/** Default @ref PageDB.track_linking_domains */
+#define PAGE_DB_DEFAULT_TRACK_LINKING_DOMAINS 0
+
+/** Version of the format of the values inside the links database.
+ *
+ * - 0: varint(number of links to different domains) followed by the varint
+ *      deltas of the link indices, starting at the page index.
+ * - 1: every value starts with a tag byte. @ref PAGE_DB_LINKS_SVB values
+ *      continue with varint(number of links to different domains),
+ *      varint(number of links) and the Stream VByte encoded zigzag deltas. If
+ *      some delta does not fit in 32 bits the value is tagged
+ *      @ref PAGE_DB_LINKS_VARINT and the rest follows format 0. Inside each
+ *      group (different and same domain) links are sorted to make the deltas
+ *      small.
+ *
+ * Databases in an older format are converted when opened.
+ */
+#define PAGE_DB_LINKS_FORMAT_VERSION 1
+#define PAGE_DB_LINKS_VARINT 0 /**< Tag of values with varint deltas */
+#define PAGE_DB_LINKS_SVB 1    /**< Tag of values with Stream VByte deltas */
+/** Flag added to the tag of values that store link weights.
+ *
+ * After the number of links to different domains these values always store
+ * varint(number of links), followed by one 4 bit quantized weight per link
+ * (two per byte, low nibble first) and then the deltas. A quantized weight q
+ * represents the weight (q + 1)/16.
+ */
+#define PAGE_DB_LINKS_WEIGHTED 0x10
+
+/** Number of bands of @ref PAGE_DB_SIMHASH_BAND_BITS bits of the SimHash LSH
+ * index. Two SimHashes at Hamming distance less than the number of bands
+ * share at least one band and so they are always found. */
+#define PAGE_DB_SIMHASH_BANDS 4
+/** Bits of each band of the SimHash LSH index */
+#define PAGE_DB_SIMHASH_BAND_BITS 16
 
 /** Page database.
  *
- * We are really talking about 4 diferent key/value databases:
+ * We are really talking about 9 diferent key/value databases:
  *   - info:
- *        contains fixed size information about the whole database. Right now
- *        it just contains the number of pages stored.
+ *        contains fixed size information about the whole database: the
+ *        number of pages stored and the version of the links format.
  *   - hash2idx:
  *        maps URL hash to index. Indices are consecutive identifier for every
  *        page. This allows to map pages to elements inside arrays.
@@ -256,6 +394,20 @@ typedef enum {
  *   - links:
  *        maps URL index to links indices. This allows us to make a fast streaming
  *        of all links inside a database.
+ *   - domains:
+ *        maps domain hash to a @ref DomainInfo structure.
+ *   - simhash:
+ *        maps URL hash to the SimHash of the page content and its last crawl
+ *        time, for pages with SimHash.
+ *   - simhash_lsh:
+ *        an index with one entry per band of each SimHash, from band number
+ *        and band bits to the URL hash of every page sharing that band.
+ *   - page_hll:
+ *        maps URL hash to a serialized @ref HLL of the domains linking to the
+ *        page. Only when @ref PageDB::track_linking_domains is set.
+ *   - domain_hll:
+ *        maps domain hash to a dense serialized @ref HLL of the domains
+ *        linking to any page of the domain.
  */
 typedef struct {
      /** Path to the database directory */
@@ -268,12 +420,25 @@ typedef struct {
      /** Track the most crawled domains */
      DomainTemp *domain_temp;
 
+     /** Temporary memory of @ref page_db_add, reset at each call. It is only
+      * used inside write transactions, which never run concurrently */
+     Arena *scratch;
+
      Error *error;
 
 // Options
 // -----------------------------------------------------------------------------
      /** If true, do not delete files after deleting object*/
      int persist;
+     /** If true, the score of each link (see @ref LinkInfo) is stored as a
+      * quantized weight together with the link and returned in
+      * @ref Link::weight when streaming links */
+     int link_weights;
+     /** If true, @ref page_db_add maintains HyperLogLog sketches of the
+      * distinct domains linking to each page and to each domain. Links from
+      * the same domain and from seeds are not counted. Links added while false
+      * are never counted. */
+     int track_linking_domains;
 } PageDB;
 
 
@@ -344,6 +509,23 @@ page_db_new(PageDB **db, const char *path);
 PageDBError
 page_db_add(PageDB *db, const CrawledPage *page, PageInfoList **page_info_list);
 
+/** Add several crawled pages inside a single transaction.
+ *
+ * Same as calling @ref page_db_add for each page, in order, but there is only
+ * one commit. Either all pages are added or none. Since the database is
+ * expanded only before starting, batches should stay small (a few hundred
+ * pages).
+ *
+ * @param page_info_list If not NULL, a single list with the @ref PageInfo
+ *                       updated by all the pages
+ * @return 0 if success, otherwise the error code
+ */
+PageDBError
+page_db_add_batch(PageDB *db,
+                  const CrawledPage **pages,
+                  size_t n_crawled,
+                  PageInfoList **page_info_list);
+
 /** Retrieve the PageInfo stored inside the database.
 
     Beware that if not found it will signal success but the PageInfo will be
@@ -360,10 +542,73 @@ page_db_get_idx(PageDB *db, uint64_t hash, uint64_t *idx);
 PageDBError
 page_db_get_scores(PageDB *db, MMapArray **scores);
 
+/** Estimate the number of distinct domains linking to a page.
+ *
+ * See @ref PageDB::track_linking_domains. Exact for pages with few linking
+ * domains, see @ref HLL.
+ */
+PageDBError
+page_db_get_linking_domains(PageDB *db, uint64_t hash, float *count);
+
+/** Estimate the number of distinct domains linking to any page of a domain */
+PageDBError
+page_db_get_domain_linking_domains(PageDB *db, uint32_t domain_hash, float *count);
+
+/** Fill an array, indexed by page index, with the estimated number of
+ * distinct domains linking to each page.
+ *
+ * The array is resized if it cannot hold all the pages.
+ */
+PageDBError
+page_db_get_linking_domains_counts(PageDB *db, MMapArray *counts);
+
 /** Get crawl rate for the given domain */
 float
 page_db_get_domain_crawl_rate(PageDB *db, uint32_t domain_hash);
 
+/** Retrieve the statistics of the given domain.
+ *
+ * If the domain is not present in the database all fields are set to 0.
+ */
+PageDBError
+page_db_get_domain_info(PageDB *db, uint32_t domain_hash, DomainInfo *di);
+
+/** Retrieve the SimHash of a page.
+ *
+ * @param simhash Output, the SimHash of the last crawl
+ * @param last_crawl Output, time of the last crawl with a SimHash
+ * @param found Output, false if the page has no SimHash
+ */
+PageDBError
+page_db_get_simhash(PageDB *db, uint64_t hash,
+                    uint64_t *simhash, double *last_crawl, int *found);
+
+/** Find a page whose content is a near duplicate.
+ *
+ * Candidates are the pages that share at least one band of the SimHash, see
+ * @ref PAGE_DB_SIMHASH_BANDS. The search is exact for distances below the
+ * number of bands and approximate above.
+ *
+ * @param simhash SimHash of the content we are looking for
+ * @param max_distance Maximum Hamming distance between the SimHashes
+ * @param min_crawl Ignore pages whose last crawl is older than this time
+ * @param exclude Ignore this URL hash, usually the page being checked
+ * @param dup_hash Output, URL hash of the first duplicate found
+ * @param found Output, true if some duplicate was found
+ */
+PageDBError
+page_db_find_near_dup(PageDB *db, uint64_t simhash,
+                      int max_distance, double min_crawl, uint64_t exclude,
+                      uint64_t *dup_hash, int *found);
+
+/** Recompute the domains database from the pages and links databases.
+ *
+ * This is done automatically when opening a database created before the
+ * domains database existed.
+ */
+PageDBError
+page_db_rebuild_domains(PageDB *db);
+
 /** Close database, delete files if it should not be persisted, and free memory */
 PageDBError
 page_db_delete(PageDB *db);
@@ -372,6 +617,14 @@ page_db_delete(PageDB *db);
 void
 page_db_set_persist(PageDB *db, int value);
 
+/** Set @ref PageDB::link_weights */
+void
+page_db_set_link_weights(PageDB *db, int value);
+
+/** Set @ref PageDB::track_linking_domains */
+void
+page_db_set_track_linking_domains(PageDB *db, int value);
+
 /** Set domain temperature tracking options */
 PageDBError
 page_db_set_domain_temp(PageDB *db, size_t n_domains, float window);
@@ -402,6 +655,10 @@ typedef struct {
      size_t m_to;   /**< Allocated memory for @ref to. It must be that @ref n_to <= @ref m_to. */
      size_t n_diff; /**< Number of out domain links */
 
+     float *weights;   /**< Weight of each link in @ref to, same allocated size */
+     uint32_t *deltas; /**< Decoding buffer for the link deltas */
+     size_t m_deltas;  /**< Allocated memory for @ref deltas */
+
      StreamState state;
 
      /** If true only links that go to a different domain will be streamed */
@@ -422,12 +679,47 @@ StreamState
 page_db_link_stream_reset(void *es);
 
 /** Get next element inside stream.
+ *
+ * This is a convenience adapter for consumers that handle one link at a time;
+ * it shares its position with @ref page_db_link_stream_next_block.
  *
  * @return @ref ::link_stream_state_next if success
  */
 StreamState
 page_db_link_stream_next(void *es, Link *link);
 
+/** Get the next block of links inside stream.
+ *
+ * Links are copied directly from the decoded links of each page, so the cost
+ * of the stream is paid once per block and not once per link.
+ *
+ * Function signature complies with @ref LinkStreamNextBlockFunc
+ */
+StreamState
+page_db_link_stream_next_block(void *es, Link *links, float *weights,
+                               size_t max_links, size_t *n_links);
+
+/** Get all the links of a single page.
+ *
+ * The links are decoded inside the stream buffers and are valid until the next
+ * call to any stream function. Since the stream cursor is moved, streaming
+ * afterwards continues after page `from`: call @ref page_db_link_stream_reset
+ * to start again from the beginning.
+ *
+ * @param es
+ * @param from Index of the page
+ * @param to Output, indices of the linked pages. Their weights are in
+ *           @ref PageDBLinkStream::weights.
+ * @param n_to Output, number of links. 0 if the page has no links stored.
+ *
+ * @return 0 if success, otherwise the error code.
+ */
+PageDBError
+page_db_link_stream_out_links(PageDBLinkStream *es,
+                              uint64_t from,
+                              const uint64_t **to,
+                              size_t *n_to);
+
 /** Delete link stream and free any transaction hold inside the database. */
 void
 page_db_link_stream_delete(PageDBLinkStream *es);
@@ -458,6 +750,65 @@ hashinfo_stream_delete(HashInfoStream *st);
 
 /// @}
 
+/// @addtogroup DomainStream
+/// @{
+
+/** Stream over the HashInfo of the pages of a single domain.
+ *
+ * The domain hash is stored in the high 32 bits of the page hash and so all
+ * the pages of a domain are contiguous inside hash2info. The stream jumps to
+ * the first page of the domain and stops at the first page of another domain,
+ * making per domain scans proportional to the number of pages of the domain.
+ */
+typedef struct {
+     PageDB *db;
+     MDB_cursor *cur;      /**< Cursor to the hash2info database */
+     uint32_t domain_hash; /**< Domain hash, as in @ref page_db_hash_get_domain */
+     StreamState state;
+} DomainStream;
+
+/** Create a new stream over the pages of the given domain */
+PageDBError
+page_db_domain_stream_new(DomainStream **st, PageDB *db, uint32_t domain_hash);
+
+/** Create a new stream over the pages of the same domain as the given URL */
+PageDBError
+page_db_domain_stream_new_url(DomainStream **st, PageDB *db, const char *url);
+
+/** Get next element in stream */
+StreamState
+page_db_domain_stream_next(DomainStream *st, uint64_t *hash, PageInfo **pi);
+
+/** Free stream */
+void
+page_db_domain_stream_delete(DomainStream *st);
+
+/// @}
+
+/// @addtogroup DomainInfoStream
+/// @{
+
+/** Stream over all the @ref DomainInfo inside PageDB */
+typedef struct {
+     PageDB *db;
+     MDB_cursor *cur;   /**< Cursor to the domains database */
+     StreamState state;
+} DomainInfoStream;
+
+/** Create a new stream */
+PageDBError
+domaininfo_stream_new(DomainInfoStream **st, PageDB *db);
+
+/** Get next element in stream */
+StreamState
+domaininfo_stream_next(DomainInfoStream *st, uint32_t *domain_hash, DomainInfo *di);
+
+/** Free stream */
+void
+domaininfo_stream_delete(DomainInfoStream *st);
+
+/// @}
+
 /// @addtogroup HashIdxStream
 /// @{
 
@@ -482,10 +833,227 @@ hashidx_stream_delete(HashIdxStream *st);
 
 /// @}
 
+/// @addtogroup PageDBColumns
+/// @{
+
+/** Columnar copy of the hash2info and hash2idx databases.
+ *
+ * Each field of @ref PageInfo is stored in its own contiguous array, so that
+ * it can be analyzed without any per page overhead, for example wrapping the
+ * arrays with numpy. Row i of every column refers to the same page and the
+ * rows are ordered by hash.
+ *
+ * The arrays are anonymous @ref MMapArray and may hold more elements than
+ * @ref PageDBColumns::n_pages. Only the first n_pages elements are valid.
+ */
+typedef struct {
+     size_t n_pages;          /**< Number of exported pages */
+
+     MMapArray *hash;         /**< uint64_t, page hash */
+     MMapArray *idx;          /**< uint64_t, index inside hash2idx. UINT64_MAX if missing */
+     MMapArray *linked_from;  /**< uint64_t, see @ref PageInfo::linked_from */
+     MMapArray *depth;        /**< uint64_t, see @ref PageInfo::depth */
+     MMapArray *n_crawls;     /**< uint64_t, see @ref PageInfo::n_crawls */
+     MMapArray *n_changes;    /**< uint64_t, see @ref PageInfo::n_changes */
+     MMapArray *first_crawl;  /**< double, see @ref PageInfo::first_crawl */
+     MMapArray *last_crawl;   /**< double, see @ref PageInfo::last_crawl */
+     MMapArray *score;        /**< float, see @ref PageInfo::score */
+
+     /** uint64_t, n_pages + 1 offsets inside @ref PageDBColumns::url_blob.
+      * The URL of page i is between url_offsets[i] and url_offsets[i + 1],
+      * without NUL terminator. NULL if URLs are not exported. */
+     MMapArray *url_offsets;
+     /** char, all the URLs one after the other. NULL if URLs are not exported */
+     MMapArray *url_blob;
+} PageDBColumns;
+
+/** Create empty columns
+ *
+ * @param cols Will point to the new columns, or NULL if failure
+ * @param with_urls If true URLs will be exported too, which is much slower
+ *                  since they must be decompressed.
+ *
+ * @return 0 if success, otherwise the error code
+ */
+PageDBError
+page_db_columns_new(PageDBColumns **cols, int with_urls);
+
+/** Free columns and all their arrays. Does nothing if NULL */
+void
+page_db_columns_delete(PageDBColumns *cols);
+
+/** Append to the columns all the pages with hash inside [hash_begin, hash_end].
+ *
+ * A single read transaction is used, and no memory is allocated per page.
+ * Several calls on disjoint ranges, each one with its own columns, can run
+ * concurrently from different threads. See @ref page_db_export_range.
+ *
+ * @return 0 if success, otherwise the error code
+ */
+PageDBError
+page_db_export(PageDB *db, uint64_t hash_begin, uint64_t hash_end, PageDBColumns *cols);
+
+/** Compute the hash range of one of n_parts partitions of equal width
+ *
+ * The ranges of all the parts cover all possible hashes without overlapping.
+ */
+void
+page_db_export_range(size_t n_parts, size_t part, uint64_t *hash_begin, uint64_t *hash_end);
+
+/// @}
+
+/// @addtogroup PageDBBackup
+/// @{
+
+/** Version of the format written by @ref page_db_backup */
+#define PAGE_DB_BACKUP_VERSION 1
+/** Maximum number of records inside each block of a backup */
+#define PAGE_DB_BACKUP_BLOCK_RECORDS 4096
+
+/** Write a binary backup of all the databases, links included.
+ *
+ * The backup starts with a versioned header, followed by the records of each
+ * database in key order, grouped in blocks. Inside each block keys, value
+ * sizes and values are stored as separate columns, with the integer keys
+ * delta encoded, and each block carries a checksum of its contents.
+ *
+ * The records can be split in n_parts disjoint parts, each one written by a
+ * different call, possibly from different threads.
+ *
+ * @param output Where the backup is written
+ * @param n_parts Number of parts in which the backup is split
+ * @param part Which part to write, from 0 to n_parts - 1
+ *
+ * @return 0 if success, otherwise the error code
+ */
+PageDBError
+page_db_backup(PageDB *db, FILE *output, size_t n_parts, size_t part);
+
+/** Load a backup made with @ref page_db_backup into an empty database.
+ *
+ * Records are appended, without searching the B-tree, and so the parts of a
+ * backup must be restored in order.
+ * The database is expanded as needed, no matter how much larger than its
+ * current size the backup is.
+ *
+ * @return 0 if success, otherwise the error code
+ */
+PageDBError
+page_db_restore(PageDB *db, FILE *input);
+
+/// @}
+
+/// @addtogroup PageDBStats
+/// @{
+
+/** Number of databases inside the @ref PageDB environment */
+#define PAGE_DB_N_DBS 9
+
+/** Storage statistics, see @ref page_db_stats */
+typedef struct {
+     TxnManagerEnvStats env;
+     /** All databases: info, hash2info, hash2idx, links, domains, simhash,
+      * simhash_lsh, page_hll and domain_hll */
+     TxnManagerDBStats dbs[PAGE_DB_N_DBS];
+
+     size_t n_samples;       /**< Number of hash2info records sampled */
+     double record_size;     /**< Average size of the hash2info values */
+     double url_size;        /**< Average length of the URLs */
+     double url_compression; /**< URL length divided by its compressed size */
+} PageDBStats;
+
+/** Get the size of the environment and of each database.
+ *
+ * Besides, up to max_samples records of hash2info are read to compute their
+ * average size and the compression ratio of the URLs. Since records are
+ * clustered by domain the sample is not made of the first records but of a
+ * random page from each of max_samples equal slices of all the pages, as
+ * counted by the domains database.
+ *
+ * @param max_samples Maximum number of hash2info records to read. If 0 all
+ *                    of them are read.
+ *
+ * @return 0 if success, otherwise the error code
+ */
+PageDBError
+page_db_stats(PageDB *db, size_t max_samples, PageDBStats *stats);
+
+/** Compact the environment to recover disk space and scan speed.
+ *
+ * See @ref txn_manager_compact. The copy takes about as long as a backup,
+ * and fails if other processes have the database open.
+ *
+ * @return 0 if success, otherwise the error code
+ */
+PageDBError
+page_db_compact(PageDB *db);
+
+/** Number of pages deleted per write transaction by @ref page_db_prune */
+#define PAGE_DB_PRUNE_BATCH 10000
+
+/** Criteria to prune uncrawled pages, see @ref page_db_prune.
+ *
+ * A page is pruned if it meets any of the enabled criteria.
+ */
+typedef struct {
+     /** Prune pages whose linking page was last crawled more than this
+      * number of seconds before @ref now. Uncrawled pages have no timestamp
+      * of their own. 0 disables */
+     double ttl;
+     /** Reference time for @ref ttl, usually the current time */
+     double now;
+     /** Prune pages deeper than this, 0 disables */
+     uint64_t max_depth;
+     /** Prune pages with a score below this percentile of the scores of all
+      * the uncrawled pages, in [0, 100]. 0 disables */
+     float score_percentile;
+} PageDBPruneOptions;
+
+/** Delete uncrawled pages that we are unlikely to ever crawl.
+ *
+ * Crawled pages and seeds are never pruned. The page info, the page index
+ * and the linking domains of the pruned pages are removed, and the domain
+ * page counts updated.
+ *
+ * Page indices are not reused: the index of a pruned page becomes a
+ * tombstone, so the links database and the arrays indexed by page stay
+ * valid, and links to the pruned page are simply dangling. If the page is
+ * found again it is added with a new index.
+ *
+ * Deletes are made in batches of @ref PAGE_DB_PRUNE_BATCH pages so that
+ * writers are not blocked for long. Run @ref page_db_compact afterwards to
+ * give back the freed space.
+ *
+ * @param pruned If not NULL, receives the sorted array of the hashes of the
+ *               pruned pages, which must be released with free
+ * @param n_pruned Number of pruned pages
+ *
+ * @return 0 if success, otherwise the error code
+ */
+PageDBError
+page_db_prune(PageDB *db,
+              const PageDBPruneOptions *options,
+              uint64_t **pruned,
+              size_t *n_pruned);
+
+/// @}
+
 #if (defined TEST) && TEST
 #include "CuTest.h"
 CuSuite *
 test_page_db_suite(size_t n_pages);
+
+CuSuite *
+test_page_db_domains_suite(void);
+
+CuSuite *
+test_page_db_export_suite(void);
+
+CuSuite *
+test_page_db_prune_suite(void);
+
+CuSuite *
+test_page_db_storage_suite(void);
 #endif
 
 #endif // __PAGE_DB_H
@@ -0,0 +1,553 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xxhash.h"
+
+#include "page_db.h"
+#include "page_db_private.h"
+#include "util.h"
+
+/// @addtogroup PageDBBackup
+/// @{
+
+/** Magic string at the start of every backup */
+static const char page_db_backup_magic[8] = {'A', 'D', 'U', 'A', 'N', 'A', 'D', 'B'};
+
+/** How the keys of a database are split between the parts of a backup */
+typedef enum {
+     page_db_backup_part_first, /**< All keys go to the first part */
+     page_db_backup_part_hash,  /**< Uniform split of the 64 bit key space */
+     page_db_backup_part_hash32,/**< Uniform split of the 32 bit key space */
+     page_db_backup_part_index  /**< Uniform split of the page indices */
+} PageDBBackupPart;
+
+/** A database inside a backup */
+typedef struct {
+     const char *name;
+     int (*open_cursor)(MDB_txn *txn, MDB_cursor **cursor);
+     size_t key_size;           /**< 0 for variable length keys */
+     int dupsort;               /**< True if keys can have several values */
+     PageDBBackupPart part;
+} PageDBBackupDB;
+
+static const PageDBBackupDB page_db_backup_dbs[] = {
+     {"info",        page_db_open_info,        0, 0, page_db_backup_part_first},
+     {"hash2info",   page_db_open_hash2info,   8, 0, page_db_backup_part_hash},
+     {"hash2idx",    page_db_open_hash2idx,    8, 0, page_db_backup_part_hash},
+     {"links",       page_db_open_links,       8, 0, page_db_backup_part_index},
+     {"domains",     page_db_open_domains,     4, 0, page_db_backup_part_hash32},
+     {"simhash",     page_db_open_simhash,     8, 0, page_db_backup_part_hash},
+     {"simhash_lsh", page_db_open_simhash_lsh, 4, 1, page_db_backup_part_hash32},
+     {"page_hll",    page_db_open_page_hll,    8, 0, page_db_backup_part_hash},
+     {"domain_hll",  page_db_open_domain_hll,  4, 0, page_db_backup_part_hash32}
+};
+
+#define PAGE_DB_BACKUP_N_DBS (sizeof(page_db_backup_dbs)/sizeof(*page_db_backup_dbs))
+
+/** Header of a block of records.
+ *
+ * The payload follows the header and is made of three columns: the keys,
+ * the sizes of the values and the values themselves. Integer keys are delta
+ * encoded with varints, variable length keys are written as a varint length
+ * followed by the key bytes.
+ */
+typedef struct {
+     uint32_t n_records;   /**< 0 marks the end of the database */
+     uint32_t keys_len;    /**< Bytes of the keys column */
+     uint32_t sizes_len;   /**< Bytes of the value sizes column */
+     uint32_t values_len;  /**< Bytes of the values column */
+     uint32_t checksum;    /**< XXH32 of the payload */
+} PageDBBackupBlock;
+
+/** A growable byte buffer */
+typedef struct {
+     uint8_t *data;
+     size_t len;
+     size_t size;
+} PageDBBackupBuf;
+
+static int
+page_db_backup_buf_reserve(PageDBBackupBuf *buf, size_t n) {
+     if (buf->len + n <= buf->size)
+          return 0;
+     size_t size = buf->size > 0? 2*buf->size: 4096;
+     while (size < buf->len + n)
+          size *= 2;
+     uint8_t *data = realloc(buf->data, size);
+     if (!data)
+          return -1;
+     buf->data = data;
+     buf->size = size;
+     return 0;
+}
+
+static int
+page_db_backup_buf_varint(PageDBBackupBuf *buf, uint64_t n) {
+     if (page_db_backup_buf_reserve(buf, MAX_VARINT_SIZE) != 0)
+          return -1;
+     buf->len = varint_encode_uint64(n, buf->data + buf->len) - buf->data;
+     return 0;
+}
+
+static int
+page_db_backup_buf_write(PageDBBackupBuf *buf, const void *data, size_t n) {
+     if (page_db_backup_buf_reserve(buf, n) != 0)
+          return -1;
+     memcpy(buf->data + buf->len, data, n);
+     buf->len += n;
+     return 0;
+}
+
+/** Read an integer key of 4 or 8 bytes */
+static uint64_t
+page_db_backup_key(const MDB_val *key) {
+     return key->mv_size == sizeof(uint32_t)?
+          *(uint32_t*)key->mv_data:
+          *(uint64_t*)key->mv_data;
+}
+
+/** Compute the inclusive range of keys of a database inside a part.
+ *
+ * @return 0 if the range is empty
+ */
+static int
+page_db_backup_range(const PageDBBackupDB *bdb,
+                     size_t n_parts,
+                     size_t part,
+                     uint64_t n_pages,
+                     uint64_t *begin,
+                     uint64_t *end) {
+     page_db_export_range(n_parts, part, begin, end);
+     switch (bdb->part) {
+     case page_db_backup_part_first:
+          *begin = 0;
+          *end = UINT64_MAX;
+          return part == 0;
+     case page_db_backup_part_hash:
+          return 1;
+     case page_db_backup_part_hash32:
+          // the ranges of consecutive parts must not overlap
+          *begin = part == 0? 0: ((*begin - 1) >> 32) + 1;
+          *end >>= 32;
+          return *begin <= *end;
+     case page_db_backup_part_index:
+          *begin = n_pages*part/n_parts;
+          if (part + 1 == n_parts)
+               *end = UINT64_MAX;
+          else if (n_pages*(part + 1)/n_parts == *begin)
+               return 0;
+          else
+               *end = n_pages*(part + 1)/n_parts - 1;
+          return 1;
+     }
+     return 0;
+}
+
+/** Checksum and write a block, emptying the column buffers */
+static int
+page_db_backup_write_block(FILE *output,
+                           uint32_t n_records,
+                           PageDBBackupBuf *keys,
+                           PageDBBackupBuf *sizes,
+                           PageDBBackupBuf *values) {
+     PageDBBackupBlock block = {
+          .n_records = n_records,
+          .keys_len = keys->len,
+          .sizes_len = sizes->len,
+          .values_len = values->len
+     };
+     // checksum the three columns as a single payload
+     XXH32_state_t state;
+     XXH32_reset(&state, 0);
+     XXH32_update(&state, keys->data, keys->len);
+     XXH32_update(&state, sizes->data, sizes->len);
+     XXH32_update(&state, values->data, values->len);
+     block.checksum = XXH32_digest(&state);
+
+     if (fwrite(&block, sizeof(block), 1, output) != 1 ||
+         fwrite(keys->data, 1, keys->len, output) != keys->len ||
+         fwrite(sizes->data, 1, sizes->len, output) != sizes->len ||
+         fwrite(values->data, 1, values->len, output) != values->len)
+          return -1;
+     keys->len = sizes->len = values->len = 0;
+     return 0;
+}
+
+PageDBError
+page_db_backup(PageDB *db, FILE *output, size_t n_parts, size_t part) {
+     MDB_txn *txn = 0;
+     MDB_cursor *cur = 0;
+     MDB_val key;
+     MDB_val val;
+
+     int mdb_rc = 0;
+     char *error1 = 0;
+     const char *error2 = 0;
+
+     PageDBBackupBuf keys = {0, 0, 0};
+     PageDBBackupBuf sizes = {0, 0, 0};
+     PageDBBackupBuf values = {0, 0, 0};
+
+     if (n_parts == 0 || part >= n_parts) {
+          error1 = "invalid part";
+          goto on_error;
+     }
+     // a single read transaction gives a consistent snapshot
+     if (txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn) != 0) {
+          error1 = db->txn_manager->error->message;
+          goto on_error;
+     }
+     if ((mdb_rc = page_db_open_info(txn, &cur)) != 0) {
+          error1 = "opening info cursor";
+          goto on_error;
+     }
+     size_t n_pages;
+     if ((mdb_rc = page_db_info_get_n_pages(cur, &n_pages)) != 0) {
+          error1 = "retrieving info.n_pages";
+          goto on_error;
+     }
+     mdb_cursor_close(cur);
+     cur = 0;
+
+     const uint32_t header[3] = {PAGE_DB_BACKUP_VERSION, part, n_parts};
+     if (fwrite(page_db_backup_magic, sizeof(page_db_backup_magic), 1, output) != 1 ||
+         fwrite(header, sizeof(header), 1, output) != 1) {
+          error1 = "writing header";
+          error2 = strerror(errno);
+          goto on_error;
+     }
+
+     for (size_t i=0; i<PAGE_DB_BACKUP_N_DBS; ++i) {
+          const PageDBBackupDB *bdb = page_db_backup_dbs + i;
+          const uint8_t name_len = strlen(bdb->name);
+          if (fwrite(&name_len, 1, 1, output) != 1 ||
+              fwrite(bdb->name, 1, name_len, output) != name_len) {
+               error1 = "writing database header";
+               error2 = strerror(errno);
+               goto on_error;
+          }
+          uint64_t begin;
+          uint64_t end;
+          if (page_db_backup_range(bdb, n_parts, part, n_pages, &begin, &end)) {
+               if ((mdb_rc = bdb->open_cursor(txn, &cur)) != 0) {
+                    error1 = "opening cursor";
+                    error2 = bdb->name;
+                    goto on_error;
+               }
+               uint32_t begin32 = begin;
+               if (bdb->key_size == 0) {
+                    mdb_rc = mdb_cursor_get(cur, &key, &val, MDB_FIRST);
+               } else {
+                    key.mv_size = bdb->key_size;
+                    key.mv_data = bdb->key_size == sizeof(begin32)?
+                         (void*)&begin32: (void*)&begin;
+                    mdb_rc = mdb_cursor_get(cur, &key, &val, MDB_SET_RANGE);
+               }
+               uint32_t n_records = 0;
+               uint64_t prev = 0;
+               for (; mdb_rc == 0; mdb_rc = mdb_cursor_get(cur, &key, &val, MDB_NEXT)) {
+                    int rc;
+                    if (bdb->key_size == 0) {
+                         rc = page_db_backup_buf_varint(&keys, key.mv_size) ||
+                              page_db_backup_buf_write(&keys, key.mv_data, key.mv_size);
+                    } else {
+                         const uint64_t k = page_db_backup_key(&key);
+                         if (k > end)
+                              break;
+                         // the first key of each block is stored in full
+                         rc = page_db_backup_buf_varint(&keys, n_records == 0? k: k - prev);
+                         prev = k;
+                    }
+                    if (rc != 0 ||
+                        page_db_backup_buf_varint(&sizes, val.mv_size) != 0 ||
+                        page_db_backup_buf_write(&values, val.mv_data, val.mv_size) != 0) {
+                         error1 = "allocating block memory";
+                         goto on_error;
+                    }
+                    if (++n_records == PAGE_DB_BACKUP_BLOCK_RECORDS) {
+                         if (page_db_backup_write_block(output, n_records, &keys, &sizes, &values) != 0) {
+                              error1 = "writing block";
+                              error2 = strerror(errno);
+                              goto on_error;
+                         }
+                         n_records = 0;
+                    }
+               }
+               if (mdb_rc != 0 && mdb_rc != MDB_NOTFOUND) {
+                    error1 = "iterating database";
+                    error2 = bdb->name;
+                    goto on_error;
+               }
+               mdb_rc = 0;
+               mdb_cursor_close(cur);
+               cur = 0;
+               if (n_records > 0 &&
+                   page_db_backup_write_block(output, n_records, &keys, &sizes, &values) != 0) {
+                    error1 = "writing block";
+                    error2 = strerror(errno);
+                    goto on_error;
+               }
+          }
+          // end of database
+          if (page_db_backup_write_block(output, 0, &keys, &sizes, &values) != 0) {
+               error1 = "writing block";
+               error2 = strerror(errno);
+               goto on_error;
+          }
+     }
+     // end of backup
+     const uint8_t end_mark = 0;
+     if (fwrite(&end_mark, 1, 1, output) != 1 || fflush(output) != 0) {
+          error1 = "writing end of backup";
+          error2 = strerror(errno);
+          goto on_error;
+     }
+     txn_manager_abort(db->txn_manager, txn);
+     free(keys.data);
+     free(sizes.data);
+     free(values.data);
+     return 0;
+
+on_error:
+     if (cur)
+          mdb_cursor_close(cur);
+     if (txn)
+          txn_manager_abort(db->txn_manager, txn);
+     free(keys.data);
+     free(sizes.data);
+     free(values.data);
+
+     page_db_set_error(db, page_db_error_internal, __func__);
+     page_db_add_error(db, error1);
+     if (error2)
+          page_db_add_error(db, error2);
+     if (mdb_rc != 0)
+          page_db_add_error(db, mdb_strerror(mdb_rc));
+     return db->error->code;
+}
+
+/** Write all the records of a block inside a new transaction
+ *
+ * @param mdb_rc Output, the LMDB error code if any. MDB_MAP_FULL means that
+ *               the block can be retried after growing the map.
+ */
+static int
+page_db_restore_block(PageDB *db,
+                      const PageDBBackupDB *bdb,
+                      const PageDBBackupBlock *block,
+                      uint8_t *payload,
+                      uint64_t *last_key,
+                      int *has_last_key,
+                      const char **error,
+                      int *mdb_rc) {
+     MDB_txn *txn = 0;
+     MDB_cursor *cur = 0;
+     *mdb_rc = 0;
+
+     uint8_t *k = payload;
+     uint8_t *s = k + block->keys_len;
+     uint8_t *v = s + block->sizes_len;
+     uint8_t *const k_end = s;
+     uint8_t *const s_end = v;
+     uint8_t *const v_end = v + block->values_len;
+
+     if (txn_manager_begin(db->txn_manager, 0, &txn) != 0) {
+          *error = db->txn_manager->error->message;
+          return -1;
+     }
+     if ((*mdb_rc = bdb->open_cursor(txn, &cur)) != 0) {
+          *error = "opening cursor";
+          goto on_error;
+     }
+     uint64_t key_value = 0;
+     uint32_t key32;
+     for (uint32_t i=0; i<block->n_records; ++i) {
+          uint8_t read;
+          MDB_val key;
+          MDB_val val;
+          if (k >= k_end || s >= s_end) {
+               *error = "truncated block";
+               goto on_error;
+          }
+          if (bdb->key_size == 0) {
+               key.mv_size = varint_decode_uint64(k, &read);
+               key.mv_data = k += read;
+               k += key.mv_size;
+          } else {
+               const uint64_t delta = varint_decode_uint64(k, &read);
+               k += read;
+               key_value = i == 0? delta: key_value + delta;
+               key.mv_size = bdb->key_size;
+               if (bdb->key_size == sizeof(key32)) {
+                    key32 = key_value;
+                    key.mv_data = &key32;
+               } else {
+                    key.mv_data = &key_value;
+               }
+          }
+          val.mv_size = varint_decode_uint64(s, &read);
+          s += read;
+          val.mv_data = v;
+          v += val.mv_size;
+          if (k > k_end || v > v_end) {
+               *error = "truncated block";
+               goto on_error;
+          }
+          // keys arrive sorted so pages are appended instead of searched
+          unsigned int flags = 0;
+          if (bdb->key_size != 0) {
+               flags = bdb->dupsort && *has_last_key && *last_key == key_value?
+                    MDB_APPENDDUP: MDB_APPEND;
+               *last_key = key_value;
+               *has_last_key = 1;
+          }
+          if ((*mdb_rc = mdb_cursor_put(cur, &key, &val, flags)) != 0) {
+               *error = *mdb_rc == MDB_KEYEXIST?
+                    "keys out of order, restore must be made on an empty database":
+                    "writing record";
+               goto on_error;
+          }
+     }
+     mdb_cursor_close(cur);
+     if (txn_manager_commit(db->txn_manager, txn) != 0) {
+          *error = db->txn_manager->error->message;
+          if (db->txn_manager->error->code == txn_manager_error_map_full)
+               *mdb_rc = MDB_MAP_FULL;
+          return -1;
+     }
+     return 0;
+
+on_error:
+     if (cur)
+          mdb_cursor_close(cur);
+     txn_manager_abort(db->txn_manager, txn);
+     return -1;
+}
+
+PageDBError
+page_db_restore(PageDB *db, FILE *input) {
+     char *error1 = 0;
+     const char *error2 = 0;
+     const char *db_name = 0;
+     int mdb_rc = 0;
+
+     uint8_t *payload = 0;
+     size_t payload_size = 0;
+
+     char magic[sizeof(page_db_backup_magic)];
+     uint32_t header[3];
+     if (fread(magic, sizeof(magic), 1, input) != 1 ||
+         fread(header, sizeof(header), 1, input) != 1 ||
+         memcmp(magic, page_db_backup_magic, sizeof(magic)) != 0) {
+          error1 = "not a backup file";
+          goto on_error;
+     }
+     if (header[0] != PAGE_DB_BACKUP_VERSION) {
+          error1 = "unsupported backup version";
+          goto on_error;
+     }
+
+     while (1) {
+          uint8_t name_len;
+          char name[256];
+          if (fread(&name_len, 1, 1, input) != 1) {
+               error1 = "truncated backup";
+               goto on_error;
+          }
+          if (name_len == 0)
+               break;
+          if (fread(name, 1, name_len, input) != name_len) {
+               error1 = "truncated backup";
+               goto on_error;
+          }
+          name[name_len] = '\0';
+
+          const PageDBBackupDB *bdb = 0;
+          for (size_t i=0; i<PAGE_DB_BACKUP_N_DBS; ++i)
+               if (strcmp(page_db_backup_dbs[i].name, name) == 0)
+                    bdb = page_db_backup_dbs + i;
+          if (!bdb) {
+               error1 = "unknown database";
+               goto on_error;
+          }
+          db_name = bdb->name;
+
+          uint64_t last_key = 0;
+          int has_last_key = 0;
+          while (1) {
+               PageDBBackupBlock block;
+               if (fread(&block, sizeof(block), 1, input) != 1) {
+                    error1 = "truncated backup";
+                    goto on_error;
+               }
+               if (block.n_records == 0)
+                    break;
+               const size_t size =
+                    (size_t)block.keys_len + block.sizes_len + block.values_len;
+               if (size > payload_size) {
+                    uint8_t *p = realloc(payload, size);
+                    if (!p) {
+                         error1 = "allocating block memory";
+                         goto on_error;
+                    }
+                    payload = p;
+                    payload_size = size;
+               }
+               if (fread(payload, 1, size, input) != size) {
+                    error1 = "truncated backup";
+                    goto on_error;
+               }
+               if (XXH32(payload, size, 0) != block.checksum) {
+                    error1 = "checksum mismatch";
+                    goto on_error;
+               }
+               // a backup can be much larger than the map, make room before
+               // each block and retry it if it still does not fit
+               if (page_db_expand(db) != 0) {
+                    free(payload);
+                    return db->error->code;
+               }
+               const uint64_t block_last_key = last_key;
+               const int block_has_last_key = has_last_key;
+               while (page_db_restore_block(db, bdb, &block, payload,
+                                            &last_key, &has_last_key,
+                                            &error2, &mdb_rc) != 0) {
+                    if (mdb_rc != MDB_MAP_FULL) {
+                         error1 = "restoring block";
+                         goto on_error;
+                    }
+                    error_clean(db->txn_manager->error);
+                    if (txn_manager_grow(db->txn_manager) != 0) {
+                         error1 = "growing database";
+                         error2 = db->txn_manager->error->message;
+                         mdb_rc = 0;
+                         goto on_error;
+                    }
+                    last_key = block_last_key;
+                    has_last_key = block_has_last_key;
+               }
+          }
+     }
+     free(payload);
+     return 0;
+
+on_error:
+     free(payload);
+     page_db_set_error(db, page_db_error_internal, __func__);
+     page_db_add_error(db, error1);
+     if (db_name)
+          page_db_add_error(db, db_name);
+     if (error2)
+          page_db_add_error(db, error2);
+     if (mdb_rc != 0)
+          page_db_add_error(db, mdb_strerror(mdb_rc));
+     return db->error->code;
+}
+/// @}
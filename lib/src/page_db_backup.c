@@ -0,0 +1,108 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <pthread.h>
+#include <stdio.h>
+#include "page_db.h"
+
+typedef struct {
+     PageDB *page_db;
+     char *path;
+     size_t n_parts;
+     size_t part;
+     int error;
+} BackupPart;
+
+static void *
+backup_part(void *arg) {
+     BackupPart *bp = arg;
+     FILE *output = fopen(bp->path, "w");
+     if (!output) {
+          int errno_cp = errno;
+          fprintf(stderr, "Could not open output file %s: %s\n",
+                  bp->path, strerror(errno_cp));
+          bp->error = 1;
+          return 0;
+     }
+     if (page_db_backup(bp->page_db, output, bp->n_parts, bp->part) != 0)
+          bp->error = 1;
+     if (fclose(output) != 0)
+          bp->error = 1;
+     return 0;
+}
+
+int
+main(int argc, char **argv) {
+     size_t n_parts = 1;
+
+     if (argc < 3) {
+          fprintf(stderr, "Insufficient number of arguments\n");
+          goto exit_help;
+     } else if (argc > 4) {
+          fprintf(stderr, "Too many arguments\n");
+          goto exit_help;
+     }
+     if (argc == 4 && (sscanf(argv[3], "%zu", &n_parts) != 1 || n_parts == 0)) {
+          fprintf(stderr, "Could not understand number of parts: %s\n", argv[3]);
+          goto exit_help;
+     }
+
+     PageDB *page_db = 0;
+     if (page_db_new(&page_db, argv[1]) != 0) {
+          fprintf(stderr, "Error opening page database: ");
+          fprintf(stderr, "%s", page_db? page_db->error->message: "NULL");
+          fprintf(stderr, "\n");
+          return -1;
+     }
+     page_db_set_persist(page_db, 1);
+
+     BackupPart *parts = calloc(n_parts, sizeof(*parts));
+     pthread_t *threads = calloc(n_parts, sizeof(*threads));
+     if (!parts || !threads) {
+          fprintf(stderr, "Could not allocate memory\n");
+          return -1;
+     }
+     // each part is written by its own thread into its own file
+     int backup_error = 0;
+     for (size_t i=0; i<n_parts; ++i) {
+          parts[i].page_db = page_db;
+          parts[i].n_parts = n_parts;
+          parts[i].part = i;
+          if (n_parts == 1)
+               parts[i].path = strdup(argv[2]);
+          else if (asprintf(&parts[i].path, "%s.%zu", argv[2], i) == -1)
+               parts[i].path = 0;
+          if (!parts[i].path ||
+              pthread_create(threads + i, 0, backup_part, parts + i) != 0) {
+               fprintf(stderr, "Could not start backup of part %zu\n", i);
+               n_parts = i;
+               backup_error = 1;
+               break;
+          }
+     }
+     for (size_t i=0; i<n_parts; ++i) {
+          pthread_join(threads[i], 0);
+          backup_error |= parts[i].error;
+          free(parts[i].path);
+     }
+     free(parts);
+     free(threads);
+
+     if (backup_error) {
+          fprintf(stderr, "Error making backup: ");
+          fprintf(stderr, "%s", page_db->error->message);
+          fprintf(stderr, "\n");
+          return -1;
+     }
+
+     page_db_delete(page_db);
+
+     return 0;
+
+exit_help:
+     fprintf(stderr, "Use: %s path_to_page_db path_to_output [n_parts]\n", argv[0]);
+     fprintf(stderr, "    n_parts: If greater than 1, write in parallel the files\n");
+     fprintf(stderr, "             path_to_output.0 ... path_to_output.(n_parts - 1)\n");
+     return -1;
+}
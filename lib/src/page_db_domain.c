@@ -0,0 +1,72 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "page_db.h"
+
+int
+main(int argc, char **argv) {
+     if (argc != 3) {
+          fprintf(stderr, "Incorrect number of arguments\n");
+          goto exit_help;
+     }
+
+     PageDB *page_db = 0;
+     if (page_db_new(&page_db, argv[1]) != 0) {
+          fprintf(stderr, "Error opening page database: ");
+          fprintf(stderr, "%s", page_db? page_db->error->message: "NULL");
+          fprintf(stderr, "\n");
+          return -1;
+     }
+     page_db_set_persist(page_db, 1);
+
+     DomainStream *st;
+     int ret;
+     if (strncmp(argv[2], "http", 4) == 0)
+          ret = page_db_domain_stream_new_url(&st, page_db, argv[2]);
+     else {
+          char *end;
+          uint32_t domain_hash = strtoul(argv[2], &end, 16);
+          if (*end != '\0') {
+               fprintf(stderr, "Could not parse domain hash: %s\n", argv[2]);
+               goto exit_help;
+          }
+          ret = page_db_domain_stream_new(&st, page_db, domain_hash);
+     }
+     if (ret != 0) {
+          fprintf(stderr, "Error creating stream inside database: ");
+          fprintf(stderr, "%s", page_db->error->message);
+          fprintf(stderr, "\n");
+          return -1;
+     }
+     uint64_t hash;
+     PageInfo *pi;
+     while (page_db_domain_stream_next(st, &hash, &pi) == stream_state_next) {
+          printf("%016"PRIx64" ", hash);
+          printf("%"PRIu64" ", pi->n_crawls);
+          printf("%.1f ", pi->last_crawl);
+          printf("%e ", pi->score);
+          printf("%s\n", pi->url);
+          page_info_delete(pi);
+     }
+     StreamState state = st->state;
+     page_db_domain_stream_delete(st);
+     page_db_delete(page_db);
+
+     if (state == stream_state_error) {
+          fprintf(stderr, "Error reading page database\n");
+          return -1;
+     }
+     return 0;
+
+exit_help:
+     fprintf(stderr, "Use: %s path_to_page_db (url | domain_hash)\n", argv[0]);
+     fprintf(stderr, "    url        : list all pages with the same domain as this URL\n");
+     fprintf(stderr, "    domain_hash: hexadecimal domain hash, as the high 32 bits of the page hash\n");
+     return -1;
+}
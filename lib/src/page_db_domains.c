@@ -0,0 +1,395 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "page_db.h"
+#include "page_db_private.h"
+
+/// @addtogroup DomainStream
+/// @{
+PageDBError
+page_db_domain_stream_new(DomainStream **st, PageDB *db, uint32_t domain_hash) {
+     DomainStream *p = *st = calloc(1, sizeof(*p));
+     if (p == 0)
+          return page_db_error_memory;
+
+     p->db = db;
+     p->domain_hash = domain_hash;
+     if (page_db_stream_open(db, page_db_open_hash2info, &p->cur, __func__) != 0) {
+          p->state = stream_state_error;
+          return db->error->code;
+     }
+     p->state = stream_state_init;
+
+     return 0;
+}
+
+PageDBError
+page_db_domain_stream_new_url(DomainStream **st, PageDB *db, const char *url) {
+     return page_db_domain_stream_new(
+          st, db, page_db_hash_get_domain(page_db_hash(url)));
+}
+
+StreamState
+page_db_domain_stream_next(DomainStream *st, uint64_t *hash, PageInfo **pi) {
+     if (st->state == stream_state_end || st->state == stream_state_error)
+          return st->state;
+
+     // smallest hash inside the domain
+     uint64_t first = 0;
+     ((uint32_t*)&first)[1] = st->domain_hash;
+
+     MDB_val key = {
+          .mv_size = sizeof(first),
+          .mv_data = &first
+     };
+     MDB_val val;
+     switch (mdb_cursor_get(st->cur,
+                            &key,
+                            &val,
+                            st->state == stream_state_init? MDB_SET_RANGE: MDB_NEXT)) {
+     case 0:
+          *hash = *(uint64_t*)key.mv_data;
+          if (page_db_hash_get_domain(*hash) != st->domain_hash)
+               return st->state = stream_state_end;
+          *pi = page_info_load(&val);
+          return st->state = stream_state_next;
+     case MDB_NOTFOUND:
+          return st->state = stream_state_end;
+     default:
+          return st->state = stream_state_error;
+     }
+}
+
+void
+page_db_domain_stream_delete(DomainStream *st) {
+     if (st) {
+          page_db_stream_close(st->db, st->cur);
+          free(st);
+     }
+}
+/// @}
+
+/// @addtogroup PageDB
+/// @{
+float
+domain_info_rate(const DomainInfo *di) {
+     return di->n_rates > 0? di->rate_sum/di->n_rates: -1.0;
+}
+
+int
+page_db_domain_info_load(MDB_cursor *cur, uint32_t domain_hash, DomainInfo *di) {
+     MDB_val key = {
+          .mv_size = sizeof(domain_hash),
+          .mv_data = &domain_hash
+     };
+     MDB_val val;
+     int mdb_rc = mdb_cursor_get(cur, &key, &val, MDB_SET);
+     switch (mdb_rc) {
+     case 0:
+          memcpy(di, val.mv_data, sizeof(*di));
+          return 0;
+     case MDB_NOTFOUND:
+          memset(di, 0, sizeof(*di));
+          return 0;
+     default:
+          return mdb_rc;
+     }
+}
+
+int
+page_db_domain_info_store(MDB_cursor *cur, uint32_t domain_hash, const DomainInfo *di) {
+     MDB_val key = {
+          .mv_size = sizeof(domain_hash),
+          .mv_data = &domain_hash
+     };
+     MDB_val val = {
+          .mv_size = sizeof(*di),
+          .mv_data = (void*)di
+     };
+     return mdb_cursor_put(cur, &key, &val, 0);
+}
+
+void
+page_db_domain_info_crawl(DomainInfo *di, const PageInfo *pi, float rate_old) {
+     if (pi->n_crawls == 1)
+          ++di->n_crawled;
+     if (rate_old >= 0) {
+          di->rate_sum -= rate_old;
+          --di->n_rates;
+     }
+     const float rate = page_info_rate(pi);
+     if (rate >= 0) {
+          di->rate_sum += rate;
+          ++di->n_rates;
+     }
+     if (pi->last_crawl > di->last_crawl)
+          di->last_crawl = pi->last_crawl;
+}
+
+PageDBError
+page_db_get_domain_info(PageDB *db, uint32_t domain_hash, DomainInfo *di) {
+     MDB_txn *txn = 0;
+     MDB_cursor *cur = 0;
+
+     int mdb_rc = 0;
+     char *error = 0;
+
+     if (txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn) != 0)
+          error = db->txn_manager->error->message;
+     else if ((mdb_rc = page_db_open_domains(txn, &cur)) != 0)
+          error = "opening domains cursor";
+     else if ((mdb_rc = page_db_domain_info_load(cur, domain_hash, di)) != 0)
+          error = "retrieving domain info";
+
+     if (cur)
+          mdb_cursor_close(cur);
+     if (txn)
+          txn_manager_abort(db->txn_manager, txn);
+
+     if (error != 0) {
+          page_db_set_error(db, page_db_error_internal, __func__);
+          page_db_add_error(db, error);
+          if (mdb_rc != 0)
+               page_db_add_error(db, mdb_strerror(mdb_rc));
+     }
+     return db->error->code;
+}
+
+/** Set the number of incoming links of a domain.
+ *
+ * @return 0 if success, otherwise an LMDB error code
+ */
+static int
+page_db_domain_info_set_links_in(MDB_cursor *cur, uint32_t domain_hash, uint64_t n_links_in) {
+     DomainInfo di;
+     int mdb_rc = page_db_domain_info_load(cur, domain_hash, &di);
+     if (mdb_rc != 0)
+          return mdb_rc;
+     di.n_links_in = n_links_in;
+     return page_db_domain_info_store(cur, domain_hash, &di);
+}
+
+PageDBError
+page_db_rebuild_domains(PageDB *db) {
+     if (page_db_expand(db) != 0)
+          return db->error->code;
+
+     MDB_txn *txn = 0;
+     MDB_cursor *cur_hash2info = 0;
+     MDB_cursor *cur_hash2idx = 0;
+     MDB_cursor *cur_links = 0;
+     MDB_cursor *cur_info = 0;
+     MDB_cursor *cur_domains = 0;
+
+     PageDBLinkStream *es = calloc(1, sizeof(*es));
+     // number of links from other domains to each page
+     uint32_t *links_in = 0;
+
+     MDB_val key;
+     MDB_val val;
+
+     int mdb_rc = 0;
+     char *error = 0;
+
+     if (!es) {
+          error = "allocating link decoder";
+          goto on_error;
+     }
+     if (txn_manager_begin(db->txn_manager, 0, &txn) != 0) {
+          error = db->txn_manager->error->message;
+          goto on_error;
+     }
+     if ((mdb_rc = page_db_open_hash2info(txn, &cur_hash2info)) != 0 ||
+         (mdb_rc = page_db_open_hash2idx(txn, &cur_hash2idx)) != 0 ||
+         (mdb_rc = page_db_open_links(txn, &cur_links)) != 0 ||
+         (mdb_rc = page_db_open_info(txn, &cur_info)) != 0 ||
+         (mdb_rc = page_db_open_domains(txn, &cur_domains)) != 0) {
+          error = "opening cursors";
+          goto on_error;
+     }
+     if ((mdb_rc = mdb_drop(txn, mdb_cursor_dbi(cur_domains), 0)) != 0) {
+          error = "emptying domains database";
+          goto on_error;
+     }
+
+     // pages of the same domain are contiguous, accumulate the statistics
+     // of the current domain and store them when the domain changes
+     DomainInfo di;
+     memset(&di, 0, sizeof(di));
+     uint32_t domain = 0;
+     int first = 1;
+     while ((mdb_rc = mdb_cursor_get(cur_hash2info, &key, &val,
+                                     first? MDB_FIRST: MDB_NEXT)) == 0) {
+          const uint32_t page_domain = page_db_hash_get_domain(*(uint64_t*)key.mv_data);
+          if (!first && page_domain != domain) {
+               if ((mdb_rc = page_db_domain_info_store(cur_domains, domain, &di)) != 0) {
+                    error = "storing domain info";
+                    goto on_error;
+               }
+               memset(&di, 0, sizeof(di));
+          }
+          first = 0;
+          domain = page_domain;
+
+          PageInfo *pi = page_info_load(&val);
+          if (!pi) {
+               error = "loading PageInfo";
+               goto on_error;
+          }
+          ++di.n_pages;
+          if (pi->n_crawls > 0)
+               page_db_domain_info_crawl(&di, pi, -1.0);
+          page_info_delete(pi);
+     }
+     if (mdb_rc != MDB_NOTFOUND) {
+          error = "iterating hash2info";
+          goto on_error;
+     }
+     if (!first && (mdb_rc = page_db_domain_info_store(cur_domains, domain, &di)) != 0) {
+          error = "storing domain info";
+          goto on_error;
+     }
+
+     // count the links from other domains to each page
+     size_t n_pages;
+     if ((mdb_rc = page_db_info_get_n_pages(cur_info, &n_pages)) != 0) {
+          error = "retrieving info.n_pages";
+          goto on_error;
+     }
+     if (n_pages > 0 && !(links_in = calloc(n_pages, sizeof(*links_in)))) {
+          error = "allocating link counts";
+          goto on_error;
+     }
+     first = 1;
+     while ((mdb_rc = mdb_cursor_get(cur_links, &key, &val,
+                                     first? MDB_FIRST: MDB_NEXT)) == 0) {
+          first = 0;
+          if (page_db_links_decode(es, *(uint64_t*)key.mv_data, &val,
+                                   PAGE_DB_LINKS_FORMAT_VERSION, 1) != 0) {
+               error = "decoding links";
+               goto on_error;
+          }
+          for (size_t i=0; i<es->n_to; ++i)
+               if (es->to[i] < n_pages)
+                    ++links_in[es->to[i]];
+     }
+     if (mdb_rc != MDB_NOTFOUND) {
+          error = "iterating links";
+          goto on_error;
+     }
+
+     // and add them for each domain, whose pages are contiguous in hash2idx too
+     uint64_t n_links_in = 0;
+     first = 1;
+     while ((mdb_rc = mdb_cursor_get(cur_hash2idx, &key, &val,
+                                     first? MDB_FIRST: MDB_NEXT)) == 0) {
+          const uint32_t page_domain = page_db_hash_get_domain(*(uint64_t*)key.mv_data);
+          if (!first && page_domain != domain) {
+               if (n_links_in > 0 &&
+                   (mdb_rc = page_db_domain_info_set_links_in(
+                        cur_domains, domain, n_links_in)) != 0) {
+                    error = "storing domain info";
+                    goto on_error;
+               }
+               n_links_in = 0;
+          }
+          first = 0;
+          domain = page_domain;
+
+          const uint64_t idx = *(uint64_t*)val.mv_data;
+          if (idx < n_pages)
+               n_links_in += links_in[idx];
+     }
+     if (mdb_rc != MDB_NOTFOUND) {
+          error = "iterating hash2idx";
+          goto on_error;
+     }
+     if (n_links_in > 0 &&
+         (mdb_rc = page_db_domain_info_set_links_in(
+              cur_domains, domain, n_links_in)) != 0) {
+          error = "storing domain info";
+          goto on_error;
+     }
+
+     // mark the domains database as up to date
+     if ((mdb_rc = page_db_info_set_domains(cur_info)) != 0) {
+          error = "storing info.domains";
+          goto on_error;
+     }
+
+     free(links_in);
+     page_db_link_stream_delete(es);
+     if (txn_manager_commit(db->txn_manager, txn) != 0) {
+          page_db_set_error(db, page_db_error_internal, __func__);
+          page_db_add_error(db, db->txn_manager->error->message);
+     }
+     return db->error->code;
+
+on_error:
+     free(links_in);
+     page_db_link_stream_delete(es);
+     if (txn)
+          txn_manager_abort(db->txn_manager, txn);
+
+     page_db_set_error(db, page_db_error_internal, __func__);
+     page_db_add_error(db, error);
+     if (mdb_rc != 0)
+          page_db_add_error(db, mdb_strerror(mdb_rc));
+
+     return db->error->code;
+}
+/// @}
+
+/// @addtogroup DomainInfoStream
+/// @{
+PageDBError
+domaininfo_stream_new(DomainInfoStream **st, PageDB *db) {
+     DomainInfoStream *p = *st = calloc(1, sizeof(*p));
+     if (p == 0)
+          return page_db_error_memory;
+
+     p->db = db;
+     if (page_db_stream_open(db, page_db_open_domains, &p->cur, __func__) != 0) {
+          p->state = stream_state_error;
+          return db->error->code;
+     }
+     p->state = stream_state_init;
+
+     return 0;
+}
+
+StreamState
+domaininfo_stream_next(DomainInfoStream *st, uint32_t *domain_hash, DomainInfo *di) {
+     MDB_val key;
+     MDB_val val;
+     switch (mdb_cursor_get(st->cur,
+                            &key,
+                            &val,
+                            st->state == stream_state_init? MDB_FIRST: MDB_NEXT)) {
+     case 0:
+          *domain_hash = *(uint32_t*)key.mv_data;
+          memcpy(di, val.mv_data, sizeof(*di));
+          return st->state = stream_state_next;
+     case MDB_NOTFOUND:
+          return st->state = stream_state_end;
+     default:
+          return st->state = stream_state_error;
+     }
+}
+
+void
+domaininfo_stream_delete(DomainInfoStream *st) {
+     page_db_stream_close(st->db, st->cur);
+     free(st);
+}
+/// @}
+
+#if (defined TEST) && TEST
+#include "test_page_db_domains.c"
+#endif // TEST
@@ -0,0 +1,227 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "smaz.h"
+
+#include "page_db.h"
+#include "page_db_private.h"
+
+/// @addtogroup PageDBColumns
+/// @{
+
+/** Initial number of rows of new columns */
+#define PAGE_DB_COLUMNS_MIN_PAGES 1024
+
+PageDBError
+page_db_columns_new(PageDBColumns **cols, int with_urls) {
+     PageDBColumns *p = *cols = calloc(1, sizeof(*p));
+     if (!p)
+          return page_db_error_memory;
+
+     const size_t n = PAGE_DB_COLUMNS_MIN_PAGES;
+     if (mmap_array_new(&p->hash,        0, n, sizeof(uint64_t)) != 0 ||
+         mmap_array_new(&p->idx,         0, n, sizeof(uint64_t)) != 0 ||
+         mmap_array_new(&p->linked_from, 0, n, sizeof(uint64_t)) != 0 ||
+         mmap_array_new(&p->depth,       0, n, sizeof(uint64_t)) != 0 ||
+         mmap_array_new(&p->n_crawls,    0, n, sizeof(uint64_t)) != 0 ||
+         mmap_array_new(&p->n_changes,   0, n, sizeof(uint64_t)) != 0 ||
+         mmap_array_new(&p->first_crawl, 0, n, sizeof(double)) != 0 ||
+         mmap_array_new(&p->last_crawl,  0, n, sizeof(double)) != 0 ||
+         mmap_array_new(&p->score,       0, n, sizeof(float)) != 0 ||
+         (with_urls &&
+          (mmap_array_new(&p->url_offsets, 0, n + 1, sizeof(uint64_t)) != 0 ||
+           mmap_array_new(&p->url_blob, 0, 64*n, 1) != 0))) {
+          page_db_columns_delete(p);
+          *cols = 0;
+          return page_db_error_memory;
+     }
+     if (with_urls)
+          ((uint64_t*)p->url_offsets->mem)[0] = 0;
+     return 0;
+}
+
+void
+page_db_columns_delete(PageDBColumns *cols) {
+     if (cols) {
+          MMapArray *arrays[] = {
+               cols->hash, cols->idx, cols->linked_from, cols->depth,
+               cols->n_crawls, cols->n_changes, cols->first_crawl,
+               cols->last_crawl, cols->score, cols->url_offsets, cols->url_blob
+          };
+          for (size_t i=0; i<sizeof(arrays)/sizeof(*arrays); ++i)
+               if (arrays[i])
+                    mmap_array_delete(arrays[i]);
+          free(cols);
+     }
+}
+
+/** Make room for at least one more row */
+static int
+page_db_columns_grow(PageDBColumns *cols) {
+     if (cols->n_pages < cols->hash->n_elements)
+          return 0;
+     const size_t n = 2*cols->hash->n_elements;
+     MMapArray *arrays[] = {
+          cols->hash, cols->idx, cols->linked_from, cols->depth,
+          cols->n_crawls, cols->n_changes, cols->first_crawl,
+          cols->last_crawl, cols->score
+     };
+     for (size_t i=0; i<sizeof(arrays)/sizeof(*arrays); ++i)
+          if (mmap_array_resize(arrays[i], n) != 0)
+               return -1;
+     if (cols->url_offsets && mmap_array_resize(cols->url_offsets, n + 1) != 0)
+          return -1;
+     return 0;
+}
+
+/** Decompress the URL of a dumped PageInfo at the end of the URL blob */
+static int
+page_db_columns_add_url(PageDBColumns *cols, const char *curl, size_t curl_size) {
+     uint64_t *offsets = (uint64_t*)cols->url_offsets->mem;
+     const uint64_t begin = offsets[cols->n_pages];
+     int len;
+     while (1) {
+          const size_t available = cols->url_blob->n_elements - begin;
+          len = smaz_decompress((char*)curl, (int)curl_size,
+                               cols->url_blob->mem + begin, (int)available);
+          if ((size_t)len < available)
+               break;
+          if (mmap_array_resize(cols->url_blob, 2*cols->url_blob->n_elements) != 0)
+               return -1;
+     }
+     offsets[cols->n_pages + 1] = begin + (uint64_t)len;
+     return 0;
+}
+
+PageDBError
+page_db_export(PageDB *db, uint64_t hash_begin, uint64_t hash_end, PageDBColumns *cols) {
+     MDB_txn *txn = 0;
+     MDB_cursor *cur_hash2info = 0;
+     MDB_cursor *cur_hash2idx = 0;
+
+     int mdb_rc = 0;
+     char *error = 0;
+
+     if (txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn) != 0) {
+          error = db->txn_manager->error->message;
+          goto on_error;
+     }
+     if ((mdb_rc = page_db_open_hash2info(txn, &cur_hash2info)) != 0 ||
+         (mdb_rc = page_db_open_hash2idx(txn, &cur_hash2idx)) != 0) {
+          error = "opening cursors";
+          goto on_error;
+     }
+
+     MDB_val key = {.mv_size = sizeof(hash_begin), .mv_data = &hash_begin};
+     MDB_val val;
+     MDB_val key_idx = key;
+     MDB_val val_idx;
+     // both databases have the same keys and so we walk them in parallel
+     int rc_idx = mdb_cursor_get(cur_hash2idx, &key_idx, &val_idx, MDB_SET_RANGE);
+     for (mdb_rc = mdb_cursor_get(cur_hash2info, &key, &val, MDB_SET_RANGE);
+          mdb_rc == 0;
+          mdb_rc = mdb_cursor_get(cur_hash2info, &key, &val, MDB_NEXT)) {
+          const uint64_t hash = *(uint64_t*)key.mv_data;
+          if (hash > hash_end)
+               break;
+          while (rc_idx == 0 && *(uint64_t*)key_idx.mv_data < hash)
+               rc_idx = mdb_cursor_get(cur_hash2idx, &key_idx, &val_idx, MDB_NEXT);
+          if (rc_idx != 0 && rc_idx != MDB_NOTFOUND) {
+               mdb_rc = rc_idx;
+               error = "iterating hash2idx";
+               goto on_error;
+          }
+          if (page_db_columns_grow(cols) != 0) {
+               error = "growing columns";
+               goto on_error;
+          }
+          const size_t n = cols->n_pages;
+          uint64_t idx = UINT64_MAX;
+          if (rc_idx == 0 && *(uint64_t*)key_idx.mv_data == hash)
+               idx = *(uint64_t*)val_idx.mv_data;
+
+          // see page_info_dump for the layout
+          const char *data = val.mv_data;
+          unsigned short curl_size;
+          memcpy(&curl_size, data, sizeof(curl_size));
+          data += sizeof(curl_size);
+          if (cols->url_blob &&
+              page_db_columns_add_url(cols, data, curl_size) != 0) {
+               error = "decompressing URL";
+               goto on_error;
+          }
+          data += curl_size;
+
+          float score;
+          uint64_t linked_from;
+          uint64_t depth;
+          uint64_t n_crawls;
+          uint64_t n_changes = 0;
+          double first_crawl = 0.0;
+          double last_crawl = 0.0;
+#define PAGE_DB_EXPORT_READ(x) do { memcpy(&(x), data, sizeof(x)); data += sizeof(x); } while (0)
+          PAGE_DB_EXPORT_READ(score);
+          PAGE_DB_EXPORT_READ(linked_from);
+          PAGE_DB_EXPORT_READ(depth);
+          PAGE_DB_EXPORT_READ(n_crawls);
+          if (n_crawls > 0) {
+               PAGE_DB_EXPORT_READ(first_crawl);
+               if (n_crawls > 1) {
+                    PAGE_DB_EXPORT_READ(last_crawl);
+                    PAGE_DB_EXPORT_READ(n_changes);
+               } else {
+                    last_crawl = first_crawl;
+               }
+          }
+#undef PAGE_DB_EXPORT_READ
+          ((uint64_t*)cols->hash->mem)[n] = hash;
+          ((uint64_t*)cols->idx->mem)[n] = idx;
+          ((uint64_t*)cols->linked_from->mem)[n] = linked_from;
+          ((uint64_t*)cols->depth->mem)[n] = depth;
+          ((uint64_t*)cols->n_crawls->mem)[n] = n_crawls;
+          ((uint64_t*)cols->n_changes->mem)[n] = n_changes;
+          ((double*)cols->first_crawl->mem)[n] = first_crawl;
+          ((double*)cols->last_crawl->mem)[n] = last_crawl;
+          ((float*)cols->score->mem)[n] = score;
+          cols->n_pages++;
+     }
+     if (mdb_rc != 0 && mdb_rc != MDB_NOTFOUND) {
+          error = "iterating hash2info";
+          goto on_error;
+     }
+     mdb_cursor_close(cur_hash2info);
+     mdb_cursor_close(cur_hash2idx);
+     txn_manager_abort(db->txn_manager, txn);
+     return 0;
+
+on_error:
+     if (cur_hash2info)
+          mdb_cursor_close(cur_hash2info);
+     if (cur_hash2idx)
+          mdb_cursor_close(cur_hash2idx);
+     if (txn)
+          txn_manager_abort(db->txn_manager, txn);
+
+     page_db_set_error(db, page_db_error_internal, __func__);
+     page_db_add_error(db, error);
+     if (mdb_rc != 0 && mdb_rc != MDB_NOTFOUND)
+          page_db_add_error(db, mdb_strerror(mdb_rc));
+     return db->error->code;
+}
+
+void
+page_db_export_range(size_t n_parts, size_t part, uint64_t *hash_begin, uint64_t *hash_end) {
+     const uint64_t width = UINT64_MAX/n_parts;
+     *hash_begin = part*width;
+     *hash_end = part + 1 == n_parts? UINT64_MAX: (part + 1)*width - 1;
+}
+/// @}
+
+#if (defined TEST) && TEST
+#include "test_page_db_export.c"
+#endif // TEST
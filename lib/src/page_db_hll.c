@@ -0,0 +1,187 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <stdint.h>
+
+#include "page_db.h"
+#include "page_db_private.h"
+
+/// @addtogroup PageDB
+/// @{
+
+int
+page_db_hll_load(MDB_cursor *cur, MDB_val *key, HLL *hll) {
+     MDB_val val;
+     int mdb_rc = mdb_cursor_get(cur, key, &val, MDB_SET);
+     switch (mdb_rc) {
+     case 0:
+          return hll_load(hll, val.mv_data, val.mv_size) == 0? 0: MDB_CORRUPTED;
+     case MDB_NOTFOUND:
+          hll_init(hll);
+          return 0;
+     default:
+          return mdb_rc;
+     }
+}
+
+int
+page_db_hll_add(MDB_cursor *cur, MDB_val *key, int dense, uint32_t domain_hash) {
+     HLL hll;
+     int mdb_rc = page_db_hll_load(cur, key, &hll);
+     if (mdb_rc != 0)
+          return mdb_rc;
+     if (dense)
+          hll_promote(&hll);
+     if (!hll_add(&hll, domain_hash))
+          return 0;
+
+     uint8_t buf[1 + HLL_REGISTERS];
+     hll_dump(&hll, buf);
+     MDB_val val = {
+          .mv_size = hll_size(&hll),
+          .mv_data = buf
+     };
+     return mdb_cursor_put(cur, key, &val, 0);
+}
+
+/** Estimate the number of linking domains of the sketch stored under key */
+static PageDBError
+page_db_count_linking_domains(PageDB *db,
+                              int (*open_cursor)(MDB_txn *, MDB_cursor **),
+                              MDB_val *key,
+                              float *count,
+                              const char *func) {
+     MDB_txn *txn = 0;
+     MDB_cursor *cur = 0;
+
+     int mdb_rc = 0;
+     char *error = 0;
+
+     HLL hll;
+     if (txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn) != 0)
+          error = db->txn_manager->error->message;
+     else if ((mdb_rc = open_cursor(txn, &cur)) != 0)
+          error = "opening sketch cursor";
+     else if ((mdb_rc = page_db_hll_load(cur, key, &hll)) != 0)
+          error = "retrieving sketch";
+     else
+          *count = hll_count(&hll);
+
+     if (cur)
+          mdb_cursor_close(cur);
+     if (txn)
+          txn_manager_abort(db->txn_manager, txn);
+
+     if (error != 0) {
+          page_db_set_error(db, page_db_error_internal, func);
+          page_db_add_error(db, error);
+          if (mdb_rc != 0)
+               page_db_add_error(db, mdb_strerror(mdb_rc));
+     }
+     return db->error->code;
+}
+
+PageDBError
+page_db_get_linking_domains(PageDB *db, uint64_t hash, float *count) {
+     MDB_val key = {
+          .mv_size = sizeof(hash),
+          .mv_data = &hash
+     };
+     return page_db_count_linking_domains(
+          db, page_db_open_page_hll, &key, count, __func__);
+}
+
+PageDBError
+page_db_get_domain_linking_domains(PageDB *db, uint32_t domain_hash, float *count) {
+     MDB_val key = {
+          .mv_size = sizeof(domain_hash),
+          .mv_data = &domain_hash
+     };
+     return page_db_count_linking_domains(
+          db, page_db_open_domain_hll, &key, count, __func__);
+}
+
+PageDBError
+page_db_get_linking_domains_counts(PageDB *db, MMapArray *counts) {
+     MDB_txn *txn = 0;
+     MDB_cursor *cur_page_hll = 0;
+     MDB_cursor *cur_hash2idx = 0;
+     MDB_cursor *cur_info = 0;
+
+     MDB_val key;
+     MDB_val val;
+
+     int mdb_rc = 0;
+     char *error1 = 0;
+     char *error2 = 0;
+
+     if (txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn) != 0) {
+          error1 = db->txn_manager->error->message;
+          goto on_error;
+     }
+     if ((mdb_rc = page_db_open_page_hll(txn, &cur_page_hll)) != 0 ||
+         (mdb_rc = page_db_open_hash2idx(txn, &cur_hash2idx)) != 0 ||
+         (mdb_rc = page_db_open_info(txn, &cur_info)) != 0) {
+          error1 = "opening cursors";
+          error2 = mdb_strerror(mdb_rc);
+          goto on_error;
+     }
+
+     size_t n_pages;
+     if ((mdb_rc = page_db_info_get_n_pages(cur_info, &n_pages)) != 0) {
+          error1 = "retrieving info.n_pages";
+          error2 = mdb_strerror(mdb_rc);
+          goto on_error;
+     }
+     if (counts->n_elements < n_pages &&
+         mmap_array_resize(counts, n_pages) != 0) {
+          error1 = "resizing counts array";
+          error2 = counts->error->message;
+          goto on_error;
+     }
+     mmap_array_zero(counts);
+
+     for (mdb_rc = mdb_cursor_get(cur_page_hll, &key, &val, MDB_FIRST);
+          mdb_rc == 0;
+          mdb_rc = mdb_cursor_get(cur_page_hll, &key, &val, MDB_NEXT)) {
+          HLL hll;
+          if (hll_load(&hll, val.mv_data, val.mv_size) != 0) {
+               error1 = "loading sketch";
+               goto on_error;
+          }
+          const float count = hll_count(&hll);
+
+          if (page_db_set_by_hash(db, cur_hash2idx, *(uint64_t*)key.mv_data,
+                                  counts, &count) != 0) {
+               error1 = "setting count";
+               goto on_error;
+          }
+     }
+     if (mdb_rc != MDB_NOTFOUND) {
+          error1 = "iterating on page_hll";
+          error2 = mdb_strerror(mdb_rc);
+          goto on_error;
+     }
+     mdb_cursor_close(cur_page_hll);
+     mdb_cursor_close(cur_hash2idx);
+     mdb_cursor_close(cur_info);
+     txn_manager_abort(db->txn_manager, txn);
+     return 0;
+
+on_error:
+     if (cur_page_hll)
+          mdb_cursor_close(cur_page_hll);
+     if (cur_hash2idx)
+          mdb_cursor_close(cur_hash2idx);
+     if (cur_info)
+          mdb_cursor_close(cur_info);
+     if (txn)
+          txn_manager_abort(db->txn_manager, txn);
+
+     page_db_set_error(db, page_db_error_internal, __func__);
+     page_db_add_error(db, error1);
+     page_db_add_error(db, error2);
+     return db->error->code;
+}
+/// @}
@@ -97,19 +97,23 @@ main(int argc, char **argv) {
      }
      lst->only_diff_domain = 0;
 
-     Link link;
+     Link links[LINK_STREAM_BLOCK_SIZE];
+     size_t n_links;
      LinkList *blinks = 0;
      LinkList *flinks = 0;
      int blinks_len = 0;
      int flinks_len = 0;
-     while (page_db_link_stream_next(lst, &link) == stream_state_next) {
-          if ((uint64_t)link.from == idx) {
-               flinks = link_list_cons(flinks, link.to);
-               ++flinks_len;
-          }
-          if ((uint64_t)link.to == idx) {
-               blinks = link_list_cons(blinks, link.from);
-               ++blinks_len;
+     while (page_db_link_stream_next_block(
+                 lst, links, 0, LINK_STREAM_BLOCK_SIZE, &n_links) == stream_state_next) {
+          for (size_t i=0; i<n_links; ++i) {
+               if ((uint64_t)links[i].from == idx) {
+                    flinks = link_list_cons(flinks, links[i].to);
+                    ++flinks_len;
+               }
+               if ((uint64_t)links[i].to == idx) {
+                    blinks = link_list_cons(blinks, links[i].from);
+                    ++blinks_len;
+               }
           }
      }
      page_db_link_stream_delete(lst);
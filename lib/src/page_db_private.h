@@ -0,0 +1,199 @@
+#ifndef __PAGE_DB_PRIVATE_H
+#define __PAGE_DB_PRIVATE_H
+
+/* Functions shared between the modules that implement @ref PageDB. They are
+ * not part of the public interface, see page_db.h for it.
+ */
+
+#include "lmdb.h"
+
+#include "page_db.h"
+
+/// @addtogroup PageDB
+/// @{
+
+void
+page_db_set_error(PageDB *db, int code, const char *message);
+
+void
+page_db_add_error(PageDB *db, const char *message);
+
+/** Open a cursor to the hash2info database
+ *
+ * @return 0 if success, otherwise an LMDB error code
+ */
+int
+page_db_open_hash2info(MDB_txn *txn, MDB_cursor **cursor);
+
+/** Open a cursor to the hash2idx database */
+int
+page_db_open_hash2idx(MDB_txn *txn, MDB_cursor **cursor);
+
+/** Open a cursor to the links database */
+int
+page_db_open_links(MDB_txn *txn, MDB_cursor **cursor);
+
+/** Open a cursor to the info database */
+int
+page_db_open_info(MDB_txn *txn, MDB_cursor **cursor);
+
+/** Open a cursor to the domains database */
+int
+page_db_open_domains(MDB_txn *txn, MDB_cursor **cursor);
+
+/** Read the total number of pages from the info database
+ *
+ * @return 0 if success, otherwise an LMDB error code
+ */
+int
+page_db_info_get_n_pages(MDB_cursor *cur_info, size_t *n_pages);
+
+/** Mark inside the info database that the domains database is up to date
+ * with the rest of the databases
+ *
+ * @return 0 if success, otherwise an LMDB error code
+ */
+int
+page_db_info_set_domains(MDB_cursor *cur_info);
+
+/** Doubles database size.
+ *
+ * This function is automatically called when an operation cannot proceed because
+ * of insufficient allocated mmap memory.
+ */
+PageDBError
+page_db_expand(PageDB *db);
+
+/** Decode a value of the links database into the buffers of the stream.
+ *
+ * @param es Output is written to @ref PageDBLinkStream::to, weights, n_to
+ *           and n_diff. Links without stored weights get weight 1.0
+ * @param from Index of the page, the key of the value
+ * @param val
+ * @param format Version of the links format of the value
+ * @param only_diff_domain If true decode just the links to different domains
+ *
+ * @return 0 if success, -1 if failure
+ */
+int
+page_db_links_decode(PageDBLinkStream *es,
+                     uint64_t from,
+                     const MDB_val *val,
+                     int format,
+                     int only_diff_domain);
+
+/** Read the statistics of a domain, or all zeros if not present.
+ *
+ * @return 0 if success, otherwise an LMDB error code
+ */
+int
+page_db_domain_info_load(MDB_cursor *cur, uint32_t domain_hash, DomainInfo *di);
+
+/** Write the statistics of a domain.
+ *
+ * @return 0 if success, otherwise an LMDB error code
+ */
+int
+page_db_domain_info_store(MDB_cursor *cur, uint32_t domain_hash, const DomainInfo *di);
+
+/** Account a new crawl of a page in the statistics of its domain.
+ *
+ * @param pi The page info, already updated with the crawl
+ * @param rate_old The change rate of the page before the crawl, negative if
+ *                 not valid
+ */
+void
+page_db_domain_info_crawl(DomainInfo *di, const PageInfo *pi, float rate_old);
+
+/** Open a cursor to the simhash database */
+int
+page_db_open_simhash(MDB_txn *txn, MDB_cursor **cursor);
+
+/** Open a cursor to the simhash_lsh database */
+int
+page_db_open_simhash_lsh(MDB_txn *txn, MDB_cursor **cursor);
+
+/** Store the SimHash of a crawled page, moving it inside the LSH index if it
+ * has changed since the last crawl.
+ *
+ * @return 0 if success, otherwise an LMDB error code
+ */
+int
+page_db_simhash_update(MDB_cursor *cur_simhash,
+                       MDB_cursor *cur_lsh,
+                       uint64_t hash,
+                       uint64_t simhash,
+                       double time);
+
+/** Open a cursor to the page_hll database */
+int
+page_db_open_page_hll(MDB_txn *txn, MDB_cursor **cursor);
+
+/** Open a cursor to the domain_hll database */
+int
+page_db_open_domain_hll(MDB_txn *txn, MDB_cursor **cursor);
+
+/** Find the index of a page
+ *
+ * @return 0 if success, @ref page_db_error_no_page if the page does not
+ *         exist, otherwise the error code
+ */
+PageDBError
+page_db_get_idx_cur(PageDB *db, MDB_cursor *cur, uint64_t hash, uint64_t *idx);
+
+/** Set the element of an array at the index of a page. Pages without index
+ * are ignored.
+ *
+ * @param cur_hash2idx Cursor to the hash2idx database
+ * @param values Array indexed by page
+ * @param value Pointer to the new value of the element
+ *
+ * @return 0 if success, otherwise the error code
+ */
+PageDBError
+page_db_set_by_hash(PageDB *db,
+                    MDB_cursor *cur_hash2idx,
+                    uint64_t hash,
+                    MMapArray *values,
+                    const void *value);
+
+/** Read the sketch stored under key, or an empty one if not present.
+ *
+ * @return 0 if success, otherwise an LMDB error code
+ */
+int
+page_db_hll_load(MDB_cursor *cur, MDB_val *key, HLL *hll);
+
+/** Add a linking domain to the sketch stored under key. The sketch is
+ * written back only if it has changed.
+ *
+ * @param dense If true the sketch is promoted to dense
+ *
+ * @return 0 if success, otherwise an LMDB error code
+ */
+int
+page_db_hll_add(MDB_cursor *cur, MDB_val *key, int dense, uint32_t domain_hash);
+
+/** Begin a read transaction and open a cursor inside it.
+ *
+ * This is how all the streams over a database start.
+ *
+ * @param open_cursor One of the page_db_open_* functions
+ * @param cur Output, the cursor or NULL if there is an error
+ * @param func Name of the caller, for the error message
+ *
+ * @return 0 if success, otherwise the error code
+ */
+PageDBError
+page_db_stream_open(PageDB *db,
+                    int (*open_cursor)(MDB_txn *txn, MDB_cursor **cursor),
+                    MDB_cursor **cur,
+                    const char *func);
+
+/** Close a cursor opened with @ref page_db_stream_open and its transaction */
+void
+page_db_stream_close(PageDB *db, MDB_cursor *cur);
+
+/// @}
+
+#endif // __PAGE_DB_PRIVATE_H
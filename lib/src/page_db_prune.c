@@ -0,0 +1,356 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "page_db.h"
+#include "page_db_private.h"
+#include "metrics.h"
+
+/// @addtogroup PageDB
+/// @{
+
+/** Pages that can be pruned: not crawled yet and not seeds */
+static int
+page_db_prune_candidate(const PageInfo *pi) {
+     return pi->n_crawls == 0 && !page_info_is_seed(pi);
+}
+
+static int
+page_db_prune_float_cmp(const void *a, const void *b) {
+     const float x = *(const float*)a;
+     const float y = *(const float*)b;
+     return x < y? -1: x > y;
+}
+
+/** Select the pages to prune, inside a single read transaction.
+ *
+ * hash2info is iterated in key order and so the selected hashes are sorted.
+ */
+static PageDBError
+page_db_prune_select(PageDB *db,
+                     const PageDBPruneOptions *options,
+                     uint64_t **hashes,
+                     size_t *n_hashes) {
+     MDB_txn *txn = 0;
+     MDB_cursor *cur = 0;
+     MDB_cursor *cur_from = 0;
+
+     MDB_val key;
+     MDB_val val;
+
+     int mdb_rc = 0;
+     char *error1 = 0;
+     char *error2 = 0;
+
+     float *scores = 0;
+     size_t n_scores = 0;
+     size_t m_scores = 0;
+     size_t m_hashes = 0;
+     *hashes = 0;
+     *n_hashes = 0;
+
+     if (txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn) != 0) {
+          error1 = db->txn_manager->error->message;
+          goto on_error;
+     }
+     if ((mdb_rc = page_db_open_hash2info(txn, &cur)) != 0 ||
+         (mdb_rc = page_db_open_hash2info(txn, &cur_from)) != 0) {
+          error1 = "opening cursors";
+          error2 = mdb_strerror(mdb_rc);
+          goto on_error;
+     }
+
+     // the score threshold needs a first pass over all the candidates
+     int by_score = 0;
+     float min_score = 0;
+     if (options->score_percentile > 0) {
+          for (mdb_rc = mdb_cursor_get(cur, &key, &val, MDB_FIRST);
+               mdb_rc == 0;
+               mdb_rc = mdb_cursor_get(cur, &key, &val, MDB_NEXT)) {
+               PageInfo *pi = page_info_load(&val);
+               if (!pi) {
+                    error1 = "deserializing data from database";
+                    goto on_error;
+               }
+               if (page_db_prune_candidate(pi)) {
+                    if (n_scores == m_scores) {
+                         m_scores = m_scores > 0? 2*m_scores: 1024;
+                         float *p = realloc(scores, m_scores*sizeof(*scores));
+                         if (!p) {
+                              page_info_delete(pi);
+                              error1 = "allocating memory for scores";
+                              goto on_error;
+                         }
+                         scores = p;
+                    }
+                    scores[n_scores++] = pi->score;
+               }
+               page_info_delete(pi);
+          }
+          if (mdb_rc != MDB_NOTFOUND) {
+               error1 = "iterating on hash2info";
+               error2 = mdb_strerror(mdb_rc);
+               goto on_error;
+          }
+          if (n_scores > 0) {
+               qsort(scores, n_scores, sizeof(*scores), page_db_prune_float_cmp);
+               size_t i = options->score_percentile/100.0*n_scores;
+               min_score = scores[i < n_scores? i: n_scores - 1];
+               by_score = 1;
+          }
+          free(scores);
+          scores = 0;
+     }
+
+     for (mdb_rc = mdb_cursor_get(cur, &key, &val, MDB_FIRST);
+          mdb_rc == 0;
+          mdb_rc = mdb_cursor_get(cur, &key, &val, MDB_NEXT)) {
+          PageInfo *pi = page_info_load(&val);
+          if (!pi) {
+               error1 = "deserializing data from database";
+               goto on_error;
+          }
+          int prune = 0;
+          if (page_db_prune_candidate(pi)) {
+               prune =
+                    (options->max_depth > 0 && pi->depth > options->max_depth) ||
+                    (by_score && pi->score < min_score);
+               // uncrawled pages have no timestamp, the best we have is the
+               // last time we saw the page that linked to them
+               if (!prune && options->ttl > 0) {
+                    MDB_val key_from = {
+                         .mv_size = sizeof(uint64_t),
+                         .mv_data = &pi->linked_from
+                    };
+                    MDB_val val_from;
+                    switch (mdb_rc = mdb_cursor_get(cur_from, &key_from, &val_from, MDB_SET)) {
+                    case 0: {
+                         PageInfo *from = page_info_load(&val_from);
+                         if (!from) {
+                              page_info_delete(pi);
+                              error1 = "deserializing data from database";
+                              goto on_error;
+                         }
+                         prune = options->now - from->last_crawl > options->ttl;
+                         page_info_delete(from);
+                         break;
+                    }
+                    case MDB_NOTFOUND:
+                         break;
+                    default:
+                         page_info_delete(pi);
+                         error1 = "retrieving linking page";
+                         error2 = mdb_strerror(mdb_rc);
+                         goto on_error;
+                    }
+               }
+          }
+          page_info_delete(pi);
+
+          if (prune) {
+               if (*n_hashes == m_hashes) {
+                    m_hashes = m_hashes > 0? 2*m_hashes: 1024;
+                    uint64_t *p = realloc(*hashes, m_hashes*sizeof(**hashes));
+                    if (!p) {
+                         error1 = "allocating memory for pruned pages";
+                         goto on_error;
+                    }
+                    *hashes = p;
+               }
+               (*hashes)[(*n_hashes)++] = *(uint64_t*)key.mv_data;
+          }
+     }
+     if (mdb_rc != MDB_NOTFOUND) {
+          error1 = "iterating on hash2info";
+          error2 = mdb_strerror(mdb_rc);
+          goto on_error;
+     }
+     mdb_cursor_close(cur);
+     mdb_cursor_close(cur_from);
+     txn_manager_abort(db->txn_manager, txn);
+     return 0;
+
+on_error:
+     if (cur)
+          mdb_cursor_close(cur);
+     if (cur_from)
+          mdb_cursor_close(cur_from);
+     if (txn)
+          txn_manager_abort(db->txn_manager, txn);
+     free(scores);
+     free(*hashes);
+     *hashes = 0;
+     *n_hashes = 0;
+
+     page_db_set_error(db, page_db_error_internal, __func__);
+     page_db_add_error(db, error1);
+     page_db_add_error(db, error2);
+     return db->error->code;
+}
+
+/** Delete a batch of pages selected by @ref page_db_prune_select.
+ *
+ * Pages crawled since they were selected are kept and removed from the
+ * array, which is compacted in place.
+ *
+ * @param n_deleted Number of pages actually deleted, which are moved to the
+ *                  front of the array
+ */
+static PageDBError
+page_db_prune_batch(PageDB *db, uint64_t *hashes, size_t n_hashes, size_t *n_deleted) {
+     MDB_txn *txn = 0;
+     MDB_cursor *cur_hash2info = 0;
+     MDB_cursor *cur_hash2idx = 0;
+     MDB_cursor *cur_domains = 0;
+     MDB_cursor *cur_page_hll = 0;
+
+     int mdb_rc = 0;
+     char *error1 = 0;
+     char *error2 = 0;
+
+     *n_deleted = 0;
+     if (page_db_expand(db) != 0)
+          return db->error->code;
+
+     if (txn_manager_begin(db->txn_manager, 0, &txn) != 0) {
+          error1 = db->txn_manager->error->message;
+          goto on_error;
+     }
+     if ((mdb_rc = page_db_open_hash2info(txn, &cur_hash2info)) != 0 ||
+         (mdb_rc = page_db_open_hash2idx(txn, &cur_hash2idx)) != 0 ||
+         (mdb_rc = page_db_open_domains(txn, &cur_domains)) != 0 ||
+         (mdb_rc = page_db_open_page_hll(txn, &cur_page_hll)) != 0) {
+          error1 = "opening cursors";
+          error2 = mdb_strerror(mdb_rc);
+          goto on_error;
+     }
+
+     for (size_t i=0; i<n_hashes; ++i) {
+          uint64_t hash = hashes[i];
+          MDB_val key = {
+               .mv_size = sizeof(hash),
+               .mv_data = &hash
+          };
+          MDB_val val;
+          switch (mdb_rc = mdb_cursor_get(cur_hash2info, &key, &val, MDB_SET)) {
+          case 0:
+               break;
+          case MDB_NOTFOUND:
+               continue;
+          default:
+               error1 = "retrieving val from hash2info";
+               error2 = mdb_strerror(mdb_rc);
+               goto on_error;
+          }
+          PageInfo *pi = page_info_load(&val);
+          if (!pi) {
+               error1 = "deserializing data from database";
+               goto on_error;
+          }
+          const int candidate = page_db_prune_candidate(pi);
+          page_info_delete(pi);
+          if (!candidate)
+               continue;
+
+          if ((mdb_rc = mdb_cursor_del(cur_hash2info, 0)) != 0) {
+               error1 = "deleting from hash2info";
+               error2 = mdb_strerror(mdb_rc);
+               goto on_error;
+          }
+          // the index is left unused: links, scores and any other array
+          // indexed by it stay valid and a page seen again gets a new index
+          if ((mdb_rc = mdb_cursor_get(cur_hash2idx, &key, &val, MDB_SET)) == 0)
+               mdb_rc = mdb_cursor_del(cur_hash2idx, 0);
+          if (mdb_rc != 0 && mdb_rc != MDB_NOTFOUND) {
+               error1 = "deleting from hash2idx";
+               error2 = mdb_strerror(mdb_rc);
+               goto on_error;
+          }
+          if ((mdb_rc = mdb_cursor_get(cur_page_hll, &key, &val, MDB_SET)) == 0)
+               mdb_rc = mdb_cursor_del(cur_page_hll, 0);
+          if (mdb_rc != 0 && mdb_rc != MDB_NOTFOUND) {
+               error1 = "deleting from page_hll";
+               error2 = mdb_strerror(mdb_rc);
+               goto on_error;
+          }
+
+          const uint32_t domain = page_db_hash_get_domain(hash);
+          DomainInfo di;
+          if ((mdb_rc = page_db_domain_info_load(cur_domains, domain, &di)) != 0) {
+               error1 = "retrieving domain info";
+               error2 = mdb_strerror(mdb_rc);
+               goto on_error;
+          }
+          if (di.n_pages > 0) {
+               di.n_pages--;
+               if ((mdb_rc = page_db_domain_info_store(cur_domains, domain, &di)) != 0) {
+                    error1 = "storing domain info";
+                    error2 = mdb_strerror(mdb_rc);
+                    goto on_error;
+               }
+          }
+          hashes[(*n_deleted)++] = hash;
+     }
+     if (txn_manager_commit(db->txn_manager, txn) != 0) {
+          txn = 0;
+          error1 = db->txn_manager->error->message;
+          goto on_error;
+     }
+     return 0;
+
+on_error:
+     if (txn)
+          txn_manager_abort(db->txn_manager, txn);
+     *n_deleted = 0;
+
+     page_db_set_error(db, page_db_error_internal, __func__);
+     page_db_add_error(db, error1);
+     page_db_add_error(db, error2);
+     return db->error->code;
+}
+
+PageDBError
+page_db_prune(PageDB *db,
+              const PageDBPruneOptions *options,
+              uint64_t **pruned,
+              size_t *n_pruned) {
+     const uint64_t t0 = metrics_now();
+     uint64_t *hashes;
+     size_t n_hashes;
+     *n_pruned = 0;
+     if (pruned)
+          *pruned = 0;
+
+     if (page_db_prune_select(db, options, &hashes, &n_hashes) != 0)
+          return db->error->code;
+
+     // deleted hashes are packed at the front of the array, so it stays
+     // sorted
+     for (size_t i=0; i<n_hashes; i+=PAGE_DB_PRUNE_BATCH) {
+          const size_t n = n_hashes - i < PAGE_DB_PRUNE_BATCH?
+               n_hashes - i: PAGE_DB_PRUNE_BATCH;
+          size_t n_deleted;
+          if (page_db_prune_batch(db, hashes + i, n, &n_deleted) != 0) {
+               free(hashes);
+               return db->error->code;
+          }
+          memmove(hashes + *n_pruned, hashes + i, n_deleted*sizeof(*hashes));
+          *n_pruned += n_deleted;
+     }
+     if (pruned)
+          *pruned = hashes;
+     else
+          free(hashes);
+
+     metrics_count(metric_page_db_pruned, *n_pruned);
+     metrics_record_since(metric_page_db_prune, t0);
+     return 0;
+}
+/// @}
+
+#if (defined TEST) && TEST
+#include "test_page_db_prune.c"
+#endif // TEST
@@ -0,0 +1,79 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <fcntl.h>
+#include <stdio.h>
+#include "page_db.h"
+
+int
+main(int argc, char **argv) {
+     size_t n_parts = 1;
+
+     if (argc < 3) {
+          fprintf(stderr, "Insufficient number of arguments\n");
+          goto exit_help;
+     } else if (argc > 4) {
+          fprintf(stderr, "Too many arguments\n");
+          goto exit_help;
+     }
+     if (argc == 4 && (sscanf(argv[3], "%zu", &n_parts) != 1 || n_parts == 0)) {
+          fprintf(stderr, "Could not understand number of parts: %s\n", argv[3]);
+          goto exit_help;
+     }
+
+     FILE **inputs = calloc(n_parts, sizeof(*inputs));
+     if (!inputs) {
+          fprintf(stderr, "Could not allocate memory\n");
+          return -1;
+     }
+     for (size_t i=0; i<n_parts; ++i) {
+          char *path = 0;
+          if (n_parts == 1)
+               path = strdup(argv[2]);
+          else if (asprintf(&path, "%s.%zu", argv[2], i) == -1)
+               path = 0;
+          if (!path || !(inputs[i] = fopen(path, "r"))) {
+               int errno_cp = errno;
+               fprintf(stderr, "Could not open input file %s: %s\n",
+                       path? path: argv[2], strerror(errno_cp));
+               return -1;
+          }
+          free(path);
+          // parts are restored one after the other, but the kernel can
+          // start reading all of them right now
+          (void)posix_fadvise(fileno(inputs[i]), 0, 0, POSIX_FADV_SEQUENTIAL);
+          (void)posix_fadvise(fileno(inputs[i]), 0, 0, POSIX_FADV_WILLNEED);
+     }
+
+     PageDB *page_db = 0;
+     if (page_db_new(&page_db, argv[1]) != 0) {
+          fprintf(stderr, "Error opening page database: ");
+          fprintf(stderr, "%s", page_db? page_db->error->message: "NULL");
+          fprintf(stderr, "\n");
+          return -1;
+     }
+     page_db_set_persist(page_db, 1);
+
+     for (size_t i=0; i<n_parts; ++i) {
+          if (page_db_restore(page_db, inputs[i]) != 0) {
+               fprintf(stderr, "Error restoring part %zu: ", i);
+               fprintf(stderr, "%s", page_db->error->message);
+               fprintf(stderr, "\n");
+               return -1;
+          }
+          fclose(inputs[i]);
+     }
+     free(inputs);
+
+     page_db_delete(page_db);
+
+     return 0;
+
+exit_help:
+     fprintf(stderr, "Use: %s path_to_page_db path_to_input [n_parts]\n", argv[0]);
+     fprintf(stderr, "    path_to_page_db: Must be a new, empty, database\n");
+     fprintf(stderr, "    n_parts        : If greater than 1, read the files\n");
+     fprintf(stderr, "                     path_to_input.0 ... path_to_input.(n_parts - 1)\n");
+     return -1;
+}
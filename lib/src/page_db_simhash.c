@@ -0,0 +1,236 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <stdint.h>
+#include <string.h>
+
+#include "page_db.h"
+#include "page_db_private.h"
+
+/// @addtogroup PageDB
+/// @{
+
+/** Value inside the simhash database */
+typedef struct {
+     uint64_t simhash;
+     double last_crawl;
+} PageDBSimHash;
+
+/** Key inside the simhash_lsh database of one of the bands of a SimHash */
+static uint32_t
+page_db_simhash_band(uint64_t simhash, uint32_t band) {
+     const uint64_t mask = (1ULL << PAGE_DB_SIMHASH_BAND_BITS) - 1;
+     return (band << PAGE_DB_SIMHASH_BAND_BITS) |
+          (uint32_t)((simhash >> (band*PAGE_DB_SIMHASH_BAND_BITS)) & mask);
+}
+
+static int
+page_db_simhash_distance(uint64_t a, uint64_t b) {
+     int n = 0;
+     for (uint64_t x = a ^ b; x != 0; x &= x - 1)
+          ++n;
+     return n;
+}
+
+int
+page_db_simhash_update(MDB_cursor *cur_simhash,
+                       MDB_cursor *cur_lsh,
+                       uint64_t hash,
+                       uint64_t simhash,
+                       double time) {
+     MDB_val key = {
+          .mv_size = sizeof(hash),
+          .mv_data = &hash
+     };
+     MDB_val val;
+     PageDBSimHash old;
+     int mdb_rc = mdb_cursor_get(cur_simhash, &key, &val, MDB_SET);
+     int indexed = 0;
+     switch (mdb_rc) {
+     case 0:
+          memcpy(&old, val.mv_data, sizeof(old));
+          indexed = old.simhash == simhash;
+          break;
+     case MDB_NOTFOUND:
+          break;
+     default:
+          return mdb_rc;
+     }
+
+     uint32_t band_key;
+     MDB_val lsh_key = {
+          .mv_size = sizeof(band_key),
+          .mv_data = &band_key
+     };
+     MDB_val lsh_val;
+     if (mdb_rc == 0 && !indexed) {
+          for (uint32_t b=0; b<PAGE_DB_SIMHASH_BANDS; ++b) {
+               band_key = page_db_simhash_band(old.simhash, b);
+               lsh_val.mv_size = sizeof(hash);
+               lsh_val.mv_data = &hash;
+               switch (mdb_rc = mdb_cursor_get(cur_lsh, &lsh_key, &lsh_val, MDB_GET_BOTH)) {
+               case 0:
+                    if ((mdb_rc = mdb_cursor_del(cur_lsh, 0)) != 0)
+                         return mdb_rc;
+                    break;
+               case MDB_NOTFOUND:
+                    break;
+               default:
+                    return mdb_rc;
+               }
+          }
+     }
+     if (!indexed) {
+          for (uint32_t b=0; b<PAGE_DB_SIMHASH_BANDS; ++b) {
+               band_key = page_db_simhash_band(simhash, b);
+               lsh_val.mv_size = sizeof(hash);
+               lsh_val.mv_data = &hash;
+               mdb_rc = mdb_cursor_put(cur_lsh, &lsh_key, &lsh_val, MDB_NODUPDATA);
+               if (mdb_rc != 0 && mdb_rc != MDB_KEYEXIST)
+                    return mdb_rc;
+          }
+     }
+
+     PageDBSimHash record = {
+          .simhash = simhash,
+          .last_crawl = time
+     };
+     key.mv_size = sizeof(hash);
+     key.mv_data = &hash;
+     val.mv_size = sizeof(record);
+     val.mv_data = &record;
+     return mdb_cursor_put(cur_simhash, &key, &val, 0);
+}
+
+PageDBError
+page_db_get_simhash(PageDB *db, uint64_t hash,
+                    uint64_t *simhash, double *last_crawl, int *found) {
+     MDB_txn *txn = 0;
+     MDB_cursor *cur = 0;
+
+     int mdb_rc = 0;
+     char *error = 0;
+
+     *found = 0;
+     if (txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn) != 0)
+          error = db->txn_manager->error->message;
+     else if ((mdb_rc = page_db_open_simhash(txn, &cur)) != 0)
+          error = "opening simhash cursor";
+     else {
+          MDB_val key = {
+               .mv_size = sizeof(hash),
+               .mv_data = &hash
+          };
+          MDB_val val;
+          switch (mdb_rc = mdb_cursor_get(cur, &key, &val, MDB_SET)) {
+          case 0: {
+               PageDBSimHash record;
+               memcpy(&record, val.mv_data, sizeof(record));
+               *simhash = record.simhash;
+               *last_crawl = record.last_crawl;
+               *found = 1;
+               break;
+          }
+          case MDB_NOTFOUND:
+               mdb_rc = 0;
+               break;
+          default:
+               error = "retrieving simhash";
+               break;
+          }
+     }
+
+     if (cur)
+          mdb_cursor_close(cur);
+     if (txn)
+          txn_manager_abort(db->txn_manager, txn);
+
+     if (error != 0) {
+          page_db_set_error(db, page_db_error_internal, __func__);
+          page_db_add_error(db, error);
+          if (mdb_rc != 0)
+               page_db_add_error(db, mdb_strerror(mdb_rc));
+     }
+     return db->error->code;
+}
+
+PageDBError
+page_db_find_near_dup(PageDB *db, uint64_t simhash,
+                      int max_distance, double min_crawl, uint64_t exclude,
+                      uint64_t *dup_hash, int *found) {
+     MDB_txn *txn = 0;
+     MDB_cursor *cur_simhash = 0;
+     MDB_cursor *cur_lsh = 0;
+
+     int mdb_rc = 0;
+     char *error = 0;
+
+     *found = 0;
+     if (txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn) != 0) {
+          error = db->txn_manager->error->message;
+          goto on_error;
+     }
+     if ((mdb_rc = page_db_open_simhash(txn, &cur_simhash)) != 0 ||
+         (mdb_rc = page_db_open_simhash_lsh(txn, &cur_lsh)) != 0) {
+          error = "opening simhash cursors";
+          goto on_error;
+     }
+
+     for (uint32_t b=0; b<PAGE_DB_SIMHASH_BANDS && !*found; ++b) {
+          uint32_t band_key = page_db_simhash_band(simhash, b);
+          MDB_val key = {
+               .mv_size = sizeof(band_key),
+               .mv_data = &band_key
+          };
+          MDB_val val;
+          // all the pages sharing this band
+          for (mdb_rc = mdb_cursor_get(cur_lsh, &key, &val, MDB_SET);
+               mdb_rc == 0 && !*found;
+               mdb_rc = mdb_cursor_get(cur_lsh, &key, &val, MDB_NEXT_DUP)) {
+               uint64_t hash = *(uint64_t*)val.mv_data;
+               if (hash == exclude)
+                    continue;
+
+               MDB_val rec_key = {
+                    .mv_size = sizeof(hash),
+                    .mv_data = &hash
+               };
+               MDB_val rec_val;
+               if ((mdb_rc = mdb_cursor_get(cur_simhash, &rec_key, &rec_val, MDB_SET)) != 0) {
+                    error = "retrieving simhash";
+                    goto on_error;
+               }
+               PageDBSimHash record;
+               memcpy(&record, rec_val.mv_data, sizeof(record));
+               if (record.last_crawl >= min_crawl &&
+                   page_db_simhash_distance(record.simhash, simhash) <= max_distance) {
+                    *dup_hash = hash;
+                    *found = 1;
+               }
+          }
+          if (mdb_rc != 0 && mdb_rc != MDB_NOTFOUND) {
+               error = "iterating simhash_lsh";
+               goto on_error;
+          }
+     }
+     mdb_cursor_close(cur_lsh);
+     mdb_cursor_close(cur_simhash);
+     txn_manager_abort(db->txn_manager, txn);
+     return 0;
+
+on_error:
+     if (cur_lsh)
+          mdb_cursor_close(cur_lsh);
+     if (cur_simhash)
+          mdb_cursor_close(cur_simhash);
+     if (txn)
+          txn_manager_abort(db->txn_manager, txn);
+
+     page_db_set_error(db, page_db_error_internal, __func__);
+     page_db_add_error(db, error);
+     if (mdb_rc != 0)
+          page_db_add_error(db, mdb_strerror(mdb_rc));
+     return db->error->code;
+}
+/// @}
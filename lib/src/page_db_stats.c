@@ -0,0 +1,133 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bf_scheduler.h"
+
+#define PAGE_DB_STATS_DEFAULT_SAMPLES 100000
+
+static void
+print_env(const char *title, const TxnManagerEnvStats *env) {
+     const double mb = 1024.0*1024.0;
+     const size_t used = env->last_page + 1;
+     printf("%s\n", title);
+     printf("  map size     %12.1f MB\n", env->map_size/mb);
+     printf("  used         %12.1f MB (%.1f%%)\n",
+            used*env->page_size/mb, 100.0*used*env->page_size/env->map_size);
+     printf("  free list    %12.1f MB (%zu pages)\n",
+            env->free_pages*env->page_size/mb, env->free_pages);
+     printf("  page size    %12zu\n", env->page_size);
+     printf("  readers      %12zu / %zu\n", env->n_readers, env->max_readers);
+}
+
+static void
+print_db_header(void) {
+     printf("\n%-12s %5s %10s %10s %10s %12s %10s\n",
+            "database", "depth", "branch", "leaf", "overflow", "entries", "MB");
+}
+
+static void
+print_db(const TxnManagerDBStats *db, size_t page_size) {
+     const size_t pages = db->branch_pages + db->leaf_pages + db->overflow_pages;
+     printf("%-12s %5zu %10zu %10zu %10zu %12zu %10.1f\n",
+            db->name, db->depth,
+            db->branch_pages, db->leaf_pages, db->overflow_pages,
+            db->entries, pages*page_size/(1024.0*1024.0));
+}
+
+static void
+print_help(const char *name) {
+     fprintf(stderr,
+             "Use: %s [options] path_to_page_db\n"
+             "\n"
+             "Print the size of the databases and of the LMDB environment\n"
+             "\n"
+             "Options:\n"
+             "  -n N     hash2info records sampled for record size and URL\n"
+             "           compression, 0 to read all of them. Default %d\n"
+             "  -b PATH  Also print the stats of this BF scheduler database\n",
+             name, PAGE_DB_STATS_DEFAULT_SAMPLES);
+}
+
+int
+main(int argc, char **argv) {
+     size_t max_samples = PAGE_DB_STATS_DEFAULT_SAMPLES;
+     const char *bf_path = 0;
+
+     int opt;
+     while ((opt = getopt(argc, argv, "n:b:h")) != -1) {
+          switch (opt) {
+          case 'n':
+               if (sscanf(optarg, "%zu", &max_samples) != 1) {
+                    fprintf(stderr, "Could not understand number of samples: %s\n", optarg);
+                    goto exit_help;
+               }
+               break;
+          case 'b':
+               bf_path = optarg;
+               break;
+          default:
+               goto exit_help;
+          }
+     }
+     if (optind != argc - 1) {
+          fprintf(stderr, "Incorrect number of arguments\n");
+          goto exit_help;
+     }
+
+     PageDB *page_db = 0;
+     if (page_db_new(&page_db, argv[optind]) != 0) {
+          fprintf(stderr, "Error opening page database: ");
+          fprintf(stderr, "%s", page_db? page_db->error->message: "NULL");
+          fprintf(stderr, "\n");
+          return -1;
+     }
+     page_db_set_persist(page_db, 1);
+
+     PageDBStats stats;
+     if (page_db_stats(page_db, max_samples, &stats) != 0) {
+          fprintf(stderr, "Error getting stats: %s\n", page_db->error->message);
+          return -1;
+     }
+     print_env("PageDB", &stats.env);
+     print_db_header();
+     for (size_t i=0; i<PAGE_DB_N_DBS; ++i)
+          print_db(stats.dbs + i, stats.env.page_size);
+     printf("\nhash2info (%zu records sampled)\n", stats.n_samples);
+     printf("  record size     %8.1f bytes\n", stats.record_size);
+     printf("  URL size        %8.1f bytes\n", stats.url_size);
+     printf("  URL compression %8.2f\n", stats.url_compression);
+
+     int ret = 0;
+     if (bf_path) {
+          BFScheduler *sch = 0;
+          BFSchedulerStats bf_stats;
+          if (bf_scheduler_new(&sch, page_db, bf_path) != 0) {
+               fprintf(stderr, "Error opening BFS scheduler database: ");
+               fprintf(stderr, "%s", sch? sch->error->message: "NULL");
+               fprintf(stderr, "\n");
+               return -1;
+          }
+          bf_scheduler_set_persist(sch, 1);
+          if (bf_scheduler_stats(sch, &bf_stats) != 0) {
+               fprintf(stderr, "Error getting stats: %s\n", sch->error->message);
+               ret = -1;
+          } else {
+               printf("\n");
+               print_env("BFScheduler", &bf_stats.env);
+               print_db_header();
+               print_db(&bf_stats.schedule, bf_stats.env.page_size);
+          }
+          bf_scheduler_delete(sch);
+     }
+     page_db_delete(page_db);
+     return ret;
+
+exit_help:
+     print_help(argv[0]);
+     return -1;
+}
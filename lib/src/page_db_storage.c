@@ -0,0 +1,270 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "page_db.h"
+#include "page_db_private.h"
+
+/// @addtogroup PageDB
+/// @{
+
+PageDBError
+page_db_compact(PageDB *db) {
+     if (txn_manager_compact(db->txn_manager, PAGE_DB_MAX_DBS) != 0) {
+          page_db_set_error(db, page_db_error_internal, __func__);
+          page_db_add_error(db, db->txn_manager->error->message);
+     }
+     return db->error->code;
+}
+
+static const char *page_db_stats_names[PAGE_DB_N_DBS] = {
+     "info", "hash2info", "hash2idx", "links", "domains",
+     "simhash", "simhash_lsh", "page_hll", "domain_hll"
+};
+
+/** Sums over the sampled hash2info records */
+typedef struct {
+     size_t n;
+     size_t record_size;
+     size_t url_size;
+     size_t curl_size;
+} PageDBStatsSums;
+
+/** Add a hash2info record to the sums
+ *
+ * @return 0 if success, -1 if the record could not be loaded
+ */
+static int
+page_db_stats_add(PageDBStatsSums *sums, const MDB_val *val) {
+     PageInfo *pi = page_info_load(val);
+     if (!pi)
+          return -1;
+     sums->record_size += val->mv_size;
+     sums->url_size += strlen(pi->url);
+     sums->curl_size += *(unsigned short*)val->mv_data;
+     page_info_delete(pi);
+     ++sums->n;
+     return 0;
+}
+
+/** Pseudo random number for the i-th sample (the splitmix64 finalizer) */
+static uint64_t
+page_db_stats_random(uint64_t i) {
+     uint64_t h = i + 0x9E3779B97F4A7C15ULL;
+     h = (h ^ (h >> 30))*0xBF58476D1CE4E5B9ULL;
+     h = (h ^ (h >> 27))*0x94D049BB133111EBULL;
+     return h ^ (h >> 31);
+}
+
+/** Read the number of pages of every domain
+ *
+ * @param domains Output, the domain hashes in key order
+ * @param cum_pages Output, for each domain the number of pages of it and all
+ *                  the previous ones
+ * @param n_domains Output, the length of both arrays
+ *
+ * @return 0 if success, otherwise an LMDB error code, or -1 if out of memory
+ */
+static int
+page_db_stats_domains(MDB_txn *txn,
+                      uint32_t **domains,
+                      uint64_t **cum_pages,
+                      size_t *n_domains) {
+     MDB_cursor *cur = 0;
+     MDB_stat stat;
+     int mdb_rc = 0;
+     *domains = 0;
+     *cum_pages = 0;
+     *n_domains = 0;
+
+     if ((mdb_rc = page_db_open_domains(txn, &cur)) != 0)
+          return mdb_rc;
+     if ((mdb_rc = mdb_stat(txn, mdb_cursor_dbi(cur), &stat)) != 0)
+          goto on_error;
+     if (stat.ms_entries == 0) {
+          mdb_cursor_close(cur);
+          return 0;
+     }
+     if (!(*domains = malloc(stat.ms_entries*sizeof(**domains))) ||
+         !(*cum_pages = malloc(stat.ms_entries*sizeof(**cum_pages)))) {
+          mdb_rc = -1;
+          goto on_error;
+     }
+     MDB_val key;
+     MDB_val val;
+     uint64_t n_pages = 0;
+     while (*n_domains < stat.ms_entries &&
+            (mdb_rc = mdb_cursor_get(cur, &key, &val, MDB_NEXT)) == 0) {
+          DomainInfo di;
+          memcpy(&di, val.mv_data, sizeof(di));
+          n_pages += di.n_pages;
+          (*domains)[*n_domains] = *(uint32_t*)key.mv_data;
+          (*cum_pages)[*n_domains] = n_pages;
+          ++(*n_domains);
+     }
+     if (mdb_rc != 0 && mdb_rc != MDB_NOTFOUND)
+          goto on_error;
+     mdb_cursor_close(cur);
+     return 0;
+
+on_error:
+     mdb_cursor_close(cur);
+     free(*domains);
+     free(*cum_pages);
+     *domains = 0;
+     *cum_pages = 0;
+     *n_domains = 0;
+     return mdb_rc;
+}
+
+/** Sample hash2info uniformly.
+ *
+ * Keys have the domain hash in their high bits, so records are clustered by
+ * domain and neither the first records nor the ones found at random keys are
+ * a uniform sample. Instead the pages are split into max_samples slices,
+ * using the page counts of the domains database, and a random page of each
+ * slice is taken. Inside a domain the low bits of the keys are hashes of the
+ * URLs, and there seeking a random key gives a random page.
+ *
+ * @return 0 if success, otherwise an LMDB error code, or -1 if a record could
+ *         not be loaded or out of memory
+ */
+static int
+page_db_stats_sample(MDB_txn *txn,
+                     MDB_cursor *cur,
+                     size_t max_samples,
+                     PageDBStatsSums *sums) {
+     uint32_t *domains;
+     uint64_t *cum_pages;
+     size_t n_domains;
+     int mdb_rc = page_db_stats_domains(txn, &domains, &cum_pages, &n_domains);
+     if (mdb_rc != 0 || n_domains == 0)
+          return mdb_rc;
+
+     const uint64_t n_pages = cum_pages[n_domains - 1];
+     for (size_t i=0; i<max_samples && n_pages > 0; ++i) {
+          const uint64_t r = page_db_stats_random(i);
+          // random page inside the i-th slice
+          const double offset = (double)(r >> 11)/(double)(1ULL << 53);
+          uint64_t page = (uint64_t)((i + offset)*n_pages/max_samples);
+          if (page >= n_pages)
+               page = n_pages - 1;
+          // first domain with more cumulated pages than page
+          size_t lo = 0;
+          size_t hi = n_domains - 1;
+          while (lo < hi) {
+               const size_t mid = lo + (hi - lo)/2;
+               if (cum_pages[mid] > page)
+                    hi = mid;
+               else
+                    lo = mid + 1;
+          }
+          const uint64_t domain_begin = (uint64_t)domains[lo] << 32;
+          uint64_t hash = domain_begin | (r & 0xFFFFFFFFULL);
+          MDB_val key = {.mv_size = sizeof(hash), .mv_data = &hash};
+          MDB_val val;
+          // past the last page of the domain wrap around to its first page
+          for (int wrap=0; wrap<2; ++wrap) {
+               mdb_rc = mdb_cursor_get(cur, &key, &val, MDB_SET_RANGE);
+               if (mdb_rc == 0 &&
+                   page_db_hash_get_domain(*(uint64_t*)key.mv_data) == domains[lo])
+                    break;
+               if (mdb_rc != 0 && mdb_rc != MDB_NOTFOUND)
+                    goto on_error;
+               mdb_rc = MDB_NOTFOUND;
+               hash = domain_begin;
+               key.mv_size = sizeof(hash);
+               key.mv_data = &hash;
+          }
+          // the domain has no pages
+          if (mdb_rc == MDB_NOTFOUND)
+               continue;
+          if (page_db_stats_add(sums, &val) != 0) {
+               mdb_rc = -1;
+               goto on_error;
+          }
+     }
+     mdb_rc = 0;
+
+on_error:
+     free(domains);
+     free(cum_pages);
+     return mdb_rc;
+}
+
+PageDBError
+page_db_stats(PageDB *db, size_t max_samples, PageDBStats *stats) {
+     memset(stats, 0, sizeof(*stats));
+     if (txn_manager_stats(db->txn_manager, &stats->env,
+                           page_db_stats_names, PAGE_DB_N_DBS, stats->dbs) != 0) {
+          page_db_set_error(db, page_db_error_internal, __func__);
+          page_db_add_error(db, db->txn_manager->error->message);
+          return db->error->code;
+     }
+
+     MDB_txn *txn = 0;
+     MDB_cursor *cur = 0;
+     MDB_val key;
+     MDB_val val;
+     int mdb_rc = 0;
+     char *error = 0;
+
+     if (txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn) != 0) {
+          error = db->txn_manager->error->message;
+          goto on_error;
+     }
+     if ((mdb_rc = page_db_open_hash2info(txn, &cur)) != 0) {
+          error = "opening hash2info database";
+          goto on_error;
+     }
+     PageDBStatsSums sums = {0};
+     if (max_samples == 0 || max_samples >= stats->dbs[1].entries) {
+          while ((mdb_rc = mdb_cursor_get(cur, &key, &val, MDB_NEXT)) == 0)
+               if (page_db_stats_add(&sums, &val) != 0) {
+                    error = "loading PageInfo";
+                    goto on_error;
+               }
+          if (mdb_rc != MDB_NOTFOUND) {
+               error = "reading hash2info";
+               goto on_error;
+          }
+     } else if ((mdb_rc = page_db_stats_sample(txn, cur, max_samples, &sums)) != 0) {
+          error = "sampling hash2info";
+          if (mdb_rc == -1)
+               mdb_rc = 0;
+          goto on_error;
+     }
+     mdb_rc = 0;
+     mdb_cursor_close(cur);
+     cur = 0;
+     txn_manager_abort(db->txn_manager, txn);
+
+     stats->n_samples = sums.n;
+     if (sums.n > 0) {
+          stats->record_size = (double)sums.record_size/sums.n;
+          stats->url_size = (double)sums.url_size/sums.n;
+     }
+     if (sums.curl_size > 0)
+          stats->url_compression = (double)sums.url_size/sums.curl_size;
+     return 0;
+
+on_error:
+     if (cur)
+          mdb_cursor_close(cur);
+     if (txn)
+          txn_manager_abort(db->txn_manager, txn);
+     page_db_set_error(db, page_db_error_internal, __func__);
+     page_db_add_error(db, error);
+     if (mdb_rc != 0)
+          page_db_add_error(db, mdb_strerror(mdb_rc));
+     return db->error->code;
+}
+/// @}
+
+#if (defined TEST) && TEST
+#include "test_page_db_storage.c"
+#endif // TEST
@@ -16,6 +16,7 @@
 #include <malloc.h>
 #endif
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,6 +31,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "metrics.h"
 #include "mmap_array.h"
 
 #include "page_rank.h"
@@ -62,12 +64,24 @@ page_rank_new(PageRank **pr, const char *path, size_t max_vertices) {
      p->persist = PAGE_RANK_DEFAULT_PERSIST;
      p->precision = PAGE_RANK_DEFAULT_PRECISION;
      p->scores = 0;
+     p->shard_size = PAGE_RANK_DEFAULT_SHARD_SIZE;
+     p->shards = 0;
+     p->extrapolation = PAGE_RANK_DEFAULT_EXTRAPOLATION;
+     p->freeze_precision = PAGE_RANK_DEFAULT_FREEZE_PRECISION;
+     p->freeze_loops = PAGE_RANK_DEFAULT_FREEZE_LOOPS;
+     p->use_weights = PAGE_RANK_DEFAULT_USE_WEIGHTS;
+     p->n_loops = 0;
+     p->loop_time = 0.0;
+     p->n_frozen = 0;
+     p->value0 = 0;
+     p->stable = 0;
 
      char *error1 = 0;
      char *error2 = 0;
      p->path_out_degree = build_path(path, "pr_out_degree.bin");
      p->path_pr = build_path(path, "pr.bin");
-     if (!p->path_out_degree || !p->path_pr) {
+     p->path_shards = build_path(path, "pr_shards");
+     if (!p->path_out_degree || !p->path_pr || !p->path_shards) {
           error1 = "building file paths";
           goto on_error;
      }
@@ -134,9 +148,19 @@ page_rank_delete(PageRank *pr) {
      } else if (mmap_array_delete(pr->value2) != 0) {
           error1 = "deleting value2";
           error2 = pr->value2->error->message;
+     } else if (mmap_array_delete(pr->value0) != 0) {
+          error1 = "deleting value0";
+          error2 = pr->value0->error->message;
+     } else if (mmap_array_delete(pr->stable) != 0) {
+          error1 = "deleting stable";
+          error2 = pr->stable->error->message;
+     } else if (link_shards_delete(pr->shards) != 0) {
+          error1 = "deleting shards";
+          error2 = pr->shards->error->message;
      } else {
           free(pr->path_out_degree);
           free(pr->path_pr);
+          free(pr->path_shards);
           error_delete(pr->error);
           free(pr);
           return 0;
@@ -161,6 +185,14 @@ page_rank_expand(PageRank *pr) {
      } else if (mmap_array_resize(pr->value2, 2*pr->value2->n_elements) != 0) {
           error1 = "resizing value2";
           error2 = pr->value2->error->message;
+     } else if (pr->value0 &&
+                mmap_array_resize(pr->value0, 2*pr->value0->n_elements) != 0) {
+          error1 = "resizing value0";
+          error2 = pr->value0->error->message;
+     } else if (pr->stable &&
+                mmap_array_resize(pr->stable, 2*pr->stable->n_elements) != 0) {
+          error1 = "resizing stable";
+          error2 = pr->stable->error->message;
      } else {
           return 0;
      }
@@ -178,22 +210,20 @@ page_rank_set_n_pages(PageRank *pr, size_t n_pages) {
      return 0;
 }
 
-// 1. Expand the mmap array until is big enough
-// 2. Compute the out degree
+// Clear out degree and compute total content score
 static PageRankError
-page_rank_init(PageRank *pr,
-               void *stream_state,
-               LinkStreamNextFunc *link_stream_next) {
-
-     char *error1 = 0;
-     char *error2 = 0;
-
+page_rank_init_begin(PageRank *pr) {
      if (mmap_array_advise(pr->out_degree, MADV_SEQUENTIAL) != 0) {
-          error1 = "advising out_degree on sequential access";
-          error2 = pr->out_degree->error->message;
-          goto on_error;
+          page_rank_set_error(pr, page_rank_error_internal, __func__);
+          page_rank_add_error(pr, "advising out_degree on sequential access");
+          page_rank_add_error(pr, pr->out_degree->error->message);
+          return pr->error->code;
      }
      mmap_array_zero(pr->out_degree);
+     // scores from previous computations are unfrozen
+     if (pr->stable)
+          mmap_array_zero(pr->stable);
+     pr->n_frozen = 0;
 
      pr->total_score = 0.0;
      if (pr->scores)
@@ -205,37 +235,17 @@ page_rank_init(PageRank *pr,
      if (pr->total_score == 0)
           pr->total_score = 1.0;
 
-     Link link;
-     int end_stream = 0;
-     do {
-          switch(link_stream_next(stream_state, &link)) {
-          case stream_state_init:
-               break;
-          case stream_state_error:
-               return page_rank_error_internal;
-          case stream_state_end:
-               end_stream = 1;
-               break;
-          case stream_state_next:
-               if (link.from >= (int64_t)pr->n_pages)
-                    if (page_rank_set_n_pages(pr, link.from + 1) != 0)
-                         return page_rank_error_internal;
-               if (link.to >= (int64_t)pr->n_pages)
-                    if (page_rank_set_n_pages(pr, link.to + 1) != 0)
-                         return page_rank_error_internal;
-               float *deg = mmap_array_idx(pr->out_degree, link.from);
-               if (!deg)
-                    return page_rank_error_internal;
-               ++(*deg);
-               break;
-          }
-     } while (!end_stream);
+     return 0;
+}
 
-     // Since its possible that the number of pages has changed, renormalize
+// Since its possible that the number of pages has changed, renormalize
+static PageRankError
+page_rank_init_end(PageRank *pr) {
      if (mmap_array_advise(pr->value1, MADV_SEQUENTIAL) != 0) {
-          error1 = "advising out_degree on sequential access";
-          error2 = pr->value1->error->message;
-          goto on_error;
+          page_rank_set_error(pr, page_rank_error_internal, __func__);
+          page_rank_add_error(pr, "advising value1 on sequential access");
+          page_rank_add_error(pr, pr->value1->error->message);
+          return pr->error->code;
      }
      float sum = 0.0;
      for (size_t i=0; i<pr->n_pages; ++i) {
@@ -247,18 +257,96 @@ page_rank_init(PageRank *pr,
           *score /= sum;
      }
      return 0;
+}
+
+// 1. Expand the mmap array until is big enough
+// 2. Compute the out degree
+static PageRankError
+page_rank_init(PageRank *pr,
+               void *stream_state,
+               LinkStreamNextBlockFunc *link_stream_next_block,
+               Link *links,
+               float *weights) {
+
+     if (page_rank_init_begin(pr) != 0)
+          return pr->error->code;
+
+     size_t n_links;
+     StreamState state;
+     while ((state = link_stream_next_block(stream_state,
+                                            links, weights, LINK_STREAM_BLOCK_SIZE,
+                                            &n_links)) == stream_state_next) {
+          for (size_t i=0; i<n_links; ++i) {
+               const Link *link = links + i;
+               if (link->from >= (int64_t)pr->n_pages)
+                    if (page_rank_set_n_pages(pr, link->from + 1) != 0)
+                         return page_rank_error_internal;
+               if (link->to >= (int64_t)pr->n_pages)
+                    if (page_rank_set_n_pages(pr, link->to + 1) != 0)
+                         return page_rank_error_internal;
+               float *deg = mmap_array_idx(pr->out_degree, link->from);
+               if (!deg)
+                    return page_rank_error_internal;
+               *deg += weights? weights[i]: 1.0;
+          }
+     }
+     if (state == stream_state_error)
+          return page_rank_error_internal;
+
+     return page_rank_init_end(pr);
+}
+
+// Same as page_rank_init but reading the links from the shards
+static PageRankError
+page_rank_init_shards(PageRank *pr, Link *links, float *weights) {
+     if (page_rank_init_begin(pr) != 0)
+          return pr->error->code;
+
+     if (pr->shards->n_vertices > pr->n_pages)
+          if (page_rank_set_n_pages(pr, pr->shards->n_vertices) != 0)
+               return pr->error->code;
+
+     size_t n_links;
+     for (size_t s=0; s<pr->shards->n_shards; ++s) {
+          if (link_shards_rewind(pr->shards, s) != 0)
+               goto on_error;
+          StreamState state;
+          while ((state = link_shards_read(pr->shards, s,
+                                           links, weights, LINK_STREAM_BLOCK_SIZE,
+                                           &n_links)) == stream_state_next)
+               for (size_t i=0; i<n_links; ++i) {
+                    float *deg = mmap_array_idx(pr->out_degree, links[i].from);
+                    if (deg)
+                         *deg += weights? weights[i]: 1.0;
+               }
+          if (state == stream_state_error)
+               goto on_error;
+     }
+     return page_rank_init_end(pr);
 
 on_error:
      page_rank_set_error(pr, page_rank_error_internal, __func__);
-     page_rank_add_error(pr, error1);
-     page_rank_add_error(pr, error2);
+     page_rank_add_error(pr, "reading shards");
+     page_rank_add_error(pr, pr->shards->error->message);
      return pr->error->code;
 }
 
+/** True if the page score is not recomputed anymore, see
+ * @ref PageRank::freeze_precision */
+static int
+page_rank_frozen(const PageRank *pr, size_t idx) {
+     if (pr->freeze_precision <= 0)
+          return 0;
+     const uint8_t *stable = pr->stable? mmap_array_idx(pr->stable, idx): 0;
+     return stable && *stable >= pr->freeze_loops;
+}
+
 static PageRankError
 page_rank_loop(PageRank *pr,
                void *stream_state,
-               LinkStreamNextFunc *link_stream_next) {
+               LinkStreamNextBlockFunc *link_stream_next_block,
+               Link *links,
+               float *weights) {
      char *error1 = 0;
      char *error2 = 0;
 
@@ -285,40 +373,99 @@ page_rank_loop(PageRank *pr,
           error2 = pr->value2->error->message;
           goto on_error;
      }
-     Link link;
-     int end_stream = 0;
-     float *value1;
-     float *value2;
-     float *degree;
-     do {
-          switch(link_stream_next(stream_state, &link)) {
-          case stream_state_init:
-               break;
-          case stream_state_error:
-               error1 = "getting next link";
-               error2 = "stream error";
+     size_t n_links;
+     StreamState state;
+     while ((state = link_stream_next_block(stream_state,
+                                            links, weights, LINK_STREAM_BLOCK_SIZE,
+                                            &n_links)) == stream_state_next) {
+          for (size_t i=0; i<n_links; ++i) {
+               float *degree = mmap_array_idx(pr->out_degree, links[i].from);
+               float *value1 = mmap_array_idx(pr->value1, links[i].from);
+               float *value2 = mmap_array_idx(pr->value2, links[i].to);
+               // ignore links out of the known graph and links to frozen pages
+               if (value1 && value2 && degree && !page_rank_frozen(pr, links[i].to))
+                    *value2 += pr->damping*(*value1)*
+                         (weights? weights[i]: 1.0)/(*degree);
+          }
+     }
+     if (state == stream_state_error) {
+          error1 = "getting next link";
+          error2 = "stream error";
+          goto on_error;
+     }
+
+     return 0;
+
+on_error:
+     page_rank_set_error(pr, page_rank_error_internal, __func__);
+     page_rank_add_error(pr, error1);
+     page_rank_add_error(pr, error2);
+     return pr->error->code;
+}
+
+// Same as page_rank_loop but processing one shard at a time. The new scores of
+// the shard destinations are accumulated in `slice` and the source scores are
+// read in increasing order.
+static PageRankError
+page_rank_loop_shards(PageRank *pr, Link *links, float *weights, float *slice) {
+     char *error1 = 0;
+     char *error2 = 0;
+
+     if (mmap_array_advise(pr->value2, MADV_SEQUENTIAL) != 0) {
+          error1 = "advising value2 on sequential access";
+          error2 = pr->value2->error->message;
+          goto on_error;
+     }
+     mmap_array_zero(pr->value2);
+
+     if (mmap_array_advise(pr->value1, MADV_SEQUENTIAL) != 0) {
+          error1 = "value1";
+          error2 = pr->value1->error->message;
+          goto on_error;
+     }
+     if (mmap_array_advise(pr->out_degree, MADV_SEQUENTIAL) != 0) {
+          error1 = "out_degree";
+          error2 = pr->out_degree->error->message;
+          goto on_error;
+     }
+
+     size_t n_links;
+     for (size_t s=0; s<pr->shards->n_shards; ++s) {
+          const size_t begin = link_shards_begin(pr->shards, s);
+          const size_t end = link_shards_end(pr->shards, s);
+          memset(slice, 0, (end - begin)*sizeof(float));
+
+          if (link_shards_rewind(pr->shards, s) != 0) {
+               error1 = "rewinding shard";
+               error2 = pr->shards->error->message;
+               goto on_error;
+          }
+          StreamState state;
+          while ((state = link_shards_read(pr->shards, s,
+                                           links, weights, LINK_STREAM_BLOCK_SIZE,
+                                           &n_links)) == stream_state_next)
+               for (size_t i=0; i<n_links; ++i) {
+                    float *degree = mmap_array_idx(pr->out_degree, links[i].from);
+                    float *value1 = mmap_array_idx(pr->value1, links[i].from);
+                    if (value1 && degree && !page_rank_frozen(pr, links[i].to))
+                         slice[links[i].to - begin] += pr->damping*(*value1)*
+                              (weights? weights[i]: 1.0)/(*degree);
+               }
+          if (state == stream_state_error) {
+               error1 = "reading shard";
+               error2 = pr->shards->error->message;
                goto on_error;
-          case stream_state_end:
-               end_stream = 1;
-               break;
-          case stream_state_next:
-               degree = mmap_array_idx(pr->out_degree, link.from);
-               value1 = mmap_array_idx(pr->value1, link.from);
-               value2 = mmap_array_idx(pr->value2, link.to);
-#if 0 // ignore links out of the known graph
-               if (!value1 || !value2 || !degree) {
-                    error1 = "indexing next link";
-                    error2 =
-                         value1 == 0? "value1":
-                         value2 == 0? "value2": "degree";
+          }
+          for (size_t i=begin; i<end; ++i) {
+               float *value2 = mmap_array_idx(pr->value2, i);
+               if (!value2) {
+                    error1 = "accessing value2";
+                    error2 = pr->value2->error->message;
                     goto on_error;
                }
-#endif
-               if (value1 && value2 && degree)
-                    *value2 += pr->damping*(*value1)/(*degree);
-               break;
+               *value2 = slice[i - begin];
           }
-     } while (!end_stream);
+     }
 
      return 0;
 
@@ -329,8 +476,39 @@ on_error:
      return pr->error->code;
 }
 
+/** Teleportation probability of a page, before scaling by the remaining
+ * score */
+static float
+page_rank_share(const PageRank *pr, size_t idx) {
+     if (!pr->scores)
+          return 1.0/pr->n_pages;
+     float *r = mmap_array_idx(pr->scores, idx);
+     return r? (*r)/pr->total_score: 0.0;
+}
+
+/** Aitken extrapolation of a page score from its last three iterates.
+ *
+ * Only applied when the iterates converge monotonically, otherwise the
+ * newest iterate is returned.
+ */
+static float
+page_rank_aitken(float x2, float x1, float x0) {
+     const float d1 = x1 - x2;
+     const float d0 = x0 - x1;
+     if (d0*d1 <= 0 || d0 == d1)
+          return x0;
+     const float y = x0 - d0*d0/(d0 - d1);
+     return y > 0? y: x0;
+}
+
+/** Finish iteration number n_loop.
+ *
+ * Adds the teleportation term, computes the change of the scores, updates
+ * the freezing state, extrapolates if it is time and finally swaps the old and
+ * new scores.
+ */
 static PageRankError
-page_rank_end_loop(PageRank *pr, float *delta) {
+page_rank_end_loop(PageRank *pr, size_t n_loop, float *delta) {
      char *error1 = 0;
      char *error2 = 0;
 
@@ -343,30 +521,49 @@ page_rank_end_loop(PageRank *pr, float *delta) {
           goto on_error;
      }
 
+     // frozen pages keep their score, which already includes their share of
+     // the teleportation term. The rest of it goes to the pages not frozen.
+     const int freeze = pr->freeze_precision > 0;
      float rem = 0.0;
+     float share = 0.0;
      for (size_t i=0; i<pr->n_pages; ++i) {
           float *score = mmap_array_idx(pr->value2, i);
+          if (freeze) {
+               if (page_rank_frozen(pr, i))
+                    *score = *(float*)mmap_array_idx(pr->value1, i);
+               else
+                    share += page_rank_share(pr, i);
+          }
           rem += *score;
      }
      rem = 1.0 - rem;
-
-     if (!pr->scores) {
-          float r = rem/pr->n_pages;
-          for (size_t i=0; i<pr->n_pages; ++i) {
-               float *score = mmap_array_idx(pr->value2, i);
-               *score += r;
-          }
-     } else {
-          for (size_t i=0; i<pr->n_pages; ++i) {
-               float *r = mmap_array_idx(pr->scores, i);
-               if (r) {
-                    float *score = mmap_array_idx(pr->value2, i);
-                    *score += rem*(*r)/pr->total_score;
+     if (!freeze)
+          share = 1.0;
+
+     if (share > 0) {
+          if (!pr->scores) {
+               float r = rem/pr->n_pages/share;
+               for (size_t i=0; i<pr->n_pages; ++i)
+                    if (!page_rank_frozen(pr, i)) {
+                         float *score = mmap_array_idx(pr->value2, i);
+                         *score += r;
+                    }
+          } else {
+               for (size_t i=0; i<pr->n_pages; ++i) {
+                    float *r = mmap_array_idx(pr->scores, i);
+                    if (r && !page_rank_frozen(pr, i)) {
+                         float *score = mmap_array_idx(pr->value2, i);
+                         *score += rem*(*r)/pr->total_score/share;
+                    }
                }
           }
      }
 
+     const int extrapolate =
+          pr->extrapolation > 0 && n_loop > 0 && (n_loop + 1) % pr->extrapolation == 0;
+     float sum = 0.0;
      *delta = 0.0;
+     pr->n_frozen = 0;
      for (size_t i=0; i<pr->n_pages; ++i) {
           score1 = mmap_array_idx(pr->value1, i);
           score2 = mmap_array_idx(pr->value2, i);
@@ -377,12 +574,34 @@ page_rank_end_loop(PageRank *pr, float *delta) {
           float diff = fabs(*score2 - *score1);
           if (diff > *delta)
                *delta = diff;
+          if (freeze) {
+               uint8_t *stable = mmap_array_idx(pr->stable, i);
+               if (diff >= pr->freeze_precision)
+                    *stable = 0;
+               else if (*stable < UINT8_MAX)
+                    ++(*stable);
+               if (*stable >= pr->freeze_loops)
+                    ++pr->n_frozen;
+          }
+          if (pr->extrapolation > 0) {
+               float *score0 = mmap_array_idx(pr->value0, i);
+               if (extrapolate)
+                    *score2 = page_rank_aitken(*score0, *score1, *score2);
+               *score0 = *score1;
+               sum += *score2;
+          }
           // swap scores, we want to retain the old score because it's needed
           // to stream over scores updates
           float tmp = *score1;
           *score1 = *score2;
           *score2 = tmp;
      }
+     // extrapolation does not preserve the total score
+     if (extrapolate && sum > 0)
+          for (size_t i=0; i<pr->n_pages; ++i) {
+               float *score = mmap_array_idx(pr->value1, i);
+               *score /= sum;
+          }
      return 0;
 on_error:
      page_rank_set_error(pr, page_rank_error_internal, __func__);
@@ -391,15 +610,124 @@ on_error:
      return pr->error->code;
 }
 
-PageRankError
-page_rank_compute(PageRank *pr,
-                  void *stream_state,
-                  LinkStreamNextFunc *link_stream_next,
-                  LinkStreamResetFunc *link_stream_reset) {
+/** Allocate the arrays needed by extrapolation and freezing.
+ *
+ * They are only created the first time these options are enabled, so
+ * that plain computations do not pay for them.
+ */
+static PageRankError
+page_rank_init_acceleration(PageRank *pr) {
+     char *error1 = 0;
+     char *error2 = 0;
+
+     const size_t n_elements = pr->value1->n_elements;
+     if (pr->extrapolation > 0 && !pr->value0 &&
+         mmap_array_new(&pr->value0, 0, n_elements, sizeof(float)) != 0) {
+          error1 = "building value0 mmap array";
+          error2 = pr->value0? pr->value0->error->message: "NULL";
+          goto on_error;
+     }
+     if (pr->freeze_precision > 0 && !pr->stable) {
+          if (mmap_array_new(&pr->stable, 0, n_elements, sizeof(uint8_t)) != 0) {
+               error1 = "building stable mmap array";
+               error2 = pr->stable? pr->stable->error->message: "NULL";
+               goto on_error;
+          }
+          mmap_array_zero(pr->stable);
+     }
+     return 0;
+on_error:
+     page_rank_set_error(pr, page_rank_error_internal, __func__);
+     page_rank_add_error(pr, error1);
+     page_rank_add_error(pr, error2);
+     return pr->error->code;
+}
+
+/** Wall time in seconds, for iteration statistics */
+static double
+page_rank_clock(void) {
+     struct timespec t;
+     clock_gettime(CLOCK_MONOTONIC, &t);
+     return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+static PageRankError
+page_rank_compute_shards(PageRank *pr,
+                         void *stream_state,
+                         LinkStreamNextBlockFunc *link_stream_next_block,
+                         Link *links,
+                         float *weights) {
+     char *error1 = 0;
+     char *error2 = 0;
+
+     float *slice = 0;
+
+     if (!pr->shards) {
+          if (link_shards_new(&pr->shards, pr->path_shards, pr->shard_size) != 0) {
+               error1 = "creating shards";
+               error2 = pr->shards? pr->shards->error->message: "NULL";
+               goto on_error;
+          }
+          pr->shards->persist = pr->persist;
+     }
+     pr->shards->shard_size = pr->shard_size;
+     pr->shards->weights = weights != 0;
+     if (link_shards_build(pr->shards, stream_state, link_stream_next_block) != 0) {
+          error1 = "building shards";
+          error2 = pr->shards->error->message;
+          goto on_error;
+     }
+
+     if (!(slice = malloc(pr->shard_size*sizeof(*slice)))) {
+          error1 = "allocating shard slice";
+          goto on_error;
+     }
+
+     if (page_rank_init_shards(pr, links, weights) != 0)
+          goto on_error_no_msg;
+
+     float delta = pr->precision + 1.0;
+     const double t0 = page_rank_clock();
+     pr->n_loops = 0;
+     pr->loop_time = 0.0;
+     while (delta > pr->precision) {
+          if (page_rank_loop_shards(pr, links, weights, slice) != 0 ||
+              page_rank_end_loop(pr, pr->n_loops, &delta) != 0)
+               goto on_error_no_msg;
+
+          ++pr->n_loops;
+          metrics_count(metric_page_rank_loops, 1);
+          pr->loop_time = (page_rank_clock() - t0)/pr->n_loops;
+          if (pr->n_loops == pr->max_loops) {
+               page_rank_set_error(pr, page_rank_error_precision, __func__);
+               page_rank_add_error(pr, "could not achieve precision");
+               goto on_error_no_msg;
+          }
+     }
+
+     free(slice);
+     return 0;
+
+on_error:
+     page_rank_set_error(pr, page_rank_error_internal, __func__);
+     page_rank_add_error(pr, error1);
+     page_rank_add_error(pr, error2);
+on_error_no_msg:
+     free(slice);
+     return pr->error->code;
+}
+
+static PageRankError
+page_rank_compute_stream(PageRank *pr,
+                         void *stream_state,
+                         LinkStreamNextBlockFunc *link_stream_next_block,
+                         LinkStreamResetFunc *link_stream_reset,
+                         Link *links,
+                         float *weights) {
 
      PageRankError rc = 0;
 
-     if ((rc = page_rank_init(pr, stream_state, link_stream_next)) != 0)
+     if ((rc = page_rank_init(pr, stream_state, link_stream_next_block, links, weights)) != 0)
           return rc;
 
      switch (link_stream_reset(stream_state)) {
@@ -414,9 +742,11 @@ page_rank_compute(PageRank *pr,
      }
 
      float delta = pr->precision + 1.0;
-     size_t n_loops = 0;
+     const double t0 = page_rank_clock();
+     pr->n_loops = 0;
+     pr->loop_time = 0.0;
      while (delta > pr->precision) {
-          rc = page_rank_loop(pr, stream_state, link_stream_next);
+          rc = page_rank_loop(pr, stream_state, link_stream_next_block, links, weights);
           if (rc != 0)
                return rc;
           if (link_stream_reset(stream_state) == stream_state_error) {
@@ -424,12 +754,14 @@ page_rank_compute(PageRank *pr,
                page_rank_add_error(pr, "resetting link stream");
                return pr->error->code;
           }
-          rc = page_rank_end_loop(pr, &delta);
+          rc = page_rank_end_loop(pr, pr->n_loops, &delta);
           if (rc != 0)
                return rc;
 
-          ++n_loops;
-          if (n_loops == pr->max_loops) {
+          ++pr->n_loops;
+          metrics_count(metric_page_rank_loops, 1);
+          pr->loop_time = (page_rank_clock() - t0)/pr->n_loops;
+          if (pr->n_loops == pr->max_loops) {
                page_rank_set_error(pr, page_rank_error_precision, __func__);
                page_rank_add_error(pr, "could not achieve precision");
                return pr->error->code;
@@ -439,6 +771,36 @@ page_rank_compute(PageRank *pr,
      return 0;
 }
 
+PageRankError
+page_rank_compute(PageRank *pr,
+                  void *stream_state,
+                  LinkStreamNextBlockFunc *link_stream_next_block,
+                  LinkStreamResetFunc *link_stream_reset) {
+
+     if (page_rank_init_acceleration(pr) != 0)
+          return pr->error->code;
+
+     const uint64_t t0 = metrics_now();
+     Link *links = malloc(LINK_STREAM_BLOCK_SIZE*sizeof(*links));
+     // weights are only requested from the stream if they are used
+     float *weights = pr->use_weights?
+          malloc(LINK_STREAM_BLOCK_SIZE*sizeof(*weights)): 0;
+     if (!links || (pr->use_weights && !weights)) {
+          free(links);
+          free(weights);
+          page_rank_set_error(pr, page_rank_error_memory, __func__);
+          page_rank_add_error(pr, "allocating link block");
+          return pr->error->code;
+     }
+     PageRankError rc = pr->shard_size > 0?
+          page_rank_compute_shards(pr, stream_state, link_stream_next_block, links, weights):
+          page_rank_compute_stream(pr, stream_state, link_stream_next_block, link_stream_reset, links, weights);
+     free(links);
+     free(weights);
+     metrics_record_since(metric_page_rank_compute, t0);
+     return rc;
+}
+
 PageRankError
 page_rank_get(const PageRank *pr, size_t idx, float *score_old, float *score_new) {
      float *pr_score_new = mmap_array_idx(pr->value1, idx);
@@ -454,6 +816,8 @@ void
 page_rank_set_persist(PageRank *pr, int value) {
      pr->persist = pr->out_degree->persist =
           pr->value1->persist = pr->value2->persist = value;
+     if (pr->shards)
+          pr->shards->persist = value;
 }
 
 #if (defined TEST) && TEST
@@ -3,6 +3,7 @@
 
 #include "mmap_array.h"
 #include "link_stream.h"
+#include "link_shards.h"
 
 /** @addtogroup PageRank
  * @{
@@ -19,6 +20,11 @@ typedef enum {
 #define PAGE_RANK_DEFAULT_MAX_LOOPS 100   /**< Default @ref PageRank::max_loops */
 #define PAGE_RANK_DEFAULT_PRECISION 1e-4  /**< Default @ref PageRank::precision */
 #define PAGE_RANK_DEFAULT_PERSIST 0       /**< Default @ref PageRank::persist */
+#define PAGE_RANK_DEFAULT_SHARD_SIZE 0    /**< Default @ref PageRank::shard_size */
+#define PAGE_RANK_DEFAULT_EXTRAPOLATION 0 /**< Default @ref PageRank::extrapolation */
+#define PAGE_RANK_DEFAULT_FREEZE_PRECISION 0.0 /**< Default @ref PageRank::freeze_precision */
+#define PAGE_RANK_DEFAULT_FREEZE_LOOPS 3  /**< Default @ref PageRank::freeze_loops */
+#define PAGE_RANK_DEFAULT_USE_WEIGHTS 0   /**< Default @ref PageRank::use_weights */
 
 /** Implementation of the PageRank algorithm.
  *
@@ -30,14 +36,21 @@ typedef enum {
 typedef struct {
      /** Number of outgoing links.
       *
-      * If page content scores are used then this array is actually the
-      * aggregated scores of all the outgoing links.
+      * If @ref PageRank::use_weights is true then this array is actually
+      * the sum of the weights of all the outgoing links.
       **/
      MMapArray *out_degree;
      /** PageRank value, old iteration */
      MMapArray *value1;
      /** PageRank value, new iteration */
      MMapArray *value2;
+     /** PageRank value, two iterations old. Only allocated when
+      * @ref PageRank::extrapolation is enabled, NULL otherwise */
+     MMapArray *value0;
+     /** Number of consecutive iterations (up to 255) that the score of each
+      * page has changed less than @ref PageRank::freeze_precision. Only
+      * allocated when freezing is enabled, NULL otherwise */
+     MMapArray *stable;
 
      /** Number of pages */
      size_t n_pages;
@@ -46,6 +59,19 @@ typedef struct {
      char *path_out_degree;
      /** Path to page rank mmap array file */
      char *path_pr;
+     /** Path to the directory of the out of core shards */
+     char *path_shards;
+
+     /** Links partitioned by destination, only used if @ref PageRank::shard_size > 0 */
+     LinkShards *shards;
+
+     /** Number of iterations made by the last call to @ref page_rank_compute */
+     size_t n_loops;
+     /** Average wall time, in seconds, of each iteration made by the last call
+      * to @ref page_rank_compute */
+     double loop_time;
+     /** Number of frozen pages at the end of the last call to @ref page_rank_compute */
+     size_t n_frozen;
 
      /** Error status */
      Error *error;
@@ -65,7 +91,23 @@ typedef struct {
      float precision;
      /** If true, do not delete files after deleting */
      int persist;
-
+     /** If greater than 0 links are first partitioned into @ref LinkShards
+      * of this number of pages and each iteration processes one shard at a
+      * time, keeping only a slice of the new scores in memory */
+     size_t shard_size;
+     /** If greater than 0, apply Aitken extrapolation every this number of
+      * iterations, using the last three iterates. Should be at least 2. */
+     size_t extrapolation;
+     /** If greater than 0, pages whose score changes less than this during
+      * @ref PageRank::freeze_loops consecutive iterations are frozen: their
+      * score is no longer recomputed until the next call to
+      * @ref page_rank_compute. It should be smaller than @ref PageRank::precision */
+     float freeze_precision;
+     /** See @ref PageRank::freeze_precision */
+     size_t freeze_loops;
+     /** If true, each page distributes its score among its links in
+      * proportion to the link weights instead of evenly */
+     int use_weights;
 } PageRank;
 
 /** Create a new structure.
@@ -93,11 +135,14 @@ page_rank_set_n_pages(PageRank *pr, size_t n_pages);
 /** Compute PageRank score for all pages.
  *
  * The algorithm makes random access of pages scores and sequential access of
- * the links.
+ * the links. If @ref PageRank::shard_size is greater than 0 the link stream is
+ * read only once, to build the shards, and all further access is sequential.
  *
  * @param pr
  * @param link_stream_state For example @ref PageDBLinkStream
- * @param link_stream_next For example @ref page_db_link_stream_next
+ * @param link_stream_next_block For example @ref page_db_link_stream_next_block.
+ *        Streams returning one link at a time can be wrapped with
+ *        @ref LinkStreamBlockAdapter.
  * @param link_stream_reset For example @ref page_db_link_stream_reset
  *
  * @return 0 if success, otherwise an error code.
@@ -105,7 +150,7 @@ page_rank_set_n_pages(PageRank *pr, size_t n_pages);
 PageRankError
 page_rank_compute(PageRank *pr,
                   void *link_stream_state,
-                  LinkStreamNextFunc *link_stream_next,
+                  LinkStreamNextBlockFunc *link_stream_next_block,
                   LinkStreamResetFunc *link_stream_reset);
 
 /** Get PageRank score associated to a given page.
@@ -66,7 +66,7 @@ page_rank_scorer_update(void *state) {
 
      if (page_rank_compute(prs->page_rank,
                            st,
-                           page_db_link_stream_next,
+                           page_db_link_stream_next_block,
                            page_db_link_stream_reset) != 0) {
           error1 = "computing PageRank";
           error2 = prs->page_rank->error->message;
@@ -138,6 +138,27 @@ page_rank_scorer_set_use_content_scores(PageRankScorer *prs, int value) {
      prs->use_content_scores = value;
 }
 
+void
+page_rank_scorer_set_shard_size(PageRankScorer *prs, size_t value) {
+     prs->page_rank->shard_size = value;
+}
+
+void
+page_rank_scorer_set_extrapolation(PageRankScorer *prs, size_t value) {
+     prs->page_rank->extrapolation = value;
+}
+
+void
+page_rank_scorer_set_freeze(PageRankScorer *prs, float precision, size_t loops) {
+     prs->page_rank->freeze_precision = precision;
+     prs->page_rank->freeze_loops = loops;
+}
+
+void
+page_rank_scorer_set_use_weights(PageRankScorer *prs, int value) {
+     prs->page_rank->use_weights = value;
+}
+
 void
 page_rank_scorer_set_damping(PageRankScorer *prs, float value) {
      prs->page_rank->damping = value;
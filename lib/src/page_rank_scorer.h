@@ -87,6 +87,24 @@ page_rank_scorer_set_persist(PageRankScorer *prs, int value);
 void
 page_rank_scorer_set_use_content_scores(PageRankScorer *prs, int value);
 
+/** Sets @ref PageRank::shard_size. If greater than 0 compute out of core */
+void
+page_rank_scorer_set_shard_size(PageRankScorer *prs, size_t value);
+
+/** Sets @ref PageRank::extrapolation. If greater than 0 accelerate convergence
+ * with Aitken extrapolation every this number of iterations */
+void
+page_rank_scorer_set_extrapolation(PageRankScorer *prs, size_t value);
+
+/** Sets @ref PageRank::freeze_precision and @ref PageRank::freeze_loops */
+void
+page_rank_scorer_set_freeze(PageRankScorer *prs, float precision, size_t loops);
+
+/** Sets @ref PageRank::use_weights. Links must be stored with weights, see
+ * @ref PageDB::link_weights */
+void
+page_rank_scorer_set_use_weights(PageRankScorer *prs, int value);
+
 /** Sets @ref PageRankScorer::page_rank::damping */
 void
 page_rank_scorer_set_damping(PageRankScorer *prs, float value);
@@ -0,0 +1,390 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "page_db.h"
+#include "ppr_scorer.h"
+#include "util.h"
+
+/** Initial number of slots of each @ref PPRMap */
+#define PPR_MAP_INITIAL_SIZE 1024
+/** Initial capacity of the push queue */
+#define PPR_QUEUE_INITIAL_SIZE 1024
+
+static void
+ppr_scorer_set_error(PPRScorer *ppr, int code, const char *message) {
+     error_set(ppr->error, code, message);
+}
+
+static void
+ppr_scorer_add_error(PPRScorer *ppr, const char *message) {
+     error_add(ppr->error, message);
+}
+
+static PPRMap *
+ppr_map_new(void) {
+     PPRMap *map = malloc(sizeof(*map));
+     if (!map)
+          return 0;
+     if (!(map->nodes = calloc(PPR_MAP_INITIAL_SIZE, sizeof(*map->nodes)))) {
+          free(map);
+          return 0;
+     }
+     map->n_nodes = 0;
+     map->m_nodes = PPR_MAP_INITIAL_SIZE;
+     return map;
+}
+
+static void
+ppr_map_delete(PPRMap *map) {
+     if (map) {
+          free(map->nodes);
+          free(map);
+     }
+}
+
+static void
+ppr_map_clear(PPRMap *map) {
+     memset(map->nodes, 0, map->m_nodes*sizeof(*map->nodes));
+     map->n_nodes = 0;
+}
+
+static size_t
+ppr_map_slot(const PPRMap *map, uint64_t idx) {
+     uint64_t h = (idx + 1)*0x9E3779B97F4A7C15ULL;
+     return (h ^ (h >> 32)) & (map->m_nodes - 1);
+}
+
+/** Find page, returns NULL if not present */
+static PPRNode *
+ppr_map_get(const PPRMap *map, uint64_t idx) {
+     for (size_t i=ppr_map_slot(map, idx);; i = (i + 1) & (map->m_nodes - 1)) {
+          PPRNode *node = map->nodes + i;
+          if (node->idx == idx + 1)
+               return node;
+          if (node->idx == 0)
+               return 0;
+     }
+}
+
+/** Double the number of slots */
+static int
+ppr_map_grow(PPRMap *map) {
+     PPRNode *old = map->nodes;
+     const size_t m_old = map->m_nodes;
+     if (!(map->nodes = calloc(2*m_old, sizeof(*map->nodes)))) {
+          map->nodes = old;
+          return -1;
+     }
+     map->m_nodes = 2*m_old;
+     for (size_t i=0; i<m_old; ++i)
+          if (old[i].idx != 0) {
+               size_t j = ppr_map_slot(map, old[i].idx - 1);
+               while (map->nodes[j].idx != 0)
+                    j = (j + 1) & (map->m_nodes - 1);
+               map->nodes[j] = old[i];
+          }
+     free(old);
+     return 0;
+}
+
+/** Find page, inserting it if not present. Returns NULL if memory error.
+ *
+ * Inserting can move the nodes, invalidating previous pointers.
+ */
+static PPRNode *
+ppr_map_insert(PPRMap *map, uint64_t idx) {
+     if (2*(map->n_nodes + 1) > map->m_nodes && ppr_map_grow(map) != 0)
+          return 0;
+     size_t i = ppr_map_slot(map, idx);
+     for (;; i = (i + 1) & (map->m_nodes - 1)) {
+          PPRNode *node = map->nodes + i;
+          if (node->idx == idx + 1)
+               return node;
+          if (node->idx == 0)
+               break;
+     }
+     PPRNode *node = map->nodes + i;
+     node->idx = idx + 1;
+     node->p = node->r = 0.0;
+     node->degree = -1.0;
+     node->queued = 0;
+     ++map->n_nodes;
+     return node;
+}
+
+static int
+ppr_scorer_queue_push(PPRScorer *ppr, uint64_t idx) {
+     if (ppr->queue_len == ppr->m_queue) {
+          const size_t m = ppr->m_queue > 0? 2*ppr->m_queue: PPR_QUEUE_INITIAL_SIZE;
+          uint64_t *queue = malloc(m*sizeof(*queue));
+          if (!queue)
+               return -1;
+          // unwrap ring buffer
+          for (size_t i=0; i<ppr->queue_len; ++i)
+               queue[i] = ppr->queue[(ppr->queue_begin + i) & (ppr->m_queue - 1)];
+          free(ppr->queue);
+          ppr->queue = queue;
+          ppr->queue_begin = 0;
+          ppr->m_queue = m;
+     }
+     ppr->queue[(ppr->queue_begin + ppr->queue_len++) & (ppr->m_queue - 1)] = idx;
+     return 0;
+}
+
+static uint64_t
+ppr_scorer_queue_pop(PPRScorer *ppr) {
+     const uint64_t idx = ppr->queue[ppr->queue_begin];
+     ppr->queue_begin = (ppr->queue_begin + 1) & (ppr->m_queue - 1);
+     --ppr->queue_len;
+     return idx;
+}
+
+PPRScorerError
+ppr_scorer_new(PPRScorer **ppr, PageDB *db) {
+     PPRScorer *p = *ppr = calloc(1, sizeof(*p));
+     if (!p)
+          return ppr_scorer_error_memory;
+     if (!(p->error = error_new())) {
+          free(p);
+          return ppr_scorer_error_memory;
+     }
+     p->page_db = db;
+     p->damping = PPR_SCORER_DEFAULT_DAMPING;
+     p->epsilon = PPR_SCORER_DEFAULT_EPSILON;
+     p->max_pushes = PPR_SCORER_DEFAULT_MAX_PUSHES;
+
+     if (!(p->map_new = ppr_map_new()) ||
+         !(p->map_old = ppr_map_new())) {
+          ppr_scorer_set_error(p, ppr_scorer_error_memory, __func__);
+          ppr_scorer_add_error(p, "allocating score maps");
+          return p->error->code;
+     }
+     return 0;
+}
+
+/** Find the indices of all the seed pages.
+ *
+ * Seed URLs have no domain and so their domain hash is 0. We only need to scan
+ * the pages of this pseudo-domain.
+ */
+static PPRScorerError
+ppr_scorer_find_seeds(PPRScorer *ppr) {
+     char *error1 = 0;
+     char *error2 = 0;
+
+     ppr->n_seeds = 0;
+     size_t m_seeds = ppr->n_seeds;
+
+     DomainStream *st = 0;
+     if (page_db_domain_stream_new(&st, ppr->page_db, 0) != 0) {
+          error1 = "creating domain stream";
+          error2 = ppr->page_db->error->message;
+          goto on_error;
+     }
+
+     uint64_t hash;
+     PageInfo *pi;
+     StreamState state;
+     while ((state = page_db_domain_stream_next(st, &hash, &pi)) == stream_state_next) {
+          if (!pi) {
+               error1 = "loading PageInfo";
+               goto on_error;
+          }
+          const int seed = page_info_is_seed(pi);
+          page_info_delete(pi);
+          if (!seed)
+               continue;
+
+          if (ppr->n_seeds == m_seeds) {
+               m_seeds = m_seeds > 0? 2*m_seeds: 16;
+               uint64_t *seeds = realloc(ppr->seeds, m_seeds*sizeof(*seeds));
+               if (!seeds) {
+                    error1 = "allocating seeds";
+                    goto on_error;
+               }
+               ppr->seeds = seeds;
+          }
+          if (page_db_get_idx(ppr->page_db, hash, ppr->seeds + ppr->n_seeds) != 0) {
+               error1 = "retrieving seed index";
+               error2 = ppr->page_db->error->message;
+               goto on_error;
+          }
+          ++ppr->n_seeds;
+     }
+     if (state == stream_state_error) {
+          error1 = "iterating domain stream";
+          goto on_error;
+     }
+     page_db_domain_stream_delete(st);
+     return 0;
+
+on_error:
+     page_db_domain_stream_delete(st);
+     ppr_scorer_set_error(ppr, ppr_scorer_error_internal, __func__);
+     ppr_scorer_add_error(ppr, error1);
+     ppr_scorer_add_error(ppr, error2);
+     return ppr->error->code;
+}
+
+/** Add residual to a page, queueing it if it exceeds the push threshold */
+static int
+ppr_scorer_add_residual(PPRScorer *ppr, uint64_t idx, float r) {
+     PPRNode *node = ppr_map_insert(ppr->map_new, idx);
+     if (!node)
+          return -1;
+     node->r += r;
+     const float degree = node->degree > 1.0? node->degree: 1.0;
+     if (!node->queued && node->r >= ppr->epsilon*degree) {
+          node->queued = 1;
+          if (ppr_scorer_queue_push(ppr, idx) != 0)
+               return -1;
+     }
+     return 0;
+}
+
+int
+ppr_scorer_update(void *state) {
+     PPRScorer *ppr = (PPRScorer*)state;
+
+     char *error1 = 0;
+     char *error2 = 0;
+
+     PageDBLinkStream *st = 0;
+
+     // the scores of the last update become the old ones
+     PPRMap *map = ppr->map_old;
+     ppr->map_old = ppr->map_new;
+     ppr->map_new = map;
+     ppr_map_clear(ppr->map_new);
+     ppr->queue_len = 0;
+     ppr->n_pushes = 0;
+
+     if (ppr_scorer_find_seeds(ppr) != 0)
+          return ppr->error->code;
+     if (ppr->n_seeds == 0)
+          return 0;
+
+     if (page_db_link_stream_new(&st, ppr->page_db) != 0) {
+          error1 = "creating link stream";
+          error2 = ppr->page_db->error->message;
+          goto on_error;
+     }
+     st->only_diff_domain = 0;
+
+     for (size_t i=0; i<ppr->n_seeds; ++i)
+          if (ppr_scorer_add_residual(ppr, ppr->seeds[i], 1.0/ppr->n_seeds) != 0) {
+               error1 = "initializing residuals";
+               goto on_error;
+          }
+
+     while (ppr->queue_len > 0 &&
+            (ppr->max_pushes == 0 || ppr->n_pushes < ppr->max_pushes)) {
+          const uint64_t idx = ppr_scorer_queue_pop(ppr);
+
+          const uint64_t *to;
+          size_t n_to;
+          if (page_db_link_stream_out_links(st, idx, &to, &n_to) != 0) {
+               error1 = "retrieving out links";
+               error2 = ppr->page_db->error->message;
+               goto on_error;
+          }
+
+          PPRNode *node = ppr_map_get(ppr->map_new, idx);
+          node->queued = 0;
+          node->degree = n_to;
+          const float r = node->r;
+          if (r < ppr->epsilon*(n_to > 1? n_to: 1))
+               continue;
+          node->p += (1.0 - ppr->damping)*r;
+          node->r = 0.0;
+          ++ppr->n_pushes;
+          // node is not valid anymore after adding residuals
+
+          if (n_to == 0) { // dangling page, jump back to the seeds
+               for (size_t i=0; i<ppr->n_seeds; ++i)
+                    if (ppr_scorer_add_residual(
+                             ppr, ppr->seeds[i], ppr->damping*r/ppr->n_seeds) != 0) {
+                         error1 = "pushing residual";
+                         goto on_error;
+                    }
+          } else {
+               for (size_t i=0; i<n_to; ++i)
+                    if (ppr_scorer_add_residual(ppr, to[i], ppr->damping*r/n_to) != 0) {
+                         error1 = "pushing residual";
+                         goto on_error;
+                    }
+          }
+     }
+
+     page_db_link_stream_delete(st);
+     return 0;
+
+on_error:
+     page_db_link_stream_delete(st);
+     ppr_scorer_set_error(ppr, ppr_scorer_error_internal, __func__);
+     ppr_scorer_add_error(ppr, error1);
+     ppr_scorer_add_error(ppr, error2);
+     return ppr->error->code;
+}
+
+int
+ppr_scorer_add(void *state, const PageInfo *page_info, float *score) {
+     (void)state;
+     (void)page_info;
+     *score = 0.0;
+     return 0;
+}
+
+int
+ppr_scorer_get(void *state, size_t idx, float *score_old, float *score_new) {
+     PPRScorer *ppr = (PPRScorer*)state;
+     const PPRNode *node_old = ppr_map_get(ppr->map_old, idx);
+     const PPRNode *node_new = ppr_map_get(ppr->map_new, idx);
+     *score_old = node_old? node_old->p: 0.0;
+     *score_new = node_new? node_new->p: 0.0;
+     return 0;
+}
+
+void
+ppr_scorer_setup(PPRScorer *ppr, Scorer *scorer) {
+     scorer->state = (void*)ppr;
+     scorer->add = ppr_scorer_add;
+     scorer->get = ppr_scorer_get;
+     scorer->update = ppr_scorer_update;
+}
+
+PPRScorerError
+ppr_scorer_delete(PPRScorer *ppr) {
+     if (!ppr)
+          return 0;
+     ppr_map_delete(ppr->map_new);
+     ppr_map_delete(ppr->map_old);
+     free(ppr->seeds);
+     free(ppr->queue);
+     error_delete(ppr->error);
+     free(ppr);
+     return 0;
+}
+
+void
+ppr_scorer_set_damping(PPRScorer *ppr, float value) {
+     ppr->damping = value;
+}
+
+void
+ppr_scorer_set_epsilon(PPRScorer *ppr, float value) {
+     ppr->epsilon = value;
+}
+
+void
+ppr_scorer_set_max_pushes(PPRScorer *ppr, size_t value) {
+     ppr->max_pushes = value;
+}
+
+#if (defined TEST) && TEST
+#include "test_ppr_scorer.c"
+#endif // TEST
@@ -0,0 +1,147 @@
+#ifndef __PPR_SCORER_H__
+#define __PPR_SCORER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "page_db.h"
+#include "scorer.h"
+#include "util.h"
+
+/** @addtogroup PPRScorer
+ *
+ * Personalized PageRank with respect to the seed pages (see
+ * @ref page_info_is_seed), approximated with the forward push algorithm of
+ * Andersen, Chung and Lang.
+ *
+ * Each page has an estimate p and a residual r. Initially all the residual is
+ * spread evenly among the seeds. Pushing a page with residual r moves
+ * (1 - damping)*r to its estimate and spreads damping*r evenly among its
+ * out links. Pages are pushed only while r >= epsilon*out_degree, so the
+ * total work is proportional to 1/((1 - damping)*epsilon) instead of the size
+ * of the graph, and only pages near the seeds are ever touched.
+ *
+ * Out links are read with random lookups on the links database, see
+ * @ref page_db_link_stream_out_links.
+ *
+ * @{
+ */
+
+typedef enum {
+     ppr_scorer_error_ok = 0,   /**< No error */
+     ppr_scorer_error_memory,   /**< Error allocating memory */
+     ppr_scorer_error_internal  /**< Unexpected error */
+} PPRScorerError;
+
+#define PPR_SCORER_DEFAULT_DAMPING 0.85  /**< Default @ref PPRScorer::damping */
+#define PPR_SCORER_DEFAULT_EPSILON 1e-6  /**< Default @ref PPRScorer::epsilon */
+#define PPR_SCORER_DEFAULT_MAX_PUSHES 0  /**< Default @ref PPRScorer::max_pushes */
+
+/** State of a page during the push computation */
+typedef struct {
+     uint64_t idx; /**< Page index plus one, 0 marks an empty slot */
+     float p;      /**< Estimated personalized PageRank */
+     float r;      /**< Residual not yet pushed */
+     /** Number of out links, negative if still unknown */
+     float degree;
+     /** True if the page is waiting inside the push queue */
+     int queued;
+} PPRNode;
+
+/** Open addressing hash map from page index to @ref PPRNode */
+typedef struct {
+     PPRNode *nodes; /**< Slots, a power of 2 */
+     size_t n_nodes; /**< Number of used slots */
+     size_t m_nodes; /**< Number of slots */
+} PPRMap;
+
+typedef struct {
+     /** Database with crawl information */
+     PageDB *page_db;
+
+     /** Scores computed by the last call to @ref ppr_scorer_update */
+     PPRMap *map_new;
+     /** Scores computed by the previous call to @ref ppr_scorer_update */
+     PPRMap *map_old;
+
+     /** Indices of the seed pages */
+     uint64_t *seeds;
+     size_t n_seeds;
+
+     /** FIFO of indices of the pages waiting to be pushed, a ring buffer */
+     uint64_t *queue;
+     size_t queue_begin; /**< Position of the first element */
+     size_t queue_len;   /**< Number of elements */
+     size_t m_queue;     /**< Capacity, a power of 2 */
+
+     /** Number of push operations made by the last update */
+     size_t n_pushes;
+
+     /** Error status */
+     Error *error;
+
+// Options
+// -----------------------------------------------------------------------------
+     /** Probability of following a link instead of jumping back to the seeds */
+     float damping;
+     /** Pages are pushed only while residual >= epsilon*out_degree */
+     float epsilon;
+     /** If greater than 0 stop each update after this number of pushes */
+     size_t max_pushes;
+} PPRScorer;
+
+/** Create new scorer */
+PPRScorerError
+ppr_scorer_new(PPRScorer **ppr, PageDB *db);
+
+/** Add new page to scorer. New pages get score 0 until the next update.
+ *
+ * Function signature complies with @ref Scorer::add
+ */
+int
+ppr_scorer_add(void *state, const PageInfo *page_info, float *score);
+
+/** Get score of the previous and last updates. Pages not reached by the push
+ * get score 0.
+ *
+ * Function signature complies with @ref Scorer::get
+ */
+int
+ppr_scorer_get(void *state, size_t idx, float *score_old, float *score_new);
+
+/** Recompute personalized PageRank from the current seeds.
+ *
+ * Function signature complies with @ref Scorer::update
+ */
+int
+ppr_scorer_update(void *state);
+
+/** Given a @ref Scorer fill its fields with the necessary info */
+void
+ppr_scorer_setup(PPRScorer *ppr, Scorer *scorer);
+
+/** Delete scorer */
+PPRScorerError
+ppr_scorer_delete(PPRScorer *ppr);
+
+/** Sets @ref PPRScorer::damping */
+void
+ppr_scorer_set_damping(PPRScorer *ppr, float value);
+
+/** Sets @ref PPRScorer::epsilon */
+void
+ppr_scorer_set_epsilon(PPRScorer *ppr, float value);
+
+/** Sets @ref PPRScorer::max_pushes */
+void
+ppr_scorer_set_max_pushes(PPRScorer *ppr, size_t value);
+
+/// @}
+
+#if (defined TEST) && TEST
+#include "CuTest.h"
+CuSuite *
+test_ppr_scorer_suite(void);
+#endif
+
+#endif // __PPR_SCORER_H__
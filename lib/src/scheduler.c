@@ -36,15 +36,25 @@ schedule_entry_mdb_cmp_asc(const MDB_val *a, const MDB_val *b) {
      return -schedule_entry_mdb_cmp_desc(a, b);
 }
 
+/** Initial guess of the URL size, to preallocate the URL buffer */
+#define PAGE_REQUEST_URL_SIZE 128
+
 PageRequest*
 page_request_new(size_t n_urls) {
      PageRequest *req = malloc(sizeof(*req));
      if (!req)
           return 0;
      req->urls = calloc(n_urls, sizeof(*req->urls));
-     if (!req->urls)
+     req->url_buf_size = (n_urls > 0? n_urls: 1)*PAGE_REQUEST_URL_SIZE;
+     req->url_buf = malloc(req->url_buf_size);
+     if (!req->urls || !req->url_buf) {
+          free(req->urls);
+          free(req->url_buf);
+          free(req);
           return 0;
+     }
      req->n_urls = 0;
+     req->url_buf_len = 0;
 
      return req;
 }
@@ -52,17 +62,40 @@ page_request_new(size_t n_urls) {
 void
 page_request_delete(PageRequest *req) {
      if (req) {
-          for (size_t i=0; i<req->n_urls; ++i)
-               free(req->urls[i]);
           free(req->urls);
+          free(req->url_buf);
           free(req);
      }
 }
 
+void
+page_request_reset(PageRequest *req) {
+     req->n_urls = 0;
+     req->url_buf_len = 0;
+}
+
 int
 page_request_add_url(PageRequest *req, const char *url) {
-     if (!(req->urls[req->n_urls] = strdup(url)))
-          return -1;
+     const size_t len = strlen(url) + 1;
+     if (req->url_buf_len + len > req->url_buf_size) {
+          size_t size = 2*req->url_buf_size;
+          if (size < req->url_buf_len + len)
+               size = req->url_buf_len + len;
+          char *buf = realloc(req->url_buf, size);
+          if (!buf)
+               return -1;
+          // the URLs are stored in order, walk the new buffer to find them
+          char *u = buf;
+          for (size_t i=0; i<req->n_urls; ++i) {
+               req->urls[i] = u;
+               u += strlen(u) + 1;
+          }
+          req->url_buf = buf;
+          req->url_buf_size = size;
+     }
+     char *dst = req->urls[req->n_urls] = req->url_buf + req->url_buf_len;
+     memcpy(dst, url, len);
+     req->url_buf_len += len;
      req->n_urls++;
      return 0;
 }
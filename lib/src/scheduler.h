@@ -42,10 +42,21 @@ schedule_entry_mdb_cmp_desc(const MDB_val *a, const MDB_val *b);
 int
 schedule_entry_mdb_cmp_asc(const MDB_val *a, const MDB_val *b);
 
-/** A request is an array of URLS */
+/** A request is an array of URLS.
+ *
+ * All the URLs are stored one after the other, NUL terminated, inside a single
+ * buffer. The array of pointers indexes this buffer.
+ */
 typedef struct {
      char **urls;
      size_t n_urls;
+
+     /** Storage of all the URLs */
+     char *url_buf;
+     /** Used bytes inside @ref url_buf */
+     size_t url_buf_len;
+     /** Allocated bytes of @ref url_buf */
+     size_t url_buf_size;
 } PageRequest;
 
 /** Create a new request
@@ -60,9 +71,13 @@ page_request_new(size_t n_urls);
 void
 page_request_delete(PageRequest *req);
 
+/** Remove all the URLs, keeping the memory for reuse */
+void
+page_request_reset(PageRequest *req);
+
 /** Add the URL to the array of URLs inside the request
  *
- * It will make a new copy of the URL.
+ * It will make a new copy of the URL, inside @ref PageRequest::url_buf.
  *
  * @param req
  * @param url URL to add
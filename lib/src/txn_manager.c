@@ -4,6 +4,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <lmdb.h>
 #ifdef __APPLE__
 #include <malloc/malloc.h>
@@ -12,8 +13,11 @@
 #endif
 #include <pthread.h>
 #include <string.h>
+#include <stdio.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include "metrics.h"
 #include "txn_manager.h"
 #include "util.h"
 
@@ -80,6 +84,22 @@ inv_semaphore_block(InvSemaphore *is) {
      return rc;
 }
 
+int
+inv_semaphore_timedblock(InvSemaphore *is, const struct timespec *abstime) {
+     int rc = 0;
+     if ((rc = pthread_mutex_lock(&is->mtx_inc_pos)) != 0)
+          return rc;
+     if ((rc = pthread_mutex_lock(&is->mtx_inc_dec)) != 0)
+          return rc;
+     while (is->value > 0)
+          if ((rc = pthread_cond_timedwait(&is->cond, &is->mtx_inc_dec, abstime)) != 0) {
+               if (rc == ETIMEDOUT)
+                    (void)inv_semaphore_release(is);
+               return rc;
+          }
+     return rc;
+}
+
 int
 inv_semaphore_release(InvSemaphore *is) {
      int rc = pthread_mutex_unlock(&is->mtx_inc_dec);
@@ -114,6 +134,9 @@ txn_manager_new(TxnManager **tm, MDB_env *env) {
      }
 
      p->env = env;
+     p->n_writes = 0;
+     p->compact_timeout = TXN_MANAGER_COMPACT_TIMEOUT;
+     p->lock_fd = -1;
      if (inv_semaphore_init(&p->txn_counter_read) != 0)
           error_set(p->error, txn_manager_error_thread, "creating read txn counter");
      else if (inv_semaphore_init(&p->txn_counter_write) != 0)
@@ -124,6 +147,7 @@ txn_manager_new(TxnManager **tm, MDB_env *env) {
 
 TxnManagerError
 txn_manager_begin(TxnManager *tm, int flags, MDB_txn **txn) {
+     const uint64_t t0 = metrics_now();
      InvSemaphore *counter =
           flags & MDB_RDONLY? &tm->txn_counter_read: &tm->txn_counter_write;
 
@@ -144,26 +168,35 @@ txn_manager_begin(TxnManager *tm, int flags, MDB_txn **txn) {
           error_add(tm->error, "beginning new transaction");
           error_add(tm->error, mdb_strerror(mdb_rc));
      }
+     metrics_record_since(flags & MDB_RDONLY?
+                          metric_txn_manager_begin_read:
+                          metric_txn_manager_begin_write, t0);
      return tm->error->code;
 }
 
 TxnManagerError
 txn_manager_commit(TxnManager *tm, MDB_txn *txn) {
+     const uint64_t t0 = metrics_now();
      InvSemaphore *counter =
           mdb_txn_rdonly(txn)?
           &tm->txn_counter_read: &tm->txn_counter_write;
 
      int mdb_rc = mdb_txn_commit(txn);
      if (mdb_rc != 0) {
-          error_set(tm->error, txn_manager_error_mdb, __func__);
+          error_set(tm->error,
+                    mdb_rc == MDB_MAP_FULL?
+                    txn_manager_error_map_full: txn_manager_error_mdb,
+                    __func__);
           error_add(tm->error, "commiting new transaction");
           error_add(tm->error, mdb_strerror(mdb_rc));
-
-          txn_manager_abort(tm, txn);
-     } else if (inv_semaphore_dec(counter) != 0) {
+     } else if (counter == &tm->txn_counter_write)
+          __atomic_fetch_add(&tm->n_writes, 1, __ATOMIC_RELAXED);
+     // a failed commit has already freed the transaction
+     if (inv_semaphore_dec(counter) != 0) {
           error_set(tm->error, txn_manager_error_thread, __func__);
           error_add(tm->error, "decrementing txn counter");
      }
+     metrics_record_since(metric_txn_manager_commit, t0);
      return tm->error->code;
 }
 
@@ -196,6 +229,8 @@ txn_manager_delete(TxnManager *tm) {
           error_set(tm->error, txn_manager_error_thread, __func__);
           error_add(tm->error, "destroying write txn counter");
      } else {
+          if (tm->lock_fd >= 0)
+               close(tm->lock_fd);
           error_delete(tm->error);
           free(tm);
           return 0;
@@ -204,10 +239,13 @@ txn_manager_delete(TxnManager *tm) {
 }
 
 
-TxnManagerError
-txn_manager_expand(TxnManager *tm, size_t size) {
+/** Resize the environment to size, or double it if size is 0, if forced or
+ * if less than MDB_MINIMUM_FREE_PAGES pages are left */
+static TxnManagerError
+txn_manager_resize(TxnManager *tm, size_t size, int force) {
      int rc = 0;
      char *error = 0;
+     const uint64_t t0 = metrics_now();
 
 #define ERROR(msg, label) do{                   \
           error = msg;                          \
@@ -227,9 +265,10 @@ txn_manager_expand(TxnManager *tm, size_t size) {
           ERROR("getting environment stats", error_mdb);
 
      size_t max_pgno = info.me_mapsize/stat.ms_psize;
-     if (max_pgno < info.me_last_pgno + MDB_MINIMUM_FREE_PAGES) {
+     if (force || max_pgno < info.me_last_pgno + MDB_MINIMUM_FREE_PAGES) {
           // we disallow creating new transactions, but allow aborting/commiting
           // until the txn_counter reaches 0
+          const uint64_t t_stall = metrics_now();
           if ((rc = inv_semaphore_block(&tm->txn_counter_read)) != 0)
                ERROR("blocking read counter", error_thread);
 
@@ -240,10 +279,13 @@ txn_manager_expand(TxnManager *tm, size_t size) {
           // allow transactions again
           if ((rc = inv_semaphore_release(&tm->txn_counter_read)) != 0)
                ERROR("releasing read counter", error_thread);
+          metrics_record_since(metric_txn_manager_resize_stall, t_stall);
+          metrics_count(metric_txn_manager_resizes, 1);
      }
      if ((rc = inv_semaphore_release(&tm->txn_counter_write)) != 0)
           ERROR("releasing write counter", error_thread);
 
+     metrics_record_since(metric_txn_manager_expand, t0);
      return tm->error->code;
 error_thread:
      error_set(tm->error, txn_manager_error_thread, __func__);
@@ -255,3 +297,339 @@ error_mdb:
      error_add(tm->error, mdb_strerror(rc));
      return tm->error->code;
 }
+
+TxnManagerError
+txn_manager_expand(TxnManager *tm, size_t size) {
+     return txn_manager_resize(tm, size, 0);
+}
+
+TxnManagerError
+txn_manager_grow(TxnManager *tm) {
+     return txn_manager_resize(tm, 0, 1);
+}
+
+TxnManagerError
+txn_manager_stats(TxnManager *tm,
+                  TxnManagerEnvStats *env,
+                  const char **db_names,
+                  size_t n_dbs,
+                  TxnManagerDBStats *dbs) {
+     int rc = 0;
+     char *error = 0;
+     MDB_txn *txn = 0;
+     MDB_cursor *cur = 0;
+
+     // see the note about mdb_env_info in TxnManager
+     if ((rc = inv_semaphore_block(&tm->txn_counter_write)) != 0) {
+          error_set(tm->error, txn_manager_error_thread, __func__);
+          error_add(tm->error, "blocking write counter");
+          error_add(tm->error, strerror(rc));
+          return tm->error->code;
+     }
+     MDB_envinfo info;
+     MDB_stat stat;
+     if ((rc = mdb_env_info(tm->env, &info)) != 0)
+          error = "getting environment info";
+     else if ((rc = mdb_env_stat(tm->env, &stat)) != 0)
+          error = "getting environment stats";
+     if (inv_semaphore_release(&tm->txn_counter_write) != 0 && !error) {
+          error_set(tm->error, txn_manager_error_thread, __func__);
+          error_add(tm->error, "releasing write counter");
+          return tm->error->code;
+     }
+     if (error)
+          goto on_error;
+
+     env->page_size = stat.ms_psize;
+     env->map_size = info.me_mapsize;
+     env->last_page = info.me_last_pgno;
+     env->n_readers = info.me_numreaders;
+     env->max_readers = info.me_maxreaders;
+     env->free_pages = 0;
+
+     if (txn_manager_begin(tm, MDB_RDONLY, &txn) != 0)
+          return tm->error->code;
+
+     // the free list is database 0: each value is a list of page numbers,
+     // starting with the length of the list
+     MDB_val key;
+     MDB_val val;
+     if ((rc = mdb_cursor_open(txn, 0, &cur)) != 0) {
+          error = "opening free list";
+          goto on_error;
+     }
+     while ((rc = mdb_cursor_get(cur, &key, &val, MDB_NEXT)) == 0)
+          env->free_pages += *(size_t*)val.mv_data;
+     mdb_cursor_close(cur);
+     if (rc != MDB_NOTFOUND) {
+          error = "reading free list";
+          goto on_error;
+     }
+
+     for (size_t i=0; i<n_dbs; ++i) {
+          MDB_dbi dbi;
+          TxnManagerDBStats *db = dbs + i;
+          memset(db, 0, sizeof(*db));
+          db->name = db_names[i];
+          switch (rc = mdb_dbi_open(txn, db_names[i], 0, &dbi)) {
+          case 0:
+               break;
+          case MDB_NOTFOUND: // not created yet, leave it empty
+               continue;
+          default:
+               error = "opening database";
+               goto on_error;
+          }
+          if ((rc = mdb_stat(txn, dbi, &stat)) != 0) {
+               error = "getting database stats";
+               goto on_error;
+          }
+          db->depth = stat.ms_depth;
+          db->branch_pages = stat.ms_branch_pages;
+          db->leaf_pages = stat.ms_leaf_pages;
+          db->overflow_pages = stat.ms_overflow_pages;
+          db->entries = stat.ms_entries;
+     }
+     txn_manager_abort(tm, txn);
+     return tm->error->code;
+
+on_error:
+     if (txn)
+          txn_manager_abort(tm, txn);
+     error_set(tm->error, txn_manager_error_mdb, __func__);
+     error_add(tm->error, error);
+     error_add(tm->error, mdb_strerror(rc));
+     return tm->error->code;
+}
+
+/** Name of the directory, inside the environment, of the compacted copy */
+#define TXN_MANAGER_COMPACT_DIR "compact.tmp"
+
+/** Check if other processes have the environment open.
+ *
+ * LMDB keeps a shared fcntl lock on the first byte of the lock file while
+ * the environment is open. F_GETLK does not report the locks of this
+ * process, and closing any descriptor of the file would release them, which
+ * is why the descriptor is kept inside the TxnManager.
+ *
+ * @return 1 if other processes have the environment open, 0 if not and -1
+ *         on error, with errno set.
+ */
+static int
+txn_manager_shared(TxnManager *tm, const char *path) {
+     if (tm->lock_fd < 0) {
+          char *lock_path = build_path(path, "lock.mdb");
+          if (!lock_path) {
+               errno = ENOMEM;
+               return -1;
+          }
+          tm->lock_fd = open(lock_path, O_RDWR);
+          free(lock_path);
+          if (tm->lock_fd < 0)
+               return -1;
+     }
+     struct flock lock = {
+          .l_type = F_WRLCK,
+          .l_whence = SEEK_SET,
+          .l_start = 0,
+          .l_len = 1
+     };
+     if (fcntl(tm->lock_fd, F_GETLK, &lock) != 0)
+          return -1;
+     return lock.l_type != F_UNLCK;
+}
+
+/** Lock or unlock the lock file, so that other processes wait before opening
+ * the environment. Only valid while this process has it closed */
+static int
+txn_manager_lock(TxnManager *tm, short type) {
+     struct flock lock = {
+          .l_type = type,
+          .l_whence = SEEK_SET,
+          .l_start = 0,
+          .l_len = 1
+     };
+     return fcntl(tm->lock_fd, F_SETLK, &lock);
+}
+
+TxnManagerError
+txn_manager_compact(TxnManager *tm, unsigned int max_dbs) {
+     int rc = 0;
+     char *error = 0;
+     char *path = 0;
+     char *copy_dir = 0;
+     char *copy_data = 0;
+     char *data = 0;
+     const char *env_path;
+     unsigned int flags;
+     MDB_envinfo info;
+     int writers_blocked = 0;
+     uint64_t t_stall = 0;
+
+     if ((rc = mdb_env_get_path(tm->env, &env_path)) != 0 ||
+         (rc = mdb_env_get_flags(tm->env, &flags)) != 0) {
+          error = "getting environment info";
+          goto on_mdb_error;
+     }
+     // get_flags also returns LMDB internal flags, not accepted by open
+     flags &= MDB_FIXEDMAP | MDB_NOSUBDIR | MDB_NOSYNC | MDB_RDONLY |
+          MDB_NOMETASYNC | MDB_WRITEMAP | MDB_MAPASYNC | MDB_NOTLS |
+          MDB_NOLOCK | MDB_NORDAHEAD | MDB_NOMEMINIT;
+     if (flags & MDB_NOSUBDIR) {
+          error = "environments without subdirectory not supported";
+          rc = EINVAL;
+          goto on_mdb_error;
+     }
+     if (!(path = strdup(env_path)) ||
+         !(copy_dir = build_path(path, TXN_MANAGER_COMPACT_DIR)) ||
+         !(copy_data = build_path(copy_dir, "data.mdb")) ||
+         !(data = build_path(path, "data.mdb"))) {
+          error_set(tm->error, txn_manager_error_memory, __func__);
+          goto on_exit;
+     }
+     if (!(flags & MDB_NOLOCK)) {
+          switch (txn_manager_shared(tm, path)) {
+          case 0:
+               break;
+          case 1:
+               error_set(tm->error, txn_manager_error_busy, __func__);
+               error_add(tm->error, "environment open by other processes");
+               goto on_exit;
+          default:
+               rc = errno;
+               error = "checking lock file";
+               goto on_mdb_error;
+          }
+     }
+
+     // leftovers of a failed compaction
+     remove(copy_data);
+     if (mkdir(copy_dir, 0775) != 0 && errno != EEXIST) {
+          rc = errno;
+          error = "creating directory for the copy";
+          goto on_mdb_error;
+     }
+     for (int attempt=1; ; ++attempt) {
+          if (attempt == TXN_MANAGER_COMPACT_ATTEMPTS) {
+               // writes keep outdating the copy, stop them for the last one
+               t_stall = metrics_now();
+               if ((rc = inv_semaphore_block(&tm->txn_counter_write)) != 0)
+                    goto on_thread_error;
+               writers_blocked = 1;
+          }
+          const uint64_t n_writes = __atomic_load_n(&tm->n_writes, __ATOMIC_RELAXED);
+          // the copy uses a read transaction, count it so that the map is
+          // not resized meanwhile
+          if ((rc = inv_semaphore_inc(&tm->txn_counter_read)) != 0)
+               goto on_thread_error;
+          int copy_rc = mdb_env_copy2(tm->env, copy_dir, MDB_CP_COMPACT);
+          if ((rc = inv_semaphore_dec(&tm->txn_counter_read)) != 0)
+               goto on_thread_error;
+          if ((rc = copy_rc) != 0) {
+               error = "copying environment";
+               goto on_copy_error;
+          }
+          if (!writers_blocked) {
+               t_stall = metrics_now();
+               if ((rc = inv_semaphore_block(&tm->txn_counter_write)) != 0)
+                    goto on_thread_error;
+               writers_blocked = 1;
+          }
+          // no writes since the copy started, it is up to date
+          if (__atomic_load_n(&tm->n_writes, __ATOMIC_RELAXED) == n_writes)
+               break;
+          if ((rc = inv_semaphore_release(&tm->txn_counter_write)) != 0)
+               goto on_thread_error;
+          writers_blocked = 0;
+          metrics_record_since(metric_txn_manager_compact_stall, t_stall);
+          remove(copy_data);
+     }
+
+     // wait until all read transactions finish, from now on no
+     // transactions are active
+     struct timespec deadline;
+     clock_gettime(CLOCK_REALTIME, &deadline);
+     deadline.tv_sec += tm->compact_timeout;
+     switch (rc = inv_semaphore_timedblock(&tm->txn_counter_read, &deadline)) {
+     case 0:
+          break;
+     case ETIMEDOUT:
+          error_set(tm->error, txn_manager_error_busy, __func__);
+          error_add(tm->error, "read transactions still active");
+          goto on_copy_cleanup;
+     default:
+          goto on_thread_error;
+     }
+     if ((rc = mdb_env_info(tm->env, &info)) != 0) {
+          error = "getting environment info";
+          remove(copy_data);
+     } else {
+          mdb_env_close(tm->env);
+          // other processes wait until the new file is in place. If one opened
+          // the environment since the check the copy is discarded.
+          if (!(flags & MDB_NOLOCK) && txn_manager_lock(tm, F_WRLCK) != 0) {
+               error_set(tm->error, txn_manager_error_busy, __func__);
+               error_add(tm->error, "environment opened by other processes");
+               remove(copy_data);
+          } else if (rename(copy_data, data) != 0) {
+               rc = errno;
+               error = "replacing data file";
+               remove(copy_data);
+          }
+          if (!(flags & MDB_NOLOCK))
+               (void)txn_manager_lock(tm, F_UNLCK);
+          // reopen even if the file was not replaced, to keep using the old one
+          int open_rc;
+          char *open_error = 0;
+          if ((open_rc = mdb_env_create(&tm->env)) != 0)
+               open_error = "creating environment";
+          else if ((open_rc = mdb_env_set_mapsize(tm->env, info.me_mapsize)) != 0)
+               open_error = "setting map size";
+          else if ((open_rc = mdb_env_set_maxdbs(tm->env, max_dbs)) != 0)
+               open_error = "setting number of databases";
+          else if ((open_rc = mdb_env_open(tm->env, path, flags, 0664)) != 0)
+               open_error = "opening environment";
+          if (open_error) {
+               error = open_error;
+               rc = open_rc;
+          }
+     }
+     if (inv_semaphore_release(&tm->txn_counter_read) != 0 && !error) {
+          error_set(tm->error, txn_manager_error_thread, __func__);
+          error_add(tm->error, "releasing read counter");
+     }
+     rmdir(copy_dir);
+     if (!error)
+          goto on_exit;
+     goto on_mdb_error;
+
+on_thread_error:
+     error_set(tm->error, txn_manager_error_thread, __func__);
+     error_add(tm->error, strerror(rc));
+     goto on_copy_cleanup;
+on_copy_error:
+     error_set(tm->error, txn_manager_error_mdb, __func__);
+     error_add(tm->error, error);
+     error_add(tm->error, mdb_strerror(rc));
+on_copy_cleanup:
+     remove(copy_data);
+     rmdir(copy_dir);
+     goto on_exit;
+on_mdb_error:
+     error_set(tm->error, txn_manager_error_mdb, __func__);
+     error_add(tm->error, error);
+     error_add(tm->error, mdb_strerror(rc));
+on_exit:
+     if (writers_blocked) {
+          if (inv_semaphore_release(&tm->txn_counter_write) != 0) {
+               error_set(tm->error, txn_manager_error_thread, __func__);
+               error_add(tm->error, "releasing write counter");
+          }
+          metrics_record_since(metric_txn_manager_compact_stall, t_stall);
+     }
+     free(path);
+     free(copy_dir);
+     free(copy_data);
+     free(data);
+     return tm->error->code;
+}
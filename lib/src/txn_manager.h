@@ -2,6 +2,7 @@
 #define __TXN_MANAGER_H__
 
 #include <pthread.h>
+#include <time.h>
 #include "lmdb.h"
 
 #include "util.h"
@@ -63,6 +64,16 @@ inv_semaphore_count(InvSemaphore *is);
 int
 inv_semaphore_block(InvSemaphore *is);
 
+/** Like @ref inv_semaphore_block but give up at the given time.
+ *
+ * @param abstime Deadline, measured with CLOCK_REALTIME
+ *
+ * @return A pthread error code, ETIMEDOUT if the count did not reach zero
+ *         in time. In that case the semaphore is not blocked.
+ */
+int
+inv_semaphore_timedblock(InvSemaphore *is, const struct timespec *abstime);
+
 /** Cancel the effect of @ref inv_semaphore_block
  *
  * @return A pthread error code
@@ -90,7 +101,11 @@ typedef enum {
      txn_manager_error_internal, /**< Unexpected error */
      txn_manager_error_memory,   /**< Error allocating new memory */
      txn_manager_error_thread,   /**< Error inside pthreads */
-     txn_manager_error_mdb       /**< Error inside LMDB */
+     txn_manager_error_mdb,      /**< Error inside LMDB */
+     txn_manager_error_map_full, /**< The write transaction did not fit inside
+                                    the mmap, see @ref txn_manager_grow */
+     txn_manager_error_busy      /**< The environment is in use and the
+                                    operation needs exclusive access */
 } TxnManagerError;
 
 /** Transaction Manager.
@@ -113,6 +128,12 @@ typedef struct {
      MDB_env *env; /**< LMDB environment where transactions happen */
      InvSemaphore txn_counter_read;  /**< Counter of read transactions */
      InvSemaphore txn_counter_write; /**< Counter of write transactions */
+     uint64_t n_writes; /**< Number of commited write transactions */
+     unsigned int compact_timeout; /**< Seconds @ref txn_manager_compact
+                                      waits for read transactions */
+     int lock_fd; /**< Lock file, used by @ref txn_manager_compact to check if
+                     other processes share the environment. Closed only after
+                     the environment is closed */
 
      Error *error;
 } TxnManager;
@@ -178,5 +199,95 @@ txn_manager_delete(TxnManager *tm);
 TxnManagerError
 txn_manager_expand(TxnManager *tm, size_t size);
 
+/** Double the size of the environment, no matter the free space left.
+ *
+ * @ref txn_manager_expand only guarantees @ref MDB_MINIMUM_FREE_PAGES, which
+ * a large write transaction can exceed. When that happens LMDB fails with
+ * MDB_MAP_FULL, reported as @ref txn_manager_error_map_full by
+ * @ref txn_manager_commit, and the transaction can be retried after
+ * calling this function. Blocks like a resize of @ref txn_manager_expand.
+ */
+TxnManagerError
+txn_manager_grow(TxnManager *tm);
+
+/** Size of a single database, as reported by mdb_stat */
+typedef struct {
+     const char *name;      /**< Name of the database */
+     size_t depth;          /**< Depth of the B-tree */
+     size_t branch_pages;   /**< Number of internal pages */
+     size_t leaf_pages;     /**< Number of leaf pages */
+     size_t overflow_pages; /**< Number of pages holding values that do not fit a leaf */
+     size_t entries;        /**< Number of records */
+} TxnManagerDBStats;
+
+/** Size and usage of the whole environment */
+typedef struct {
+     size_t page_size;   /**< Size of a page in bytes */
+     size_t map_size;    /**< Size of the mmap in bytes */
+     size_t last_page;   /**< Last page used. Pages after it have never been used */
+     size_t free_pages;  /**< Pages in the free list, which will be reused */
+     size_t n_readers;   /**< Reader slots in use, by all processes */
+     size_t max_readers; /**< Maximum number of reader slots */
+} TxnManagerEnvStats;
+
+/** Get the size of the environment and of some of its databases.
+ *
+ * Writes are blocked only while reading the environment info, the rest of
+ * the statistics are taken inside a read transaction.
+ *
+ * @param env Environment statistics
+ * @param db_names Names of the databases
+ * @param n_dbs Number of databases
+ * @param dbs Array with room for n_dbs statistics
+ *
+ * @return 0 if success, otherwise the error code
+ */
+TxnManagerError
+txn_manager_stats(TxnManager *tm,
+                  TxnManagerEnvStats *env,
+                  const char **db_names,
+                  size_t n_dbs,
+                  TxnManagerDBStats *dbs);
+
+/** Compact the environment, removing the free pages and writing each B-tree
+ * again in order.
+ *
+ * LMDB never shrinks its data file, and databases with many deletes or
+ * rewrites accumulate free pages and lose locality. This makes a compacted
+ * copy with mdb_env_copy2 and swaps it for the current data file.
+ *
+ * Transactions are not blocked while the copy is made. If a write is
+ * commited meanwhile the copy is outdated and is made again, and only the
+ * last of @ref TXN_MANAGER_COMPACT_ATTEMPTS copies blocks write
+ * transactions. Once the copy is up to date the swap waits up to
+ * compact_timeout seconds for the open read transactions,
+ * including the ones of the calling thread, and fails with
+ * @ref txn_manager_error_busy if they do not finish.
+ *
+ * Since the data file is replaced the environment must not be open in other
+ * processes. This is checked with the LMDB lock file, and compaction fails
+ * with @ref txn_manager_error_busy if other processes have it open, for
+ * example the workers of a pre-forked server. It is not checked for
+ * MDB_NOLOCK environments.
+ *
+ * Must not be called from several threads at the same time. Only
+ * environments inside a directory (without MDB_NOSUBDIR) are supported.
+ *
+ * @param tm
+ * @param max_dbs Maximum number of named databases, as passed to
+ *                mdb_env_set_maxdbs when the environment was created
+ *
+ * @return 0 if success, otherwise the error code. If the environment could
+ *         not be reopened it is no longer usable.
+ */
+TxnManagerError
+txn_manager_compact(TxnManager *tm, unsigned int max_dbs);
+
+/** Maximum number of copies made by @ref txn_manager_compact. The last one
+ * blocks write transactions */
+#define TXN_MANAGER_COMPACT_ATTEMPTS 3
+/** Default value of TxnManager::compact_timeout */
+#define TXN_MANAGER_COMPACT_TIMEOUT 10
+
 /// @}
 #endif // __TXN_MANAGER_H__
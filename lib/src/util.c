@@ -143,6 +143,97 @@ make_dir(const char *path) {
      return 0;
 }
 
+/** Size of the block header, keeping the data aligned */
+#define ARENA_HEADER_SIZE \
+     ((sizeof(ArenaBlock) + ARENA_ALIGN - 1)/ARENA_ALIGN*ARENA_ALIGN)
+
+static ArenaBlock *
+arena_block_new(size_t size, ArenaBlock *next) {
+     ArenaBlock *block = malloc(ARENA_HEADER_SIZE + size);
+     if (block) {
+          block->next = next;
+          block->size = size;
+          block->used = 0;
+     }
+     return block;
+}
+
+Arena *
+arena_new(size_t block_size) {
+     Arena *arena = malloc(sizeof(*arena));
+     if (arena) {
+          arena->block = 0;
+          arena->block_size = block_size > 0? block_size: ARENA_DEFAULT_BLOCK_SIZE;
+     }
+     return arena;
+}
+
+void *
+arena_alloc(Arena *arena, size_t size) {
+     size = (size + ARENA_ALIGN - 1)/ARENA_ALIGN*ARENA_ALIGN;
+     ArenaBlock *block = arena->block;
+     if (!block || block->used + size > block->size) {
+          // blocks grow geometrically to keep the number of mallocs low
+          size_t block_size = block? 2*block->size: arena->block_size;
+          if (block_size < size)
+               block_size = size;
+          if (!(block = arena_block_new(block_size, arena->block)))
+               return 0;
+          arena->block = block;
+     }
+     void *p = (char*)block + ARENA_HEADER_SIZE + block->used;
+     block->used += size;
+     return p;
+}
+
+char *
+arena_strndup(Arena *arena, const char *s, size_t n) {
+     char *p = arena_alloc(arena, n + 1);
+     if (p) {
+          memcpy(p, s, n);
+          p[n] = '\0';
+     }
+     return p;
+}
+
+char *
+arena_strdup(Arena *arena, const char *s) {
+     return arena_strndup(arena, s, strlen(s));
+}
+
+int
+arena_reset(Arena *arena) {
+     ArenaBlock *block = arena->block;
+     if (!block)
+          return 0;
+     if (!block->next) {
+          block->used = 0;
+          return 0;
+     }
+     size_t size = 0;
+     while (block) {
+          ArenaBlock *next = block->next;
+          size += block->size;
+          free(block);
+          block = next;
+     }
+     arena->block = arena_block_new(size, 0);
+     return arena->block? 0: -1;
+}
+
+void
+arena_delete(Arena *arena) {
+     if (arena) {
+          ArenaBlock *block = arena->block;
+          while (block) {
+               ArenaBlock *next = block->next;
+               free(block);
+               block = next;
+          }
+          free(arena);
+     }
+}
+
 uint8_t*
 varint_encode_uint64(uint64_t n, uint8_t *out) {
      do {
@@ -157,7 +248,7 @@ varint_decode_uint64(uint8_t *in, uint8_t* read) {
      uint64_t res = 0;
      uint8_t b = 0;
      do {
-          res |= (*in & 0x7F) << b;
+          res |= (uint64_t)(*in & 0x7F) << b;
           b += 7;
      } while (*(in++) & 0x80);
 
@@ -179,6 +270,117 @@ varint_decode_int64(uint8_t *in, uint8_t* read) {
           return -((res - 1)/2);
 }
 
+uint8_t *
+svb_encode_uint32(const uint32_t *in, size_t n, uint8_t *out) {
+     uint8_t *control = out;
+     uint8_t *data = out + (n + 3)/4;
+     memset(control, 0, (n + 3)/4);
+     for (size_t i=0; i<n; ++i) {
+          uint32_t x = in[i];
+          uint8_t code =
+               x < (1U << 8)?  0:
+               x < (1U << 16)? 1:
+               x < (1U << 24)? 2: 3;
+          control[i/4] |= code << (2*(i%4));
+          for (int b=0; b<=code; ++b) {
+               *(data++) = x & 0xFF;
+               x >>= 8;
+          }
+     }
+     return data;
+}
+
+/* The SSSE3 decoder is compiled for its own target and selected at run time,
+ * since the library is built for plain SSE2 */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SVB_SSSE3 1
+#include <tmmintrin.h>
+
+/** Number of data bytes used by the 4 integers of a control byte */
+static size_t
+svb_control_length(uint8_t c) {
+     return 4 + (c & 3) + ((c >> 2) & 3) + ((c >> 4) & 3) + (c >> 6);
+}
+
+static uint8_t svb_shuffle[256][16];
+static int svb_has_ssse3 = 0;
+static pthread_once_t svb_shuffle_once = PTHREAD_ONCE_INIT;
+
+static void
+svb_shuffle_init(void) {
+     __builtin_cpu_init();
+     svb_has_ssse3 = __builtin_cpu_supports("ssse3");
+     for (int c=0; c<256; ++c) {
+          uint8_t pos = 0;
+          for (int k=0; k<4; ++k) {
+               int len = ((c >> (2*k)) & 3) + 1;
+               for (int b=0; b<4; ++b)
+                    svb_shuffle[c][4*k + b] = b < len? pos + b: 0xFF;
+               pos += len;
+          }
+     }
+}
+
+/** Decode groups of 4 integers with a byte shuffle each, while 16 bytes can
+ * be loaded without going past end.
+ *
+ * @return Number of integers decoded, data is advanced past them
+ */
+__attribute__((target("ssse3")))
+static size_t
+svb_decode_ssse3(const uint8_t *control, const uint8_t **data,
+                 const uint8_t *end, size_t n, uint32_t *out) {
+     const uint8_t *p = *data;
+     size_t i = 0;
+     for (; i + 4 <= n && p + 16 <= end; i += 4) {
+          const uint8_t c = control[i/4];
+          __m128i x = _mm_loadu_si128((const __m128i*)p);
+          __m128i shuffle = _mm_loadu_si128((const __m128i*)svb_shuffle[c]);
+          _mm_storeu_si128((__m128i*)(out + i), _mm_shuffle_epi8(x, shuffle));
+          p += svb_control_length(c);
+     }
+     *data = p;
+     return i;
+}
+#endif
+
+/** Decode, using the SSSE3 decoder if simd is set and the CPU supports it */
+static size_t
+svb_decode_uint32_simd(const uint8_t *in, size_t in_size, size_t n, uint32_t *out,
+                       int simd) {
+     const size_t n_control = (n + 3)/4;
+     if (in_size < n_control)
+          return 0;
+     const uint8_t *control = in;
+     const uint8_t *data = in + n_control;
+     const uint8_t *end = in + in_size;
+
+     size_t i = 0;
+#ifdef SVB_SSSE3
+     (void)pthread_once(&svb_shuffle_once, svb_shuffle_init);
+     if (simd && svb_has_ssse3)
+          i = svb_decode_ssse3(control, &data, end, n, out);
+#else
+     (void)simd;
+#endif
+     for (; i<n; ++i) {
+          const int len = ((control[i/4] >> (2*(i%4))) & 3) + 1;
+          if (data + len > end)
+               return 0;
+          uint32_t x = 0;
+          for (int b=0; b<len; ++b)
+               x |= (uint32_t)data[b] << (8*b);
+          out[i] = x;
+          data += len;
+     }
+     return data - in;
+}
+
+size_t
+svb_decode_uint32(const uint8_t *in, size_t in_size, size_t n, uint32_t *out) {
+     return svb_decode_uint32_simd(in, in_size, n, out, 1);
+}
+
 int
 url_domain(const char *url, int *start, int *end) {
      //     +-- colon 1
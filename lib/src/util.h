@@ -2,6 +2,7 @@
 #define __UTIL_H__
 
 #include <pthread.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "lmdb.h"
@@ -126,6 +127,79 @@ build_path(const char *path, const char *fname);
 char *
 make_dir(const char *path);
 
+/** @addtogroup Arena
+ *
+ * Bump allocator for objects that are created and destroyed together, for
+ * example all the link URLs of a @ref CrawledPage.
+ *
+ * Memory is taken from big blocks, so allocating is just advancing a pointer
+ * and freeing is not possible except for the whole arena. When an arena is
+ * reset all the space is coalesced into a single block, so an arena reused for
+ * similar operations stops calling malloc after the first one.
+ * @{
+ */
+
+/** Default value of @ref Arena::block_size */
+#define ARENA_DEFAULT_BLOCK_SIZE 4096
+/** All allocations are aligned to this number of bytes */
+#define ARENA_ALIGN 16
+
+typedef struct ArenaBlock ArenaBlock;
+
+/** A block of memory, followed by its data */
+struct ArenaBlock {
+     ArenaBlock *next; /**< Previous, already full, block */
+     size_t size;      /**< Bytes of data */
+     size_t used;      /**< Bytes of data already allocated */
+};
+
+typedef struct {
+     /** Block where allocations are made, the head of a list of blocks */
+     ArenaBlock *block;
+     /** Minimum size of new blocks */
+     size_t block_size;
+} Arena;
+
+/** Create a new empty arena. No memory is reserved until the first allocation.
+ *
+ * @param block_size Minimum size of blocks. If 0 @ref ARENA_DEFAULT_BLOCK_SIZE
+ *
+ * @return A pointer to the new arena or NULL if failure
+ */
+Arena *
+arena_new(size_t block_size);
+
+/** Allocate memory. It is not initialized.
+ *
+ * @return A pointer to the new memory or NULL if failure
+ */
+void *
+arena_alloc(Arena *arena, size_t size);
+
+/** Copy a string of known length inside the arena and null terminate it */
+char *
+arena_strndup(Arena *arena, const char *s, size_t n);
+
+/** Copy a null terminated string inside the arena */
+char *
+arena_strdup(Arena *arena, const char *s);
+
+/** Free all allocations at once.
+ *
+ * Memory is kept for reuse, coalesced into a single block.
+ *
+ * @return 0 if success, -1 if the coalesced block could not be allocated, in
+ *         which case the arena is empty but still valid.
+ */
+int
+arena_reset(Arena *arena);
+
+/** Free all memory, including the arena. Does nothing if NULL */
+void
+arena_delete(Arena *arena);
+
+/// @}
+
 /** @addtogroup Varint
  *
  * Variable length integer encoding following Google's
@@ -180,6 +254,49 @@ varint_decode_int64(uint8_t *in, uint8_t* read);
 
 /// @}
 
+/** @addtogroup StreamVByte
+ *
+ * [Stream VByte](https://arxiv.org/abs/1709.08990) encoding of 32bit
+ * unsigned integers.
+ *
+ * The length of each integer (1 to 4 bytes) is stored as a 2 bit code inside a
+ * stream of control bytes, separated from the stream of data bytes. Since the
+ * position of each integer can be computed from a single control byte, 4
+ * integers can be decoded at once without branches. On x86 CPUs with SSSE3,
+ * detected at run time, decoding uses a byte shuffle per control byte,
+ * otherwise a scalar fallback is used. Both produce the same output.
+ * @{
+ */
+
+/** Maximum number of bytes necessary to encode `n` integers */
+#define SVB_MAX_SIZE(n) (((n) + 3)/4 + 4*(n))
+
+/** Encode `n` integers.
+ *
+ * @param in Input integers
+ * @param n Number of integers
+ * @param out Output byte stream, with room for at least @ref SVB_MAX_SIZE(n) bytes
+ * @return Pointer at the end of the output byte stream
+ */
+uint8_t *
+svb_encode_uint32(const uint32_t *in, size_t n, uint8_t *out);
+
+/** Decode `n` integers.
+ *
+ * The decoder never reads past `in + in_size`.
+ *
+ * @param in Input byte stream
+ * @param in_size Number of bytes available in the input byte stream
+ * @param n Number of integers to decode
+ * @param out Output integers
+ * @return Number of bytes of the input byte stream used by the `n` integers,
+ *         or 0 if the input is too short.
+ */
+size_t
+svb_decode_uint32(const uint8_t *in, size_t in_size, size_t n, uint32_t *out);
+
+/// @}
+
 /** Extract domain from a valid http URL */
 int
 url_domain(const char *url, int *start, int *end);
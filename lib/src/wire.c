@@ -0,0 +1,297 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wire.h"
+
+static void
+wire_pages_set_error(WirePages *wp, int code, const char *message) {
+     error_set(wp->error, code, message);
+}
+
+static void
+wire_pages_add_error(WirePages *wp, const char *message) {
+     error_add(wp->error, message);
+}
+
+WireError
+wire_pages_new(WirePages **wp) {
+     WirePages *p = *wp = calloc(1, sizeof(*p));
+     if (!p)
+          return wire_error_memory;
+     if (!(p->error = error_new())) {
+          free(p);
+          *wp = 0;
+          return wire_error_memory;
+     }
+     return 0;
+}
+
+void
+wire_pages_delete(WirePages *wp) {
+     if (!wp)
+          return;
+     for (size_t i=0; i<wp->n_alloc; ++i)
+          crawled_page_delete(wp->pages[i]);
+     free(wp->pages);
+     free(wp->url);
+     free(wp->offsets);
+     free(wp->scores);
+     error_delete(wp->error);
+     free(wp);
+}
+
+/** Reads little endian integers and floats from a message, checking bounds */
+typedef struct {
+     const char *cur;
+     const char *end;
+} WireReader;
+
+static int
+wire_read(WireReader *r, void *out, size_t n) {
+     if ((size_t)(r->end - r->cur) < n)
+          return -1;
+     memcpy(out, r->cur, n);
+     r->cur += n;
+     return 0;
+}
+
+static const char *
+wire_skip(WireReader *r, size_t n) {
+     if ((size_t)(r->end - r->cur) < n)
+          return 0;
+     const char *p = r->cur;
+     r->cur += n;
+     return p;
+}
+
+static int
+wire_read_header(WireReader *r, uint32_t *n_items, const char **error) {
+     char magic[4];
+     uint8_t version;
+     uint8_t flags;
+     if (wire_read(r, magic, sizeof(magic)) != 0 ||
+         wire_read(r, &version, sizeof(version)) != 0 ||
+         wire_read(r, &flags, sizeof(flags)) != 0 ||
+         wire_read(r, n_items, sizeof(*n_items)) != 0) {
+          *error = "message too short";
+          return -1;
+     }
+     if (memcmp(magic, WIRE_MAGIC, sizeof(magic)) != 0) {
+          *error = "bad magic";
+          return -1;
+     }
+     if (version != WIRE_VERSION) {
+          *error = "unsupported version";
+          return -1;
+     }
+     if (flags & WIRE_FLAG_ZLIB) {
+          *error = "compressed messages not supported";
+          return -1;
+     }
+     return 0;
+}
+
+/** Make room for at least n pages */
+static int
+wire_pages_reserve(WirePages *wp, size_t n) {
+     if (n <= wp->n_alloc)
+          return 0;
+     CrawledPage **pages = realloc(wp->pages, n*sizeof(*pages));
+     if (!pages)
+          return -1;
+     wp->pages = pages;
+     for (; wp->n_alloc < n; ++wp->n_alloc)
+          if (!(wp->pages[wp->n_alloc] = crawled_page_new("")))
+               return -1;
+     return 0;
+}
+
+/** Copy the URL to the scratch space adding the terminating NUL */
+static const char *
+wire_pages_url(WirePages *wp, const char *url, size_t len) {
+     if (len + 1 > wp->url_size) {
+          char *p = realloc(wp->url, len + 1);
+          if (!p)
+               return 0;
+          wp->url = p;
+          wp->url_size = len + 1;
+     }
+     memcpy(wp->url, url, len);
+     wp->url[len] = '\0';
+     return wp->url;
+}
+
+static int
+wire_pages_reserve_links(WirePages *wp, size_t n_links) {
+     if (n_links <= wp->n_links_alloc)
+          return 0;
+     size_t *offsets = realloc(wp->offsets, (n_links + 1)*sizeof(*offsets));
+     if (!offsets)
+          return -1;
+     wp->offsets = offsets;
+     float *scores = realloc(wp->scores, n_links*sizeof(*scores));
+     if (!scores)
+          return -1;
+     wp->scores = scores;
+     wp->n_links_alloc = n_links;
+     return 0;
+}
+
+WireError
+wire_pages_decode(WirePages *wp, const char *buf, size_t len) {
+     error_clean(wp->error);
+     wp->n_pages = 0;
+
+     WireReader r = {.cur = buf, .end = buf + len};
+     const char *error1 = 0;
+     int code = wire_error_format;
+
+     uint32_t n_pages;
+     if (wire_read_header(&r, &n_pages, &error1) != 0)
+          goto on_error;
+     // every page takes at least 13 bytes, do not trust n_pages blindly
+     if (n_pages > len/13) {
+          error1 = "too many pages for message length";
+          goto on_error;
+     }
+     if (wire_pages_reserve(wp, n_pages) != 0) {
+          error1 = "allocating pages";
+          code = wire_error_memory;
+          goto on_error;
+     }
+
+     for (size_t i=0; i<n_pages; ++i) {
+          CrawledPage *cp = wp->pages[i];
+
+          uint32_t url_len;
+          const char *url;
+          float score;
+          uint8_t flags;
+          if (wire_read(&r, &url_len, sizeof(url_len)) != 0 ||
+              !(url = wire_skip(&r, url_len)) ||
+              wire_read(&r, &score, sizeof(score)) != 0 ||
+              wire_read(&r, &flags, sizeof(flags)) != 0) {
+               error1 = "truncated page";
+               goto on_error;
+          }
+          if (!(url = wire_pages_url(wp, url, url_len)) ||
+              crawled_page_reset(cp, url) != 0) {
+               error1 = "resetting page";
+               code = wire_error_memory;
+               goto on_error;
+          }
+          cp->score = score;
+
+          uint64_t hash;
+          if (flags & WIRE_PAGE_CONTENT_HASH) {
+               if (wire_read(&r, &hash, sizeof(hash)) != 0) {
+                    error1 = "truncated content hash";
+                    goto on_error;
+               }
+               if (crawled_page_set_hash64(cp, hash) != 0) {
+                    error1 = "setting content hash";
+                    code = wire_error_memory;
+                    goto on_error;
+               }
+          }
+          if (flags & WIRE_PAGE_SIMHASH) {
+               if (wire_read(&r, &hash, sizeof(hash)) != 0) {
+                    error1 = "truncated simhash";
+                    goto on_error;
+               }
+               crawled_page_set_simhash(cp, hash);
+          }
+
+          uint32_t n_links;
+          if (wire_read(&r, &n_links, sizeof(n_links)) != 0) {
+               error1 = "truncated number of links";
+               goto on_error;
+          }
+          if (n_links == 0)
+               continue;
+          const char *lengths;
+          const char *scores;
+          if (!(lengths = wire_skip(&r, n_links*sizeof(uint32_t))) ||
+              !(scores = wire_skip(&r, n_links*sizeof(float)))) {
+               error1 = "truncated links";
+               goto on_error;
+          }
+          if (wire_pages_reserve_links(wp, n_links) != 0) {
+               error1 = "allocating links";
+               code = wire_error_memory;
+               goto on_error;
+          }
+          wp->offsets[0] = 0;
+          for (size_t j=0; j<n_links; ++j) {
+               uint32_t l;
+               memcpy(&l, lengths + j*sizeof(l), sizeof(l));
+               wp->offsets[j + 1] = wp->offsets[j] + l;
+          }
+          memcpy(wp->scores, scores, n_links*sizeof(float));
+          const char *urls;
+          if (!(urls = wire_skip(&r, wp->offsets[n_links]))) {
+               error1 = "truncated link URLs";
+               goto on_error;
+          }
+          if (crawled_page_add_links(cp, urls, wp->offsets, wp->scores, n_links) != 0) {
+               error1 = "adding links";
+               code = wire_error_memory;
+               goto on_error;
+          }
+     }
+     if (r.cur != r.end) {
+          error1 = "trailing bytes after last page";
+          goto on_error;
+     }
+     wp->n_pages = n_pages;
+     return 0;
+
+on_error:
+     wire_pages_set_error(wp, code, __func__);
+     wire_pages_add_error(wp, error1);
+     return wp->error->code;
+}
+
+int
+wire_encode_urls(char **urls, size_t n_urls, char **buf, size_t *len, size_t *size) {
+     size_t n = WIRE_HEADER_SIZE + n_urls*sizeof(uint32_t);
+     for (size_t i=0; i<n_urls; ++i)
+          n += strlen(urls[i]);
+     if (*len + n > *size) {
+          size_t new_size = *size? *size: 4096;
+          while (new_size < *len + n)
+               new_size *= 2;
+          char *p = realloc(*buf, new_size);
+          if (!p)
+               return -1;
+          *buf = p;
+          *size = new_size;
+     }
+     char *out = *buf + *len;
+     const uint8_t version = WIRE_VERSION;
+     const uint8_t flags = 0;
+     const uint32_t n_items = n_urls;
+     memcpy(out, WIRE_MAGIC, 4);
+     memcpy(out + 4, &version, 1);
+     memcpy(out + 5, &flags, 1);
+     memcpy(out + 6, &n_items, 4);
+     out += WIRE_HEADER_SIZE;
+
+     char *blob = out + n_urls*sizeof(uint32_t);
+     for (size_t i=0; i<n_urls; ++i) {
+          const uint32_t l = strlen(urls[i]);
+          memcpy(out + i*sizeof(l), &l, sizeof(l));
+          memcpy(blob, urls[i], l);
+          blob += l;
+     }
+     *len += n;
+     return 0;
+}
+
+#if (defined TEST) && TEST
+#include "test_wire.c"
+#endif // TEST
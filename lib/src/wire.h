@@ -0,0 +1,111 @@
+#ifndef __WIRE_H__
+#define __WIRE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "page_db.h"
+#include "util.h"
+
+/** @addtogroup Wire
+ *
+ * Binary encoding of crawled pages and URL lists, the same one produced by
+ * the Python module `aduana.wire`. All integers are little endian.
+ *
+ * @verbatim
+   header: magic "ADNW", uint8 version, uint8 flags, uint32 number of items
+   page:   uint32 url length, url
+           float32 score
+           uint8 flags (bit 0: content hash present, bit 1: simhash present)
+           [uint64 content hash] [uint64 simhash]
+           uint32 number of links n
+           n x uint32 link URL lengths
+           n x float32 link scores
+           the link URLs, one after the other
+   urls:   n x uint32 URL lengths, the URLs one after the other
+   @endverbatim
+ *
+ * The Python module can compress the body with zlib, which is signaled with
+ * @ref WIRE_FLAG_ZLIB. The C library does not decompress and rejects such
+ * messages.
+ * @{
+ */
+
+#define WIRE_MAGIC "ADNW"
+#define WIRE_VERSION 1
+/** Size of the message header */
+#define WIRE_HEADER_SIZE 10
+
+/** Body compressed with zlib */
+#define WIRE_FLAG_ZLIB 1
+
+#define WIRE_PAGE_CONTENT_HASH 1
+#define WIRE_PAGE_SIMHASH 2
+
+typedef enum {
+     wire_error_ok = 0,   /**< No error */
+     wire_error_memory,   /**< Error allocating memory */
+     wire_error_format    /**< Malformed message */
+} WireError;
+
+/** Crawled pages decoded from a message.
+ *
+ * The @ref CrawledPage objects are kept between calls to
+ * @ref wire_pages_decode and reused with @ref crawled_page_reset.
+ */
+typedef struct {
+     /** Decoded pages */
+     CrawledPage **pages;
+     /** Number of pages decoded by the last call */
+     size_t n_pages;
+     /** Number of allocated pages */
+     size_t n_alloc;
+
+     /** Scratch space for a NUL terminated URL */
+     char *url;
+     size_t url_size;
+     /** Scratch space for link offsets and scores */
+     size_t *offsets;
+     float *scores;
+     size_t n_links_alloc;
+
+     Error *error;
+} WirePages;
+
+WireError
+wire_pages_new(WirePages **wp);
+
+/** Decode a message with crawled pages
+ *
+ * @param buf Whole message, including header
+ * @param len Length of the message
+ *
+ * @return 0 if success, otherwise the error code. After an error
+ *         @ref WirePages::n_pages is 0
+ */
+WireError
+wire_pages_decode(WirePages *wp, const char *buf, size_t len);
+
+void
+wire_pages_delete(WirePages *wp);
+
+/** Encode a list of URLs, appending the message to a growing buffer
+ *
+ * @param buf  Buffer, reallocated as necessary. Can point to NULL
+ * @param len  Used bytes inside buf, updated
+ * @param size Allocated bytes of buf, updated
+ *
+ * @return 0 if success, -1 if memory error
+ */
+int
+wire_encode_urls(char **urls, size_t n_urls, char **buf, size_t *len, size_t *size);
+
+/// @}
+
+#if (defined TEST) && TEST
+#include "CuTest.h"
+CuSuite *
+test_wire_suite(void);
+#endif
+
+#endif // __WIRE_H__
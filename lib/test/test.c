@@ -3,6 +3,7 @@
 #include <errno.h>
 
 #include "CuTest.h"
+#include "test.h"
 
 #include "page_db.h"
 #include "page_rank.h"
@@ -10,6 +11,13 @@
 #include "bf_scheduler.h"
 #include "domain_temp.h"
 #include "freq_scheduler.h"
+#include "link_shards.h"
+#include "link_stream.h"
+#include "ppr_scorer.h"
+#include "hll.h"
+#include "linking_domains_scorer.h"
+#include "wire.h"
+#include "metrics.h"
 
 int main(int argc, char **argv) {
      size_t n_pages = 0;
@@ -45,12 +53,24 @@ int main(int argc, char **argv) {
      } while(0);
 
      RUN_SUITE("page_db", test_page_db_suite(n_pages));
+     RUN_SUITE("page_db_domains", test_page_db_domains_suite());
+     RUN_SUITE("page_db_export", test_page_db_export_suite());
+     RUN_SUITE("page_db_prune", test_page_db_prune_suite());
+     RUN_SUITE("page_db_storage", test_page_db_storage_suite());
      RUN_SUITE("page_rank", test_page_rank_suite());
      RUN_SUITE("hits", test_hits_suite());
      RUN_SUITE("bf_scheduler", test_bf_scheduler_suite(n_pages));
      RUN_SUITE("util", test_util_suite());
      RUN_SUITE("domain_temp", test_domain_temp_suite());
      RUN_SUITE("freq_scheduler", test_freq_scheduler_suite(n_pages));
+     RUN_SUITE("link_shards", test_link_shards_suite());
+     RUN_SUITE("link_stream", test_link_stream_suite());
+     RUN_SUITE("ppr_scorer", test_ppr_scorer_suite());
+     RUN_SUITE("hll", test_hll_suite());
+     RUN_SUITE("linking_domains_scorer", test_linking_domains_scorer_suite());
+     RUN_SUITE("wire", test_wire_suite());
+     RUN_SUITE("metrics", test_metrics_suite());
+     RUN_SUITE("aduana_server", test_aduana_server_suite());
      if (fail_count == 0)
 	  return 0;
      else
@@ -3,6 +3,10 @@
 
 #include "CuTest.h"
 
+/** Suite of aduana_server, which is not part of the library */
+CuSuite *
+test_aduana_server_suite(void);
+
 #define CHECK_DELETE(tc, msg, cmd) do {\
      int __ret = (cmd);\
      CuAssert(tc, __ret? msg: "", __ret == 0);\
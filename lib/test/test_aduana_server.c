@@ -0,0 +1,236 @@
+#define _POSIX_C_SOURCE 200809L
+#define _BSD_SOURCE 1
+#define _GNU_SOURCE 1
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "CuTest.h"
+
+#include "test.h"
+#include "wire.h"
+
+/* Round trip against a running aduana_server. The operation codes and
+ * status values are the ones documented in aduana_server.c */
+#define TEST_SERVER_OP_ADD 1
+#define TEST_SERVER_OP_REQUEST 2
+
+#define TEST_SERVER_STATUS_OK 0
+#define TEST_SERVER_STATUS_ERROR 1
+
+/** Append n bytes to the message being built */
+static void
+test_server_put(char *buf, size_t *len, const void *data, size_t n) {
+     memcpy(buf + *len, data, n);
+     *len += n;
+}
+
+/** Append a frame with the given operation and payload */
+static void
+test_server_put_frame(char *buf, size_t *len, uint8_t op, const char *payload, uint32_t n) {
+     const uint32_t frame_len = n + 1;
+     test_server_put(buf, len, &frame_len, sizeof(frame_len));
+     test_server_put(buf, len, &op, sizeof(op));
+     test_server_put(buf, len, payload, n);
+}
+
+/** Message with a single page linking to the given URLs */
+static size_t
+test_server_pages(char *buf, const char *url,
+                  const char **links, const float *scores, uint32_t n_links) {
+     size_t len = 0;
+     const uint8_t version = WIRE_VERSION;
+     const uint8_t flags = 0;
+     const uint32_t n_pages = 1;
+     test_server_put(buf, &len, WIRE_MAGIC, 4);
+     test_server_put(buf, &len, &version, 1);
+     test_server_put(buf, &len, &flags, 1);
+     test_server_put(buf, &len, &n_pages, 4);
+
+     const uint32_t url_len = strlen(url);
+     const float score = 1.0;
+     test_server_put(buf, &len, &url_len, sizeof(url_len));
+     test_server_put(buf, &len, url, url_len);
+     test_server_put(buf, &len, &score, sizeof(score));
+     test_server_put(buf, &len, &flags, sizeof(flags));
+     test_server_put(buf, &len, &n_links, sizeof(n_links));
+     for (size_t i=0; i<n_links; ++i) {
+          const uint32_t l = strlen(links[i]);
+          test_server_put(buf, &len, &l, sizeof(l));
+     }
+     test_server_put(buf, &len, scores, n_links*sizeof(*scores));
+     for (size_t i=0; i<n_links; ++i)
+          test_server_put(buf, &len, links[i], strlen(links[i]));
+     return len;
+}
+
+static int
+test_server_read_all(int fd, char *buf, size_t n) {
+     while (n > 0) {
+          ssize_t r = read(fd, buf, n);
+          if (r <= 0 && errno != EINTR)
+               return -1;
+          if (r > 0) {
+               buf += r;
+               n -= r;
+          }
+     }
+     return 0;
+}
+
+/** Read a response frame. Returns the payload length or -1 if the
+ * connection was closed */
+static ssize_t
+test_server_read_frame(int fd, uint8_t *status, char *payload, size_t size) {
+     uint32_t len;
+     if (test_server_read_all(fd, (char*)&len, sizeof(len)) != 0 ||
+         len < 1 || len - 1 > size ||
+         test_server_read_all(fd, (char*)status, 1) != 0 ||
+         test_server_read_all(fd, payload, len - 1) != 0)
+          return -1;
+     return len - 1;
+}
+
+static int
+test_server_connect(const char *path) {
+     struct sockaddr_un addr = {.sun_family = AF_UNIX};
+     strcpy(addr.sun_path, path);
+     // wait until the server is listening
+     for (int i=0; i<500; ++i) {
+          int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+          if (fd < 0)
+               return -1;
+          if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+               // fail instead of hanging if a response never arrives
+               struct timeval tv = {.tv_sec = 10, .tv_usec = 0};
+               setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+               return fd;
+          }
+          close(fd);
+          struct timespec ts = {.tv_sec = 0, .tv_nsec = 10000000};
+          nanosleep(&ts, 0);
+     }
+     return -1;
+}
+
+static int
+test_server_remove(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+     (void)st;
+     (void)flag;
+     (void)ftw;
+     return remove(path);
+}
+
+void
+test_aduana_server_round_trip(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-server-XXXXXX";
+     CuAssert(tc, "creating test directory", mkdtemp(test_dir) != 0);
+
+     char sock_path[64];
+     char db_path[64];
+     snprintf(sock_path, sizeof(sock_path), "%s/sock", test_dir);
+     snprintf(db_path, sizeof(db_path), "%s/db", test_dir);
+
+     pid_t pid = fork();
+     CuAssert(tc, "forking server", pid >= 0);
+     if (pid == 0) {
+          int null = open("/dev/null", O_WRONLY);
+          if (null >= 0)
+               dup2(null, STDOUT_FILENO);
+          execl(ADUANA_SERVER_PATH, "aduana_server",
+                "-u", sock_path, "-w", "2", "-q", "4", db_path, (char*)0);
+          _exit(127);
+     }
+     int fd = test_server_connect(sock_path);
+     if (fd < 0) {
+          kill(pid, SIGTERM);
+          waitpid(pid, 0, 0);
+          nftw(test_dir, test_server_remove, 16, FTW_DEPTH | FTW_PHYS);
+     }
+     CuAssert(tc, "connecting to server", fd >= 0);
+
+     // all requests are sent before reading any response, and the client
+     // closes its side before reading
+     static char buf[4096];
+     char payload[1024];
+     size_t len = 0;
+
+     const char *links[] = {"http://b.com/", "http://c.com/", "http://d.com/"};
+     const float scores[] = {0.9, 0.5, 0.1};
+     size_t n = test_server_pages(payload, "http://a.com/", links, scores, 3);
+     test_server_put_frame(buf, &len, TEST_SERVER_OP_ADD, payload, n);
+
+     const uint32_t n_urls = 2;
+     test_server_put_frame(buf, &len, TEST_SERVER_OP_REQUEST, (char*)&n_urls, sizeof(n_urls));
+     test_server_put_frame(buf, &len, TEST_SERVER_OP_ADD, "garbage", 7);
+     test_server_put_frame(buf, &len, TEST_SERVER_OP_REQUEST, "xx", 2);
+     test_server_put_frame(buf, &len, 99, "", 0);
+
+     const int sent = write(fd, buf, len) == (ssize_t)len && shutdown(fd, SHUT_WR) == 0;
+
+     // read everything and stop the server before checking, so that a
+     // failed check does not leave it running
+     uint8_t status[6] = {0};
+     ssize_t r[6];
+     char payloads[6][256];
+     for (size_t i=0; i<6; ++i) {
+          memset(payloads[i], 0, sizeof(payloads[i]));
+          r[i] = sent?
+               test_server_read_frame(fd, status + i, payloads[i], sizeof(payloads[i]) - 1):
+               -1;
+     }
+     close(fd);
+
+     int wstatus = 0;
+     const int stopped = kill(pid, SIGTERM) == 0 && waitpid(pid, &wstatus, 0) == pid;
+     nftw(test_dir, test_server_remove, 16, FTW_DEPTH | FTW_PHYS);
+
+     CuAssert(tc, "sending requests", sent);
+     CuAssert(tc, "stopping server", stopped);
+     CuAssert(tc, "server exit status", WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+     CuAssertIntEquals(tc, 0, r[0]);
+     CuAssertIntEquals(tc, TEST_SERVER_STATUS_OK, status[0]);
+
+     // the links with highest score
+     CuAssertIntEquals(tc, TEST_SERVER_STATUS_OK, status[1]);
+     CuAssertIntEquals(tc, WIRE_HEADER_SIZE + 2*4 + 26, r[1]);
+     CuAssert(tc, "magic", memcmp(payloads[1], WIRE_MAGIC, 4) == 0);
+     uint32_t m;
+     memcpy(&m, payloads[1] + 6, sizeof(m));
+     CuAssertIntEquals(tc, 2, m);
+     CuAssert(tc, "urls",
+              memcmp(payloads[1] + WIRE_HEADER_SIZE + 8, "http://b.com/http://c.com/", 26) == 0);
+
+     // errors are framed and do not close the connection
+     CuAssertIntEquals(tc, TEST_SERVER_STATUS_ERROR, status[2]);
+     CuAssert(tc, "error message", r[2] > 0);
+     CuAssertIntEquals(tc, TEST_SERVER_STATUS_ERROR, status[3]);
+     CuAssertStrEquals(tc, "request payload must be an uint32", payloads[3]);
+     CuAssertIntEquals(tc, TEST_SERVER_STATUS_ERROR, status[4]);
+     CuAssertStrEquals(tc, "unknown operation", payloads[4]);
+
+     // and then the server closes the connection
+     CuAssertIntEquals(tc, -1, r[5]);
+}
+
+CuSuite *
+test_aduana_server_suite(void) {
+     CuSuite *suite = CuSuiteNew();
+     SUITE_ADD_TEST(suite, test_aduana_server_round_trip);
+
+     return suite;
+}
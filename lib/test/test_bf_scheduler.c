@@ -102,6 +102,11 @@ test_bf_scheduler_requests(CuTest *tc) {
      CuAssertStrEquals(tc, "3", req->urls[1]);
      page_request_delete(req);
 
+     // the schedule keeps its order after compaction
+     CuAssert(tc,
+	      sch->error->message,
+	      bf_scheduler_compact(sch) == 0);
+
      CuAssert(tc,
 	      sch->error->message,
 	      bf_scheduler_request(sch, 4, &req) == 0);
@@ -110,12 +115,78 @@ test_bf_scheduler_requests(CuTest *tc) {
      CuAssert(tc, "too many requests returned", req->n_urls == 1);
      page_request_delete(req);
 
+     BFSchedulerStats stats;
+     CuAssert(tc,
+	      sch->error->message,
+	      bf_scheduler_stats(sch, &stats) == 0);
+     CuAssertStrEquals(tc, "schedule", stats.schedule.name);
+     CuAssert(tc, "page size", stats.env.page_size > 0);
+
      bf_scheduler_delete(sch);
      page_db_delete(db);
 
      free(crawl);
 }
 
+void
+test_bf_scheduler_prune(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir_db[] = "test-bfs-XXXXXX";
+     mkdtemp(test_dir_db);
+
+     PageDB *db;
+     CuAssert(tc, "creating PageDB", page_db_new(&db, test_dir_db) == 0);
+     db->persist = 0;
+
+     BFScheduler *sch;
+     CuAssert(tc, "creating BFScheduler", bf_scheduler_new(&sch, db, 0) == 0);
+     sch->persist = 0;
+
+     /* Depth of the uncrawled pages 3, 4 and 5
+      *
+      *      0.5    0.9
+      *   1 ---> 2 ---> 4
+      *   |      |
+      *   | 0.1  | 0.2
+      *   v      v
+      *   3      5
+      */
+     CrawledPage *cp = crawled_page_new("1");
+     crawled_page_add_link(cp, "2", 0.5);
+     crawled_page_add_link(cp, "3", 0.1);
+     CuAssert(tc, sch->error->message, bf_scheduler_add(sch, cp) == 0);
+     crawled_page_delete(cp);
+
+     cp = crawled_page_new("2");
+     crawled_page_add_link(cp, "4", 0.9);
+     crawled_page_add_link(cp, "5", 0.2);
+     CuAssert(tc, sch->error->message, bf_scheduler_add(sch, cp) == 0);
+     crawled_page_delete(cp);
+
+     BFSchedulerStats stats;
+     CuAssert(tc, sch->error->message, bf_scheduler_stats(sch, &stats) == 0);
+     CuAssertIntEquals(tc, 4, stats.schedule.entries);
+
+     PageDBPruneOptions options = {.max_depth = 1};
+     size_t n_pruned;
+     CuAssert(tc, sch->error->message,
+              bf_scheduler_prune(sch, &options, &n_pruned) == 0);
+     CuAssertIntEquals(tc, 2, n_pruned);
+
+     // only 2, already crawled, and 3 are left
+     CuAssert(tc, sch->error->message, bf_scheduler_stats(sch, &stats) == 0);
+     CuAssertIntEquals(tc, 2, stats.schedule.entries);
+
+     PageRequest *req;
+     CuAssert(tc, sch->error->message, bf_scheduler_request(sch, 10, &req) == 0);
+     CuAssertIntEquals(tc, 1, req->n_urls);
+     CuAssertStrEquals(tc, "3", req->urls[0]);
+     page_request_delete(req);
+
+     bf_scheduler_delete(sch);
+     page_db_delete(db);
+}
+
 static void
 test_bf_scheduler_crawl(CuTest *tc,
 			BFScheduler *sch,
@@ -319,6 +390,7 @@ test_bf_scheduler_suite(size_t n_pages) {
 
      CuSuite *suite = CuSuiteNew();
      SUITE_ADD_TEST(suite, test_bf_scheduler_requests);
+     SUITE_ADD_TEST(suite, test_bf_scheduler_prune);
      SUITE_ADD_TEST(suite, test_bf_scheduler_restart);
      SUITE_ADD_TEST(suite, test_bf_scheduler_page_rank);
      SUITE_ADD_TEST(suite, test_bf_scheduler_hits);
@@ -189,6 +189,102 @@ test_freq_scheduler_requests_simple(CuTest *tc) {
      page_db_delete(db);
 }
 
+static void
+test_freq_scheduler_near_dup(CuTest *tc) {
+     printf("%s\n", __func__);
+
+     char test_dir_db[] = "test-freqs-XXXXXX";
+     mkdtemp(test_dir_db);
+
+     PageDB *db;
+     int ret = page_db_new(&db, test_dir_db);
+     CuAssert(tc,
+	      db!=0? db->error->message: "NULL",
+	      ret == 0);
+     db->persist = 0;
+
+     FreqScheduler *sch;
+     ret = freq_scheduler_new(&sch, db, 0);
+     CuAssert(tc,
+	      sch != 0? sch->error->message: "NULL",
+	      ret == 0);
+     sch->persist = 0;
+
+     // a and b differ in 2 bits, c is far from both
+     const char *urls[] = {"http://a.com/", "http://b.com/", "http://c.com/"};
+     const uint64_t simhash[] = {
+          0x0123456789ABCDEFULL,
+          0x0123456789ABCDEFULL ^ 0x0000000100000001ULL,
+          0xFEDCBA9876543210ULL
+     };
+     for (size_t i=0; i<3; ++i) {
+          CrawledPage *cp = crawled_page_new(urls[i]);
+          crawled_page_set_simhash(cp, simhash[i]);
+	  CuAssert(tc,
+		   sch->error->message,
+		   freq_scheduler_add(sch, cp) == 0);
+	  crawled_page_delete(cp);
+     }
+
+     uint64_t dup_hash;
+     int found;
+     CuAssert(tc,
+              db->error->message,
+              page_db_find_near_dup(db, simhash[0], 3, 0.0, page_db_hash(urls[0]),
+                                    &dup_hash, &found) == 0);
+     CuAssertTrue(tc, found);
+     CuAssertTrue(tc, dup_hash == page_db_hash(urls[1]));
+     CuAssert(tc,
+              db->error->message,
+              page_db_find_near_dup(db, simhash[2], 3, 0.0, page_db_hash(urls[2]),
+                                    &dup_hash, &found) == 0);
+     CuAssertTrue(tc, !found);
+
+     CuAssert(tc,
+	      sch->error->message,
+	      freq_scheduler_load_simple(sch, 0.1, -1.0) == 0);
+
+     // a and b have just been crawled, only c is returned
+     sch->near_dup_distance = 3;
+     PageRequest *req;
+     CuAssert(tc,
+	      sch->error->message,
+	      freq_scheduler_request(sch, 3, &req) == 0);
+     CuAssert(tc, "no requests returned", req->n_urls > 0);
+     for (size_t i=0; i<req->n_urls; ++i)
+          CuAssertStrEquals(tc, urls[2], req->urls[i]);
+     page_request_delete(req);
+
+     // a and b are not near duplicates at distance 1
+     sch->near_dup_distance = 1;
+     CuAssert(tc,
+	      sch->error->message,
+	      freq_scheduler_request(sch, 6, &req) == 0);
+     int returned[] = {0, 0, 0};
+     for (size_t i=0; i<req->n_urls; ++i)
+          for (size_t j=0; j<3; ++j)
+               if (strcmp(req->urls[i], urls[j]) == 0)
+                    returned[j] = 1;
+     page_request_delete(req);
+     CuAssertTrue(tc, returned[0] && returned[1] && returned[2]);
+
+     // b changes content and leaves the cluster of a
+     CrawledPage *cp = crawled_page_new(urls[1]);
+     crawled_page_set_simhash(cp, ~simhash[0]);
+     CuAssert(tc,
+              sch->error->message,
+              freq_scheduler_add(sch, cp) == 0);
+     crawled_page_delete(cp);
+     CuAssert(tc,
+              db->error->message,
+              page_db_find_near_dup(db, simhash[0], 3, 0.0, page_db_hash(urls[0]),
+                                    &dup_hash, &found) == 0);
+     CuAssertTrue(tc, !found);
+
+     freq_scheduler_delete(sch);
+     page_db_delete(db);
+}
+
 CuSuite *
 test_freq_scheduler_suite(size_t n_pages) {
      test_n_pages = n_pages/100;
@@ -196,5 +292,6 @@ test_freq_scheduler_suite(size_t n_pages) {
      CuSuite *suite = CuSuiteNew();
      SUITE_ADD_TEST(suite, test_freq_scheduler_requests_mmap);
      SUITE_ADD_TEST(suite, test_freq_scheduler_requests_simple);
+     SUITE_ADD_TEST(suite, test_freq_scheduler_near_dup);
      return suite;
 }
@@ -78,7 +78,7 @@ test_hits(CuTest *tc) {
               hits->error->message,
               hits_compute(hits,
                            st,
-                           page_db_link_stream_next,
+                           page_db_link_stream_next_block,
                            page_db_link_stream_reset) == 0);
      page_db_link_stream_delete(st);
 
@@ -103,6 +103,44 @@ test_hits(CuTest *tc) {
      }
      CHECK_DELETE(tc, hits->error->message, hits_delete(hits));
 
+     // Out of core, two pages per shard
+     // ------------------------------------------------------------------------
+     CuAssert(tc,
+              db->error->message,
+              page_db_link_stream_new(&st, db) == 0);
+     st->only_diff_domain = 0;
+
+     ret = hits_new(&hits, test_dir, 5);
+     CuAssert(tc,
+              hits!=0? hits->error->message: "NULL",
+              ret == 0);
+
+     hits->precision = 1e-8;
+     hits->shard_size = 2;
+     CuAssert(tc,
+              hits->error->message,
+              hits_compute(hits,
+                           st,
+                           page_db_link_stream_next_block,
+                           page_db_link_stream_reset) == 0);
+     page_db_link_stream_delete(st);
+     CuAssertIntEquals(tc, 3, hits->shards->n_shards);
+
+     for (int i=0; i<5; ++i) {
+          CuAssert(tc,
+                   db->error->message,
+                   page_db_get_idx(db, page_db_hash(urls[i]), &idx) == 0);
+
+          CuAssertPtrNotNull(tc,
+                             h_score = mmap_array_idx(hits->h1, idx));
+          CuAssertPtrNotNull(tc,
+                             a_score = mmap_array_idx(hits->a1, idx));
+
+          CuAssertDblEquals(tc, h_scores[i], *h_score, 1e-6);
+          CuAssertDblEquals(tc, a_scores[i], *a_score, 1e-6);
+     }
+     CHECK_DELETE(tc, hits->error->message, hits_delete(hits));
+
      page_db_delete(db);
 }
 
@@ -0,0 +1,97 @@
+#include "CuTest.h"
+
+void
+test_hll_sparse(CuTest *tc) {
+     printf("%s\n", __func__);
+
+     HLL hll;
+     hll_init(&hll);
+     CuAssertDblEquals(tc, 0.0, hll_count(&hll), 1e-6);
+
+     CuAssertIntEquals(tc, 1, hll_add(&hll, 7));
+     CuAssertIntEquals(tc, 1, hll_add(&hll, 3));
+     CuAssertIntEquals(tc, 0, hll_add(&hll, 7));
+     CuAssertIntEquals(tc, 1, hll_add(&hll, 5));
+     CuAssertIntEquals(tc, 0, hll.dense);
+     CuAssertDblEquals(tc, 3.0, hll_count(&hll), 1e-6);
+     CuAssertIntEquals(tc, 3, hll.sparse[0]);
+     CuAssertIntEquals(tc, 5, hll.sparse[1]);
+     CuAssertIntEquals(tc, 7, hll.sparse[2]);
+
+     uint8_t buf[1 + HLL_REGISTERS];
+     CuAssertIntEquals(tc, 1 + 3*sizeof(uint32_t), hll_size(&hll));
+     hll_dump(&hll, buf);
+     HLL copy;
+     CuAssertIntEquals(tc, 0, hll_load(&copy, buf, hll_size(&hll)));
+     CuAssertIntEquals(tc, 0, copy.dense);
+     CuAssertDblEquals(tc, 3.0, hll_count(&copy), 1e-6);
+
+     // malformed data
+     CuAssertIntEquals(tc, -1, hll_load(&copy, buf, 2));
+     buf[0] = 0xFF;
+     CuAssertIntEquals(tc, -1, hll_load(&copy, buf, hll_size(&hll)));
+}
+
+void
+test_hll_dense(CuTest *tc) {
+     printf("%s\n", __func__);
+
+     HLL hll;
+     hll_init(&hll);
+     for (uint32_t i=0; i<HLL_SPARSE_MAX; ++i)
+          hll_add(&hll, i*2654435761U);
+     CuAssertIntEquals(tc, 0, hll.dense);
+     CuAssertDblEquals(tc, HLL_SPARSE_MAX, hll_count(&hll), 1e-6);
+
+     // promotion keeps the items added so far
+     hll_add(&hll, 0xFFFFFFFF);
+     CuAssertIntEquals(tc, 1, hll.dense);
+     CuAssertIntEquals(tc, 1 + HLL_REGISTERS, hll_size(&hll));
+     CuAssertDblEquals(tc, HLL_SPARSE_MAX + 1, hll_count(&hll), 0.2*(HLL_SPARSE_MAX + 1));
+
+     for (size_t n=1000; n<=100000; n*=10) {
+          HLL big;
+          hll_init(&big);
+          hll_promote(&big);
+          for (uint32_t i=0; i<n; ++i)
+               hll_add(&big, i);
+          // repeated items do not change the sketch
+          for (uint32_t i=0; i<n; ++i)
+               CuAssertIntEquals(tc, 0, hll_add(&big, i));
+          // 3 standard deviations
+          CuAssertDblEquals(tc, n, hll_count(&big), 3.0*1.04/sqrt(HLL_REGISTERS)*n);
+
+          uint8_t buf[1 + HLL_REGISTERS];
+          hll_dump(&big, buf);
+          HLL copy;
+          CuAssertIntEquals(tc, 0, hll_load(&copy, buf, hll_size(&big)));
+          CuAssertDblEquals(tc, hll_count(&big), hll_count(&copy), 1e-6);
+     }
+
+     // merging disjoint sets adds the counts
+     HLL a, b;
+     hll_init(&a);
+     hll_init(&b);
+     for (uint32_t i=0; i<5000; ++i) {
+          hll_add(&a, i);
+          hll_add(&b, 5000 + i);
+     }
+     hll_merge(&a, &b);
+     CuAssertDblEquals(tc, 10000.0, hll_count(&a), 3.0*1.04/sqrt(HLL_REGISTERS)*10000.0);
+
+     // merging a sparse sketch into itself changes nothing
+     HLL s;
+     hll_init(&s);
+     hll_add(&s, 1);
+     hll_add(&s, 2);
+     hll_merge(&s, &s);
+     CuAssertDblEquals(tc, 2.0, hll_count(&s), 1e-6);
+}
+
+CuSuite *
+test_hll_suite(void) {
+     CuSuite *suite = CuSuiteNew();
+     SUITE_ADD_TEST(suite, test_hll_sparse);
+     SUITE_ADD_TEST(suite, test_hll_dense);
+     return suite;
+}
@@ -0,0 +1,125 @@
+#include "CuTest.h"
+
+#include "test.h"
+
+typedef struct {
+     const Link *links;
+     size_t n_links;
+     size_t i;
+} TestLinkArray;
+
+/* The weight of a link encodes its source and destination */
+static float
+test_link_weight(const Link *link) {
+     return 10*link->from + link->to;
+}
+
+static StreamState
+test_link_array_next_block(void *state, Link *links, float *weights,
+                           size_t max_links, size_t *n_links) {
+     TestLinkArray *arr = (TestLinkArray*)state;
+     *n_links = 0;
+     while (arr->i < arr->n_links && *n_links < max_links) {
+          if (weights)
+               weights[*n_links] = test_link_weight(arr->links + arr->i);
+          links[(*n_links)++] = arr->links[arr->i++];
+     }
+     return *n_links > 0? stream_state_next: stream_state_end;
+}
+
+/* Checks that links are partitioned by destination and keep source order,
+ * and that weights are kept if requested */
+static void
+test_link_shards_weights(CuTest *tc, int weights) {
+
+     char test_dir[] = "test-linkshards-XXXXXX";
+     mkdtemp(test_dir);
+     char *path = build_path(test_dir, "shards");
+
+     const Link links[] = {
+          {0, 1}, {0, 6}, {1, 2}, {1, 3}, {2, 0},
+          {3, 5}, {4, 4}, {5, 1}, {6, 6}, {6, 0}
+     };
+     const size_t n_links = sizeof(links)/sizeof(Link);
+     TestLinkArray arr = {links, n_links, 0};
+
+     LinkShards *ls;
+     int ret = link_shards_new(&ls, path, 3);
+     CuAssert(tc,
+              ls!=0? ls->error->message: "NULL",
+              ret == 0);
+     ls->weights = weights;
+     CuAssert(tc,
+              ls->error->message,
+              link_shards_build(ls, &arr, test_link_array_next_block) == 0);
+
+     CuAssertIntEquals(tc, 3, ls->n_shards);
+     CuAssertIntEquals(tc, 7, ls->n_vertices);
+     CuAssertIntEquals(tc, n_links, ls->n_links);
+
+     Link buffer[2];
+     float weight_buffer[2];
+     size_t total = 0;
+     for (size_t s=0; s<ls->n_shards; ++s) {
+          CuAssertIntEquals(tc, 3*s, link_shards_begin(ls, s));
+          CuAssertIntEquals(tc, s < 2? 3*(s + 1): 7, link_shards_end(ls, s));
+          CuAssert(tc,
+                   ls->error->message,
+                   link_shards_rewind(ls, s) == 0);
+
+          size_t n;
+          int64_t last_from = -1;
+          StreamState state;
+          while ((state = link_shards_read(ls, s, buffer, weight_buffer, 2, &n)) == stream_state_next) {
+               for (size_t i=0; i<n; ++i) {
+                    CuAssertTrue(tc, buffer[i].to >= (int64_t)link_shards_begin(ls, s));
+                    CuAssertTrue(tc, buffer[i].to < (int64_t)link_shards_end(ls, s));
+                    CuAssertTrue(tc, buffer[i].from >= last_from);
+                    CuAssertDblEquals(tc,
+                                      weights? test_link_weight(buffer + i): 1.0,
+                                      weight_buffer[i],
+                                      1e-6);
+                    last_from = buffer[i].from;
+               }
+               total += n;
+          }
+          CuAssertIntEquals(tc, stream_state_end, state);
+     }
+     CuAssertIntEquals(tc, n_links, total);
+
+     // rebuilding discards the previous content
+     arr.i = 0;
+     arr.n_links = 2;
+     CuAssert(tc,
+              ls->error->message,
+              link_shards_build(ls, &arr, test_link_array_next_block) == 0);
+     CuAssertIntEquals(tc, 2, ls->n_links);
+     CuAssertIntEquals(tc, 1, ls->shards[0].n_links);
+     CuAssertIntEquals(tc, 0, ls->shards[1].n_links);
+     CuAssertIntEquals(tc, 1, ls->shards[2].n_links);
+
+     CHECK_DELETE(tc, ls->error->message, link_shards_delete(ls));
+     free(path);
+     rmdir(test_dir);
+}
+
+void
+test_link_shards(CuTest *tc) {
+     printf("%s\n", __func__);
+     test_link_shards_weights(tc, 0);
+}
+
+void
+test_link_shards_weighted(CuTest *tc) {
+     printf("%s\n", __func__);
+     test_link_shards_weights(tc, 1);
+}
+
+CuSuite *
+test_link_shards_suite(void) {
+     CuSuite *suite = CuSuiteNew();
+     SUITE_ADD_TEST(suite, test_link_shards);
+     SUITE_ADD_TEST(suite, test_link_shards_weighted);
+
+     return suite;
+}
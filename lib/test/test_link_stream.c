@@ -0,0 +1,108 @@
+#include "CuTest.h"
+
+#include "test.h"
+
+typedef struct {
+     size_t n_links;
+     size_t i;
+     int started;    /**< False until stream_state_init has been returned */
+     size_t fail_at; /**< Return an error when reaching this link, if not 0 */
+} TestLinkCounter;
+
+/* Single link stream of i -> i + 1. Like the streams written for the single
+ * link consumers it returns stream_state_init before the first link */
+static StreamState
+test_link_counter_next(void *state, Link *link) {
+     TestLinkCounter *lc = (TestLinkCounter*)state;
+     if (!lc->started) {
+          lc->started = 1;
+          return stream_state_init;
+     }
+     if (lc->fail_at > 0 && lc->i == lc->fail_at)
+          return stream_state_error;
+     if (lc->i == lc->n_links)
+          return stream_state_end;
+     link->from = lc->i;
+     link->to = lc->i + 1;
+     ++lc->i;
+     return stream_state_next;
+}
+
+static StreamState
+test_link_counter_reset(void *state) {
+     TestLinkCounter *lc = (TestLinkCounter*)state;
+     lc->i = 0;
+     lc->started = 0;
+     return stream_state_init;
+}
+
+/* Checks that the adapter splits the single link stream into blocks */
+void
+test_link_stream_block_adapter(CuTest *tc) {
+     printf("%s\n", __func__);
+
+     TestLinkCounter lc = {.n_links = 10, .i = 0, .started = 0, .fail_at = 0};
+     LinkStreamBlockAdapter adapter = {
+          .state = &lc,
+          .next = test_link_counter_next,
+          .reset = test_link_counter_reset
+     };
+
+     Link links[4];
+     float weights[4];
+     size_t n_links;
+     for (int pass=0; pass<2; ++pass) {
+          // weights are only written if requested
+          float *w = pass == 0? 0: weights;
+          size_t total = 0;
+          const size_t expected[3] = {4, 4, 2};
+          for (size_t b=0; b<3; ++b) {
+               weights[0] = 0.0;
+               CuAssertIntEquals(tc,
+                                 stream_state_next,
+                                 link_stream_block_adapter_next_block(
+                                      &adapter, links, w, 4, &n_links));
+               CuAssertIntEquals(tc, expected[b], n_links);
+               for (size_t i=0; i<n_links; ++i) {
+                    CuAssertIntEquals(tc, total + i, links[i].from);
+                    CuAssertIntEquals(tc, total + i + 1, links[i].to);
+               }
+               CuAssertDblEquals(tc, w? 1.0: 0.0, weights[0], 1e-9);
+               total += n_links;
+          }
+          CuAssertIntEquals(tc,
+                            stream_state_end,
+                            link_stream_block_adapter_next_block(
+                                 &adapter, links, w, 4, &n_links));
+          CuAssertIntEquals(tc, 0, n_links);
+          CuAssertIntEquals(tc,
+                            stream_state_init,
+                            link_stream_block_adapter_reset(&adapter));
+     }
+
+     // errors are returned without links
+     lc.fail_at = 6;
+     CuAssertIntEquals(tc,
+                       stream_state_next,
+                       link_stream_block_adapter_next_block(
+                            &adapter, links, 0, 4, &n_links));
+     CuAssertIntEquals(tc,
+                       stream_state_error,
+                       link_stream_block_adapter_next_block(
+                            &adapter, links, 0, 4, &n_links));
+     CuAssertIntEquals(tc, 0, n_links);
+
+     // streams that cannot be rewound
+     adapter.reset = 0;
+     CuAssertIntEquals(tc,
+                       stream_state_error,
+                       link_stream_block_adapter_reset(&adapter));
+}
+
+CuSuite *
+test_link_stream_suite(void) {
+     CuSuite *suite = CuSuiteNew();
+     SUITE_ADD_TEST(suite, test_link_stream_block_adapter);
+
+     return suite;
+}
@@ -0,0 +1,114 @@
+#include "CuTest.h"
+
+#include "test.h"
+
+void
+test_linking_domains_scorer(CuTest *tc) {
+     printf("%s\n", __func__);
+
+     char test_dir_db[] = "test-lds-XXXXXX";
+     mkdtemp(test_dir_db);
+
+     PageDB *db;
+     int ret = page_db_new(&db, test_dir_db);
+     CuAssert(tc,
+              db!=0? db->error->message: "NULL",
+              ret == 0);
+     db->persist = 0;
+
+     LinkingDomainsScorer *lds;
+     ret = linking_domains_scorer_new(&lds, db);
+     CuAssert(tc,
+              lds != 0? lds->error->message: "NULL",
+              ret == 0);
+     CuAssertIntEquals(tc, 1, db->track_linking_domains);
+
+     /* Links to x come from a.com (twice) and b.com, and also from its own
+      * domain and from a seed, which are not counted */
+     const char *x = "http://t.com/x";
+     const char *y = "http://t.com/y";
+     const struct {
+          const char *from;
+          const char *to[2];
+     } links[] = {
+          {"http://a.com/1", {x, 0}},
+          {"http://a.com/2", {x, 0}},
+          {"http://b.com/1", {x, y}},
+          {"http://t.com/z", {x, y}},
+          {"_seed_0",        {y, 0}}
+     };
+     for (size_t i=0; i<sizeof(links)/sizeof(*links); ++i) {
+          CrawledPage *cp = crawled_page_new(links[i].from);
+          for (size_t j=0; j<2 && links[i].to[j]; ++j)
+               crawled_page_add_link(cp, links[i].to[j], 1.0);
+          CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+          crawled_page_delete(cp);
+     }
+
+     float count;
+     CuAssert(tc, db->error->message,
+              page_db_get_linking_domains(db, page_db_hash(x), &count) == 0);
+     CuAssertDblEquals(tc, 2.0, count, 1e-6);
+     CuAssert(tc, db->error->message,
+              page_db_get_linking_domains(db, page_db_hash(y), &count) == 0);
+     CuAssertDblEquals(tc, 1.0, count, 1e-6);
+     CuAssert(tc, db->error->message,
+              page_db_get_linking_domains(db, page_db_hash("http://a.com/1"), &count) == 0);
+     CuAssertDblEquals(tc, 0.0, count, 1e-6);
+     CuAssert(tc, db->error->message,
+              page_db_get_domain_linking_domains(
+                   db, page_db_hash_get_domain(page_db_hash(x)), &count) == 0);
+     // the dense estimate is exact for so few items
+     CuAssertDblEquals(tc, 2.0, count, 0.1);
+
+     uint64_t idx_x, idx_y, idx_a;
+     CuAssert(tc, db->error->message, page_db_get_idx(db, page_db_hash(x), &idx_x) == 0);
+     CuAssert(tc, db->error->message, page_db_get_idx(db, page_db_hash(y), &idx_y) == 0);
+     CuAssert(tc, db->error->message,
+              page_db_get_idx(db, page_db_hash("http://a.com/1"), &idx_a) == 0);
+
+     Scorer scorer;
+     linking_domains_scorer_setup(lds, &scorer);
+     CuAssert(tc, lds->error->message, scorer.update(scorer.state) == 0);
+     CuAssertDblEquals(tc, 2.0, lds->max_count, 1e-6);
+
+     float score_old;
+     float score_new;
+     CuAssert(tc, lds->error->message,
+              scorer.get(scorer.state, idx_x, &score_old, &score_new) == 0);
+     CuAssertDblEquals(tc, 0.0, score_old, 1e-6);
+     CuAssertDblEquals(tc, 1.0, score_new, 1e-6);
+     CuAssert(tc, lds->error->message,
+              scorer.get(scorer.state, idx_y, &score_old, &score_new) == 0);
+     CuAssertDblEquals(tc, log(2.0)/log(3.0), score_new, 1e-6);
+     CuAssert(tc, lds->error->message,
+              scorer.get(scorer.state, idx_a, &score_old, &score_new) == 0);
+     CuAssertDblEquals(tc, 0.0, score_new, 1e-6);
+
+     // a new linking domain for y
+     CrawledPage *cp = crawled_page_new("http://c.com/1");
+     crawled_page_add_link(cp, y, 1.0);
+     CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+
+     CuAssert(tc, lds->error->message, scorer.update(scorer.state) == 0);
+     CuAssert(tc, lds->error->message,
+              scorer.get(scorer.state, idx_y, &score_old, &score_new) == 0);
+     CuAssertDblEquals(tc, log(2.0)/log(3.0), score_old, 1e-6);
+     CuAssertDblEquals(tc, 1.0, score_new, 1e-6);
+
+     // pages beyond the last update have no score
+     CuAssert(tc, lds->error->message,
+              scorer.get(scorer.state, 1000000, &score_old, &score_new) == 0);
+     CuAssertDblEquals(tc, 0.0, score_new, 1e-6);
+
+     CHECK_DELETE(tc, lds->error->message, linking_domains_scorer_delete(lds));
+     page_db_delete(db);
+}
+
+CuSuite *
+test_linking_domains_scorer_suite(void) {
+     CuSuite *suite = CuSuiteNew();
+     SUITE_ADD_TEST(suite, test_linking_domains_scorer);
+     return suite;
+}
@@ -0,0 +1,67 @@
+#include "CuTest.h"
+
+#include "test.h"
+
+void
+test_metrics_buckets(CuTest *tc) {
+     printf("%s\n", __func__);
+
+     // buckets are contiguous and every value falls inside its bucket
+     size_t prev = 0;
+     for (uint64_t v=1; v<(1 << 20); v = v*5/4 + 1) {
+          const size_t b = metrics_bucket(v);
+          CuAssert(tc, "monotonic", b >= prev);
+          CuAssert(tc, "inside bucket", v <= metrics_bucket_value(b));
+          CuAssert(tc, "relative error",
+                   metrics_bucket_value(b) - v <= v/METRICS_SUB_BUCKETS);
+          prev = b;
+     }
+     CuAssert(tc, "last bucket", metrics_bucket(UINT64_MAX) == METRICS_N_BUCKETS - 1);
+     CuAssert(tc, "last value", metrics_bucket_value(METRICS_N_BUCKETS - 1) == UINT64_MAX);
+}
+
+void
+test_metrics_snapshot(CuTest *tc) {
+     printf("%s\n", __func__);
+
+     metrics_reset();
+     for (uint64_t v=1; v<=1000; ++v)
+          metrics_record(metric_page_rank_compute, v);
+     metrics_count(metric_page_rank_loops, 3);
+     metrics_count(metric_page_rank_loops, 4);
+
+     metrics_set_enabled(0);
+     metrics_record(metric_page_rank_compute, 1000000);
+     metrics_count(metric_page_rank_loops, 1);
+     metrics_set_enabled(1);
+
+     MetricsSnapshot s;
+     metrics_snapshot(&s);
+     CuAssertStrEquals(tc, "page_rank_loops", s.counters[metric_page_rank_loops].name);
+     CuAssert(tc, "counter", s.counters[metric_page_rank_loops].value == 7);
+
+     const MetricsHistogramSnapshot *h = &s.histograms[metric_page_rank_compute];
+     CuAssertStrEquals(tc, "page_rank_compute", h->name);
+     CuAssert(tc, "count", h->count == 1000);
+     CuAssert(tc, "sum", h->sum == 500500);
+     CuAssert(tc, "max", h->max == 1000);
+     CuAssert(tc, "p50", h->p50 >= 500 && h->p50 <= 500 + 500/METRICS_SUB_BUCKETS);
+     CuAssert(tc, "p90", h->p90 >= 900 && h->p90 <= 900 + 900/METRICS_SUB_BUCKETS);
+     CuAssert(tc, "p99", h->p99 >= 990 && h->p99 <= 1000);
+     CuAssert(tc, "p999", h->p999 == 1000);
+
+     CuAssert(tc, "empty", s.histograms[metric_hits_compute].p99 == 0);
+
+     metrics_reset();
+     metrics_snapshot(&s);
+     CuAssert(tc, "reset counter", s.counters[metric_page_rank_loops].value == 0);
+     CuAssert(tc, "reset histogram", s.histograms[metric_page_rank_compute].count == 0);
+}
+
+CuSuite *
+test_metrics_suite(void) {
+     CuSuite *suite = CuSuiteNew();
+     SUITE_ADD_TEST(suite, test_metrics_buckets);
+     SUITE_ADD_TEST(suite, test_metrics_snapshot);
+     return suite;
+}
@@ -0,0 +1,180 @@
+#include "CuTest.h"
+
+#include "test.h"
+
+static void
+check_domain_info(CuTest *tc, PageDB *db, const char *url,
+                  uint64_t n_pages, uint64_t n_crawled, uint64_t n_links_in,
+                  uint64_t n_rates, float rate, double last_crawl) {
+     DomainInfo di;
+     CuAssert(tc,
+              db->error->message,
+              page_db_get_domain_info(
+                   db, page_db_hash_get_domain(page_db_hash(url)), &di) == 0);
+     CuAssertIntEquals(tc, n_pages, di.n_pages);
+     CuAssertIntEquals(tc, n_crawled, di.n_crawled);
+     CuAssertIntEquals(tc, n_links_in, di.n_links_in);
+     CuAssertIntEquals(tc, n_rates, di.n_rates);
+     CuAssertDblEquals(tc, rate, domain_info_rate(&di), 1e-6);
+     CuAssertDblEquals(tc, last_crawl, di.last_crawl, 1e-6);
+}
+
+void
+test_domain_info(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+
+     PageDB *db;
+     int ret = page_db_new(&db, test_dir);
+     CuAssert(tc,
+              db!=0? db->error->message: "NULL",
+              ret == 0);
+     db->persist = 0;
+
+     CrawledPage *cp = crawled_page_new("http://a.com/");
+     cp->time = 1.0;
+     crawled_page_add_link(cp, "http://a.com/1", 0);
+     crawled_page_add_link(cp, "http://b.com/", 0);
+     crawled_page_add_link(cp, "http://b.com/1", 0);
+     CuAssert(tc,
+              db->error->message,
+              page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+
+     cp = crawled_page_new("http://a.com/1");
+     cp->time = 2.0;
+     crawled_page_add_link(cp, "http://b.com/", 0);
+     CuAssert(tc,
+              db->error->message,
+              page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+
+     check_domain_info(tc, db, "http://a.com/", 2, 2, 0, 0, -1.0, 2.0);
+     check_domain_info(tc, db, "http://b.com/", 2, 0, 3, 0, -1.0, 0.0);
+     check_domain_info(tc, db, "http://c.com/", 0, 0, 0, 0, -1.0, 0.0);
+
+     // rebuilding from scratch gives the same result
+     CuAssert(tc,
+              db->error->message,
+              page_db_rebuild_domains(db) == 0);
+     check_domain_info(tc, db, "http://a.com/", 2, 2, 0, 0, -1.0, 2.0);
+     check_domain_info(tc, db, "http://b.com/", 2, 0, 3, 0, -1.0, 0.0);
+
+     // a second crawl gives a change rate and does not count links again
+     cp = crawled_page_new("http://a.com/");
+     cp->time = 11.0;
+     crawled_page_set_hash64(cp, 1);
+     crawled_page_add_link(cp, "http://b.com/", 0);
+     CuAssert(tc,
+              db->error->message,
+              page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+
+     check_domain_info(tc, db, "http://a.com/", 2, 2, 0, 1, 0.2, 11.0);
+     check_domain_info(tc, db, "http://b.com/", 2, 0, 3, 0, -1.0, 0.0);
+
+     DomainInfoStream *st;
+     CuAssert(tc,
+              db->error->message,
+              domaininfo_stream_new(&st, db) == 0);
+     uint32_t domain_hash;
+     DomainInfo di;
+     size_t n_domains = 0;
+     uint64_t n_pages = 0;
+     while (domaininfo_stream_next(st, &domain_hash, &di) == stream_state_next) {
+          ++n_domains;
+          n_pages += di.n_pages;
+     }
+     CuAssert(tc, "stream did not end", st->state == stream_state_end);
+     domaininfo_stream_delete(st);
+     CuAssertIntEquals(tc, 2, n_domains);
+     CuAssertIntEquals(tc, 4, n_pages);
+
+     page_db_delete(db);
+}
+
+void
+test_domain_stream(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+
+     PageDB *db;
+     int ret = page_db_new(&db, test_dir);
+     CuAssert(tc,
+              db!=0? db->error->message: "NULL",
+              ret == 0);
+     db->persist = 0;
+
+     CrawledPage *cp = crawled_page_new("http://a.com/");
+     crawled_page_add_link(cp, "http://a.com/1", 0);
+     crawled_page_add_link(cp, "http://a.com/2", 0);
+     crawled_page_add_link(cp, "http://b.com/", 0);
+     crawled_page_add_link(cp, "http://c.com/", 0);
+     CuAssert(tc,
+              db->error->message,
+              page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+
+     cp = crawled_page_new("http://b.com/");
+     crawled_page_add_link(cp, "http://b.com/1", 0);
+     CuAssert(tc,
+              db->error->message,
+              page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+
+     char *expected_url[] = {"http://a.com/", "http://a.com/1", "http://a.com/2"};
+     int found[] = {0, 0, 0};
+
+     DomainStream *stream;
+     CuAssert(tc,
+              db->error->message,
+              page_db_domain_stream_new_url(&stream, db, "http://a.com/foo") == 0);
+
+     uint64_t hash;
+     PageInfo *pi;
+     StreamState state;
+     size_t n_pages = 0;
+     while ((state = page_db_domain_stream_next(stream, &hash, &pi)) == stream_state_next) {
+          ++n_pages;
+          int match = 0;
+          for (int j=0; j<3; ++j)
+               if (hash == page_db_hash(expected_url[j])) {
+                    found[j] = 1;
+                    CuAssertStrEquals(tc, expected_url[j], pi->url);
+                    match = 1;
+               }
+          CuAssert(tc, "unexpected page hash", match);
+          page_info_delete(pi);
+     }
+     CuAssert(tc, "stream did not end", state == stream_state_end);
+     CuAssert(tc,
+              "stream must stay at end",
+              page_db_domain_stream_next(stream, &hash, &pi) == stream_state_end);
+     page_db_domain_stream_delete(stream);
+
+     CuAssertIntEquals(tc, 3, n_pages);
+     for (int i=0; i<3; ++i)
+          CuAssertTrue(tc, found[i]);
+
+     // domain with no pages
+     CuAssert(tc,
+              db->error->message,
+              page_db_domain_stream_new_url(&stream, db, "http://d.com/") == 0);
+     CuAssert(tc,
+              "stream should be empty",
+              page_db_domain_stream_next(stream, &hash, &pi) == stream_state_end);
+     page_db_domain_stream_delete(stream);
+
+     page_db_delete(db);
+}
+
+CuSuite *
+test_page_db_domains_suite(void) {
+     CuSuite *suite = CuSuiteNew();
+     SUITE_ADD_TEST(suite, test_domain_info);
+     SUITE_ADD_TEST(suite, test_domain_stream);
+
+     return suite;
+}
@@ -0,0 +1,96 @@
+#include "CuTest.h"
+
+#include "test.h"
+
+/* Export of the database into columns must give the same data as the
+ * hashinfo stream, both in a single call and by partitions */
+void
+test_page_db_export(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+
+     PageDB *db;
+     int ret = page_db_new(&db, test_dir);
+     CuAssert(tc,
+              db!=0? db->error->message: "NULL",
+              ret == 0);
+     db->persist = 0;
+
+     const char *crawled[] = {"http://a.com/", "http://b.com/", "http://a.com/"};
+     char url[64];
+     for (size_t i=0; i<3; ++i) {
+          CrawledPage *cp = crawled_page_new(crawled[i]);
+          cp->time = 100.0*(i + 1);
+          cp->score = 0.5;
+          for (size_t j=0; j<50; ++j) {
+               sprintf(url, "%s%zu", crawled[i], j);
+               crawled_page_add_link(cp, url, 0.1);
+          }
+          CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+          crawled_page_delete(cp);
+     }
+
+     PageDBColumns *cols;
+     CuAssert(tc, "creating columns", page_db_columns_new(&cols, 1) == 0);
+     CuAssert(tc, db->error->message, page_db_export(db, 0, UINT64_MAX, cols) == 0);
+     CuAssertIntEquals(tc, 102, cols->n_pages);
+
+     const uint64_t *hash = (uint64_t*)cols->hash->mem;
+     const uint64_t *offsets = (uint64_t*)cols->url_offsets->mem;
+     for (size_t i=0; i<cols->n_pages; ++i) {
+          if (i > 0)
+               CuAssert(tc, "rows not ordered by hash", hash[i - 1] < hash[i]);
+          PageInfo *pi;
+          CuAssert(tc, db->error->message, page_db_get_info(db, hash[i], &pi) == 0);
+          const size_t len = offsets[i + 1] - offsets[i];
+          CuAssertIntEquals(tc, strlen(pi->url), len);
+          CuAssert(tc, "URL mismatch",
+                   strncmp(pi->url, cols->url_blob->mem + offsets[i], len) == 0);
+          CuAssertIntEquals(tc, pi->n_crawls, ((uint64_t*)cols->n_crawls->mem)[i]);
+          CuAssertIntEquals(tc, pi->depth, ((uint64_t*)cols->depth->mem)[i]);
+          CuAssertDblEquals(tc, pi->first_crawl, ((double*)cols->first_crawl->mem)[i], 1e-6);
+          CuAssertDblEquals(tc, pi->last_crawl, ((double*)cols->last_crawl->mem)[i], 1e-6);
+          CuAssertDblEquals(tc, pi->score, ((float*)cols->score->mem)[i], 1e-6);
+          uint64_t idx;
+          CuAssert(tc, db->error->message, page_db_get_idx(db, hash[i], &idx) == 0);
+          CuAssertIntEquals(tc, idx, ((uint64_t*)cols->idx->mem)[i]);
+          if (strcmp(pi->url, "http://a.com/") == 0) {
+               CuAssertIntEquals(tc, 2, pi->n_crawls);
+               CuAssertDblEquals(tc, 300.0, ((double*)cols->last_crawl->mem)[i], 1e-6);
+          }
+          page_info_delete(pi);
+     }
+
+     // the partitions cover all the pages
+     size_t n_pages = 0;
+     for (size_t part=0; part<7; ++part) {
+          uint64_t begin, end;
+          page_db_export_range(7, part, &begin, &end);
+          PageDBColumns *pcols;
+          CuAssert(tc, "creating columns", page_db_columns_new(&pcols, 0) == 0);
+          CuAssert(tc, db->error->message, page_db_export(db, begin, end, pcols) == 0);
+          CuAssertPtrEquals(tc, 0, pcols->url_blob);
+          for (size_t i=0; i<pcols->n_pages; ++i) {
+               const uint64_t h = ((uint64_t*)pcols->hash->mem)[i];
+               CuAssert(tc, "hash outside partition", h >= begin && h <= end);
+               CuAssert(tc, "hash mismatch", h == hash[n_pages + i]);
+          }
+          n_pages += pcols->n_pages;
+          page_db_columns_delete(pcols);
+     }
+     CuAssertIntEquals(tc, cols->n_pages, n_pages);
+
+     page_db_columns_delete(cols);
+     page_db_delete(db);
+}
+
+/* Dump text of info and links of a database, to compare databases */
+
+CuSuite *
+test_page_db_export_suite(void) {
+     CuSuite *suite = CuSuiteNew();
+     SUITE_ADD_TEST(suite, test_page_db_export);
+
+     return suite;
+}
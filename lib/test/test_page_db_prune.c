@@ -0,0 +1,131 @@
+#include "CuTest.h"
+
+#include "test.h"
+
+static void
+test_page_db_prune_crawl(CuTest *tc, PageDB *db, const char *url, double time,
+                         const char *prefix, size_t n_links, float score) {
+     CrawledPage *cp = crawled_page_new(url);
+     cp->time = time;
+     crawled_page_set_hash64(cp, 0);
+     char link[64];
+     for (size_t i=1; i<=n_links; ++i) {
+          sprintf(link, "%s%zu", prefix, i);
+          crawled_page_add_link(cp, link, score > 0? score: i/10.0);
+     }
+     CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+}
+
+static int
+test_page_db_has_page(CuTest *tc, PageDB *db, const char *url) {
+     PageInfo *pi;
+     CuAssert(tc, db->error->message,
+              page_db_get_info(db, page_db_hash(url), &pi) == 0);
+     if (!pi)
+          return 0;
+     page_info_delete(pi);
+     return 1;
+}
+
+void
+test_page_db_prune(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+
+     PageDB *db;
+     CuAssert(tc, "creating database", page_db_new(&db, test_dir) == 0);
+     db->persist = 0;
+     db->track_linking_domains = 1;
+
+     // uncrawled pages and scores:
+     //     http://a.com/2..10   depth 1, 0.2..1.0, linked at time 100
+     //     http://a.com/1/1..5  depth 2, 0.55
+     //     http://c.com/1       depth 1, 0.05, linked from another domain
+     test_page_db_prune_crawl(tc, db, "http://a.com/", 100, "http://a.com/", 10, 0);
+     test_page_db_prune_crawl(tc, db, "http://a.com/1", 200, "http://a.com/1/", 5, 0.55);
+     test_page_db_prune_crawl(tc, db, "http://b.com/", 1000, "http://c.com/", 1, 0.05);
+
+     uint64_t n_pages_before;
+     CuAssert(tc, "index of last page",
+              page_db_get_idx(db, page_db_hash("http://c.com/1"), &n_pages_before) == 0);
+     ++n_pages_before;
+
+     DomainInfo di_before;
+     const uint32_t domain_a = page_db_hash_get_domain(page_db_hash("http://a.com/"));
+     CuAssert(tc, db->error->message,
+              page_db_get_domain_info(db, domain_a, &di_before) == 0);
+
+     // nothing enabled, nothing pruned
+     PageDBPruneOptions options = {0};
+     size_t n_pruned;
+     CuAssert(tc, db->error->message,
+              page_db_prune(db, &options, 0, &n_pruned) == 0);
+     CuAssertIntEquals(tc, 0, n_pruned);
+
+     // the 20th percentile of the 15 uncrawled pages is 0.4
+     options.score_percentile = 20;
+     uint64_t *pruned;
+     CuAssert(tc, db->error->message,
+              page_db_prune(db, &options, &pruned, &n_pruned) == 0);
+     CuAssertIntEquals(tc, 3, n_pruned);
+     for (size_t i=1; i<n_pruned; ++i)
+          CuAssert(tc, "sorted hashes", pruned[i - 1] < pruned[i]);
+     free(pruned);
+     CuAssert(tc, "pruned low score", !test_page_db_has_page(tc, db, "http://c.com/1"));
+     CuAssert(tc, "pruned low score", !test_page_db_has_page(tc, db, "http://a.com/3"));
+     CuAssert(tc, "kept high score", test_page_db_has_page(tc, db, "http://a.com/4"));
+     uint64_t idx;
+     CuAssertIntEquals(tc, page_db_error_no_page,
+                       page_db_get_idx(db, page_db_hash("http://a.com/2"), &idx));
+
+     options.score_percentile = 0;
+     options.max_depth = 1;
+     CuAssert(tc, db->error->message,
+              page_db_prune(db, &options, 0, &n_pruned) == 0);
+     CuAssertIntEquals(tc, 5, n_pruned);
+     CuAssert(tc, "pruned deep page", !test_page_db_has_page(tc, db, "http://a.com/1/3"));
+
+     options.max_depth = 0;
+     options.ttl = 500;
+     options.now = 1000;
+     CuAssert(tc, db->error->message,
+              page_db_prune(db, &options, 0, &n_pruned) == 0);
+     CuAssertIntEquals(tc, 7, n_pruned);
+     CuAssert(tc, "pruned old page", !test_page_db_has_page(tc, db, "http://a.com/10"));
+
+     // crawled pages are never pruned
+     CuAssert(tc, "crawled page", test_page_db_has_page(tc, db, "http://a.com/"));
+     CuAssert(tc, "crawled page", test_page_db_has_page(tc, db, "http://a.com/1"));
+     CuAssert(tc, "crawled page", test_page_db_has_page(tc, db, "http://b.com/"));
+
+     DomainInfo di;
+     CuAssert(tc, db->error->message,
+              page_db_get_domain_info(db, domain_a, &di) == 0);
+     CuAssertIntEquals(tc, di_before.n_pages - 14, di.n_pages);
+     CuAssertIntEquals(tc, di_before.n_crawled, di.n_crawled);
+
+     PageDBStats stats;
+     CuAssert(tc, db->error->message, page_db_stats(db, 0, &stats) == 0);
+     CuAssertIntEquals(tc, 3, stats.dbs[1].entries);
+     CuAssertIntEquals(tc, 3, stats.dbs[2].entries);
+     CuAssertIntEquals(tc, 0, stats.dbs[7].entries);
+
+     // a pruned page found again gets a new index
+     test_page_db_prune_crawl(tc, db, "http://b.com/", 2000, "http://a.com/", 2, 0.5);
+     CuAssert(tc, "page found again", test_page_db_has_page(tc, db, "http://a.com/2"));
+     CuAssert(tc, "new index",
+              page_db_get_idx(db, page_db_hash("http://a.com/2"), &idx) == 0);
+     CuAssert(tc, "index not reused", idx >= n_pages_before);
+
+     page_db_delete(db);
+}
+
+CuSuite *
+test_page_db_prune_suite(void) {
+     CuSuite *suite = CuSuiteNew();
+     SUITE_ADD_TEST(suite, test_page_db_prune);
+
+     return suite;
+}
@@ -0,0 +1,219 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "CuTest.h"
+
+#include "test.h"
+
+void
+test_page_db_stats(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+
+     PageDB *db;
+     CuAssert(tc, "creating database", page_db_new(&db, test_dir) == 0);
+     db->persist = 0;
+
+     char url[64];
+     for (size_t i=0; i<10; ++i) {
+          sprintf(url, "http://www.example.com/%zu", i);
+          CrawledPage *cp = crawled_page_new(url);
+          for (size_t j=0; j<10; ++j) {
+               sprintf(url, "http://www.example.com/%zu/%zu", i, j);
+               crawled_page_add_link(cp, url, 0.1);
+          }
+          CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+          crawled_page_delete(cp);
+     }
+
+     PageDBStats stats;
+     CuAssert(tc, db->error->message, page_db_stats(db, 0, &stats) == 0);
+     CuAssert(tc, "page size", stats.env.page_size > 0);
+     CuAssert(tc, "map size", stats.env.map_size >= PAGE_DB_DEFAULT_SIZE);
+     CuAssert(tc, "last page", stats.env.last_page > 0);
+     CuAssertStrEquals(tc, "hash2info", stats.dbs[1].name);
+     CuAssertIntEquals(tc, 110, stats.dbs[1].entries);
+     CuAssertIntEquals(tc, 110, stats.dbs[2].entries);
+     CuAssertIntEquals(tc, 10, stats.dbs[3].entries);
+     CuAssert(tc, "depth", stats.dbs[1].depth >= 1);
+     CuAssertIntEquals(tc, 110, stats.n_samples);
+     CuAssert(tc, "record size", stats.record_size > 0);
+     CuAssert(tc, "url size",
+              stats.url_size > strlen("http://www.example.com/0") &&
+              stats.url_size < strlen("http://www.example.com/0/0") + 1);
+     CuAssert(tc, "url compression", stats.url_compression > 1.0);
+
+     CuAssert(tc, db->error->message, page_db_stats(db, 7, &stats) == 0);
+     CuAssertIntEquals(tc, 7, stats.n_samples);
+
+     page_db_delete(db);
+}
+
+/* Sampling must not be biased towards the domains with the lowest hashes */
+void
+test_page_db_stats_sample(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+
+     PageDB *db;
+     CuAssert(tc, "creating database", page_db_new(&db, test_dir) == 0);
+     db->persist = 0;
+
+     // one domain with short URLs and another with long ones
+     const char *domains[] = {"http://a.com/", "http://b.com/"};
+     const size_t path_len[] = {1, 100};
+     char path[128];
+     char url[256];
+     for (size_t d=0; d<2; ++d) {
+          CrawledPage *cp = crawled_page_new(domains[d]);
+          for (size_t j=0; j<199; ++j) {
+               memset(path, 'x', path_len[d]);
+               path[path_len[d]] = '\0';
+               sprintf(url, "%s%s%zu", domains[d], path, j);
+               crawled_page_add_link(cp, url, 0.1);
+          }
+          CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+          crawled_page_delete(cp);
+     }
+
+     PageDBStats all;
+     CuAssert(tc, db->error->message, page_db_stats(db, 0, &all) == 0);
+     CuAssertIntEquals(tc, 400, all.n_samples);
+
+     PageDBStats sample;
+     CuAssert(tc, db->error->message, page_db_stats(db, 40, &sample) == 0);
+     CuAssertIntEquals(tc, 40, sample.n_samples);
+     // the first 40 records would all be from a single domain, with an
+     // average URL length off by about 50 characters
+     CuAssertDblEquals(tc, all.url_size, sample.url_size, 10.0);
+     CuAssertDblEquals(tc, all.record_size, sample.record_size, 10.0);
+
+     page_db_delete(db);
+}
+
+/* Tests that compaction removes the free pages left by rewrites and that
+ * the database is usable afterwards */
+void
+test_page_db_compact(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+
+     PageDB *db;
+     CuAssert(tc, "creating database", page_db_new(&db, test_dir) == 0);
+     db->persist = 0;
+
+     // crawl the same pages several times, rewriting their PageInfo
+     char url[64];
+     for (size_t k=0; k<5; ++k)
+          for (size_t i=0; i<200; ++i) {
+               sprintf(url, "http://www.example.com/%zu", i);
+               CrawledPage *cp = crawled_page_new(url);
+               cp->time = k;
+               crawled_page_set_hash64(cp, k);
+               for (size_t j=0; j<10; ++j) {
+                    sprintf(url, "http://www.example.com/%zu/%zu", i, j);
+                    crawled_page_add_link(cp, url, 0.1);
+               }
+               CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+               crawled_page_delete(cp);
+          }
+
+     PageDBStats before;
+     PageDBStats after;
+     CuAssert(tc, db->error->message, page_db_stats(db, 0, &before) == 0);
+     CuAssert(tc, "free pages before", before.env.free_pages > 0);
+
+     CuAssert(tc, db->error->message, page_db_compact(db) == 0);
+     CuAssert(tc, db->error->message, page_db_stats(db, 0, &after) == 0);
+     CuAssertIntEquals(tc, 0, after.env.free_pages);
+     CuAssert(tc, "last page", after.env.last_page < before.env.last_page);
+     CuAssertIntEquals(tc, before.env.map_size, after.env.map_size);
+     for (size_t i=0; i<PAGE_DB_N_DBS; ++i)
+          CuAssertIntEquals(tc, before.dbs[i].entries, after.dbs[i].entries);
+
+     char *copy_dir = build_path(test_dir, "compact.tmp");
+     struct stat st;
+     CuAssert(tc, "copy removed", stat(copy_dir, &st) != 0);
+     free(copy_dir);
+
+     // read and write after the swap
+     PageInfo *pi;
+     CuAssert(tc, db->error->message,
+              page_db_get_info(db, page_db_hash("http://www.example.com/7"), &pi) == 0);
+     CuAssert(tc, "page info", pi != 0);
+     CuAssertIntEquals(tc, 5, pi->n_crawls);
+     CuAssertIntEquals(tc, 4, pi->n_changes);
+     page_info_delete(pi);
+
+     CrawledPage *cp = crawled_page_new("http://www.example.com/new");
+     crawled_page_add_link(cp, "http://www.example.com/7", 0.1);
+     CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+     CuAssert(tc, db->error->message,
+              page_db_get_info(db, page_db_hash("http://www.example.com/new"), &pi) == 0);
+     CuAssert(tc, "new page info", pi != 0);
+     page_info_delete(pi);
+
+     // a read transaction of the calling thread makes it fail instead of
+     // waiting forever
+     db->txn_manager->compact_timeout = 0;
+     HashIdxStream *reader;
+     CuAssert(tc, db->error->message, hashidx_stream_new(&reader, db) == 0);
+     CuAssert(tc, "compacting with open reader", page_db_compact(db) != 0);
+     CuAssertIntEquals(tc, txn_manager_error_busy, db->txn_manager->error->code);
+     hashidx_stream_delete(reader);
+     error_clean(db->error);
+     error_clean(db->txn_manager->error);
+
+     // the data file cannot be swapped while other processes have it open
+     int ready[2];
+     int done[2];
+     CuAssert(tc, "creating pipes", pipe(ready) == 0 && pipe(done) == 0);
+     pid_t pid = fork();
+     CuAssert(tc, "forking", pid >= 0);
+     if (pid == 0) {
+          close(done[1]);
+          PageDB *other;
+          char opened = page_db_new(&other, test_dir) == 0;
+          if (write(ready[1], &opened, 1) == 1)
+               // wait until the parent closes its end
+               (void)read(done[0], &opened, 1);
+          _exit(0);
+     }
+     close(done[0]);
+     char opened = 0;
+     const int got_ready = read(ready[0], &opened, 1) == 1;
+     const int rc_shared = page_db_compact(db);
+     const int code_shared = db->txn_manager->error->code;
+     close(done[1]);
+     waitpid(pid, 0, 0);
+     close(ready[0]);
+     close(ready[1]);
+     CuAssert(tc, "opening from other process", got_ready && opened);
+     CuAssert(tc, "compacting shared environment", rc_shared != 0);
+     CuAssertIntEquals(tc, txn_manager_error_busy, code_shared);
+     error_clean(db->error);
+     error_clean(db->txn_manager->error);
+
+     // and works again once they exit
+     CuAssert(tc, db->error->message, page_db_compact(db) == 0);
+     CuAssert(tc, db->error->message,
+              page_db_get_info(db, page_db_hash("http://www.example.com/new"), &pi) == 0);
+     CuAssert(tc, "new page info after second compaction", pi != 0);
+     page_info_delete(pi);
+
+     page_db_delete(db);
+}
+
+CuSuite *
+test_page_db_storage_suite(void) {
+     CuSuite *suite = CuSuiteNew();
+     SUITE_ADD_TEST(suite, test_page_db_stats);
+     SUITE_ADD_TEST(suite, test_page_db_stats_sample);
+     SUITE_ADD_TEST(suite, test_page_db_compact);
+
+     return suite;
+}
@@ -3,6 +3,31 @@
 #include "test.h"
 #include "page_db.h"
 
+typedef struct {
+     const Link *links;
+     size_t n_links;
+     size_t i;
+} TestLinkArray;
+
+static StreamState
+test_link_array_next_block(void *state, Link *links, float *weights,
+                           size_t max_links, size_t *n_links) {
+     TestLinkArray *arr = (TestLinkArray*)state;
+     *n_links = 0;
+     while (arr->i < arr->n_links && *n_links < max_links) {
+          if (weights)
+               weights[*n_links] = 1.0;
+          links[(*n_links)++] = arr->links[arr->i++];
+     }
+     return *n_links > 0? stream_state_next: stream_state_end;
+}
+
+static StreamState
+test_link_array_reset(void *state) {
+     ((TestLinkArray*)state)->i = 0;
+     return stream_state_init;
+}
+
 /* Checks the accuracy of the PageRank computation */
 void
 test_page_rank(CuTest *tc) {
@@ -120,9 +145,12 @@ test_page_rank(CuTest *tc) {
               pr->error->message,
               page_rank_compute(pr,
                                 st,
-                                page_db_link_stream_next,
+                                page_db_link_stream_next_block,
                                 page_db_link_stream_reset) == 0);
      page_db_link_stream_delete(st);
+     // acceleration arrays are not allocated unless needed
+     CuAssertPtrEquals(tc, 0, pr->value0);
+     CuAssertPtrEquals(tc, 0, pr->stable);
 
      uint64_t idx;
      float *score;
@@ -140,6 +168,81 @@ test_page_rank(CuTest *tc) {
      }
      CHECK_DELETE(tc, pr->error->message, page_rank_delete(pr));
 
+     // Out of core, two pages per shard
+     // ------------------------------------------------------------------------
+     CuAssert(tc,
+              db->error->message,
+              page_db_link_stream_new(&st, db) == 0);
+     st->only_diff_domain = 0;
+
+     ret = page_rank_new(&pr, test_dir, 5);
+     CuAssert(tc,
+              pr!=0? pr->error->message: "NULL",
+              ret == 0);
+
+     pr->precision = 1e-6;
+     pr->shard_size = 2;
+
+     CuAssert(tc,
+              pr->error->message,
+              page_rank_compute(pr,
+                                st,
+                                page_db_link_stream_next_block,
+                                page_db_link_stream_reset) == 0);
+     page_db_link_stream_delete(st);
+     CuAssertIntEquals(tc, 3, pr->shards->n_shards);
+
+     for (int i=0; i<5; ++i) {
+          CuAssert(tc,
+                   db->error->message,
+                   page_db_get_idx(db, page_db_hash(urls[i]), &idx) == 0);
+
+          CuAssertPtrNotNull(tc,
+                             score = mmap_array_idx(pr->value1, idx));
+
+          CuAssertDblEquals(tc, scores[i], *score, 1e-6);
+     }
+     CHECK_DELETE(tc, pr->error->message, page_rank_delete(pr));
+
+     // With extrapolation and freezing
+     // ------------------------------------------------------------------------
+     CuAssert(tc,
+              db->error->message,
+              page_db_link_stream_new(&st, db) == 0);
+     st->only_diff_domain = 0;
+
+     ret = page_rank_new(&pr, test_dir, 5);
+     CuAssert(tc,
+              pr!=0? pr->error->message: "NULL",
+              ret == 0);
+
+     pr->precision = 1e-6;
+     pr->extrapolation = 3;
+     pr->freeze_precision = 1e-8;
+     pr->freeze_loops = 2;
+
+     CuAssert(tc,
+              pr->error->message,
+              page_rank_compute(pr,
+                                st,
+                                page_db_link_stream_next_block,
+                                page_db_link_stream_reset) == 0);
+     page_db_link_stream_delete(st);
+     CuAssertTrue(tc, pr->n_loops > 0);
+     CuAssertTrue(tc, pr->loop_time >= 0.0);
+
+     for (int i=0; i<5; ++i) {
+          CuAssert(tc,
+                   db->error->message,
+                   page_db_get_idx(db, page_db_hash(urls[i]), &idx) == 0);
+
+          CuAssertPtrNotNull(tc,
+                             score = mmap_array_idx(pr->value1, idx));
+
+          CuAssertDblEquals(tc, scores[i], *score, 1e-5);
+     }
+     CHECK_DELETE(tc, pr->error->message, page_rank_delete(pr));
+
      // With content scores, damping = 0
      // ------------------------------------------------------------------------
      CuAssert(tc,
@@ -163,7 +266,7 @@ test_page_rank(CuTest *tc) {
               pr->error->message,
               page_rank_compute(pr,
                                 st,
-                                page_db_link_stream_next,
+                                page_db_link_stream_next_block,
                                 page_db_link_stream_reset) == 0);
 
      page_db_link_stream_delete(st);
@@ -208,7 +311,7 @@ test_page_rank(CuTest *tc) {
               pr->error->message,
               page_rank_compute(pr,
                                 st,
-                                page_db_link_stream_next,
+                                page_db_link_stream_next_block,
                                 page_db_link_stream_reset) == 0);
 
      page_db_link_stream_delete(st);
@@ -237,9 +340,160 @@ test_page_rank(CuTest *tc) {
      page_db_delete(db);
 }
 
+/* Scores are split in proportion to the link weights */
+void
+test_page_rank_weights(CuTest *tc) {
+     printf("%s\n", __func__);
+     /* A links to B and C, which link back to A. The link scores quantize to
+      * weights 0.75 and 0.25, see PAGE_DB_LINKS_WEIGHTED, so with d = 0.85
+      * and N = 3:
+      *
+      *   A = (1 - d)/N + d*(B + C)
+      *   B = (1 - d)/N + d*0.75*A
+      *   C = (1 - d)/N + d*0.25*A
+      *
+      * which gives A = (1 - d)/N*(1 + 2d)/(1 - d^2) = 0.4864865,
+      * B = 0.3601351 and C = 0.1533784. Without weights B = C = 0.2567568.
+      */
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+
+     PageDB *db;
+     int ret = page_db_new(&db, test_dir);
+     CuAssert(tc,
+              db!=0? db->error->message: "NULL",
+              ret == 0);
+     db->persist = 0;
+     db->link_weights = 1;
+
+     const char *urls[3] = {"http://a.com/", "http://b.com/", "http://c.com/"};
+     CrawledPage *cp = crawled_page_new(urls[0]);
+     crawled_page_add_link(cp, urls[1], 0.7);
+     crawled_page_add_link(cp, urls[2], 0.2);
+     CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+     for (int i=1; i<3; ++i) {
+          cp = crawled_page_new(urls[i]);
+          crawled_page_add_link(cp, urls[0], 0.5);
+          CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+          crawled_page_delete(cp);
+     }
+
+     const float expected[2][3] = {
+          {0.4864865, 0.2567568, 0.2567568}, // without weights
+          {0.4864865, 0.3601351, 0.1533784}  // with weights
+     };
+     // streaming the links and with out of core shards
+     for (int sharded=0; sharded<2; ++sharded)
+          for (int use_weights=0; use_weights<2; ++use_weights) {
+               PageDBLinkStream *st;
+               CuAssert(tc,
+                        db->error->message,
+                        page_db_link_stream_new(&st, db) == 0);
+               st->only_diff_domain = 0;
+
+               PageRank *pr;
+               ret = page_rank_new(&pr, test_dir, 3);
+               CuAssert(tc,
+                        pr!=0? pr->error->message: "NULL",
+                        ret == 0);
+               pr->precision = 1e-6;
+               pr->use_weights = use_weights;
+               pr->shard_size = sharded? 2: 0;
+
+               CuAssert(tc,
+                        pr->error->message,
+                        page_rank_compute(pr,
+                                          st,
+                                          page_db_link_stream_next_block,
+                                          page_db_link_stream_reset) == 0);
+               page_db_link_stream_delete(st);
+
+               for (int i=0; i<3; ++i) {
+                    uint64_t idx;
+                    float *score;
+                    CuAssert(tc,
+                             db->error->message,
+                             page_db_get_idx(db, page_db_hash(urls[i]), &idx) == 0);
+                    CuAssertPtrNotNull(tc,
+                                       score = mmap_array_idx(pr->value1, idx));
+                    CuAssertDblEquals(tc, expected[use_weights][i], *score, 1e-5);
+               }
+               CHECK_DELETE(tc, pr->error->message, page_rank_delete(pr));
+          }
+
+     page_db_delete(db);
+}
+
+/* Checks that extrapolation and freezing converge in fewer iterations to
+ * the same scores */
+void
+test_page_rank_acceleration(CuTest *tc) {
+     printf("%s\n", __func__);
+     /* Two cliques of 5 pages joined by a single link from page 0 to page 5.
+      * The score flows slowly from one clique to the other, which makes the
+      * plain power iteration converge monotonically but slowly */
+     enum { n_pages = 10, clique = 5 };
+     Link links[2*clique*(clique - 1) + 1];
+     size_t n_links = 0;
+     for (int64_t c=0; c<n_pages; c+=clique)
+          for (int64_t i=c; i<c + clique; ++i)
+               for (int64_t j=c; j<c + clique; ++j)
+                    if (i != j)
+                         links[n_links++] = (Link){.from = i, .to = j};
+     links[n_links++] = (Link){.from = 0, .to = clique};
+
+     char test_dir[] = "test-pagerank-XXXXXX";
+     mkdtemp(test_dir);
+
+     // plain, extrapolation and extrapolation with freezing
+     const size_t extrapolation[3] = {0, 3, 3};
+     const float freeze_precision[3] = {0.0, 0.0, 1e-6};
+     size_t n_loops[3];
+     float scores[3][n_pages];
+     for (int k=0; k<3; ++k) {
+          PageRank *pr;
+          int ret = page_rank_new(&pr, test_dir, n_pages);
+          CuAssert(tc,
+                   pr!=0? pr->error->message: "NULL",
+                   ret == 0);
+          pr->precision = 1e-6;
+          pr->extrapolation = extrapolation[k];
+          pr->freeze_precision = freeze_precision[k];
+          pr->freeze_loops = 2;
+
+          TestLinkArray arr = {.links = links, .n_links = n_links, .i = 0};
+          CuAssert(tc,
+                   pr->error->message,
+                   page_rank_compute(pr,
+                                     &arr,
+                                     test_link_array_next_block,
+                                     test_link_array_reset) == 0);
+          CuAssertTrue(tc, (pr->value0 != 0) == (extrapolation[k] > 0));
+          CuAssertTrue(tc, (pr->stable != 0) == (freeze_precision[k] > 0));
+          if (freeze_precision[k] > 0)
+               CuAssertTrue(tc, pr->n_frozen > 0);
+
+          n_loops[k] = pr->n_loops;
+          for (size_t i=0; i<n_pages; ++i)
+               scores[k][i] = *(float*)mmap_array_idx(pr->value1, i);
+          CHECK_DELETE(tc, pr->error->message, page_rank_delete(pr));
+     }
+     rmdir(test_dir);
+
+     // frozen pages stop short of the precision, so allow a larger error
+     for (int k=1; k<3; ++k) {
+          CuAssertTrue(tc, n_loops[k] < n_loops[0]);
+          for (size_t i=0; i<n_pages; ++i)
+               CuAssertDblEquals(tc, scores[0][i], scores[k][i], 5e-5);
+     }
+}
+
 CuSuite *
 test_page_rank_suite() {
      CuSuite *suite = CuSuiteNew();
      SUITE_ADD_TEST(suite, test_page_rank);
+     SUITE_ADD_TEST(suite, test_page_rank_weights);
+     SUITE_ADD_TEST(suite, test_page_rank_acceleration);
      return suite;
 }
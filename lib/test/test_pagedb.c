@@ -37,6 +37,66 @@ test_page_info_serialization(CuTest *tc) {
      page_info_delete(pi2);
 }
 
+/* Tests adding links from a packed buffer */
+void
+test_crawled_page_add_links(CuTest *tc) {
+     printf("%s\n", __func__);
+
+     CrawledPage *cp = crawled_page_new("http://a.com");
+     CuAssertPtrNotNull(tc, cp);
+     CuAssertIntEquals(tc, 0, crawled_page_add_link(cp, "http://a.com/0", 0.5));
+
+     // more links than the initial reserved space
+     char urls[2000];
+     size_t offsets[101];
+     float scores[100];
+     offsets[0] = 0;
+     for (size_t i=0; i<100; ++i) {
+          offsets[i + 1] = offsets[i] +
+               (size_t)sprintf(urls + offsets[i], "http://b.com/%zu", i);
+          scores[i] = i/100.0;
+     }
+     CuAssertIntEquals(tc, 0, crawled_page_add_links(cp, urls, offsets, scores, 100));
+     CuAssertIntEquals(tc, 101, crawled_page_n_links(cp));
+
+     const LinkInfo *link = crawled_page_get_link(cp, 0);
+     CuAssertStrEquals(tc, "http://a.com/0", link->url);
+     CuAssertDblEquals(tc, 0.5, link->score, 1e-6);
+     char url[32];
+     for (size_t i=0; i<100; ++i) {
+          link = crawled_page_get_link(cp, i + 1);
+          sprintf(url, "http://b.com/%zu", i);
+          CuAssertStrEquals(tc, url, link->url);
+          CuAssertDblEquals(tc, i/100.0, link->score, 1e-6);
+     }
+
+     // without scores
+     CuAssertIntEquals(tc, 0, crawled_page_add_links(cp, urls, offsets, 0, 2));
+     CuAssertIntEquals(tc, 103, crawled_page_n_links(cp));
+     link = crawled_page_get_link(cp, 102);
+     CuAssertStrEquals(tc, "http://b.com/1", link->url);
+     CuAssertDblEquals(tc, 0.0, link->score, 1e-6);
+
+     // URLs with null bytes are rejected as a whole
+     const char with_null[] = "http://d.com/0http://d.com/\0x";
+     const size_t with_null_offsets[] = {0, 14, sizeof(with_null) - 1};
+     CuAssertIntEquals(tc, -1,
+                       crawled_page_add_links(cp, with_null, with_null_offsets, 0, 2));
+     CuAssertIntEquals(tc, 103, crawled_page_n_links(cp));
+
+     // reuse the page and its memory
+     crawled_page_set_hash64(cp, 42);
+     CuAssertIntEquals(tc, 0, crawled_page_reset(cp, "http://c.com"));
+     CuAssertStrEquals(tc, "http://c.com", cp->url);
+     CuAssertIntEquals(tc, 0, crawled_page_n_links(cp));
+     CuAssertIntEquals(tc, 0, cp->content_hash_length);
+     CuAssertIntEquals(tc, 0, crawled_page_add_link(cp, "http://c.com/0", 0.25));
+     CuAssertIntEquals(tc, 1, crawled_page_n_links(cp));
+     CuAssertStrEquals(tc, "http://c.com/0", crawled_page_get_link(cp, 0)->url);
+
+     crawled_page_delete(cp);
+}
+
 /* Tests all the database operations on a very simple crawl of just two pages */
 void
 test_page_db_simple(CuTest *tc) {
@@ -258,7 +318,7 @@ test_page_db_crawl(CuTest *tc) {
      hits->precision = 1e-3;
      HitsError hits_err = hits_compute(hits,
                                        st,
-                                       page_db_link_stream_next,
+                                       page_db_link_stream_next_block,
                                        page_db_link_stream_reset);
      if (hits_err == hits_error_precision)
           hits_err = 0;
@@ -509,6 +569,654 @@ test_link_stream(CuTest *tc) {
      }
      CuAssertIntEquals(tc, 5, n_links);
      page_db_link_stream_delete(st);
+
+     // same links, read in blocks smaller than the number of links per page
+     CuAssert(tc,
+              db->error->message,
+              page_db_link_stream_new(&st, db) == 0);
+     st->only_diff_domain = 0;
+     n_links = 0;
+     Link block[2];
+     float block_weights[2];
+     size_t n_block;
+     StreamState state;
+     while ((state = page_db_link_stream_next_block(st, block, block_weights, 2, &n_block)) == stream_state_next) {
+          CuAssertTrue(tc, n_block > 0 && n_block <= 2);
+          for (size_t j=0; j<n_block; ++j) {
+               // stored without weights
+               CuAssertDblEquals(tc, 1.0, block_weights[j], 1e-6);
+               int found = 0;
+               for (int i=0; i<3; ++i)
+                    if (((links_diff[i].from == block[j].from) &&
+                         (links_diff[i].to == block[j].to)) ||
+                        ((links_same[i].from == block[j].from) &&
+                         (links_same[i].to == block[j].to)))
+                         found = 1;
+               CuAssertTrue(tc, found);
+          }
+          n_links += n_block;
+     }
+     CuAssertIntEquals(tc, stream_state_end, state);
+     CuAssertIntEquals(tc, 0, n_block);
+     CuAssertIntEquals(tc, 5, n_links);
+
+     // random access to the links of a single page
+     const uint64_t *to;
+     size_t n_to;
+     CuAssert(tc,
+              db->error->message,
+              page_db_link_stream_out_links(st, idx[0], &to, &n_to) == 0);
+     CuAssertIntEquals(tc, 3, n_to);
+     for (int i=1; i<4; ++i) {
+          int found = 0;
+          for (size_t j=0; j<n_to; ++j)
+               if (to[j] == idx[i])
+                    found = 1;
+          CuAssertTrue(tc, found);
+     }
+     CuAssert(tc,
+              db->error->message,
+              page_db_link_stream_out_links(st, idx[1], &to, &n_to) == 0);
+     CuAssertIntEquals(tc, 0, n_to);
+     page_db_link_stream_delete(st);
+     page_db_delete(db);
+}
+
+/* Pages with more links to their own domain than SVB values fit in a control
+ * byte must still give the right targets when only the links to other
+ * domains are read */
+void
+test_link_stream_diff_domain(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+
+     PageDB *db;
+     int ret = page_db_new(&db, test_dir);
+     CuAssert(tc,
+              db!=0? db->error->message: "NULL",
+              ret == 0);
+     db->persist = 0;
+
+     char url[64];
+     CrawledPage *cp = crawled_page_new("http://test_a.org/");
+     for (int i=1; i<=5; ++i) {
+          snprintf(url, sizeof(url), "http://test_a.org/%d", i);
+          crawled_page_add_link(cp, url, 1.0);
+          snprintf(url, sizeof(url), "http://test_b.org/%d", i);
+          crawled_page_add_link(cp, url, 1.0);
+     }
+     CuAssert(tc,
+              db->error->message,
+              page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+
+     uint64_t from;
+     uint64_t diff[5];
+     CuAssert(tc,
+              db->error->message,
+              page_db_get_idx(db, page_db_hash("http://test_a.org/"), &from) == 0);
+     for (int i=1; i<=5; ++i) {
+          snprintf(url, sizeof(url), "http://test_b.org/%d", i);
+          CuAssert(tc,
+                   db->error->message,
+                   page_db_get_idx(db, page_db_hash(url), diff + i - 1) == 0);
+     }
+
+     PageDBLinkStream *st;
+     CuAssert(tc,
+              db->error->message,
+              page_db_link_stream_new(&st, db) == 0);
+     st->only_diff_domain = 1;
+     Link link;
+     size_t n_links = 0;
+     while (page_db_link_stream_next(st, &link) == stream_state_next) {
+          CuAssertIntEquals(tc, from, link.from);
+          int found = 0;
+          for (int i=0; i<5; ++i)
+               if (diff[i] == (uint64_t)link.to)
+                    found = 1;
+          CuAssertTrue(tc, found);
+          ++n_links;
+     }
+     CuAssertIntEquals(tc, 5, n_links);
+     page_db_link_stream_delete(st);
+
+     // the domains table is rebuilt from the same links
+     CuAssert(tc,
+              db->error->message,
+              page_db_rebuild_domains(db) == 0);
+     DomainInfo di;
+     CuAssert(tc,
+              db->error->message,
+              page_db_get_domain_info(
+                   db, page_db_hash_get_domain(page_db_hash("http://test_b.org/1")), &di) == 0);
+     CuAssertIntEquals(tc, 5, di.n_links_in);
+     CuAssert(tc,
+              db->error->message,
+              page_db_get_domain_info(
+                   db, page_db_hash_get_domain(page_db_hash("http://test_a.org/")), &di) == 0);
+     CuAssertIntEquals(tc, 0, di.n_links_in);
+
+     page_db_delete(db);
+}
+
+void
+test_link_weights(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+
+     PageDB *db;
+     int ret = page_db_new(&db, test_dir);
+     CuAssert(tc,
+              db!=0? db->error->message: "NULL",
+              ret == 0);
+     db->persist = 0;
+     page_db_set_link_weights(db, 1);
+
+     const char *urls[] = {
+          "http://test_a.org/2",
+          "http://test_a.org/3",
+          "http://test_b.org/1",
+          "http://test_c.org/1"
+     };
+     const float scores[] = {0.0, 0.5, 1.0, 0.25};
+     const float weights[] = {1.0/16, 9.0/16, 1.0, 5.0/16};
+
+     CrawledPage *cp = crawled_page_new("http://test_a.org/1");
+     for (int i=0; i<4; ++i)
+          crawled_page_add_link(cp, urls[i], scores[i]);
+     CuAssert(tc,
+              db->error->message,
+              page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+
+     PageDBLinkStream *st;
+     CuAssert(tc,
+              db->error->message,
+              page_db_link_stream_new(&st, db) == 0);
+     st->only_diff_domain = 0;
+     Link links[8];
+     float link_weights[8];
+     size_t n_links;
+     CuAssertIntEquals(tc,
+                       stream_state_next,
+                       page_db_link_stream_next_block(st, links, link_weights, 8, &n_links));
+     CuAssertIntEquals(tc, 4, n_links);
+     for (size_t i=0; i<n_links; ++i) {
+          int found = 0;
+          for (int j=0; j<4; ++j) {
+               uint64_t idx;
+               CuAssert(tc,
+                        db->error->message,
+                        page_db_get_idx(db, page_db_hash(urls[j]), &idx) == 0);
+               if (idx == (uint64_t)links[i].to) {
+                    CuAssertDblEquals(tc, weights[j], link_weights[i], 1e-6);
+                    found = 1;
+               }
+          }
+          CuAssertTrue(tc, found);
+     }
+     page_db_link_stream_delete(st);
+
+     // only links to other domains
+     CuAssert(tc,
+              db->error->message,
+              page_db_link_stream_new(&st, db) == 0);
+     st->only_diff_domain = 1;
+     CuAssertIntEquals(tc,
+                       stream_state_next,
+                       page_db_link_stream_next_block(st, links, link_weights, 8, &n_links));
+     CuAssertIntEquals(tc, 2, n_links);
+     for (size_t i=0; i<n_links; ++i)
+          CuAssertTrue(tc,
+                       link_weights[i] == weights[2] ||
+                       link_weights[i] == weights[3]);
+     page_db_link_stream_delete(st);
+
+     page_db_delete(db);
+}
+
+/* Read all links into an array, returns the number of links */
+static size_t
+test_read_links(CuTest *tc, PageDB *db, Link *links, size_t max_links) {
+     PageDBLinkStream *st;
+     CuAssert(tc,
+              db->error->message,
+              page_db_link_stream_new(&st, db) == 0);
+     st->only_diff_domain = 0;
+     size_t n_links = 0;
+     size_t n_block;
+     while (n_links < max_links &&
+            page_db_link_stream_next_block(
+                 st, links + n_links, 0, max_links - n_links, &n_block) == stream_state_next)
+          n_links += n_block;
+     CuAssertTrue(tc, st->state != stream_state_error);
+     page_db_link_stream_delete(st);
+     return n_links;
+}
+
+void
+test_links_upgrade(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+
+     PageDB *db;
+     int ret = page_db_new(&db, test_dir);
+     CuAssert(tc,
+              db!=0? db->error->message: "NULL",
+              ret == 0);
+     db->persist = 1;
+
+     char url[256];
+     const size_t n_pages = 20;
+     const size_t n_page_links = 10;
+     for (size_t i=0; i<n_pages; ++i) {
+          sprintf(url, "http://test_%zu.org/page", i);
+          CrawledPage *cp = crawled_page_new(url);
+          for (size_t j=0; j<n_page_links; ++j) {
+               sprintf(url, "http://test_%zu.org/%zu", (i*j) % 3, i + j);
+               crawled_page_add_link(cp, url, 1.0);
+          }
+          CuAssert(tc,
+                   db->error->message,
+                   page_db_add(db, cp, 0) == 0);
+          crawled_page_delete(cp);
+     }
+     Link links[n_pages*n_page_links];
+     const size_t n_links = test_read_links(tc, db, links, n_pages*n_page_links);
+     CuAssertTrue(tc, n_links > 0);
+
+     // rewrite the database as if it had been created with format 0
+     MDB_txn *txn;
+     MDB_cursor *cur_links;
+     MDB_cursor *cur_info;
+     CuAssertIntEquals(tc, 0, txn_manager_begin(db->txn_manager, 0, &txn));
+     CuAssertIntEquals(tc, 0, page_db_open_links(txn, &cur_links));
+     CuAssertIntEquals(tc, 0, page_db_open_info(txn, &cur_info));
+
+     PageDBLinkStream *es = calloc(1, sizeof(*es));
+     MDB_val key;
+     MDB_val val;
+     uint8_t buf[MAX_VARINT_SIZE*(n_page_links + 1)];
+     int mdb_rc;
+     for (mdb_rc = mdb_cursor_get(cur_links, &key, &val, MDB_FIRST);
+          mdb_rc == 0;
+          mdb_rc = mdb_cursor_get(cur_links, &key, &val, MDB_NEXT)) {
+          uint64_t from = *(uint64_t*)key.mv_data;
+          CuAssertIntEquals(tc,
+                            0,
+                            page_db_links_decode(es, from, &val, PAGE_DB_LINKS_FORMAT_VERSION, 0));
+          uint8_t *pos = varint_encode_uint64(es->n_diff, buf);
+          uint64_t prev = from;
+          for (size_t i=0; i<es->n_to; ++i) {
+               pos = varint_encode_int64((int64_t)es->to[i] - (int64_t)prev, pos);
+               prev = es->to[i];
+          }
+          key.mv_data = &from;
+          val.mv_size = pos - buf;
+          val.mv_data = buf;
+          CuAssertIntEquals(tc, 0, mdb_cursor_put(cur_links, &key, &val, 0));
+     }
+     CuAssertIntEquals(tc, MDB_NOTFOUND, mdb_rc);
+     page_db_link_stream_delete(es);
+
+     key.mv_size = sizeof(info_links_format);
+     key.mv_data = info_links_format;
+     CuAssertIntEquals(tc, 0, mdb_cursor_get(cur_info, &key, &val, MDB_SET));
+     CuAssertIntEquals(tc, 0, mdb_cursor_del(cur_info, 0));
+     mdb_cursor_close(cur_links);
+     mdb_cursor_close(cur_info);
+     CuAssertIntEquals(tc, 0, txn_manager_commit(db->txn_manager, txn));
+     page_db_delete(db);
+
+     // opening the database should convert the links back
+     ret = page_db_new(&db, test_dir);
+     CuAssert(tc,
+              db!=0? db->error->message: "NULL",
+              ret == 0);
+     db->persist = 0;
+
+     CuAssertIntEquals(tc, 0, txn_manager_begin(db->txn_manager, MDB_RDONLY, &txn));
+     CuAssertIntEquals(tc, 0, page_db_open_info(txn, &cur_info));
+     key.mv_size = sizeof(info_links_format);
+     key.mv_data = info_links_format;
+     CuAssertIntEquals(tc, 0, mdb_cursor_get(cur_info, &key, &val, MDB_SET));
+     CuAssertIntEquals(tc, PAGE_DB_LINKS_FORMAT_VERSION, *(uint32_t*)val.mv_data);
+     key.mv_size = sizeof(info_links_upgrade);
+     key.mv_data = info_links_upgrade;
+     CuAssertIntEquals(tc, MDB_NOTFOUND, mdb_cursor_get(cur_info, &key, &val, MDB_SET));
+     mdb_cursor_close(cur_info);
+     txn_manager_abort(db->txn_manager, txn);
+
+     Link upgraded[n_pages*n_page_links];
+     CuAssertIntEquals(tc,
+                       n_links,
+                       test_read_links(tc, db, upgraded, n_pages*n_page_links));
+     for (size_t i=0; i<n_links; ++i) {
+          CuAssertIntEquals(tc, links[i].from, upgraded[i].from);
+          CuAssertIntEquals(tc, links[i].to, upgraded[i].to);
+     }
+     page_db_delete(db);
+}
+
+static char *
+test_page_db_dump_text(PageDB *db) {
+     char *text = 0;
+     size_t size = 0;
+     FILE *f = open_memstream(&text, &size);
+     if (!f)
+          return 0;
+     if (page_db_info_dump(db, f) != 0 || page_db_links_dump(db, f) != 0) {
+          fclose(f);
+          free(text);
+          return 0;
+     }
+     fclose(f);
+     return text;
+}
+
+/* A database restored from a backup, made in several parts, must have the
+ * same contents as the original */
+void
+test_page_db_backup(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+     char test_dir_restore[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir_restore);
+
+     PageDB *db;
+     int ret = page_db_new(&db, test_dir);
+     CuAssert(tc,
+              db!=0? db->error->message: "NULL",
+              ret == 0);
+     db->persist = 0;
+     page_db_set_track_linking_domains(db, 1);
+
+     char url[64];
+     for (size_t i=0; i<20; ++i) {
+          sprintf(url, "http://%zu.com/", i % 7);
+          CrawledPage *cp = crawled_page_new(url);
+          cp->time = 10.0*i;
+          crawled_page_set_simhash(cp, 0x0123456789ABCDEFULL*i);
+          for (size_t j=0; j<30; ++j) {
+               sprintf(url, "http://%zu.com/%zu", (i + j) % 11, j);
+               crawled_page_add_link(cp, url, 0.01*j);
+          }
+          CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+          crawled_page_delete(cp);
+     }
+
+     const size_t n_parts = 3;
+     FILE *parts[3];
+     for (size_t i=0; i<n_parts; ++i) {
+          CuAssertPtrNotNull(tc, parts[i] = tmpfile());
+          CuAssert(tc, db->error->message,
+                   page_db_backup(db, parts[i], n_parts, i) == 0);
+          rewind(parts[i]);
+     }
+
+     PageDB *db_restore;
+     ret = page_db_new(&db_restore, test_dir_restore);
+     CuAssert(tc,
+              db_restore!=0? db_restore->error->message: "NULL",
+              ret == 0);
+     db_restore->persist = 0;
+     for (size_t i=0; i<n_parts; ++i) {
+          CuAssert(tc, db_restore->error->message,
+                   page_db_restore(db_restore, parts[i]) == 0);
+          fclose(parts[i]);
+     }
+
+     char *text = test_page_db_dump_text(db);
+     char *text_restore = test_page_db_dump_text(db_restore);
+     CuAssertPtrNotNull(tc, text);
+     CuAssertPtrNotNull(tc, text_restore);
+     CuAssertStrEquals(tc, text, text_restore);
+     free(text);
+     free(text_restore);
+
+     float count;
+     float count_restore;
+     const uint64_t hash = page_db_hash("http://3.com/3");
+     CuAssert(tc, db->error->message,
+              page_db_get_linking_domains(db, hash, &count) == 0);
+     CuAssert(tc, db_restore->error->message,
+              page_db_get_linking_domains(db_restore, hash, &count_restore) == 0);
+     CuAssert(tc, "no linking domains", count > 0);
+     CuAssertDblEquals(tc, count, count_restore, 1e-6);
+
+     DomainInfo di;
+     DomainInfo di_restore;
+     const uint32_t domain = page_db_hash_get_domain(page_db_hash("http://3.com/"));
+     CuAssert(tc, db->error->message,
+              page_db_get_domain_info(db, domain, &di) == 0);
+     CuAssert(tc, db_restore->error->message,
+              page_db_get_domain_info(db_restore, domain, &di_restore) == 0);
+     CuAssertIntEquals(tc, di.n_pages, di_restore.n_pages);
+     CuAssertIntEquals(tc, di.n_crawled, di_restore.n_crawled);
+
+     uint64_t simhash = 0;
+     uint64_t near_dup = 0;
+     int found = 0;
+     double last_crawl;
+     CuAssert(tc, db_restore->error->message,
+              page_db_get_simhash(db_restore, page_db_hash("http://1.com/"),
+                                  &simhash, &last_crawl, &found) == 0);
+     CuAssertIntEquals(tc, 1, found);
+     CuAssert(tc, db_restore->error->message,
+              page_db_find_near_dup(db_restore, simhash, 0, 0.0,
+                                    page_db_hash("http://2.com/"), &near_dup, &found) == 0);
+     CuAssertIntEquals(tc, 1, found);
+     CuAssert(tc, "wrong near duplicate", near_dup == page_db_hash("http://1.com/"));
+
+     // a second restore must fail: records can only be appended
+     FILE *f = tmpfile();
+     CuAssert(tc, db->error->message, page_db_backup(db, f, 1, 0) == 0);
+     rewind(f);
+     CuAssert(tc, "restore over non empty database", page_db_restore(db_restore, f) != 0);
+     fclose(f);
+
+     page_db_delete(db);
+     page_db_delete(db_restore);
+}
+
+/* Restoring a backup larger than the map grows the map */
+void
+test_page_db_restore_map_full(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+     char test_dir_restore[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir_restore);
+
+     PageDB *db;
+     CuAssert(tc, "creating database", page_db_new(&db, test_dir) == 0);
+     db->persist = 0;
+
+     const size_t n_crawled = 1000;
+     const size_t n_links = 100;
+     CrawledPage **pages = calloc(n_crawled, sizeof(*pages));
+     char url[64];
+     for (size_t i=0; i<n_crawled; ++i) {
+          sprintf(url, "http://%zu.com/", i);
+          pages[i] = crawled_page_new(url);
+          for (size_t j=0; j<n_links; ++j) {
+               sprintf(url, "http://%zu.com/%zu", i, j);
+               crawled_page_add_link(pages[i], url, 0.5);
+          }
+     }
+     CuAssert(tc, db->error->message,
+              page_db_add_batch(db, (const CrawledPage**)pages, n_crawled, 0) == 0);
+     for (size_t i=0; i<n_crawled; ++i)
+          crawled_page_delete(pages[i]);
+     free(pages);
+
+     FILE *f = tmpfile();
+     CuAssertPtrNotNull(tc, f);
+     CuAssert(tc, db->error->message, page_db_backup(db, f, 1, 0) == 0);
+     CuAssert(tc, "backup larger than the map", ftell(f) > 1*MB);
+     rewind(f);
+
+     PageDB *db_restore;
+     CuAssert(tc, "creating database", page_db_new(&db_restore, test_dir_restore) == 0);
+     db_restore->persist = 0;
+     CuAssert(tc, "shrinking map",
+              mdb_env_set_mapsize(db_restore->txn_manager->env, 1*MB) == 0);
+     CuAssert(tc, db_restore->error->message,
+              page_db_restore(db_restore, f) == 0);
+     fclose(f);
+
+     MDB_envinfo info;
+     CuAssert(tc, "getting map size",
+              mdb_env_info(db_restore->txn_manager->env, &info) == 0);
+     CuAssert(tc, "map has grown", info.me_mapsize > 1*MB);
+
+     char *text = test_page_db_dump_text(db);
+     char *text_restore = test_page_db_dump_text(db_restore);
+     CuAssertPtrNotNull(tc, text);
+     CuAssertPtrNotNull(tc, text_restore);
+     CuAssertStrEquals(tc, text, text_restore);
+     free(text);
+     free(text_restore);
+
+     page_db_delete(db);
+     page_db_delete(db_restore);
+}
+
+/* Adding pages in a batch gives the same database as adding them one by one */
+void
+test_page_db_add_batch(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir_single[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir_single);
+     char test_dir_batch[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir_batch);
+
+     PageDB *db_single;
+     PageDB *db_batch;
+     CuAssert(tc, "creating database", page_db_new(&db_single, test_dir_single) == 0);
+     CuAssert(tc, "creating database", page_db_new(&db_batch, test_dir_batch) == 0);
+     db_single->persist = db_batch->persist = 0;
+
+     const size_t n_crawled = 10;
+     CrawledPage *pages[10];
+     char url[64];
+     for (size_t i=0; i<n_crawled; ++i) {
+          // the same page crawled twice inside the batch
+          sprintf(url, "http://%zu.com/", i % 6);
+          pages[i] = crawled_page_new(url);
+          pages[i]->time = 10.0*i;
+          for (size_t j=0; j<20; ++j) {
+               sprintf(url, "http://%zu.com/%zu", (i + j) % 8, j);
+               crawled_page_add_link(pages[i], url, 0.05*j);
+          }
+          CuAssert(tc, db_single->error->message,
+                   page_db_add(db_single, pages[i], 0) == 0);
+     }
+     PageInfoList *pil = 0;
+     CuAssert(tc, db_batch->error->message,
+              page_db_add_batch(db_batch, (const CrawledPage**)pages, n_crawled, &pil) == 0);
+
+     // one entry per crawled page plus one per new page
+     size_t n_entries = 0;
+     for (PageInfoList *node = pil; node; node = node->next)
+          ++n_entries;
+     size_t n_pages = 0;
+     HashIdxStream *st;
+     CuAssert(tc, db_batch->error->message, hashidx_stream_new(&st, db_batch) == 0);
+     uint64_t hash;
+     size_t idx;
+     while (hashidx_stream_next(st, &hash, &idx) == stream_state_next)
+          ++n_pages;
+     hashidx_stream_delete(st);
+     CuAssertIntEquals(tc, n_crawled + n_pages - 6, n_entries);
+     page_info_list_delete(pil);
+
+     char *text_single = test_page_db_dump_text(db_single);
+     char *text_batch = test_page_db_dump_text(db_batch);
+     CuAssertPtrNotNull(tc, text_single);
+     CuAssertPtrNotNull(tc, text_batch);
+     CuAssertStrEquals(tc, text_single, text_batch);
+     free(text_single);
+     free(text_batch);
+
+     for (size_t i=0; i<n_crawled; ++i)
+          crawled_page_delete(pages[i]);
+     page_db_delete(db_single);
+     page_db_delete(db_batch);
+}
+
+/* A batch larger than the free space left by the expansion is retried with
+ * a bigger map instead of failing */
+void
+test_page_db_add_batch_map_full(CuTest *tc) {
+     printf("%s\n", __func__);
+     char test_dir[] = "test-pagedb-XXXXXX";
+     mkdtemp(test_dir);
+
+     PageDB *db;
+     CuAssert(tc, "creating database", page_db_new(&db, test_dir) == 0);
+     db->persist = 0;
+     CuAssert(tc, "shrinking map",
+              mdb_env_set_mapsize(db->txn_manager->env, 1*MB) == 0);
+
+     // an empty batch returns an empty list
+     PageInfoList *pil = 0;
+     CuAssert(tc, db->error->message,
+              page_db_add_batch(db, 0, 0, &pil) == 0);
+     CuAssertPtrEquals(tc, 0, pil);
+
+     const size_t n_crawled = 500;
+     const size_t n_links = 50;
+     CrawledPage **pages = calloc(n_crawled, sizeof(*pages));
+     char url[64];
+     for (size_t i=0; i<n_crawled; ++i) {
+          sprintf(url, "http://%zu.com/", i);
+          pages[i] = crawled_page_new(url);
+          for (size_t j=0; j<n_links; ++j) {
+               sprintf(url, "http://%zu.com/%zu", i, j);
+               crawled_page_add_link(pages[i], url, 0.5);
+          }
+     }
+     // a batch that does not fit is rolled back, including the domain
+     // temperatures
+     CuAssert(tc, db->error->message,
+              page_db_set_domain_temp(db, 10, 60.0) == 0);
+     const uint32_t domain = page_db_hash_get_domain(page_db_hash(pages[0]->url));
+     int map_full = 0;
+     CuAssert(tc, "batch larger than the map",
+              page_db_add_batch_txn(
+                   db, (const CrawledPage**)pages, n_crawled, 0, &map_full) != 0);
+     CuAssertIntEquals(tc, 1, map_full);
+     CuAssertDblEquals(tc, 0.0, page_db_get_domain_crawl_rate(db, domain), 1e-6);
+     error_clean(db->error);
+     error_clean(db->txn_manager->error);
+
+     CuAssert(tc, db->error->message,
+              page_db_add_batch(db, (const CrawledPage**)pages, n_crawled, 0) == 0);
+     CuAssertDblEquals(tc, 1.0, page_db_get_domain_crawl_rate(db, domain), 1e-6);
+
+     MDB_envinfo info;
+     CuAssert(tc, "getting map size", mdb_env_info(db->txn_manager->env, &info) == 0);
+     CuAssert(tc, "map has grown", info.me_mapsize > 2*MB);
+
+     size_t n_pages = 0;
+     HashIdxStream *st;
+     CuAssert(tc, db->error->message, hashidx_stream_new(&st, db) == 0);
+     uint64_t hash;
+     size_t idx;
+     while (hashidx_stream_next(st, &hash, &idx) == stream_state_next)
+          ++n_pages;
+     hashidx_stream_delete(st);
+     CuAssertIntEquals(tc, n_crawled*(n_links + 1), n_pages);
+
+     for (size_t i=0; i<n_crawled; ++i)
+          crawled_page_delete(pages[i]);
+     free(pages);
      page_db_delete(db);
 }
 
@@ -518,11 +1226,19 @@ test_page_db_suite(size_t n_pages) {
 
      CuSuite *suite = CuSuiteNew();
      SUITE_ADD_TEST(suite, test_page_info_serialization);
+     SUITE_ADD_TEST(suite, test_crawled_page_add_links);
      SUITE_ADD_TEST(suite, test_page_db_simple);
      SUITE_ADD_TEST(suite, test_page_db_crawl);
      SUITE_ADD_TEST(suite, test_hashidx_stream);
      SUITE_ADD_TEST(suite, test_hashinfo_stream);
+     SUITE_ADD_TEST(suite, test_page_db_backup);
+     SUITE_ADD_TEST(suite, test_page_db_restore_map_full);
+     SUITE_ADD_TEST(suite, test_page_db_add_batch);
+     SUITE_ADD_TEST(suite, test_page_db_add_batch_map_full);
      SUITE_ADD_TEST(suite, test_link_stream);
+     SUITE_ADD_TEST(suite, test_link_stream_diff_domain);
+     SUITE_ADD_TEST(suite, test_links_upgrade);
+     SUITE_ADD_TEST(suite, test_link_weights);
 
      return suite;
 }
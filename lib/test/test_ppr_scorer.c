@@ -0,0 +1,134 @@
+#include "CuTest.h"
+
+#include "test.h"
+
+void
+test_ppr_scorer(CuTest *tc) {
+     printf("%s\n", __func__);
+
+     char test_dir_db[] = "test-ppr-XXXXXX";
+     mkdtemp(test_dir_db);
+
+     PageDB *db;
+     int ret = page_db_new(&db, test_dir_db);
+     CuAssert(tc,
+              db!=0? db->error->message: "NULL",
+              ret == 0);
+     db->persist = 0;
+
+     /* Make the link structure
+      *
+      *   _seed_0 ---> a ---> b ---> c       x ---> y
+      *      |                ^
+      *      +----------------+
+      *
+      * Pages x and y are not reachable from the seeds
+      */
+     const char *urls[] = {
+          "_seed_0",
+          "http://a.com/",
+          "http://b.com/",
+          "http://c.com/",
+          "http://x.com/",
+          "http://y.com/"
+     };
+     CrawledPage *cp;
+     cp = crawled_page_new(urls[0]);
+     crawled_page_add_link(cp, urls[1], 1.0);
+     crawled_page_add_link(cp, urls[2], 1.0);
+     CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+
+     cp = crawled_page_new(urls[1]);
+     crawled_page_add_link(cp, urls[2], 1.0);
+     CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+
+     cp = crawled_page_new(urls[2]);
+     crawled_page_add_link(cp, urls[3], 1.0);
+     CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+
+     cp = crawled_page_new(urls[4]);
+     crawled_page_add_link(cp, urls[5], 1.0);
+     CuAssert(tc, db->error->message, page_db_add(db, cp, 0) == 0);
+     crawled_page_delete(cp);
+
+     uint64_t idx[6];
+     for (size_t i=0; i<6; ++i)
+          CuAssert(tc,
+                   db->error->message,
+                   page_db_get_idx(db, page_db_hash(urls[i]), idx + i) == 0);
+
+     PPRScorer *ppr;
+     ret = ppr_scorer_new(&ppr, db);
+     CuAssert(tc,
+              ppr != 0? ppr->error->message: "NULL",
+              ret == 0);
+     ppr_scorer_set_epsilon(ppr, 1e-7);
+
+     Scorer scorer;
+     ppr_scorer_setup(ppr, &scorer);
+     CuAssert(tc, ppr->error->message, scorer.update(scorer.state) == 0);
+     CuAssertIntEquals(tc, 1, ppr->n_seeds);
+     CuAssert(tc, "no pushes made", ppr->n_pushes > 0);
+
+     float score[6];
+     float score_old;
+     float sum = 0.0;
+     for (size_t i=0; i<6; ++i) {
+          CuAssert(tc,
+                   ppr->error->message,
+                   scorer.get(scorer.state, idx[i], &score_old, score + i) == 0);
+          CuAssertDblEquals(tc, 0.0, score_old, 1e-9);
+          sum += score[i];
+     }
+     /* Solve for the stationary distribution of the random walk that restarts
+      * at the seed with probability 1 - d, and also from dangling page c:
+      *
+      *   s = (1 - d) + d*c
+      *   a = d/2*s
+      *   b = d/2*s + d*a
+      *   c = d*b
+      */
+     const float d = PPR_SCORER_DEFAULT_DAMPING;
+     const float k = (d/2.0 + d*d/2.0)*d;
+     const float s = (1.0 - d)/(1.0 - d*k);
+     CuAssertDblEquals(tc, s, score[0], 1e-4);
+     CuAssertDblEquals(tc, d/2.0*s, score[1], 1e-4);
+     CuAssertDblEquals(tc, d/2.0*s + d*score[1], score[2], 1e-4);
+     CuAssertDblEquals(tc, d*score[2], score[3], 1e-4);
+     CuAssertDblEquals(tc, 0.0, score[4], 1e-9);
+     CuAssertDblEquals(tc, 0.0, score[5], 1e-9);
+     CuAssert(tc, "scores do not add up to 1", sum <= 1.0 + 1e-4 && sum >= 0.999);
+
+     // scores of the previous update are kept as the old scores
+     CuAssert(tc, ppr->error->message, scorer.update(scorer.state) == 0);
+     for (size_t i=0; i<6; ++i) {
+          float score_new;
+          CuAssert(tc,
+                   ppr->error->message,
+                   scorer.get(scorer.state, idx[i], &score_old, &score_new) == 0);
+          CuAssertDblEquals(tc, score[i], score_old, 1e-9);
+          CuAssertDblEquals(tc, score[i], score_new, 1e-9);
+     }
+
+     // limiting the number of pushes gives a partial result
+     ppr_scorer_set_max_pushes(ppr, 2);
+     CuAssert(tc, ppr->error->message, scorer.update(scorer.state) == 0);
+     CuAssertIntEquals(tc, 2, ppr->n_pushes);
+     CuAssert(tc,
+              ppr->error->message,
+              scorer.get(scorer.state, idx[3], &score_old, score + 3) == 0);
+     CuAssertDblEquals(tc, 0.0, score[3], 1e-9);
+
+     CHECK_DELETE(tc, ppr->error->message, ppr_scorer_delete(ppr));
+     page_db_delete(db);
+}
+
+CuSuite *
+test_ppr_scorer_suite(void) {
+     CuSuite *suite = CuSuiteNew();
+     SUITE_ADD_TEST(suite, test_ppr_scorer);
+     return suite;
+}
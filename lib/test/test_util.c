@@ -4,7 +4,7 @@ void
 test_varint_uint64(CuTest *tc) {
      printf("%s\n", __func__);
      uint64_t test[] = {
-          1000000, 10000, 100, 1, 0
+          1000000, 10000, 100, 1, 0, 0xFEDCBA9876543210ULL, UINT64_MAX
      };
      size_t test_length = sizeof(test)/sizeof(uint64_t);
 
@@ -16,9 +16,8 @@ test_varint_uint64(CuTest *tc) {
      uint8_t read = 0;
      next = buf;
      for (size_t i=0; i<test_length; ++i) {
-          CuAssertIntEquals(tc,
-                            test[i],
-                            varint_decode_uint64(next, &read));
+          CuAssert(tc, "varint mismatch",
+                   test[i] == varint_decode_uint64(next, &read));
           next += read;
      }
 
@@ -47,6 +46,68 @@ test_varint_int64(CuTest *tc) {
      }
 }
 
+void
+test_svb_uint32(CuTest *tc) {
+     printf("%s\n", __func__);
+     uint32_t test[] = {
+          0, 1, 255, 256, 65535, 65536, 16777215, 16777216, 4294967295U,
+          7, 300, 100000, 42
+     };
+     const size_t test_length = sizeof(test)/sizeof(uint32_t);
+
+     uint8_t buf[SVB_MAX_SIZE(test_length)];
+     uint8_t *end = svb_encode_uint32(test, test_length, buf);
+     // 4 control bytes and 1 + 1 + 1 + 2 + 2 + 3 + 3 + 4 + 4 + 1 + 2 + 3 + 1 data bytes
+     CuAssertIntEquals(tc, 4 + 28, end - buf);
+
+     // round trip every prefix, which exercises both full groups of 4 and the tail
+     uint32_t out[test_length];
+     for (size_t n=0; n<=test_length; ++n) {
+          memset(out, 0, sizeof(out));
+          uint8_t *prefix_end = svb_encode_uint32(test, n, buf);
+          CuAssertIntEquals(tc,
+                            prefix_end - buf,
+                            svb_decode_uint32(buf, prefix_end - buf, n, out));
+          for (size_t i=0; i<n; ++i)
+               CuAssertIntEquals(tc, test[i], out[i]);
+     }
+     // truncated input
+     CuAssertIntEquals(tc, 0, svb_decode_uint32(buf, end - buf - 1, test_length, out));
+}
+
+/* The SSSE3 and scalar decoders agree on random lengths, for every prefix
+ * and every truncation of the input */
+void
+test_svb_uint32_simd(CuTest *tc) {
+     printf("%s\n", __func__);
+     const size_t n = 200;
+     uint32_t in[200];
+     uint32_t out_simd[200];
+     uint32_t out_scalar[200];
+     uint8_t buf[SVB_MAX_SIZE(200)];
+
+     srand(1);
+     for (size_t i=0; i<n; ++i)
+          // lengths of 1 to 4 bytes
+          in[i] = (uint32_t)rand() >> (8*(rand() % 4));
+
+     for (size_t m=0; m<=n; m+=13) {
+          const size_t size = svb_encode_uint32(in, m, buf) - buf;
+          for (size_t in_size=0; in_size<=size; ++in_size) {
+               memset(out_simd, 0, sizeof(out_simd));
+               memset(out_scalar, 0, sizeof(out_scalar));
+               const size_t r_simd = svb_decode_uint32_simd(buf, in_size, m, out_simd, 1);
+               const size_t r_scalar = svb_decode_uint32_simd(buf, in_size, m, out_scalar, 0);
+               CuAssertIntEquals(tc, r_scalar, r_simd);
+               CuAssertIntEquals(tc, in_size == size? size: 0, r_scalar);
+               if (r_scalar)
+                    CuAssert(tc, "same output",
+                             memcmp(out_simd, out_scalar, m*sizeof(*out_simd)) == 0 &&
+                             memcmp(out_scalar, in, m*sizeof(*in)) == 0);
+          }
+     }
+}
+
 void
 test_url_domain(CuTest *tc) {
      printf("%s\n", __func__);
@@ -110,12 +171,54 @@ test_same_domain(CuTest *tc) {
                                    "http://blablabla.com/foo"));              
 }
 
+void
+test_arena(CuTest *tc) {
+     printf("%s\n", __func__);
+     Arena *arena = arena_new(64);
+     CuAssertPtrNotNull(tc, arena);
+
+     // several blocks, with an allocation bigger than the block size
+     char *s[100];
+     char buf[32];
+     for (size_t i=0; i<100; ++i) {
+          sprintf(buf, "string %zu", i);
+          CuAssertPtrNotNull(tc, s[i] = arena_strdup(arena, buf));
+          CuAssertIntEquals(tc, 0, (int)((uintptr_t)s[i] % ARENA_ALIGN));
+     }
+     uint64_t *big = arena_alloc(arena, 1000*sizeof(*big));
+     CuAssertPtrNotNull(tc, big);
+     for (size_t i=0; i<1000; ++i)
+          big[i] = i;
+     for (size_t i=0; i<100; ++i) {
+          sprintf(buf, "string %zu", i);
+          CuAssertStrEquals(tc, buf, s[i]);
+     }
+     CuAssertStrEquals(tc, "abc", arena_strndup(arena, "abcdef", 3));
+
+     // after reset everything fits inside a single block
+     size_t size = 0;
+     for (ArenaBlock *block = arena->block; block; block = block->next)
+          size += block->size;
+     CuAssertIntEquals(tc, 0, arena_reset(arena));
+     CuAssertPtrNotNull(tc, arena->block);
+     CuAssertPtrEquals(tc, 0, arena->block->next);
+     CuAssertIntEquals(tc, size, arena->block->size);
+     for (size_t i=0; i<100; ++i)
+          arena_strdup(arena, "string");
+     CuAssertPtrEquals(tc, 0, arena->block->next);
+
+     arena_delete(arena);
+}
+
 CuSuite *
 test_util_suite() {
      CuSuite *suite = CuSuiteNew();
      SUITE_ADD_TEST(suite, test_varint_uint64);
      SUITE_ADD_TEST(suite, test_varint_int64);
+     SUITE_ADD_TEST(suite, test_svb_uint32);
+     SUITE_ADD_TEST(suite, test_svb_uint32_simd);
      SUITE_ADD_TEST(suite, test_url_domain);
      SUITE_ADD_TEST(suite, test_same_domain);
+     SUITE_ADD_TEST(suite, test_arena);
      return suite;
 }
@@ -0,0 +1,131 @@
+#include "CuTest.h"
+
+#include "test.h"
+
+/** Append n bytes to the message being built */
+static void
+test_wire_put(char *buf, size_t *len, const void *data, size_t n) {
+     memcpy(buf + *len, data, n);
+     *len += n;
+}
+
+/** Append a page with the given links and scores */
+static void
+test_wire_put_page(char *buf, size_t *len,
+                   const char *url, float score, uint8_t flags,
+                   uint64_t content_hash, uint64_t simhash,
+                   const char **links, const float *scores, uint32_t n_links) {
+     const uint32_t url_len = strlen(url);
+     test_wire_put(buf, len, &url_len, sizeof(url_len));
+     test_wire_put(buf, len, url, url_len);
+     test_wire_put(buf, len, &score, sizeof(score));
+     test_wire_put(buf, len, &flags, sizeof(flags));
+     if (flags & WIRE_PAGE_CONTENT_HASH)
+          test_wire_put(buf, len, &content_hash, sizeof(content_hash));
+     if (flags & WIRE_PAGE_SIMHASH)
+          test_wire_put(buf, len, &simhash, sizeof(simhash));
+     test_wire_put(buf, len, &n_links, sizeof(n_links));
+     for (size_t i=0; i<n_links; ++i) {
+          const uint32_t l = strlen(links[i]);
+          test_wire_put(buf, len, &l, sizeof(l));
+     }
+     test_wire_put(buf, len, scores, n_links*sizeof(*scores));
+     for (size_t i=0; i<n_links; ++i)
+          test_wire_put(buf, len, links[i], strlen(links[i]));
+}
+
+void
+test_wire_pages(CuTest *tc) {
+     printf("%s\n", __func__);
+
+     char buf[1024];
+     size_t len = 0;
+     const uint8_t version = WIRE_VERSION;
+     const uint8_t flags = 0;
+     const uint32_t n_pages = 2;
+     test_wire_put(buf, &len, WIRE_MAGIC, 4);
+     test_wire_put(buf, &len, &version, 1);
+     test_wire_put(buf, &len, &flags, 1);
+     test_wire_put(buf, &len, &n_pages, 4);
+     CuAssertIntEquals(tc, WIRE_HEADER_SIZE, len);
+
+     const char *links[] = {"http://b.com", "http://c.com/x"};
+     const float scores[] = {0.5, 0.25};
+     test_wire_put_page(buf, &len, "http://a.com", 0.75,
+                        WIRE_PAGE_CONTENT_HASH | WIRE_PAGE_SIMHASH,
+                        0x0102030405060708ULL, 0xFFFFFFFF00000001ULL,
+                        links, scores, 2);
+     test_wire_put_page(buf, &len, "http://d.com", 0.0, 0, 0, 0, 0, 0, 0);
+
+     WirePages *wp;
+     CuAssertIntEquals(tc, 0, wire_pages_new(&wp));
+     // twice, the second time reusing the pages
+     for (int k=0; k<2; ++k) {
+          CuAssert(tc, wp->error->message, wire_pages_decode(wp, buf, len) == 0);
+          CuAssertIntEquals(tc, 2, wp->n_pages);
+
+          const CrawledPage *cp = wp->pages[0];
+          CuAssertStrEquals(tc, "http://a.com", cp->url);
+          CuAssertDblEquals(tc, 0.75, cp->score, 1e-6);
+          CuAssertIntEquals(tc, 8, cp->content_hash_length);
+          CuAssert(tc, "content hash",
+                   *(uint64_t*)cp->content_hash == 0x0102030405060708ULL);
+          CuAssertIntEquals(tc, 1, cp->has_simhash);
+          CuAssert(tc, "simhash", cp->simhash == 0xFFFFFFFF00000001ULL);
+          CuAssertIntEquals(tc, 2, crawled_page_n_links(cp));
+          CuAssertStrEquals(tc, "http://b.com", crawled_page_get_link(cp, 0)->url);
+          CuAssertStrEquals(tc, "http://c.com/x", crawled_page_get_link(cp, 1)->url);
+          CuAssertDblEquals(tc, 0.25, crawled_page_get_link(cp, 1)->score, 1e-6);
+
+          cp = wp->pages[1];
+          CuAssertStrEquals(tc, "http://d.com", cp->url);
+          CuAssertIntEquals(tc, 0, cp->content_hash_length);
+          CuAssertIntEquals(tc, 0, cp->has_simhash);
+          CuAssertIntEquals(tc, 0, crawled_page_n_links(cp));
+     }
+
+     // every truncation must be detected
+     for (size_t l=0; l<len; ++l) {
+          CuAssertIntEquals(tc, wire_error_format, wire_pages_decode(wp, buf, l));
+          CuAssertIntEquals(tc, 0, wp->n_pages);
+     }
+     buf[0] = 'X';
+     CuAssertIntEquals(tc, wire_error_format, wire_pages_decode(wp, buf, len));
+
+     wire_pages_delete(wp);
+}
+
+void
+test_wire_urls(CuTest *tc) {
+     printf("%s\n", __func__);
+
+     char *urls[] = {"http://a.com", "", "http://bb.com"};
+     char *buf = 0;
+     size_t len = 0;
+     size_t size = 0;
+     CuAssertIntEquals(tc, 0, wire_encode_urls(urls, 3, &buf, &len, &size));
+     CuAssertIntEquals(tc, WIRE_HEADER_SIZE + 3*4 + 12 + 13, len);
+     CuAssert(tc, "magic", memcmp(buf, WIRE_MAGIC, 4) == 0);
+
+     uint32_t n;
+     memcpy(&n, buf + 6, 4);
+     CuAssertIntEquals(tc, 3, n);
+     memcpy(&n, buf + WIRE_HEADER_SIZE + 4, 4);
+     CuAssertIntEquals(tc, 0, n);
+     CuAssert(tc, "urls",
+              memcmp(buf + WIRE_HEADER_SIZE + 12, "http://a.comhttp://bb.com", 25) == 0);
+
+     // messages are appended
+     CuAssertIntEquals(tc, 0, wire_encode_urls(urls, 0, &buf, &len, &size));
+     CuAssertIntEquals(tc, WIRE_HEADER_SIZE + 3*4 + 25 + WIRE_HEADER_SIZE, len);
+
+     free(buf);
+}
+
+CuSuite *
+test_wire_suite(void) {
+     CuSuite *suite = CuSuiteNew();
+     SUITE_ADD_TEST(suite, test_wire_pages);
+     SUITE_ADD_TEST(suite, test_wire_urls);
+     return suite;
+}